@@ -23,13 +23,8 @@
 #include <mpi.h>
 
 int should_lock = 0;
-pthread_mutex_t mpi_lock;
 extern __thread int recursion_shield = 0;
 
-_Atomic int current_mpi_calls = 0;
-_Atomic int current_mpi_call_thread = 0;
-volatile const char* current_mpi_call_function = NULL;
-
 /* rank of the current thread */
 __thread int thread_rank = -1;
 
@@ -48,8 +43,14 @@ int (*libMPI_Finalize)(void);
 int (*libMPI_Initialized)(int*);
 int (*libMPI_Abort)(MPI_Comm, int);
 int (*libMPI_Type_size)(MPI_Datatype datatype, int* size);
+int (*libMPI_Type_get_extent)(MPI_Datatype datatype, MPI_Aint* lb, MPI_Aint* extent);
+int (*libMPI_Type_get_true_extent)(MPI_Datatype datatype, MPI_Aint* true_lb,
+                                   MPI_Aint* true_extent);
+int (*libMPI_Type_commit)(MPI_Datatype* datatype);
+int (*libMPI_Type_free)(MPI_Datatype* datatype);
 
 int (*libMPI_Cancel)(MPI_Request*);
+int (*libMPI_Request_free)(MPI_Request*);
 
 int (*libMPI_Comm_disconnect)(MPI_Comm* comm);
 int (*libMPI_Comm_free)(MPI_Comm* comm);
@@ -192,6 +193,17 @@ int (*libMPI_Get)(void*, int, MPI_Datatype, int, MPI_Aint, int, MPI_Datatype,
                   MPI_Win);
 int (*libMPI_Put)(CONST void*, int, MPI_Datatype, int, MPI_Aint, int,
                   MPI_Datatype, MPI_Win);
+#ifdef USE_MPI3
+int (*libMPI_Rget)(void*, int, MPI_Datatype, int, MPI_Aint, int, MPI_Datatype,
+                   MPI_Win, MPI_Request*);
+int (*libMPI_Rput)(const void*, int, MPI_Datatype, int, MPI_Aint, int,
+                   MPI_Datatype, MPI_Win, MPI_Request*);
+int (*libMPI_Win_lock_all)(int, MPI_Win);
+int (*libMPI_Win_unlock_all)(MPI_Win);
+#endif
+int (*libMPI_Win_lock)(int, int, int, MPI_Win);
+int (*libMPI_Win_unlock)(int, MPI_Win);
+int (*libMPI_Win_free)(MPI_Win*);
 
 int (*libMPI_Comm_spawn)(CONST char* command, char* argv[], int maxprocs,
                          MPI_Info info, int root, MPI_Comm comm,
@@ -396,30 +408,198 @@ int MPI_Comm_spawn(CONST char* command MAYBE_UNUSED,
   return 0;
 }
 
+static int MPI_Comm_get_parent_call(void* arg) {
+  int ret = libMPI_Comm_get_parent(arg);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*(MPI_Comm*)arg);
+  return ret;
+}
+
 int MPI_Comm_get_parent(MPI_Comm* parent) {
   if (!libMPI_Comm_get_parent) {
     /* MPI_Comm_get_parent was not found. Let's assume the application doesn't use it. */
     *parent = MPI_COMM_NULL;
     return MPI_SUCCESS;
   }
-  return libMPI_Comm_get_parent(parent);
+  return MPII_DELEGATE(MPI_Comm_get_parent_call, parent);
+}
+
+struct MPI_Comm_query_args {
+  MPI_Comm c;
+  int* value;
+};
+
+/* The rank and size of the communicators are cached (see
+ * mpii_comm_cache.c), so that querying them does not require to take
+ * the MPI lock. When a communicator is not in the cache, MPI is called
+ * with the lock held, and the communicator is added to the cache.
+ */
+static int MPI_Comm_size_call(void* arg) {
+  struct MPI_Comm_query_args* a = arg;
+  int ret = libMPI_Comm_size(a->c, a->value);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(a->c);
+  return ret;
 }
 
 int MPI_Comm_size(MPI_Comm c, int* s) {
-  return libMPI_Comm_size(c, s);
+  if(mpii_comm_cache_lookup(c, NULL, s))
+    return MPI_SUCCESS;
+  struct MPI_Comm_query_args args = { c, s };
+  return MPII_EXEC(MPI_Comm_size_call, &args);
+}
+
+static int MPI_Comm_rank_call(void* arg) {
+  struct MPI_Comm_query_args* a = arg;
+  int ret = libMPI_Comm_rank(a->c, a->value);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(a->c);
+  return ret;
 }
 
 int MPI_Comm_rank(MPI_Comm c, int* r) {
-  return libMPI_Comm_rank(c, r);
+  if(mpii_comm_cache_lookup(c, r, NULL))
+    return MPI_SUCCESS;
+  struct MPI_Comm_query_args args = { c, r };
+  return MPII_EXEC(MPI_Comm_rank_call, &args);
 }
 
+/* The size and extent of the datatypes are cached (see
+ * mpii_type_cache.c), so that querying them does not require to take
+ * the MPI lock.
+ */
 int MPI_Type_size(MPI_Datatype datatype, int* size) {
-  return libMPI_Type_size(datatype, size);
+  struct mpii_type_info info;
+  int ret = mpii_type_info(datatype, &info);
+  if(ret == MPI_SUCCESS)
+    *size = info.size;
+  return ret;
+}
+
+int MPI_Type_get_extent(MPI_Datatype datatype, MPI_Aint* lb, MPI_Aint* extent) {
+  struct mpii_type_info info;
+  int ret = mpii_type_info(datatype, &info);
+  if(ret == MPI_SUCCESS) {
+    *lb = info.lb;
+    *extent = info.extent;
+  }
+  return ret;
+}
+
+int MPI_Type_get_true_extent(MPI_Datatype datatype, MPI_Aint* true_lb,
+                             MPI_Aint* true_extent) {
+  struct mpii_type_info info;
+  int ret = mpii_type_info(datatype, &info);
+  if(ret == MPI_SUCCESS) {
+    *true_lb = info.true_lb;
+    *true_extent = info.true_extent;
+  }
+  return ret;
+}
+
+static int MPI_Type_commit_call(void* arg) {
+  MPI_Datatype* datatype = arg;
+  int ret = libMPI_Type_commit(datatype);
+  if(ret == MPI_SUCCESS)
+    mpii_type_cache_add(*datatype, NULL);
+  return ret;
+}
+
+int MPI_Type_commit(MPI_Datatype* datatype) {
+  FUNCTION_ENTRY;
+  int ret = MPII_EXEC(MPI_Type_commit_call, datatype);
+  FUNCTION_EXIT;
+  return ret;
+}
+
+static int MPI_Type_free_call(void* arg) {
+  MPI_Datatype* datatype = arg;
+  mpii_type_cache_remove(*datatype);
+  return libMPI_Type_free(datatype);
+}
+
+int MPI_Type_free(MPI_Datatype* datatype) {
+  FUNCTION_ENTRY;
+  int ret = MPII_EXEC(MPI_Type_free_call, datatype);
+  FUNCTION_EXIT;
+  return ret;
+}
+
+static int MPI_Request_free_call(void* arg) {
+  MPI_Request* req = arg;
+  return libMPI_Request_free(req);
+}
+
+int MPI_Request_free(MPI_Request* req) {
+  FUNCTION_ENTRY;
+  /* MPI sets *req to MPI_REQUEST_NULL */
+  if(mpii_infos.settings.request_registry)
+    mpii_registry_free(*req);
+  if(mpii_infos.settings.comm_matrix)
+    mpii_comm_matrix_free(*req);
+  int ret = MPII_EXEC(MPI_Request_free_call, req);
+  FUNCTION_EXIT;
+  return ret;
+}
+
+void mpii_call_args(int peer, int tag, MPI_Comm comm, int count, MPI_Datatype datatype) {
+  /* only record the arguments of the function called by the application */
+  if(recursion_shield != 1)
+    return;
+  uint64_t bytes = 0;
+  struct mpii_type_info type_info;
+  if(count > 0 && datatype != MPI_DATATYPE_NULL &&
+     mpii_type_info(datatype, &type_info) == MPI_SUCCESS)
+    bytes = (uint64_t)count * type_info.size;
+
+  MPII_PROBE4(call_args, mpii_current_function_id, thread_rank, peer, bytes);
+  if(mpii_infos.settings.trace && MPII_SAMPLED)
+    mpii_trace_args(peer, tag, comm, bytes);
+  if(mpii_sampled)
+    mpii_sample_args(bytes);
+  if(mpii_infos.settings.call_sites)
+    mpii_call_sites_args(bytes);
+  if(mpii_infos.settings.live)
+    mpii_shm_args(bytes);
+  /* MPI_DATATYPE_NULL means that the function does not send a message
+   * (eg. MPI_Barrier), or that its size is unknown
+   */
+  if(mpii_infos.settings.size_histograms && datatype != MPI_DATATYPE_NULL)
+    mpii_histogram_record(comm, bytes);
+}
+
+static int MPI_Finalize_call(void* arg MAYBE_UNUSED) {
+  return libMPI_Finalize();
 }
 
 int MPI_Finalize() {
   FUNCTION_ENTRY;
-  int ret = libMPI_Finalize();
+  if(mpii_infos.settings.check_concurrency)
+    mpii_concurrency_report();
+  if(mpii_infos.settings.lock_stats)
+    mpii_stats_report();
+  if(mpii_infos.settings.sample_rate)
+    mpii_sample_report();
+  if(mpii_infos.settings.request_registry)
+    mpii_registry_report();
+  if(mpii_infos.settings.comm_matrix)
+    mpii_comm_matrix_report();
+  if(mpii_infos.settings.size_histograms)
+    mpii_histogram_report();
+  if(mpii_infos.settings.pvars)
+    mpii_pvar_report();
+  if(mpii_infos.settings.perf_events)
+    mpii_perf_report();
+  int ret = MPII_DELEGATE(MPI_Finalize_call, NULL);
+  /* MPI is finalized, the communication thread is not needed anymore */
+  mpii_progress_stop();
+  if(mpii_infos.settings.trace)
+    mpii_trace_finalize();
+  if(mpii_infos.settings.live)
+    mpii_shm_finalize();
+  /* addr2line is run once MPI is finalized */
+  if(mpii_infos.settings.call_sites)
+    mpii_call_sites_report();
   FUNCTION_EXIT;
   return ret;
 }
@@ -433,8 +613,8 @@ int MPI_Finalize() {
  */
 void __mpi_init_generic() {
   int ret __attribute__((__unused__));
-  libMPI_Comm_size(MPI_COMM_WORLD, &mpii_infos.size);
-  libMPI_Comm_rank(MPI_COMM_WORLD, &mpii_infos.rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &mpii_infos.size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &mpii_infos.rank);
   mpii_infos.mpi_any_source = MPI_ANY_SOURCE;
   mpii_infos.mpi_any_tag = MPI_ANY_TAG;
   mpii_infos.mpi_proc_null = MPI_PROC_NULL;
@@ -442,23 +622,72 @@ void __mpi_init_generic() {
   mpii_infos.mpi_comm_world = MPI_COMM_WORLD;
   mpii_infos.mpi_comm_self = MPI_COMM_SELF;
 
+  /* Fortran request arrays can be passed as is to the C functions if
+   * C requests are Fortran integers, and the conversion is the identity
+   */
+  MPI_Request c_request_null = MPI_REQUEST_NULL;
+  mpii_infos.f_request_null = MPI_Request_c2f(c_request_null);
+  mpii_infos.f_requests_are_c_requests = MPII_REQUEST_IS_FINT &&
+    memcmp(&c_request_null, &mpii_infos.f_request_null, sizeof(MPI_Fint)) == 0 &&
+    MPI_Request_f2c(mpii_infos.f_request_null) == c_request_null;
+  MPII_PRINTF(1, "[MPII] Fortran requests are converted: %s\n",
+	      mpii_infos.f_requests_are_c_requests ? "no" : "yes");
+
+  mpii_stats_init();
+  if(mpii_infos.settings.async_log)
+    mpii_log_init();
+  if(mpii_infos.settings.trace)
+    mpii_trace_init();
+  if(mpii_infos.settings.live)
+    mpii_shm_init();
+  if(mpii_infos.settings.pvars)
+    mpii_pvar_init();
+
   __mpi_init_called = 1;
 }
 
 
+struct MPI_Init_thread_args {
+  int* argc;
+  char*** argv;
+  int required;
+  int* provided;
+};
+
+static int MPI_Init_thread_call(void* arg) {
+  struct MPI_Init_thread_args* a = arg;
+  return libMPI_Init_thread(a->argc, a->argv, a->required, a->provided);
+}
+
 int MPI_Init_thread(int* argc, char*** argv, int required, int* provided) {
   INTERCEPT_FUNCTION("MPI_Init_thread", libMPI_Init_thread);
   int ret = -1;
+
+  /* In delegate mode, MPI is initialized by the communication thread
+   * so that, from MPI point of view, it is the main thread.
+   */
+  int delegate = mpii_infos.settings.progress_mode == MPII_PROGRESS_DELEGATE &&
+    ! mpii_infos.settings.disable_thread_safety &&
+    (mpii_infos.settings.force_thread_safety || required == MPI_THREAD_MULTIPLE);
+  if(delegate)
+    mpii_progress_start(mpii_infos.settings.progress_cpu);
+
   if(mpii_infos.settings.force_thread_safety) {
-    /* even if the MPI implementation supports thread-safety, disable it and use ours */
-    ret = libMPI_Init_thread(argc, argv, MPI_THREAD_SERIALIZED, provided);
+    /* even if the MPI implementation supports thread-safety, disable it and use ours.
+     * When delegating, only the communication thread calls MPI.
+     */
+    struct MPI_Init_thread_args args = { argc, argv,
+					 delegate ? MPI_THREAD_FUNNELED : MPI_THREAD_SERIALIZED,
+					 provided };
+    ret = MPII_DELEGATE(MPI_Init_thread_call, &args);
     should_lock = 1 ;
-    pthread_mutex_init(&mpi_lock, NULL);
+    mpii_lock_init(mpii_infos.settings.lock_type);
     *provided = required;
     printf("[MPII] MPI custom thread-safety: FORCED\n");
       goto next;
   } else {
-    ret = libMPI_Init_thread(argc, argv, required, provided);
+    struct MPI_Init_thread_args args = { argc, argv, required, provided };
+    ret = MPII_DELEGATE(MPI_Init_thread_call, &args);
     if(mpii_infos.settings.disable_thread_safety == 1) {
       printf("[MPII] MPI custom thread-safety: DISABLED\n");
       goto next;
@@ -467,7 +696,7 @@ int MPI_Init_thread(int* argc, char*** argv, int required, int* provided) {
     if(required == MPI_THREAD_MULTIPLE && *provided != MPI_THREAD_MULTIPLE) {
       /* The application needs MPI_THREAD_MULTIPLE, but the implementation does not support it */
       should_lock = 1 ;
-      pthread_mutex_init(&mpi_lock, NULL);
+      mpii_lock_init(mpii_infos.settings.lock_type);
       *provided = required;
       printf("[MPII] MPI custom thread-safety: ON\n");
     } else {
@@ -480,6 +709,15 @@ int MPI_Init_thread(int* argc, char*** argv, int required, int* provided) {
   }
 
  next:
+  if(delegate && !should_lock) {
+    /* MPI supports MPI_THREAD_MULTIPLE, so the application threads call
+     * MPI directly and the communication thread is not needed
+     */
+    mpii_progress_stop();
+    delegate = 0;
+  }
+  if(delegate)
+    printf("[MPII] MPI calls are delegated to a communication thread\n");
   __mpi_init_generic();
   return ret;
 }
@@ -490,126 +728,330 @@ int MPI_Init(int* argc, char*** argv) {
   __mpi_init_generic();
   return ret;
 }
+static int MPI_Comm_disconnect_call(void* arg) {
+  mpii_comm_cache_remove(*(MPI_Comm*)arg);
+  if(mpii_infos.settings.comm_matrix)
+    mpii_comm_matrix_remove_comm(*(MPI_Comm*)arg);
+  if(mpii_infos.settings.size_histograms)
+    mpii_histogram_remove_comm(*(MPI_Comm*)arg);
+  return libMPI_Comm_disconnect(arg);
+}
+
 int MPI_Comm_disconnect(MPI_Comm* comm) {
-  return libMPI_Comm_disconnect(comm);
+  return MPII_DELEGATE(MPI_Comm_disconnect_call, comm);
+}
+
+struct MPI_Comm_free_args {
+  MPI_Comm* comm;
+};
+
+static int MPI_Comm_free_call(void* arg) {
+  struct MPI_Comm_free_args* a = arg;
+  mpii_comm_cache_remove(*a->comm);
+  if(mpii_infos.settings.comm_matrix)
+    mpii_comm_matrix_remove_comm(*a->comm);
+  if(mpii_infos.settings.size_histograms)
+    mpii_histogram_remove_comm(*a->comm);
+  return libMPI_Comm_free(a->comm);
 }
 
 int MPI_Comm_free(MPI_Comm* comm) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Comm_free(comm);
-  UNLOCK();
+  struct MPI_Comm_free_args args = { comm };
+  int ret = MPII_EXEC(MPI_Comm_free_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Comm_create_args {
+  MPI_Comm comm;
+  MPI_Group group;
+  MPI_Comm* newcomm;
+};
+
+static int MPI_Comm_create_call(void* arg) {
+  struct MPI_Comm_create_args* a = arg;
+  int ret = libMPI_Comm_create(a->comm, a->group, a->newcomm);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->newcomm);
+  return ret;
+}
+
 int MPI_Comm_create(MPI_Comm comm, MPI_Group group, MPI_Comm* newcomm) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Comm_create(comm, group, newcomm);
-  UNLOCK();
+  struct MPI_Comm_create_args args = { comm, group, newcomm };
+  int ret = MPII_EXEC(MPI_Comm_create_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Comm_create_group_args {
+  MPI_Comm comm;
+  MPI_Group group;
+  int tag;
+  MPI_Comm* newcomm;
+};
+
+static int MPI_Comm_create_group_call(void* arg) {
+  struct MPI_Comm_create_group_args* a = arg;
+  int ret = libMPI_Comm_create_group(a->comm, a->group, a->tag, a->newcomm);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->newcomm);
+  return ret;
+}
+
 int MPI_Comm_create_group(MPI_Comm comm, MPI_Group group, int tag, MPI_Comm* newcomm) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Comm_create_group(comm, group, tag, newcomm);
-  UNLOCK();
+  struct MPI_Comm_create_group_args args = { comm, group, tag, newcomm };
+  int ret = MPII_EXEC(MPI_Comm_create_group_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Comm_split_args {
+  MPI_Comm comm;
+  int color;
+  int key;
+  MPI_Comm* newcomm;
+};
+
+static int MPI_Comm_split_call(void* arg) {
+  struct MPI_Comm_split_args* a = arg;
+  int ret = libMPI_Comm_split(a->comm, a->color, a->key, a->newcomm);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->newcomm);
+  return ret;
+}
+
 int MPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm* newcomm) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Comm_split(comm, color, key, newcomm);
-  UNLOCK();
+  struct MPI_Comm_split_args args = { comm, color, key, newcomm };
+  int ret = MPII_EXEC(MPI_Comm_split_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Comm_dup_args {
+  MPI_Comm comm;
+  MPI_Comm* newcomm;
+};
+
+static int MPI_Comm_dup_call(void* arg) {
+  struct MPI_Comm_dup_args* a = arg;
+  int ret = libMPI_Comm_dup(a->comm, a->newcomm);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->newcomm);
+  return ret;
+}
+
 int MPI_Comm_dup(MPI_Comm comm, MPI_Comm* newcomm) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Comm_dup(comm, newcomm);
-  UNLOCK();
+  struct MPI_Comm_dup_args args = { comm, newcomm };
+  int ret = MPII_EXEC(MPI_Comm_dup_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Comm_dup_with_info_args {
+  MPI_Comm comm;
+  MPI_Info info;
+  MPI_Comm* newcomm;
+};
+
+static int MPI_Comm_dup_with_info_call(void* arg) {
+  struct MPI_Comm_dup_with_info_args* a = arg;
+  int ret = libMPI_Comm_dup_with_info(a->comm, a->info, a->newcomm);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->newcomm);
+  return ret;
+}
+
 int MPI_Comm_dup_with_info(MPI_Comm comm, MPI_Info info, MPI_Comm* newcomm) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Comm_dup_with_info(comm, info, newcomm);
-  UNLOCK();
+  struct MPI_Comm_dup_with_info_args args = { comm, info, newcomm };
+  int ret = MPII_EXEC(MPI_Comm_dup_with_info_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Comm_split_type_args {
+  MPI_Comm comm;
+  int split_type;
+  int key;
+  MPI_Info info;
+  MPI_Comm* newcomm;
+};
+
+static int MPI_Comm_split_type_call(void* arg) {
+  struct MPI_Comm_split_type_args* a = arg;
+  int ret = libMPI_Comm_split_type(a->comm, a->split_type, a->key, a->info,
+                                   a->newcomm);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->newcomm);
+  return ret;
+}
+
 int MPI_Comm_split_type(MPI_Comm comm, int split_type, int key, MPI_Info info,
                         MPI_Comm* newcomm) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Comm_split_type(comm, split_type, key, info, newcomm);
-  UNLOCK();
+  struct MPI_Comm_split_type_args args = { comm, split_type, key, info,
+                                           newcomm };
+  int ret = MPII_EXEC(MPI_Comm_split_type_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Intercomm_create_args {
+  MPI_Comm local_comm;
+  int local_leader;
+  MPI_Comm peer_comm;
+  int remote_leader;
+  int tag;
+  MPI_Comm* newintercomm;
+};
+
+static int MPI_Intercomm_create_call(void* arg) {
+  struct MPI_Intercomm_create_args* a = arg;
+  int ret = libMPI_Intercomm_create(a->local_comm, a->local_leader, a->peer_comm,
+                                    a->remote_leader, a->tag, a->newintercomm);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->newintercomm);
+  return ret;
+}
+
 int MPI_Intercomm_create(MPI_Comm local_comm, int local_leader,
                          MPI_Comm peer_comm, int remote_leader, int tag,
                          MPI_Comm* newintercomm) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Intercomm_create(local_comm, local_leader, peer_comm,
-                                    remote_leader, tag, newintercomm);
-  UNLOCK();
+  struct MPI_Intercomm_create_args args = { local_comm, local_leader, peer_comm,
+                                            remote_leader, tag, newintercomm };
+  int ret = MPII_EXEC(MPI_Intercomm_create_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Intercomm_merge_args {
+  MPI_Comm intercomm;
+  int high;
+  MPI_Comm* newintracomm;
+};
+
+static int MPI_Intercomm_merge_call(void* arg) {
+  struct MPI_Intercomm_merge_args* a = arg;
+  int ret = libMPI_Intercomm_merge(a->intercomm, a->high, a->newintracomm);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->newintracomm);
+  return ret;
+}
+
 int MPI_Intercomm_merge(MPI_Comm intercomm, int high, MPI_Comm* newintracomm) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Intercomm_merge(intercomm, high, newintracomm);
-  UNLOCK();
+  struct MPI_Intercomm_merge_args args = { intercomm, high, newintracomm };
+  int ret = MPII_EXEC(MPI_Intercomm_merge_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Cart_sub_args {
+  MPI_Comm old_comm;
+  CONST int* belongs;
+  MPI_Comm* new_comm;
+};
+
+static int MPI_Cart_sub_call(void* arg) {
+  struct MPI_Cart_sub_args* a = arg;
+  int ret = libMPI_Cart_sub(a->old_comm, a->belongs, a->new_comm);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->new_comm);
+  return ret;
+}
+
 int MPI_Cart_sub(MPI_Comm old_comm, CONST int* belongs, MPI_Comm* new_comm) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Cart_sub(old_comm, belongs, new_comm);
-  UNLOCK();
+  struct MPI_Cart_sub_args args = { old_comm, belongs, new_comm };
+  int ret = MPII_EXEC(MPI_Cart_sub_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Cart_create_args {
+  MPI_Comm comm_old;
+  int ndims;
+  CONST int* dims;
+  CONST int* periods;
+  int reorder;
+  MPI_Comm* comm_cart;
+};
+
+static int MPI_Cart_create_call(void* arg) {
+  struct MPI_Cart_create_args* a = arg;
+  int ret = libMPI_Cart_create(a->comm_old, a->ndims, a->dims, a->periods,
+                               a->reorder, a->comm_cart);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->comm_cart);
+  return ret;
+}
+
 int MPI_Cart_create(MPI_Comm comm_old, int ndims, CONST int* dims,
                     CONST int* periods, int reorder, MPI_Comm* comm_cart) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Cart_create(comm_old, ndims, dims, periods, reorder,
-                               comm_cart);
-  UNLOCK();
+  struct MPI_Cart_create_args args = { comm_old, ndims, dims, periods, reorder,
+                                       comm_cart };
+  int ret = MPII_EXEC(MPI_Cart_create_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Graph_create_args {
+  MPI_Comm comm_old;
+  int nnodes;
+  CONST int* index;
+  CONST int* edges;
+  int reorder;
+  MPI_Comm* comm_graph;
+};
+
+static int MPI_Graph_create_call(void* arg) {
+  struct MPI_Graph_create_args* a = arg;
+  int ret = libMPI_Graph_create(a->comm_old, a->nnodes, a->index, a->edges,
+                                a->reorder, a->comm_graph);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->comm_graph);
+  return ret;
+}
+
 int MPI_Graph_create(MPI_Comm comm_old, int nnodes, CONST int* index,
                      CONST int* edges, int reorder, MPI_Comm* comm_graph) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Graph_create(comm_old, nnodes, index, edges, reorder,
-                                comm_graph);
-  UNLOCK();
+  struct MPI_Graph_create_args args = { comm_old, nnodes, index, edges, reorder,
+                                        comm_graph };
+  int ret = MPII_EXEC(MPI_Graph_create_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Dist_graph_create_args {
+  MPI_Comm comm_old;
+  int n;
+  CONST int* sources;
+  CONST int* degrees;
+  CONST int* destinations;
+  CONST int* weights;
+  MPI_Info info;
+  int reorder;
+  MPI_Comm* comm_dist_graph;
+};
+
+static int MPI_Dist_graph_create_call(void* arg) {
+  struct MPI_Dist_graph_create_args* a = arg;
+  int ret = libMPI_Dist_graph_create(a->comm_old, a->n, a->sources, a->degrees,
+                                     a->destinations, a->weights, a->info,
+                                     a->reorder, a->comm_dist_graph);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->comm_dist_graph);
+  return ret;
+}
+
 int MPI_Dist_graph_create(MPI_Comm comm_old,
                           int n,
                           CONST int sources[],
@@ -621,14 +1063,39 @@ int MPI_Dist_graph_create(MPI_Comm comm_old,
                           MPI_Comm* comm_dist_graph) {
 
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Dist_graph_create(comm_old, n, sources, degrees, destinations,
-                                     weights, info, reorder, comm_dist_graph);
-  UNLOCK();
+  struct MPI_Dist_graph_create_args args = { comm_old, n, sources, degrees,
+                                             destinations, weights, info,
+                                             reorder, comm_dist_graph };
+  int ret = MPII_EXEC(MPI_Dist_graph_create_call, &args);
   FUNCTION_EXIT;
   return ret;
 }
 
+struct MPI_Dist_graph_create_adjacent_args {
+  MPI_Comm comm_old;
+  int indegree;
+  CONST int* sources;
+  CONST int* sourceweights;
+  int outdegree;
+  CONST int* destinations;
+  CONST int* destweights;
+  MPI_Info info;
+  int reorder;
+  MPI_Comm* comm_dist_graph;
+};
+
+static int MPI_Dist_graph_create_adjacent_call(void* arg) {
+  struct MPI_Dist_graph_create_adjacent_args* a = arg;
+  int ret = libMPI_Dist_graph_create_adjacent(a->comm_old, a->indegree, a->sources,
+                                              a->sourceweights, a->outdegree,
+                                              a->destinations, a->destweights,
+                                              a->info, a->reorder,
+                                              a->comm_dist_graph);
+  if(ret == MPI_SUCCESS)
+    mpii_comm_cache_add(*a->comm_dist_graph);
+  return ret;
+}
+
 int MPI_Dist_graph_create_adjacent(MPI_Comm comm_old,
                                    int indegree,
                                    CONST int sources[],
@@ -640,12 +1107,112 @@ int MPI_Dist_graph_create_adjacent(MPI_Comm comm_old,
                                    int reorder,
                                    MPI_Comm* comm_dist_graph) {
   FUNCTION_ENTRY;
-  LOCK();
-  int ret = libMPI_Dist_graph_create_adjacent(comm_old, indegree, sources,
-                                              sourceweights, outdegree,
-                                              destinations, destweights, info,
-                                              reorder, comm_dist_graph);
-  UNLOCK();
+  struct MPI_Dist_graph_create_adjacent_args args = { comm_old, indegree,
+                                                      sources, sourceweights,
+                                                      outdegree, destinations,
+                                                      destweights, info,
+                                                      reorder,
+                                                      comm_dist_graph };
+  int ret = MPII_EXEC(MPI_Dist_graph_create_adjacent_call, &args);
+  FUNCTION_EXIT;
+  return ret;
+}
+
+
+/* The passive target epochs are tracked so that MPI_Put and MPI_Get
+ * can be converted to request-based operations (see mpii_win.c)
+ */
+struct MPI_Win_lock_args {
+  int lock_type;
+  int rank;
+  int assert;
+  MPI_Win win;
+};
+
+static int MPI_Win_lock_call(void* arg) {
+  struct MPI_Win_lock_args* a = arg;
+  int ret = libMPI_Win_lock(a->lock_type, a->rank, a->assert, a->win);
+  if(ret == MPI_SUCCESS)
+    mpii_win_passive_begin(a->win);
+  return ret;
+}
+
+int MPI_Win_lock(int lock_type, int rank, int assert, MPI_Win win) {
+  FUNCTION_ENTRY;
+  struct MPI_Win_lock_args args = { lock_type, rank, assert, win };
+  int ret = MPII_EXEC(MPI_Win_lock_call, &args);
+  FUNCTION_EXIT;
+  return ret;
+}
+
+struct MPI_Win_unlock_args {
+  int rank;
+  MPI_Win win;
+};
+
+static int MPI_Win_unlock_call(void* arg) {
+  struct MPI_Win_unlock_args* a = arg;
+  int ret = libMPI_Win_unlock(a->rank, a->win);
+  if(ret == MPI_SUCCESS)
+    mpii_win_passive_end(a->win);
+  return ret;
+}
+
+int MPI_Win_unlock(int rank, MPI_Win win) {
+  FUNCTION_ENTRY;
+  struct MPI_Win_unlock_args args = { rank, win };
+  int ret = MPII_EXEC(MPI_Win_unlock_call, &args);
+  FUNCTION_EXIT;
+  return ret;
+}
+
+#ifdef USE_MPI3
+struct MPI_Win_lock_all_args {
+  int assert;
+  MPI_Win win;
+};
+
+static int MPI_Win_lock_all_call(void* arg) {
+  struct MPI_Win_lock_all_args* a = arg;
+  int ret = libMPI_Win_lock_all(a->assert, a->win);
+  if(ret == MPI_SUCCESS)
+    mpii_win_passive_begin(a->win);
+  return ret;
+}
+
+int MPI_Win_lock_all(int assert, MPI_Win win) {
+  FUNCTION_ENTRY;
+  struct MPI_Win_lock_all_args args = { assert, win };
+  int ret = MPII_EXEC(MPI_Win_lock_all_call, &args);
+  FUNCTION_EXIT;
+  return ret;
+}
+
+static int MPI_Win_unlock_all_call(void* arg) {
+  MPI_Win* win = arg;
+  int ret = libMPI_Win_unlock_all(*win);
+  if(ret == MPI_SUCCESS)
+    mpii_win_passive_end(*win);
+  return ret;
+}
+
+int MPI_Win_unlock_all(MPI_Win win) {
+  FUNCTION_ENTRY;
+  int ret = MPII_EXEC(MPI_Win_unlock_all_call, &win);
+  FUNCTION_EXIT;
+  return ret;
+}
+#endif
+
+static int MPI_Win_free_call(void* arg) {
+  MPI_Win* win = arg;
+  mpii_win_remove(*win);
+  return libMPI_Win_free(win);
+}
+
+int MPI_Win_free(MPI_Win* win) {
+  FUNCTION_ENTRY;
+  int ret = MPII_EXEC(MPI_Win_free_call, win);
   FUNCTION_EXIT;
   return ret;
 }
@@ -660,8 +1227,13 @@ INTERCEPT3("MPI_Comm_size", libMPI_Comm_size)
 INTERCEPT3("MPI_Comm_rank", libMPI_Comm_rank)
 INTERCEPT3("MPI_Comm_get_parent", libMPI_Comm_get_parent)
 INTERCEPT3("MPI_Type_size", libMPI_Type_size)
+INTERCEPT3("MPI_Type_get_extent", libMPI_Type_get_extent)
+INTERCEPT3("MPI_Type_get_true_extent", libMPI_Type_get_true_extent)
+INTERCEPT3("MPI_Type_commit", libMPI_Type_commit)
+INTERCEPT3("MPI_Type_free", libMPI_Type_free)
 
 INTERCEPT3("MPI_Cancel", libMPI_Cancel)
+INTERCEPT3("MPI_Request_free", libMPI_Request_free)
 
 INTERCEPT3("MPI_Comm_disconnect", libMPI_Comm_disconnect)
 INTERCEPT3("MPI_Comm_free", libMPI_Comm_free)
@@ -708,6 +1280,15 @@ INTERCEPT3("MPI_Probe", libMPI_Probe)
 
 INTERCEPT3("MPI_Get", libMPI_Get)
 INTERCEPT3("MPI_Put", libMPI_Put)
+#ifdef USE_MPI3
+INTERCEPT3("MPI_Rget", libMPI_Rget)
+INTERCEPT3("MPI_Rput", libMPI_Rput)
+INTERCEPT3("MPI_Win_lock_all", libMPI_Win_lock_all)
+INTERCEPT3("MPI_Win_unlock_all", libMPI_Win_unlock_all)
+#endif
+INTERCEPT3("MPI_Win_lock", libMPI_Win_lock)
+INTERCEPT3("MPI_Win_unlock", libMPI_Win_unlock)
+INTERCEPT3("MPI_Win_free", libMPI_Win_free)
 
 INTERCEPT3("MPI_Bcast", libMPI_Bcast)
 INTERCEPT3("MPI_Gather", libMPI_Gather)
@@ -923,6 +1504,127 @@ static void load_settings() {
     mpii_infos.settings.abort_on_concurrency_check_failure = atoi(mpii_abort_on_concurrency_check_failure);
   }
 
+  char* mpii_lock = getenv("MPII_LOCK");
+  if(mpii_lock) {
+    int type = mpii_lock_type_from_name(mpii_lock);
+    if(type < 0) {
+      fprintf(stderr, "Warning: unknown lock type MPII_LOCK=%s. Using %s instead\n",
+	      mpii_lock, mpii_lock_type_name(SETTINGS_LOCK_TYPE_DEFAULT));
+      type = SETTINGS_LOCK_TYPE_DEFAULT;
+    }
+    mpii_infos.settings.lock_type = type;
+  }
+
+  char* mpii_progress = getenv("MPII_PROGRESS");
+  if(mpii_progress) {
+    int mode = mpii_progress_mode_from_name(mpii_progress);
+    if(mode < 0) {
+      fprintf(stderr, "Warning: unknown progress mode MPII_PROGRESS=%s. Using %s instead\n",
+	      mpii_progress, mpii_progress_mode_name(SETTINGS_PROGRESS_MODE_DEFAULT));
+      mode = SETTINGS_PROGRESS_MODE_DEFAULT;
+    }
+    mpii_infos.settings.progress_mode = mode;
+  }
+
+  char* mpii_progress_cpu = getenv("MPII_PROGRESS_CPU");
+  if(mpii_progress_cpu) {
+    mpii_infos.settings.progress_cpu = atoi(mpii_progress_cpu);
+  }
+
+  char* mpii_combine = getenv("MPII_COMBINE");
+  if(mpii_combine) {
+    mpii_infos.settings.combine = atoi(mpii_combine);
+  }
+
+  char* mpii_completion_engine = getenv("MPII_COMPLETION_ENGINE");
+  if(mpii_completion_engine) {
+    mpii_infos.settings.completion_engine = atoi(mpii_completion_engine);
+  }
+
+  char* mpii_rma_requests = getenv("MPII_RMA_REQUESTS");
+  if(mpii_rma_requests) {
+    mpii_infos.settings.rma_requests = atoi(mpii_rma_requests);
+  }
+
+  char* mpii_request_registry = getenv("MPII_REQUEST_REGISTRY");
+  if(mpii_request_registry) {
+    mpii_infos.settings.request_registry = atoi(mpii_request_registry);
+  }
+
+  char* mpii_lock_stats = getenv("MPII_LOCK_STATS");
+  if(mpii_lock_stats) {
+    mpii_infos.settings.lock_stats = atoi(mpii_lock_stats);
+  }
+
+  char* mpii_comm_matrix = getenv("MPII_COMM_MATRIX");
+  if(mpii_comm_matrix) {
+    mpii_infos.settings.comm_matrix = atoi(mpii_comm_matrix);
+  }
+
+  char* mpii_size_histograms = getenv("MPII_SIZE_HISTOGRAMS");
+  if(mpii_size_histograms) {
+    mpii_infos.settings.size_histograms = atoi(mpii_size_histograms);
+  }
+
+  char* mpii_sample_rate = getenv("MPII_SAMPLE_RATE");
+  if(mpii_sample_rate) {
+    mpii_infos.settings.sample_rate = atoi(mpii_sample_rate);
+    if(mpii_infos.settings.sample_rate < 0) {
+      fprintf(stderr, "Warning: invalid sample rate MPII_SAMPLE_RATE=%s. Sampling is disabled\n",
+	      mpii_sample_rate);
+      mpii_infos.settings.sample_rate = 0;
+    }
+  }
+
+  char* mpii_call_sites = getenv("MPII_CALL_SITES");
+  if(mpii_call_sites) {
+    mpii_infos.settings.call_sites = atoi(mpii_call_sites);
+    if(mpii_infos.settings.call_sites > MPII_CALL_SITES_MAX_DEPTH)
+      mpii_infos.settings.call_sites = MPII_CALL_SITES_MAX_DEPTH;
+  }
+
+  char* mpii_live = getenv("MPII_LIVE");
+  if(mpii_live) {
+    mpii_infos.settings.live = atoi(mpii_live);
+  }
+
+  char* mpii_pvars = getenv("MPII_PVARS");
+  if(mpii_pvars) {
+    mpii_infos.settings.pvars = atoi(mpii_pvars);
+    if(mpii_infos.settings.pvars < 0) {
+      fprintf(stderr, "Warning: invalid sampling period MPII_PVARS=%s. The performance variables are not sampled\n",
+	      mpii_pvars);
+      mpii_infos.settings.pvars = 0;
+    }
+  }
+
+  char* mpii_perf_events = getenv("MPII_PERF_EVENTS");
+  if(mpii_perf_events) {
+    mpii_infos.settings.perf_events = atoi(mpii_perf_events);
+  }
+
+  char* mpii_async_log = getenv("MPII_ASYNC_LOG");
+  if(mpii_async_log) {
+    mpii_infos.settings.async_log = atoi(mpii_async_log);
+  }
+
+  char* mpii_trace = getenv("MPII_TRACE");
+  if(mpii_trace) {
+    mpii_infos.settings.trace = atoi(mpii_trace);
+  }
+
+  char* mpii_wait_policy = getenv("MPII_WAIT_POLICY");
+  if(mpii_wait_policy) {
+    if(mpii_wait_configure(mpii_wait_policy) < 0)
+      fprintf(stderr, "Warning: invalid wait policy MPII_WAIT_POLICY=%s. Using the default policy instead\n",
+	      mpii_wait_policy);
+  }
+
+  char* mpii_wait_sleep_max = getenv("MPII_WAIT_SLEEP_MAX");
+  if(mpii_wait_sleep_max) {
+    mpii_wait_set_sleep_max(atoi(mpii_wait_sleep_max));
+  }
+
   printf("----------------------\n");
   printf("MPII settings:\n");
   printf("[MPII] Debug level: %d\n", mpii_infos.settings.verbose);
@@ -930,6 +1632,24 @@ static void load_settings() {
   printf("[MPII] Disable thread-safety: %d\n", mpii_infos.settings.disable_thread_safety);
   printf("[MPII] Check concurrency: %d\n", mpii_infos.settings.check_concurrency);
   printf("[MPII] Abort on concurrency check_failure: %d\n", mpii_infos.settings.abort_on_concurrency_check_failure);
+  printf("[MPII] Lock type: %s\n", mpii_lock_type_name(mpii_infos.settings.lock_type));
+  printf("[MPII] Progress mode: %s\n", mpii_progress_mode_name(mpii_infos.settings.progress_mode));
+  printf("[MPII] Communication thread cpu: %d\n", mpii_infos.settings.progress_cpu);
+  printf("[MPII] Combine posting calls: %d\n", mpii_infos.settings.combine);
+  printf("[MPII] Completion engine: %d\n", mpii_infos.settings.completion_engine);
+  printf("[MPII] Request-based RMA: %d\n", mpii_infos.settings.rma_requests);
+  printf("[MPII] Request registry: %d\n", mpii_infos.settings.request_registry);
+  printf("[MPII] Lock statistics: %d\n", mpii_infos.settings.lock_stats);
+  printf("[MPII] Communication matrix: %d\n", mpii_infos.settings.comm_matrix);
+  printf("[MPII] Message size histograms: %d\n", mpii_infos.settings.size_histograms);
+  printf("[MPII] Trace: %d\n", mpii_infos.settings.trace);
+  printf("[MPII] Sample rate: %d\n", mpii_infos.settings.sample_rate);
+  printf("[MPII] Call sites depth: %d\n", mpii_infos.settings.call_sites);
+  printf("[MPII] Live metrics: %d\n", mpii_infos.settings.live);
+  printf("[MPII] Performance variables sampling period (ms): %d\n", mpii_infos.settings.pvars);
+  printf("[MPII] Perf events: %d\n", mpii_infos.settings.perf_events);
+  printf("[MPII] Asynchronous log: %d\n", mpii_infos.settings.async_log);
+  mpii_wait_print_config();
   printf("----------------------\n");
   
   if( mpii_infos.settings.force_thread_safety &&
@@ -943,6 +1663,23 @@ static void load_settings() {
 void mpii_init(void) __attribute__((constructor));
 void mpii_init(void) {
   mpii_infos.settings.verbose=SETTINGS_VERBOSE_DEFAULT;
+  mpii_infos.settings.lock_type=SETTINGS_LOCK_TYPE_DEFAULT;
+  mpii_infos.settings.progress_mode=SETTINGS_PROGRESS_MODE_DEFAULT;
+  mpii_infos.settings.progress_cpu=SETTINGS_PROGRESS_CPU_DEFAULT;
+  mpii_infos.settings.combine=SETTINGS_COMBINE_DEFAULT;
+  mpii_infos.settings.completion_engine=SETTINGS_COMPLETION_ENGINE_DEFAULT;
+  mpii_infos.settings.rma_requests=SETTINGS_RMA_REQUESTS_DEFAULT;
+  mpii_infos.settings.request_registry=SETTINGS_REQUEST_REGISTRY_DEFAULT;
+  mpii_infos.settings.lock_stats=SETTINGS_LOCK_STATS_DEFAULT;
+  mpii_infos.settings.comm_matrix=SETTINGS_COMM_MATRIX_DEFAULT;
+  mpii_infos.settings.size_histograms=SETTINGS_SIZE_HISTOGRAMS_DEFAULT;
+  mpii_infos.settings.trace=SETTINGS_TRACE_DEFAULT;
+  mpii_infos.settings.sample_rate=SETTINGS_SAMPLE_RATE_DEFAULT;
+  mpii_infos.settings.call_sites=SETTINGS_CALL_SITES_DEFAULT;
+  mpii_infos.settings.live=SETTINGS_LIVE_DEFAULT;
+  mpii_infos.settings.pvars=SETTINGS_PVARS_DEFAULT;
+  mpii_infos.settings.perf_events=SETTINGS_PERF_EVENTS_DEFAULT;
+  mpii_infos.settings.async_log=SETTINGS_ASYNC_LOG_DEFAULT;
   unset_ld_preload();
   load_settings();  
   INSTRUMENT_ALL_FUNCTIONS();
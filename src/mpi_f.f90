@@ -176,8 +176,8 @@ call MPIF_Waitall(COUNT, R, S, IERROR)
 return
 end
 
-subroutine MPI_WAITANY(COUNT, R, S, INDEX, IERROR)
-call MPIF_Waitany(COUNT, R, S, INDEX, IERROR)
+subroutine MPI_WAITANY(COUNT, R, INDEX, S, IERROR)
+call MPIF_Waitany(COUNT, R, INDEX, S, IERROR)
 return
 end
 
@@ -303,3 +303,22 @@ subroutine MPI_TYPE_SIZE(TYPE, SIZE, IERROR)
   return
 end subroutine MPI_TYPE_SIZE
 
+subroutine MPI_TYPE_COMMIT(TYPE, IERROR)
+  call MPIF_TYPE_COMMIT(TYPE, IERROR)
+  return
+end subroutine MPI_TYPE_COMMIT
+
+subroutine MPI_TYPE_FREE(TYPE, IERROR)
+  call MPIF_TYPE_FREE(TYPE, IERROR)
+  return
+end subroutine MPI_TYPE_FREE
+
+subroutine MPI_REQUEST_FREE(REQUEST, IERROR)
+  call MPIF_REQUEST_FREE(REQUEST, IERROR)
+  return
+end subroutine MPI_REQUEST_FREE
+
+subroutine MPI_COMM_FREE(COMM, IERROR)
+  call MPIF_COMM_FREE(COMM, IERROR)
+  return
+end subroutine MPI_COMM_FREE
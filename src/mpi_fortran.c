@@ -40,9 +40,10 @@ void mpif_comm_rank_(MPI_Fint* c, int* r, int* error) {
 void mpif_comm_spawn_(char* command, char** argv, int* maxprocs, MPI_Fint* info,
                       int* root, MPI_Fint* comm, MPI_Fint* intercomm,
                       int* array_of_errcodes, int* error) {
+  FUNCTION_ENTRY_("mpi_comm_spawn_");
   MPI_Comm c_comm = MPI_Comm_f2c(*comm);
   MPI_Info c_info = MPI_Info_f2c(*info);
-  ALLOCATE_ITEMS(MPI_Comm, *maxprocs, c_intercomm, p_intercomm);
+  MPI_Comm* p_intercomm = MPII_ARENA_ALLOC(MPI_Comm, *maxprocs);
 
   int i;
   for (i = 0; i < *maxprocs; i++)
@@ -52,8 +53,7 @@ void mpif_comm_spawn_(char* command, char** argv, int* maxprocs, MPI_Fint* info,
                           p_intercomm, array_of_errcodes);
   for (i = 0; i < *maxprocs; i++)
     intercomm[i] = MPI_Comm_c2f(p_intercomm[i]);
-
-  FREE_ITEMS(*maxprocs, p_intercomm);
+  FUNCTION_EXIT_("mpi_comm_spawn_");
 }
 
 void mpif_comm_create_(MPI_Fint* comm, MPI_Fint* group, MPI_Fint* newcomm,
@@ -196,6 +196,29 @@ void mpif_dist_graph_create_adjacent_(MPI_Fint* comm_old, int* indegree,
   *comm_dist_graph = MPI_Comm_c2f(comm_dist_graph_c);
 }
 
-void mpif_type_size_(int* datatype, int* size, MPI_Fint* error) {
-  *error = MPI_Type_size(*datatype, size);
+void mpif_type_size_(MPI_Fint* datatype, int* size, MPI_Fint* error) {
+  *error = MPI_Type_size(MPI_Type_f2c(*datatype), size);
+}
+
+void mpif_type_commit_(MPI_Fint* datatype, MPI_Fint* error) {
+  MPI_Datatype c_type = MPI_Type_f2c(*datatype);
+  *error = MPI_Type_commit(&c_type);
+}
+
+void mpif_type_free_(MPI_Fint* datatype, MPI_Fint* error) {
+  MPI_Datatype c_type = MPI_Type_f2c(*datatype);
+  *error = MPI_Type_free(&c_type);
+  *datatype = MPI_Type_c2f(c_type);
+}
+
+void mpif_request_free_(MPI_Fint* req, MPI_Fint* error) {
+  MPI_Request c_req = MPI_Request_f2c(*req);
+  *error = MPI_Request_free(&c_req);
+  *req = MPI_Request_c2f(c_req);
+}
+
+void mpif_comm_free_(MPI_Fint* comm, MPI_Fint* error) {
+  MPI_Comm c_comm = MPI_Comm_f2c(*comm);
+  *error = MPI_Comm_free(&c_comm);
+  *comm = MPI_Comm_c2f(c_comm);
 }
@@ -27,7 +27,7 @@ static void MPI_Allgather_prolog(CONST void* sendbuf MAYBE_UNUSED,
                                  int  recvcount MAYBE_UNUSED,
                                  MPI_Datatype recvtype MAYBE_UNUSED,
 				 MPI_Comm comm MAYBE_UNUSED) {
-
+  MPII_CALL_ARGS(-1, -1, comm, sendcount, sendtype);
 }
 
 static int MPI_Allgather_core(CONST void* sendbuf, int sendcount,
@@ -37,7 +37,7 @@ static int MPI_Allgather_core(CONST void* sendbuf, int sendcount,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Iallgather(sendbuf, sendcount, sendtype, recvbuf, recvcount,
+    MPI_Iallgather(sendbuf, sendcount, sendtype, recvbuf, recvcount,
 			    recvtype, comm, &req);
     MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
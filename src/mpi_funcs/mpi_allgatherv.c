@@ -28,7 +28,7 @@ static void MPI_Allgatherv_prolog(CONST void* sendbuf MAYBE_UNUSED,
                                   CONST int* displs MAYBE_UNUSED,
                                   MPI_Datatype recvtype MAYBE_UNUSED,
                                   MPI_Comm comm MAYBE_UNUSED) {
-
+  MPII_CALL_ARGS(-1, -1, comm, sendcount, sendtype);
 }
 
 static int MPI_Allgatherv_core(CONST void* sendbuf,
@@ -42,7 +42,7 @@ static int MPI_Allgatherv_core(CONST void* sendbuf,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Iallgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts,
+    MPI_Iallgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts,
 		       displs, recvtype, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
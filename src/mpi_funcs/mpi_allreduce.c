@@ -26,6 +26,7 @@ static void MPI_Allreduce_prolog(CONST void* sendbuf MAYBE_UNUSED,
                                  MPI_Datatype datatype  MAYBE_UNUSED,
                                  MPI_Op op  MAYBE_UNUSED,
                                  MPI_Comm comm  MAYBE_UNUSED) {
+  MPII_CALL_ARGS(-1, -1, comm, count, datatype);
 }
 
 static int MPI_Allreduce_core(CONST void* sendbuf, void* recvbuf, int count,
@@ -33,7 +34,7 @@ static int MPI_Allreduce_core(CONST void* sendbuf, void* recvbuf, int count,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Iallreduce(sendbuf, recvbuf, count, datatype, op, comm, &req);
+    MPI_Iallreduce(sendbuf, recvbuf, count, datatype, op, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
     ret = libMPI_Allreduce(sendbuf, recvbuf, count, datatype, op, comm);
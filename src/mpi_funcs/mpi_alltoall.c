@@ -27,6 +27,7 @@ static void MPI_Alltoall_prolog(CONST void* sendbuf MAYBE_UNUSED,
                                 int recvcnt MAYBE_UNUSED,
                                 MPI_Datatype recvtype MAYBE_UNUSED,
                                 MPI_Comm comm MAYBE_UNUSED) {
+  MPII_CALL_ARGS(-1, -1, comm, sendcount, sendtype);
 }
 
 static int MPI_Alltoall_core(CONST void* sendbuf, int sendcount,
@@ -35,7 +36,7 @@ static int MPI_Alltoall_core(CONST void* sendbuf, int sendcount,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Ialltoall(sendbuf, sendcount, sendtype, recvbuf, recvcnt,
+    MPI_Ialltoall(sendbuf, sendcount, sendtype, recvbuf, recvcnt,
 		     recvtype, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
@@ -29,7 +29,8 @@ static void MPI_Alltoallv_prolog(CONST void* sendbuf   MAYBE_UNUSED,
                                  CONST int* rdispls    MAYBE_UNUSED,
                                  MPI_Datatype recvtype MAYBE_UNUSED,
                                  MPI_Comm comm MAYBE_UNUSED) {
-
+  /* the size of the messages depends on the peer, it is not recorded */
+  MPII_CALL_ARGS(-1, -1, comm, 0, MPI_DATATYPE_NULL);
 }
 
 static int MPI_Alltoallv_core(CONST void* sendbuf, CONST int* sendcnts,
@@ -40,7 +41,7 @@ static int MPI_Alltoallv_core(CONST void* sendbuf, CONST int* sendcnts,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Ialltoallv(sendbuf, sendcnts, sdispls, sendtype, recvbuf,
+    MPI_Ialltoallv(sendbuf, sendcnts, sdispls, sendtype, recvbuf,
 		      recvcnts, rdispls, recvtype, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
@@ -21,13 +21,14 @@
 #include <unistd.h>
 
 static void MPI_Barrier_prolog(MPI_Comm c MAYBE_UNUSED) {
+  MPII_CALL_ARGS(-1, -1, c, 0, MPI_DATATYPE_NULL);
 }
 
 static int MPI_Barrier_core(MPI_Comm c) {
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Ibarrier(c, &req);
+    MPI_Ibarrier(c, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
     ret = libMPI_Barrier(c);
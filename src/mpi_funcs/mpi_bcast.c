@@ -25,7 +25,7 @@ static void MPI_Bcast_prolog(void* buffer MAYBE_UNUSED,
                              MPI_Datatype datatype MAYBE_UNUSED,
 			     int root MAYBE_UNUSED,
 			     MPI_Comm comm MAYBE_UNUSED) {
-
+  MPII_CALL_ARGS(root, -1, comm, count, datatype);
 }
 
 static int MPI_Bcast_core(void* buffer,
@@ -36,7 +36,7 @@ static int MPI_Bcast_core(void* buffer,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Ibcast(buffer, count, datatype, root, comm, &req);
+    MPI_Ibcast(buffer, count, datatype, root, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
     ret = libMPI_Bcast(buffer, count, datatype, root, comm);
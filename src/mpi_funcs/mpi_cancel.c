@@ -23,16 +23,18 @@
 static void MPI_Cancel_prolog(MPI_Fint* req MAYBE_UNUSED) {
 }
 
+static int MPI_Cancel_call(void* arg) {
+  return libMPI_Cancel(arg);
+}
+
 static int MPI_Cancel_core(MPI_Request* request) {
-  return libMPI_Cancel(request);
+  return MPII_EXEC(MPI_Cancel_call, request);
 }
 
 int MPI_Cancel(MPI_Request* req) {
   FUNCTION_ENTRY;
   MPI_Cancel_prolog((MPI_Fint*)req);
-  LOCK();
   int ret = MPI_Cancel_core(req);
-  UNLOCK();
   FUNCTION_EXIT;
   return ret;
 }
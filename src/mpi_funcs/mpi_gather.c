@@ -28,6 +28,7 @@ static void MPI_Gather_prolog(CONST void* sendbuf MAYBE_UNUSED,
                               MPI_Datatype recvtype MAYBE_UNUSED,
                               int root MAYBE_UNUSED,
                               MPI_Comm comm MAYBE_UNUSED) {
+  MPII_CALL_ARGS(root, -1, comm, sendcnt, sendtype);
 }
 
 static int MPI_Gather_core(CONST void* sendbuf,
@@ -40,7 +41,7 @@ static int MPI_Gather_core(CONST void* sendbuf,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Igather(sendbuf, sendcnt, sendtype, recvbuf, recvcount, recvtype,
+    MPI_Igather(sendbuf, sendcnt, sendtype, recvbuf, recvcount, recvtype,
 		   root, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
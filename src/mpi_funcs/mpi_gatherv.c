@@ -29,7 +29,7 @@ static void MPI_Gatherv_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                MPI_Datatype recvtype MAYBE_UNUSED,
                                int root MAYBE_UNUSED,
                                MPI_Comm comm MAYBE_UNUSED) {
-
+  MPII_CALL_ARGS(root, -1, comm, sendcnt, sendtype);
 }
 
 static int MPI_Gatherv_core(CONST void* sendbuf,
@@ -44,7 +44,7 @@ static int MPI_Gatherv_core(CONST void* sendbuf,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Igatherv(sendbuf, sendcnt, sendtype, recvbuf, recvcnts, displs,
+    MPI_Igatherv(sendbuf, sendcnt, sendtype, recvbuf, recvcnts, displs,
 		    recvtype, root, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
@@ -28,9 +28,48 @@ static void MPI_Get_prolog(void* origin_addr  MAYBE_UNUSED,
                            int target_count  MAYBE_UNUSED,
                            MPI_Datatype target_datatype  MAYBE_UNUSED,
                            MPI_Win win MAYBE_UNUSED) {
+  MPII_CALL_ARGS(target_rank, -1, MPI_COMM_NULL, origin_count, origin_datatype);
+}
+
+struct MPI_Get_args {
+  void* origin_addr;
+  int origin_count;
+  MPI_Datatype origin_datatype;
+  int target_rank;
+  MPI_Aint target_disp;
+  int target_count;
+  MPI_Datatype target_datatype;
+  MPI_Win win;
+};
 
+static int MPI_Get_call(void* arg) {
+  struct MPI_Get_args* a = arg;
+  return libMPI_Get(a->origin_addr, a->origin_count, a->origin_datatype,
+                    a->target_rank, a->target_disp, a->target_count,
+                    a->target_datatype, a->win);
 }
 
+#ifdef USE_MPI3
+struct MPI_Rget_args {
+  void* origin_addr;
+  int origin_count;
+  MPI_Datatype origin_datatype;
+  int target_rank;
+  MPI_Aint target_disp;
+  int target_count;
+  MPI_Datatype target_datatype;
+  MPI_Win win;
+  MPI_Request* req;
+};
+
+static int MPI_Rget_call(void* arg) {
+  struct MPI_Rget_args* a = arg;
+  return libMPI_Rget(a->origin_addr, a->origin_count, a->origin_datatype,
+                     a->target_rank, a->target_disp, a->target_count,
+                     a->target_datatype, a->win, a->req);
+}
+#endif
+
 static int MPI_Get_core(void* origin_addr,
 			int origin_count,
                         MPI_Datatype origin_datatype,
@@ -39,12 +78,28 @@ static int MPI_Get_core(void* origin_addr,
 			int target_count,
                         MPI_Datatype target_datatype,
 			MPI_Win win) {
-  LOCK();
-  /* Warning: get is blocking, so this may lead to a deadlock :/ */
-  int ret = libMPI_Get(origin_addr, origin_count, origin_datatype, target_rank,
-                    target_disp, target_count, target_datatype, win);
-  UNLOCK();
-  return ret;
+#ifdef USE_MPI3
+  if(should_lock && mpii_infos.settings.rma_requests && libMPI_Rget &&
+     mpii_win_passive(win)) {
+    /* In a passive target epoch, post the operation, release the lock,
+     * and wait for its completion like MPI_Wait. Other threads may call
+     * MPI in the meantime.
+     */
+    MPI_Request req;
+    struct MPI_Rget_args rargs = { origin_addr, origin_count, origin_datatype,
+                                   target_rank, target_disp, target_count,
+                                   target_datatype, win, &req };
+    int ret = MPII_EXEC_COMBINE(MPI_Rget_call, &rargs);
+    if(ret != MPI_SUCCESS)
+      return ret;
+    return MPI_Wait(&req, MPI_STATUS_IGNORE);
+  }
+#endif
+
+  struct MPI_Get_args args = { origin_addr, origin_count, origin_datatype,
+                               target_rank, target_disp, target_count,
+                               target_datatype, win };
+  return MPII_EXEC(MPI_Get_call, &args);
 }
 
 
@@ -30,7 +30,24 @@ static void MPI_Iallgather_prolog(CONST void  * sendbuf MAYBE_UNUSED,
                                   MPI_Datatype recvtype MAYBE_UNUSED,
                                   MPI_Comm comm MAYBE_UNUSED,
                                   MPI_Request* r MAYBE_UNUSED) {
+  MPII_CALL_ARGS(-1, -1, comm, sendcount, sendtype);
+}
+
+struct MPI_Iallgather_args {
+  CONST void* sendbuf;
+  int sendcount;
+  MPI_Datatype sendtype;
+  void* recvbuf;
+  int recvcount;
+  MPI_Datatype recvtype;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
 
+static int MPI_Iallgather_call(void* arg) {
+  struct MPI_Iallgather_args* a = arg;
+  return libMPI_Iallgather(a->sendbuf, a->sendcount, a->sendtype, a->recvbuf,
+                           a->recvcount, a->recvtype, a->comm, a->r);
 }
 
 static int MPI_Iallgather_core(CONST void* sendbuf,
@@ -41,9 +58,11 @@ static int MPI_Iallgather_core(CONST void* sendbuf,
 			       MPI_Datatype recvtype,
                                MPI_Comm comm,
 			       MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Iallgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm, r);
-  UNLOCK();
+  struct MPI_Iallgather_args args = { sendbuf, sendcount, sendtype, recvbuf,
+                                      recvcount, recvtype, comm, r };
+  int ret = MPII_EXEC(MPI_Iallgather_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, -1, -1, comm, sendcount, sendtype);
   return ret;
 }
 
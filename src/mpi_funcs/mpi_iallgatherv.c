@@ -31,6 +31,26 @@ static void MPI_Iallgatherv_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                    MPI_Datatype recvtype  MAYBE_UNUSED,
                                    MPI_Comm comm  MAYBE_UNUSED,
                                    MPI_Request* r MAYBE_UNUSED) {
+  MPII_CALL_ARGS(-1, -1, comm, sendcount, sendtype);
+}
+
+struct MPI_Iallgatherv_args {
+  CONST void* sendbuf;
+  int sendcount;
+  MPI_Datatype sendtype;
+  void* recvbuf;
+  CONST int* recvcounts;
+  CONST int* displs;
+  MPI_Datatype recvtype;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
+
+static int MPI_Iallgatherv_call(void* arg) {
+  struct MPI_Iallgatherv_args* a = arg;
+  return libMPI_Iallgatherv(a->sendbuf, a->sendcount, a->sendtype, a->recvbuf,
+                            a->recvcounts, a->displs, a->recvtype, a->comm,
+                            a->r);
 }
 
 static int MPI_Iallgatherv_core(CONST void* sendbuf ,
@@ -42,9 +62,11 @@ static int MPI_Iallgatherv_core(CONST void* sendbuf ,
                                 MPI_Datatype recvtype,
                                 MPI_Comm comm,
                                 MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Iallgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm, r);
-  UNLOCK();
+  struct MPI_Iallgatherv_args args = { sendbuf, sendcount, sendtype, recvbuf,
+                                       recvcounts, displs, recvtype, comm, r };
+  int ret = MPII_EXEC(MPI_Iallgatherv_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, -1, -1, comm, sendcount, sendtype);
   return ret;
 }
 
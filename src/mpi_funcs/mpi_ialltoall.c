@@ -30,6 +30,24 @@ static void MPI_Ialltoall_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                  MPI_Datatype recvtype MAYBE_UNUSED,
                                  MPI_Comm comm MAYBE_UNUSED,
                                  MPI_Request* r MAYBE_UNUSED) {
+  MPII_CALL_ARGS(-1, -1, comm, sendcount, sendtype);
+}
+
+struct MPI_Ialltoall_args {
+  CONST void* sendbuf;
+  int sendcount;
+  MPI_Datatype sendtype;
+  void* recvbuf;
+  int recvcnt;
+  MPI_Datatype recvtype;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
+
+static int MPI_Ialltoall_call(void* arg) {
+  struct MPI_Ialltoall_args* a = arg;
+  return libMPI_Ialltoall(a->sendbuf, a->sendcount, a->sendtype, a->recvbuf,
+                          a->recvcnt, a->recvtype, a->comm, a->r);
 }
 
 static int MPI_Ialltoall_core(CONST void* sendbuf,
@@ -40,9 +58,11 @@ static int MPI_Ialltoall_core(CONST void* sendbuf,
 			      MPI_Datatype recvtype,
                               MPI_Comm comm,
                               MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Ialltoall(sendbuf, sendcount, sendtype, recvbuf, recvcnt, recvtype, comm, r);
-  UNLOCK();
+  struct MPI_Ialltoall_args args = { sendbuf, sendcount, sendtype, recvbuf,
+                                     recvcnt, recvtype, comm, r };
+  int ret = MPII_EXEC(MPI_Ialltoall_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, -1, -1, comm, sendcount, sendtype);
   return ret;
 }
 
@@ -32,6 +32,28 @@ static void MPI_Ialltoallv_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                   MPI_Datatype recvtype MAYBE_UNUSED,
                                   MPI_Comm comm MAYBE_UNUSED,
                                   MPI_Request* r MAYBE_UNUSED) {
+  /* the size of the messages depends on the peer, it is not recorded */
+  MPII_CALL_ARGS(-1, -1, comm, 0, MPI_DATATYPE_NULL);
+}
+
+struct MPI_Ialltoallv_args {
+  CONST void* sendbuf;
+  CONST int* sendcnts;
+  CONST int* sdispls;
+  MPI_Datatype sendtype;
+  void* recvbuf;
+  CONST int* recvcnts;
+  CONST int* rdispls;
+  MPI_Datatype recvtype;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
+
+static int MPI_Ialltoallv_call(void* arg) {
+  struct MPI_Ialltoallv_args* a = arg;
+  return libMPI_Ialltoallv(a->sendbuf, a->sendcnts, a->sdispls, a->sendtype,
+                           a->recvbuf, a->recvcnts, a->rdispls, a->recvtype,
+                           a->comm, a->r);
 }
 
 static int MPI_Ialltoallv_core(CONST void* sendbuf,
@@ -44,9 +66,13 @@ static int MPI_Ialltoallv_core(CONST void* sendbuf,
 			       MPI_Datatype recvtype,
                                MPI_Comm comm,
                                MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Ialltoallv(sendbuf, sendcnts, sdispls, sendtype, recvbuf, recvcnts, rdispls, recvtype, comm, r);
-  UNLOCK();
+  struct MPI_Ialltoallv_args args = { sendbuf, sendcnts, sdispls, sendtype,
+                                      recvbuf, recvcnts, rdispls, recvtype,
+                                      comm, r };
+  int ret = MPII_EXEC(MPI_Ialltoallv_call, &args);
+  /* the size of the messages depends on the peer, it is not recorded */
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, -1, -1, comm, 0, sendtype);
   return ret;
 }
 
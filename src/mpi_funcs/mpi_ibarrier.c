@@ -24,12 +24,24 @@
 
 static void MPI_Ibarrier_prolog(MPI_Comm comm MAYBE_UNUSED,
 				MPI_Fint* r MAYBE_UNUSED) {
+  MPII_CALL_ARGS(-1, -1, comm, 0, MPI_DATATYPE_NULL);
+}
+
+struct MPI_Ibarrier_args {
+  MPI_Comm c;
+  MPI_Request* r;
+};
+
+static int MPI_Ibarrier_call(void* arg) {
+  struct MPI_Ibarrier_args* a = arg;
+  return libMPI_Ibarrier(a->c, a->r);
 }
 
 static int MPI_Ibarrier_core(MPI_Comm c, MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Ibarrier(c, r);
-  UNLOCK();
+  struct MPI_Ibarrier_args args = { c, r };
+  int ret = MPII_EXEC(MPI_Ibarrier_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, -1, -1, c, 0, MPI_DATATYPE_NULL);
   return ret;
 }
 
@@ -28,7 +28,21 @@ static void MPI_Ibcast_prolog(void* buffer  MAYBE_UNUSED,
                               int root MAYBE_UNUSED,
                               MPI_Comm comm MAYBE_UNUSED,
                               MPI_Request* r MAYBE_UNUSED) {
+  MPII_CALL_ARGS(root, -1, comm, count, datatype);
+}
+
+struct MPI_Ibcast_args {
+  void* buffer;
+  int count;
+  MPI_Datatype datatype;
+  int root;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
 
+static int MPI_Ibcast_call(void* arg) {
+  struct MPI_Ibcast_args* a = arg;
+  return libMPI_Ibcast(a->buffer, a->count, a->datatype, a->root, a->comm, a->r);
 }
 
 static int MPI_Ibcast_core(void* buffer,
@@ -37,9 +51,10 @@ static int MPI_Ibcast_core(void* buffer,
 			   int root,
 			   MPI_Comm comm,
 			   MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Ibcast(buffer, count, datatype, root, comm, r);
-  UNLOCK();
+  struct MPI_Ibcast_args args = { buffer, count, datatype, root, comm, r };
+  int ret = MPII_EXEC(MPI_Ibcast_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, root, -1, comm, count, datatype);
   return ret;
 }
 
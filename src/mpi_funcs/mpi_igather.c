@@ -31,7 +31,25 @@ static void MPI_Igather_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                int root MAYBE_UNUSED,
                                MPI_Comm comm MAYBE_UNUSED,
                                MPI_Request* r MAYBE_UNUSED) {
+  MPII_CALL_ARGS(root, -1, comm, sendcnt, sendtype);
+}
+
+struct MPI_Igather_args {
+  CONST void* sendbuf;
+  int sendcnt;
+  MPI_Datatype sendtype;
+  void* recvbuf;
+  int recvcount;
+  MPI_Datatype recvtype;
+  int root;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
 
+static int MPI_Igather_call(void* arg) {
+  struct MPI_Igather_args* a = arg;
+  return libMPI_Igather(a->sendbuf, a->sendcnt, a->sendtype, a->recvbuf,
+                        a->recvcount, a->recvtype, a->root, a->comm, a->r);
 }
 
 static int MPI_Igather_core(CONST void* sendbuf,
@@ -43,9 +61,11 @@ static int MPI_Igather_core(CONST void* sendbuf,
                             int root,
 			    MPI_Comm comm,
 			    MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Igather(sendbuf, sendcnt, sendtype, recvbuf, recvcount, recvtype, root, comm, r);
-  UNLOCK();
+  struct MPI_Igather_args args = { sendbuf, sendcnt, sendtype, recvbuf,
+                                   recvcount, recvtype, root, comm, r };
+  int ret = MPII_EXEC(MPI_Igather_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, root, -1, comm, sendcnt, sendtype);
   return ret;
 }
 
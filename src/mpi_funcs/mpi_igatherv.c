@@ -33,7 +33,27 @@ static void MPI_Igatherv_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                 int root MAYBE_UNUSED,
                                 MPI_Comm comm MAYBE_UNUSED,
                                 MPI_Request* r MAYBE_UNUSED) {
+  MPII_CALL_ARGS(root, -1, comm, sendcnt, sendtype);
+}
+
+struct MPI_Igatherv_args {
+  CONST void* sendbuf;
+  int sendcnt;
+  MPI_Datatype sendtype;
+  void* recvbuf;
+  CONST int* recvcnts;
+  CONST int* displs;
+  MPI_Datatype recvtype;
+  int root;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
 
+static int MPI_Igatherv_call(void* arg) {
+  struct MPI_Igatherv_args* a = arg;
+  return libMPI_Igatherv(a->sendbuf, a->sendcnt, a->sendtype, a->recvbuf,
+                         a->recvcnts, a->displs, a->recvtype, a->root, a->comm,
+                         a->r);
 }
 
 static int MPI_Igatherv_core(CONST void* sendbuf,
@@ -46,10 +66,11 @@ static int MPI_Igatherv_core(CONST void* sendbuf,
 			     int root,
 			     MPI_Comm comm,
 			     MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Igatherv(sendbuf, sendcnt, sendtype,
-			 recvbuf, recvcnts, displs, recvtype, root, comm, r);
-  UNLOCK();
+  struct MPI_Igatherv_args args = { sendbuf, sendcnt, sendtype, recvbuf,
+                                    recvcnts, displs, recvtype, root, comm, r };
+  int ret = MPII_EXEC(MPI_Igatherv_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, root, -1, comm, sendcnt, sendtype);
   return ret;
 }
 
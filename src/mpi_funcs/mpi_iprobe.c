@@ -20,15 +20,27 @@
 #include <sys/timeb.h>
 #include <unistd.h>
 
+struct MPI_Iprobe_args {
+  int source;
+  int tag;
+  MPI_Comm comm;
+  int* flag;
+  MPI_Status* status;
+};
+
+static int MPI_Iprobe_call(void* arg) {
+  struct MPI_Iprobe_args* a = arg;
+  return libMPI_Iprobe(a->source, a->tag, a->comm, a->flag, a->status);
+}
+
 static int MPI_Iprobe_core(int source MAYBE_UNUSED,
 			   int tag MAYBE_UNUSED,
 			   MPI_Comm comm MAYBE_UNUSED,
 			   int* flag MAYBE_UNUSED,
                            MPI_Status* status) {
-  LOCK();
-  int ret = libMPI_Iprobe(source, tag, comm, flag, status);
-  UNLOCK();
-  return ret;
+  MPII_CALL_ARGS(source, tag, comm, 0, MPI_DATATYPE_NULL);
+  struct MPI_Iprobe_args args = { source, tag, comm, flag, status };
+  return MPII_EXEC(MPI_Iprobe_call, &args);
 }
 
 static void MPI_Iprobe_epilog(int source MAYBE_UNUSED,
@@ -27,6 +27,24 @@ static void MPI_Irecv_prolog(void* buf MAYBE_UNUSED,
 			     int tag MAYBE_UNUSED,
                              MPI_Comm comm MAYBE_UNUSED,
 			     MPI_Fint* req MAYBE_UNUSED) {
+  MPII_CALL_ARGS(src, tag, comm, count, datatype);
+  MPII_COMM_MATRIX_RECV(src, comm, count, datatype);
+}
+
+struct MPI_Irecv_args {
+  void* buf;
+  int count;
+  MPI_Datatype datatype;
+  int src;
+  int tag;
+  MPI_Comm comm;
+  MPI_Request* req;
+};
+
+static int MPI_Irecv_call(void* arg) {
+  struct MPI_Irecv_args* a = arg;
+  return libMPI_Irecv(a->buf, a->count, a->datatype, a->src, a->tag, a->comm,
+                      a->req);
 }
 
 static int MPI_Irecv_core(void* buf,
@@ -36,9 +54,10 @@ static int MPI_Irecv_core(void* buf,
                           int tag,
 			  MPI_Comm comm,
 			  MPI_Request* req) {
-  LOCK();
-  int ret = libMPI_Irecv(buf, count, datatype, src, tag, comm, req);
-  UNLOCK();
+  struct MPI_Irecv_args args = { buf, count, datatype, src, tag, comm, req };
+  int ret = MPII_EXEC_COMBINE(MPI_Irecv_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*req, src, tag, comm, count, datatype);
   return ret;
 }
 
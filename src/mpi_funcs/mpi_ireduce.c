@@ -30,6 +30,24 @@ static void MPI_Ireduce_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                int root MAYBE_UNUSED,
                                MPI_Comm comm MAYBE_UNUSED,
                                MPI_Request* r MAYBE_UNUSED) {
+  MPII_CALL_ARGS(root, -1, comm, count, datatype);
+}
+
+struct MPI_Ireduce_args {
+  CONST void* sendbuf;
+  void* recvbuf;
+  int count;
+  MPI_Datatype datatype;
+  MPI_Op op;
+  int root;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
+
+static int MPI_Ireduce_call(void* arg) {
+  struct MPI_Ireduce_args* a = arg;
+  return libMPI_Ireduce(a->sendbuf, a->recvbuf, a->count, a->datatype, a->op,
+                        a->root, a->comm, a->r);
 }
 
 static int MPI_Ireduce_core(CONST void* sendbuf,
@@ -40,9 +58,11 @@ static int MPI_Ireduce_core(CONST void* sendbuf,
 			    int root,
 			    MPI_Comm comm,
                             MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Ireduce(sendbuf, recvbuf, count, datatype, op, root, comm, r);
-  UNLOCK();
+  struct MPI_Ireduce_args args = { sendbuf, recvbuf, count, datatype, op, root,
+                                   comm, r };
+  int ret = MPII_EXEC(MPI_Ireduce_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, root, -1, comm, count, datatype);
   return ret;
 }
 
@@ -29,6 +29,24 @@ static void MPI_Ireduce_scatter_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                        MPI_Op op  MAYBE_UNUSED,
                                        MPI_Comm comm MAYBE_UNUSED,
                                        MPI_Request* r MAYBE_UNUSED) {
+  /* the size of the messages depends on the peer, it is not recorded */
+  MPII_CALL_ARGS(-1, -1, comm, 0, MPI_DATATYPE_NULL);
+}
+
+struct MPI_Ireduce_scatter_args {
+  CONST void* sendbuf;
+  void* recvbuf;
+  CONST int* recvcnts;
+  MPI_Datatype datatype;
+  MPI_Op op;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
+
+static int MPI_Ireduce_scatter_call(void* arg) {
+  struct MPI_Ireduce_scatter_args* a = arg;
+  return libMPI_Ireduce_scatter(a->sendbuf, a->recvbuf, a->recvcnts,
+                                a->datatype, a->op, a->comm, a->r);
 }
 
 static int MPI_Ireduce_scatter_core(CONST void* sendbuf,
@@ -38,9 +56,12 @@ static int MPI_Ireduce_scatter_core(CONST void* sendbuf,
 				    MPI_Op op,
 				    MPI_Comm comm,
                                     MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Ireduce_scatter(sendbuf, recvbuf, recvcnts, datatype, op, comm, r);
-  UNLOCK();
+  struct MPI_Ireduce_scatter_args args = { sendbuf, recvbuf, recvcnts,
+                                           datatype, op, comm, r };
+  int ret = MPII_EXEC(MPI_Ireduce_scatter_call, &args);
+  /* the size of the messages depends on the peer, it is not recorded */
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, -1, -1, comm, 0, datatype);
   return ret;
 }
 
@@ -29,7 +29,23 @@ static void MPI_Iscan_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                              MPI_Op op  MAYBE_UNUSED,
                              MPI_Comm comm MAYBE_UNUSED,
                              MPI_Request* r MAYBE_UNUSED) {
+  MPII_CALL_ARGS(-1, -1, comm, count, datatype);
+}
+
+struct MPI_Iscan_args {
+  CONST void* sendbuf;
+  void* recvbuf;
+  int count;
+  MPI_Datatype datatype;
+  MPI_Op op;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
 
+static int MPI_Iscan_call(void* arg) {
+  struct MPI_Iscan_args* a = arg;
+  return libMPI_Iscan(a->sendbuf, a->recvbuf, a->count, a->datatype, a->op,
+                      a->comm, a->r);
 }
 
 static int MPI_Iscan_core(CONST void* sendbuf,
@@ -39,9 +55,10 @@ static int MPI_Iscan_core(CONST void* sendbuf,
                           MPI_Op op,
 			  MPI_Comm comm,
                           MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Iscan(sendbuf, recvbuf, count, datatype, op, comm, r);
-  UNLOCK();
+  struct MPI_Iscan_args args = { sendbuf, recvbuf, count, datatype, op, comm, r };
+  int ret = MPII_EXEC(MPI_Iscan_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, -1, -1, comm, count, datatype);
   return ret;
 }
 
@@ -31,6 +31,25 @@ static void MPI_Iscatter_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                 int root MAYBE_UNUSED,
                                 MPI_Comm comm MAYBE_UNUSED,
                                 MPI_Request* r MAYBE_UNUSED) {
+  MPII_CALL_ARGS(root, -1, comm, recvcnt, recvtype);
+}
+
+struct MPI_Iscatter_args {
+  CONST void* sendbuf;
+  int sendcnt;
+  MPI_Datatype sendtype;
+  void* recvbuf;
+  int recvcnt;
+  MPI_Datatype recvtype;
+  int root;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
+
+static int MPI_Iscatter_call(void* arg) {
+  struct MPI_Iscatter_args* a = arg;
+  return libMPI_Iscatter(a->sendbuf, a->sendcnt, a->sendtype, a->recvbuf,
+                         a->recvcnt, a->recvtype, a->root, a->comm, a->r);
 }
 
 static int MPI_Iscatter_core(CONST void* sendbuf,
@@ -42,9 +61,11 @@ static int MPI_Iscatter_core(CONST void* sendbuf,
 			     int root,
 			     MPI_Comm comm,
 			     MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Iscatter(sendbuf, sendcnt, sendtype, recvbuf, recvcnt, recvtype, root, comm, r);
-  UNLOCK();
+  struct MPI_Iscatter_args args = { sendbuf, sendcnt, sendtype, recvbuf,
+                                    recvcnt, recvtype, root, comm, r };
+  int ret = MPII_EXEC(MPI_Iscatter_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, root, -1, comm, recvcnt, recvtype);
   return ret;
 }
 
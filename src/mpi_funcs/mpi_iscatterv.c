@@ -32,7 +32,27 @@ static void MPI_Iscatterv_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                  int root MAYBE_UNUSED,
                                  MPI_Comm comm MAYBE_UNUSED,
                                  MPI_Request* r MAYBE_UNUSED) {
+  MPII_CALL_ARGS(root, -1, comm, recvcnt, recvtype);
+}
+
+struct MPI_Iscatterv_args {
+  CONST void* sendbuf;
+  CONST int* sendcnts;
+  CONST int* displs;
+  MPI_Datatype sendtype;
+  void* recvbuf;
+  int recvcnt;
+  MPI_Datatype recvtype;
+  int root;
+  MPI_Comm comm;
+  MPI_Request* r;
+};
 
+static int MPI_Iscatterv_call(void* arg) {
+  struct MPI_Iscatterv_args* a = arg;
+  return libMPI_Iscatterv(a->sendbuf, a->sendcnts, a->displs, a->sendtype,
+                          a->recvbuf, a->recvcnt, a->recvtype, a->root,
+                          a->comm, a->r);
 }
 
 static int MPI_Iscatterv_core(CONST void* sendbuf,
@@ -45,10 +65,12 @@ static int MPI_Iscatterv_core(CONST void* sendbuf,
                               int root,
                               MPI_Comm comm,
                               MPI_Request* r) {
-  LOCK();
-  int ret = libMPI_Iscatterv(sendbuf, sendcnts, displs, sendtype,
-			  recvbuf, recvcnt, recvtype, root, comm, r);
-  UNLOCK();
+  struct MPI_Iscatterv_args args = { sendbuf, sendcnts, displs, sendtype,
+                                     recvbuf, recvcnt, recvtype, root, comm,
+                                     r };
+  int ret = MPII_EXEC(MPI_Iscatterv_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*r, root, -1, comm, recvcnt, recvtype);
   return ret;
 }
 
@@ -27,6 +27,24 @@ static void MPI_Issend_prolog(CONST void* buf  MAYBE_UNUSED,
                               int tag MAYBE_UNUSED,
                               MPI_Comm comm MAYBE_UNUSED,
                               MPI_Fint* req MAYBE_UNUSED) {
+  MPII_CALL_ARGS(dest, tag, comm, count, datatype);
+  MPII_COMM_MATRIX_SEND(dest, comm, count, datatype);
+}
+
+struct MPI_Issend_args {
+  CONST void* buf;
+  int count;
+  MPI_Datatype datatype;
+  int dest;
+  int tag;
+  MPI_Comm comm;
+  MPI_Request* req;
+};
+
+static int MPI_Issend_call(void* arg) {
+  struct MPI_Issend_args* a = arg;
+  return libMPI_Issend(a->buf, a->count, a->datatype, a->dest, a->tag, a->comm,
+                       a->req);
 }
 
 static int MPI_Issend_core(CONST void* buf,
@@ -36,9 +54,10 @@ static int MPI_Issend_core(CONST void* buf,
 			   int tag,
 			   MPI_Comm comm,
 			   MPI_Request* req) {
-  LOCK();
-  int ret = libMPI_Issend(buf, count, datatype, dest, tag, comm, req);
-  UNLOCK();
+  struct MPI_Issend_args args = { buf, count, datatype, dest, tag, comm, req };
+  int ret = MPII_EXEC_COMBINE(MPI_Issend_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post(*req, dest, tag, comm, count, datatype);
   return ret;
 }
 
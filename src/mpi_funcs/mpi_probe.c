@@ -24,7 +24,19 @@ static void MPI_Probe_prolog(int source  MAYBE_UNUSED,
                              int tag  MAYBE_UNUSED,
                              MPI_Comm comm  MAYBE_UNUSED,
                              MPI_Status* status MAYBE_UNUSED ) {
+  MPII_CALL_ARGS(source, tag, comm, 0, MPI_DATATYPE_NULL);
+}
+
+struct MPI_Probe_args {
+  int source;
+  int tag;
+  MPI_Comm comm;
+  MPI_Status* status;
+};
 
+static int MPI_Probe_test(void* arg, int* flag) {
+  struct MPI_Probe_args* a = arg;
+  return libMPI_Iprobe(a->source, a->tag, a->comm, flag, a->status);
 }
 
 static int MPI_Probe_core(int source,
@@ -35,22 +47,8 @@ static int MPI_Probe_core(int source,
     /* MPI_Probe is blocking. So we should not call it while holding the lock.
      * Replace MPI_Probe with an active waiting
      */
-    uint64_t count = 0;
-    while(1) {
-      int ret = 0;
-      int flag;
-      ret = MPI_Iprobe(source, tag, comm, &flag, status);
-      if(flag)
-	return ret;
-      count++;
-
-      if(count > 10) {      /* sleep a little bit to decrease contention */
-	sched_yield();
-      } else if (count > 100){
-	/* sleep even more */
-	usleep(10);
-      }
-    }
+    struct MPI_Probe_args args = { source, tag, comm, status };
+    return mpii_exec_wait(MPI_Probe_test, &args);
   } else {
     return libMPI_Probe(source, tag, comm, status);
   }
@@ -27,7 +27,7 @@ static void MPI_Recv_prolog(void* buf  MAYBE_UNUSED,
 			    int tag MAYBE_UNUSED,
                             MPI_Comm comm MAYBE_UNUSED,
                             MPI_Status* status MAYBE_UNUSED ) {
-
+  MPII_CALL_ARGS(source, tag, comm, count, datatype);
 }
 
 static int MPI_Recv_core(void* buf,
@@ -54,7 +54,11 @@ static void MPI_Recv_epilog(void* buf  MAYBE_UNUSED,
 			    int source MAYBE_UNUSED,
 			    int tag MAYBE_UNUSED,
                             MPI_Comm comm MAYBE_UNUSED,
-                            MPI_Status* status MAYBE_UNUSED) {
+                            MPI_Status* status MAYBE_UNUSED,
+			    int ret) {
+  /* the actual source and size of the message are known once it is received */
+  if(ret == MPI_SUCCESS)
+    MPII_COMM_MATRIX_RECV_STATUS(source, comm, status);
 }
 
 int MPI_Recv(void* buf,
@@ -71,7 +75,7 @@ int MPI_Recv(void* buf,
 
   MPI_Recv_prolog(buf, count, datatype, source, tag, comm, status);
   int ret = MPI_Recv_core(buf, count, datatype, source, tag, comm, status);
-  MPI_Recv_epilog(buf, count, datatype, source, tag, comm, status);
+  MPI_Recv_epilog(buf, count, datatype, source, tag, comm, status, ret);
   
   FUNCTION_EXIT;
   return ret;
@@ -93,6 +97,6 @@ void mpif_recv_(void* buf,
   MPI_Recv_prolog(buf, *count, c_type, *src, *tag, c_comm, &c_status);
   *error = MPI_Recv_core(buf, *count, c_type, *src, *tag, c_comm, &c_status);
   MPI_Status_c2f(&c_status, s);
-  MPI_Recv_epilog(buf, *count, c_type, *src, *tag, c_comm, &c_status);
+  MPI_Recv_epilog(buf, *count, c_type, *src, *tag, c_comm, &c_status, *error);
   FUNCTION_EXIT_("mpi_recv_");
 }
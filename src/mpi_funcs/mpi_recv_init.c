@@ -20,6 +20,22 @@
 #include <sys/timeb.h>
 #include <unistd.h>
 
+struct MPI_Recv_init_args {
+  void* buffer;
+  int count;
+  MPI_Datatype type;
+  int src;
+  int tag;
+  MPI_Comm comm;
+  MPI_Request* req;
+};
+
+static int MPI_Recv_init_call(void* arg) {
+  struct MPI_Recv_init_args* a = arg;
+  return libMPI_Recv_init(a->buffer, a->count, a->type, a->src, a->tag,
+                          a->comm, a->req);
+}
+
 static int MPI_Recv_init_core(void* buffer,
 			      int count,
 			      MPI_Datatype type,
@@ -27,9 +43,13 @@ static int MPI_Recv_init_core(void* buffer,
 			      int tag,
 			      MPI_Comm comm,
 			      MPI_Request* req) {
-  LOCK();
-  int ret = libMPI_Recv_init(buffer, count, type, src, tag, comm, req);
-  UNLOCK();
+  MPII_CALL_ARGS(src, tag, comm, count, type);
+  struct MPI_Recv_init_args args = { buffer, count, type, src, tag, comm, req };
+  int ret = MPII_EXEC(MPI_Recv_init_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post_persistent(*req, src, tag, comm, count, type);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.comm_matrix)
+    mpii_comm_matrix_init_persistent(*req, 0, src, comm, count, type);
   return ret;
 }
 
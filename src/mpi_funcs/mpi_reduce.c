@@ -27,6 +27,7 @@ static void MPI_Reduce_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                               MPI_Op op  MAYBE_UNUSED,
                               int root MAYBE_UNUSED,
                               MPI_Comm comm MAYBE_UNUSED) {
+  MPII_CALL_ARGS(root, -1, comm, count, datatype);
 }
 
 static int MPI_Reduce_core(CONST void* sendbuf,
@@ -39,7 +40,7 @@ static int MPI_Reduce_core(CONST void* sendbuf,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Ireduce(sendbuf, recvbuf, count, datatype, op, root, comm, &req);
+    MPI_Ireduce(sendbuf, recvbuf, count, datatype, op, root, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
     ret = libMPI_Reduce(sendbuf, recvbuf, count, datatype, op, root, comm);
@@ -26,6 +26,8 @@ static void MPI_Reduce_scatter_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                       MPI_Datatype datatype MAYBE_UNUSED,
                                       MPI_Op op  MAYBE_UNUSED,
                                       MPI_Comm comm MAYBE_UNUSED) {
+  /* the size of the messages depends on the peer, it is not recorded */
+  MPII_CALL_ARGS(-1, -1, comm, 0, MPI_DATATYPE_NULL);
 }
 
 static int MPI_Reduce_scatter_core(CONST void* sendbuf,
@@ -37,7 +39,7 @@ static int MPI_Reduce_scatter_core(CONST void* sendbuf,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Ireduce_scatter(sendbuf, recvbuf, recvcnts, datatype, op, comm, &req);
+    MPI_Ireduce_scatter(sendbuf, recvbuf, recvcnts, datatype, op, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
     ret = libMPI_Reduce_scatter(sendbuf, recvbuf, recvcnts, datatype, op, comm);
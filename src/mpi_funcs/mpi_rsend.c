@@ -26,6 +26,8 @@ static void MPI_Rsend_prolog(CONST void* buf  MAYBE_UNUSED,
                              int dest MAYBE_UNUSED,
                              int tag MAYBE_UNUSED,
                              MPI_Comm comm MAYBE_UNUSED) {
+  MPII_CALL_ARGS(dest, tag, comm, count, datatype);
+  MPII_COMM_MATRIX_SEND(dest, comm, count, datatype);
 }
 
 static int MPI_Rsend_core(CONST void* buf,
@@ -37,7 +39,7 @@ static int MPI_Rsend_core(CONST void* buf,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Irsend(buf, count, datatype, dest, tag, comm, &req);
+    MPI_Irsend(buf, count, datatype, dest, tag, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
     ret = libMPI_Rsend(buf, count, datatype, dest, tag, comm);
@@ -20,6 +20,22 @@
 #include <sys/timeb.h>
 #include <unistd.h>
 
+struct MPI_Rsend_init_args {
+  CONST void* buffer;
+  int count;
+  MPI_Datatype type;
+  int dest;
+  int tag;
+  MPI_Comm comm;
+  MPI_Request* req;
+};
+
+static int MPI_Rsend_init_call(void* arg) {
+  struct MPI_Rsend_init_args* a = arg;
+  return libMPI_Rsend_init(a->buffer, a->count, a->type, a->dest, a->tag,
+                           a->comm, a->req);
+}
+
 static int MPI_Rsend_init_core(CONST void* buffer,
 			       int count,
 			       MPI_Datatype type,
@@ -27,9 +43,13 @@ static int MPI_Rsend_init_core(CONST void* buffer,
 			       int tag,
 			       MPI_Comm comm,
                                MPI_Request* req) {
-  LOCK();
-  int ret = libMPI_Rsend_init(buffer, count, type, dest, tag, comm, req);
-  UNLOCK();
+  MPII_CALL_ARGS(dest, tag, comm, count, type);
+  struct MPI_Rsend_init_args args = { buffer, count, type, dest, tag, comm, req };
+  int ret = MPII_EXEC(MPI_Rsend_init_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_post_persistent(*req, dest, tag, comm, count, type);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.comm_matrix)
+    mpii_comm_matrix_init_persistent(*req, 1, dest, comm, count, type);
   return ret;
 }
 
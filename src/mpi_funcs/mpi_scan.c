@@ -26,7 +26,7 @@ static void MPI_Scan_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                             MPI_Datatype datatype MAYBE_UNUSED,
                             MPI_Op op  MAYBE_UNUSED,
                             MPI_Comm comm MAYBE_UNUSED) {
-
+  MPII_CALL_ARGS(-1, -1, comm, count, datatype);
 }
 
 static int MPI_Scan_core(CONST void* sendbuf,
@@ -38,7 +38,7 @@ static int MPI_Scan_core(CONST void* sendbuf,
   int ret;
   if(should_lock) {
     MPI_Request req;
-    ret = libMPI_Iscan(sendbuf, recvbuf, count, datatype, op, comm, &req);
+    ret = MPI_Iscan(sendbuf, recvbuf, count, datatype, op, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
     ret = libMPI_Scan(sendbuf, recvbuf, count, datatype, op, comm);
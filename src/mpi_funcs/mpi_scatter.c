@@ -28,6 +28,7 @@ static void MPI_Scatter_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                MPI_Datatype recvtype MAYBE_UNUSED,
                                int root MAYBE_UNUSED,
                                MPI_Comm comm MAYBE_UNUSED) {
+  MPII_CALL_ARGS(root, -1, comm, recvcnt, recvtype);
 }
 
 static int MPI_Scatter_core(CONST void* sendbuf,
@@ -40,7 +41,7 @@ static int MPI_Scatter_core(CONST void* sendbuf,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Iscatter(sendbuf, sendcnt, sendtype, recvbuf, recvcnt, recvtype,
+    MPI_Iscatter(sendbuf, sendcnt, sendtype, recvbuf, recvcnt, recvtype,
 		    root, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
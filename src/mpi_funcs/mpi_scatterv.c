@@ -29,6 +29,7 @@ static void MPI_Scatterv_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                 MPI_Datatype recvtype MAYBE_UNUSED,
                                 int root MAYBE_UNUSED,
                                 MPI_Comm comm MAYBE_UNUSED) {
+  MPII_CALL_ARGS(root, -1, comm, recvcnt, recvtype);
 }
 
 static int MPI_Scatterv_core(CONST void* sendbuf,
@@ -43,7 +44,7 @@ static int MPI_Scatterv_core(CONST void* sendbuf,
   int ret = 0;
   if(should_lock) {
     MPI_Request req;
-    libMPI_Iscatterv(sendbuf, sendcnts, displs, sendtype, recvbuf, recvcnt,
+    MPI_Iscatterv(sendbuf, sendcnts, displs, sendtype, recvbuf, recvcnt,
 		     recvtype, root, comm, &req);
     ret = MPI_Wait(&req, MPI_STATUS_IGNORE);
   } else {
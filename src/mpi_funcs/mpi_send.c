@@ -26,6 +26,8 @@ static void MPI_Send_prolog(CONST void* buf  MAYBE_UNUSED,
                             int dest MAYBE_UNUSED,
                             int tag MAYBE_UNUSED,
                             MPI_Comm comm MAYBE_UNUSED) {
+  MPII_CALL_ARGS(dest, tag, comm, count, datatype);
+  MPII_COMM_MATRIX_SEND(dest, comm, count, datatype);
 }
 
 static int MPI_Send_core(CONST void* buf,
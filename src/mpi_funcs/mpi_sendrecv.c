@@ -32,7 +32,30 @@ static void MPI_Sendrecv_prolog(CONST void* sendbuf  MAYBE_UNUSED,
                                 int recvtag MAYBE_UNUSED,
                                 MPI_Comm comm MAYBE_UNUSED,
                                 MPI_Status* status MAYBE_UNUSED) {
+  MPII_CALL_ARGS(dest, sendtag, comm, sendcount, sendtype);
+  MPII_COMM_MATRIX_SEND(dest, comm, sendcount, sendtype);
+}
+
+struct MPI_Sendrecv_args {
+  CONST void* sendbuf;
+  int sendcount;
+  MPI_Datatype sendtype;
+  int dest;
+  int sendtag;
+  void* recvbuf;
+  int recvcount;
+  MPI_Datatype recvtype;
+  int src;
+  int recvtag;
+  MPI_Comm comm;
+  MPI_Status* status;
+};
 
+static int MPI_Sendrecv_call(void* arg) {
+  struct MPI_Sendrecv_args* a = arg;
+  return libMPI_Sendrecv(a->sendbuf, a->sendcount, a->sendtype, a->dest,
+                         a->sendtag, a->recvbuf, a->recvcount, a->recvtype,
+                         a->src, a->recvtag, a->comm, a->status);
 }
 
 static int MPI_Sendrecv_core(CONST void* sendbuf,
@@ -47,12 +70,30 @@ static int MPI_Sendrecv_core(CONST void* sendbuf,
 			     int recvtag,
 			     MPI_Comm comm,
 			     MPI_Status* status) {
-  LOCK();
-  /* Warning: this may lead to a deadlock */
-  int ret = libMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf,
-                         recvcount, recvtype, src, recvtag, comm, status);
-  UNLOCK();
-  return ret;
+  if(should_lock) {
+    /* Holding the lock during the whole exchange would block the other
+     * threads (and may deadlock), so post both communications and wait
+     * for them like MPI_Send/MPI_Recv
+     */
+    MPI_Request reqs[2];
+    int ret = MPI_Irecv(recvbuf, recvcount, recvtype, src, recvtag, comm, &reqs[0]);
+    if(ret != MPI_SUCCESS)
+      return ret;
+    ret = MPI_Isend(sendbuf, sendcount, sendtype, dest, sendtag, comm, &reqs[1]);
+    if(ret != MPI_SUCCESS) {
+      MPI_Cancel(&reqs[0]);
+      MPI_Wait(&reqs[0], MPI_STATUS_IGNORE);
+      return ret;
+    }
+    ret = MPI_Wait(&reqs[0], status);
+    int send_ret = MPI_Wait(&reqs[1], MPI_STATUS_IGNORE);
+    return ret != MPI_SUCCESS ? ret : send_ret;
+  }
+
+  struct MPI_Sendrecv_args args = { sendbuf, sendcount, sendtype, dest,
+                                    sendtag, recvbuf, recvcount, recvtype, src,
+                                    recvtag, comm, status };
+  return MPII_EXEC(MPI_Sendrecv_call, &args);
 }
 
 
@@ -67,8 +108,12 @@ static void MPI_Sendrecv_epilog(CONST void* sendbuf  MAYBE_UNUSED,
                                 int src MAYBE_UNUSED,
                                 int recvtag MAYBE_UNUSED,
                                 MPI_Comm comm MAYBE_UNUSED,
-                                MPI_Status* status MAYBE_UNUSED ) {
-
+                                MPI_Status* status MAYBE_UNUSED,
+				int ret) {
+  if(ret != MPI_SUCCESS)
+    return;
+  MPII_COMM_MATRIX_RECV(src == MPI_ANY_SOURCE && status != MPI_STATUS_IGNORE ?
+			status->MPI_SOURCE : src, comm, recvcount, recvtype);
 }
 
 int MPI_Sendrecv(CONST void* sendbuf,
@@ -92,7 +137,7 @@ int MPI_Sendrecv(CONST void* sendbuf,
                               status);
 
   MPI_Sendrecv_epilog(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf,
-                      recvcount, recvtype, src, recvtag, comm, status);
+                      recvcount, recvtype, src, recvtag, comm, status, ret);
   FUNCTION_EXIT;
   return ret;
 }
@@ -121,6 +166,6 @@ void mpif_sendrecv_(void* sendbuf,
                              recvbuf, *recvcount, c_rtype, *src, *recvtag,
                              c_comm, status);
   MPI_Sendrecv_epilog(sendbuf, *sendcount, c_stype, *dest, *sendtag, recvbuf,
-                      *recvcount, c_rtype, *src, *recvtag, c_comm, status);
+                      *recvcount, c_rtype, *src, *recvtag, c_comm, status, *error);
   FUNCTION_EXIT_("mpi_sendrecv_");
 }
@@ -29,7 +29,27 @@ static void MPI_Sendrecv_replace_prolog(void* buf  MAYBE_UNUSED,
                                         int recvtag MAYBE_UNUSED,
                                         MPI_Comm comm MAYBE_UNUSED,
                                         MPI_Status* status MAYBE_UNUSED ) {
+  MPII_CALL_ARGS(dest, sendtag, comm, count, type);
+  MPII_COMM_MATRIX_SEND(dest, comm, count, type);
+}
+
+struct MPI_Sendrecv_replace_args {
+  void* buf;
+  int count;
+  MPI_Datatype type;
+  int dest;
+  int sendtag;
+  int src;
+  int recvtag;
+  MPI_Comm comm;
+  MPI_Status* status;
+};
 
+static int MPI_Sendrecv_replace_call(void* arg) {
+  struct MPI_Sendrecv_replace_args* a = arg;
+  return libMPI_Sendrecv_replace(a->buf, a->count, a->type, a->dest,
+                                 a->sendtag, a->src, a->recvtag, a->comm,
+                                 a->status);
 }
 
 static int MPI_Sendrecv_replace_core(void* buf,
@@ -41,11 +61,45 @@ static int MPI_Sendrecv_replace_core(void* buf,
 				     int recvtag,
 				     MPI_Comm comm,
                                      MPI_Status* status) {
-  LOCK();
-  int ret = libMPI_Sendrecv_replace(buf, count, type, dest, sendtag, src, recvtag,
-                                 comm, status);
-  UNLOCK();
-  return ret;
+  if(should_lock) {
+    /* Copy the data to send to a temporary buffer, and exchange it like
+     * MPI_Sendrecv. The copy spans the data as described by type, so
+     * it can be sent with the same datatype.
+     */
+    struct mpii_type_info info;
+    int ret = mpii_type_info(type, &info);
+    if(ret != MPI_SUCCESS)
+      return ret;
+    /* first byte of the data, and number of bytes between the first and the last byte */
+    MPI_Aint stride = count > 0 ? (MPI_Aint)(count - 1) * info.extent : 0;
+    MPI_Aint lb = info.true_lb + (stride < 0 ? stride : 0);
+    size_t span = count > 0 ? (size_t)(stride < 0 ? -stride : stride) + info.true_extent : 0;
+    char* tmp = mpii_pool_alloc(span);
+    if(tmp) {
+      memcpy(tmp, (char*)buf + lb, span);
+      MPI_Request reqs[2];
+      ret = MPI_Irecv(buf, count, type, src, recvtag, comm, &reqs[0]);
+      if(ret == MPI_SUCCESS) {
+	ret = MPI_Isend(tmp - lb, count, type, dest, sendtag, comm, &reqs[1]);
+	if(ret != MPI_SUCCESS) {
+	  MPI_Cancel(&reqs[0]);
+	  MPI_Wait(&reqs[0], MPI_STATUS_IGNORE);
+	} else {
+	  ret = MPI_Wait(&reqs[0], status);
+	  int send_ret = MPI_Wait(&reqs[1], MPI_STATUS_IGNORE);
+	  if(ret == MPI_SUCCESS)
+	    ret = send_ret;
+	}
+      }
+      mpii_pool_free(tmp);
+      return ret;
+    }
+    /* out of memory: let MPI handle it */
+  }
+
+  struct MPI_Sendrecv_replace_args args = { buf, count, type, dest, sendtag,
+                                            src, recvtag, comm, status };
+  return MPII_EXEC(MPI_Sendrecv_replace_call, &args);
 }
 
 
@@ -57,8 +111,12 @@ static void MPI_Sendrecv_replace_epilog(void* buf  MAYBE_UNUSED,
                                         int src MAYBE_UNUSED,
                                         int recvtag MAYBE_UNUSED,
                                         MPI_Comm comm MAYBE_UNUSED,
-                                        MPI_Status* status MAYBE_UNUSED) {
-
+                                        MPI_Status* status MAYBE_UNUSED,
+					int ret) {
+  if(ret != MPI_SUCCESS)
+    return;
+  MPII_COMM_MATRIX_RECV(src == MPI_ANY_SOURCE && status != MPI_STATUS_IGNORE ?
+			status->MPI_SOURCE : src, comm, count, type);
 }
 
 int MPI_Sendrecv_replace(void* buf,
@@ -76,7 +134,7 @@ int MPI_Sendrecv_replace(void* buf,
   int ret = MPI_Sendrecv_replace_core(buf, count, type, dest, sendtag, src,
                                       recvtag, comm, status);
   MPI_Sendrecv_replace_epilog(buf, count, type, dest, sendtag, src, recvtag,
-                              comm, status);
+                              comm, status, ret);
   FUNCTION_EXIT;
   return ret;
 }
@@ -100,6 +158,6 @@ void mpif_sendrecv_replace_(void* buf,
   *error = MPI_Sendrecv_replace_core(buf, *count, c_type, *dest, *sendtag, *src,
                                      *recvtag, c_comm, status);
   MPI_Sendrecv_replace_epilog(buf, *count, c_type, *dest, *sendtag, *src,
-                              *recvtag, c_comm, status);
+                              *recvtag, c_comm, status, *error);
   FUNCTION_EXIT_("mpi_sendrecv_replace_");
 }
@@ -24,10 +24,22 @@ static void MPI_Start_prolog(MPI_Fint* req MAYBE_UNUSED) {
 
 }
 
+struct MPI_Start_args {
+  MPI_Request* req;
+};
+
+static int MPI_Start_call(void* arg) {
+  struct MPI_Start_args* a = arg;
+  return libMPI_Start(a->req);
+}
+
 static int MPI_Start_core(MPI_Request* req) {
-  LOCK();
-  int ret = libMPI_Start(req);
-  UNLOCK();
+  struct MPI_Start_args args = { req };
+  int ret = MPII_EXEC_COMBINE(MPI_Start_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry)
+    mpii_registry_start(*req);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.comm_matrix)
+    mpii_comm_matrix_start(*req);
   return ret;
 }
 
@@ -25,11 +25,28 @@ static void MPI_Startall_prolog(int count MAYBE_UNUSED,
 				size_t size MAYBE_UNUSED) {
 }
 
+struct MPI_Startall_args {
+  int count;
+  MPI_Request* req;
+};
+
+static int MPI_Startall_call(void* arg) {
+  struct MPI_Startall_args* a = arg;
+  return libMPI_Startall(a->count, a->req);
+}
+
 static int MPI_Startall_core(int count,
 			     MPI_Request* req) {
-  LOCK();
-  int ret = libMPI_Startall(count, req);
-  UNLOCK();
+  struct MPI_Startall_args args = { count, req };
+  int ret = MPII_EXEC_COMBINE(MPI_Startall_call, &args);
+  if(ret == MPI_SUCCESS && mpii_infos.settings.request_registry) {
+    for(int i = 0; i < count; i++)
+      mpii_registry_start(req[i]);
+  }
+  if(ret == MPI_SUCCESS && mpii_infos.settings.comm_matrix) {
+    for(int i = 0; i < count; i++)
+      mpii_comm_matrix_start(req[i]);
+  }
   return ret;
 }
 
@@ -48,18 +65,12 @@ void mpif_startall_(int* count,
 		    MPI_Fint* reqs,
 		    int* error) {
   FUNCTION_ENTRY_("mpi_startall_");
-  int i;
-  ALLOCATE_ITEMS(MPI_Request, *count, c_req, p_req);
-
-  for (i = 0; i < *count; i++)
-    p_req[i] = MPI_Request_f2c(reqs[i]);
+  MPI_Request* p_req = mpii_requests_f2c(*count, reqs);
 
   MPI_Startall_prolog(*count, reqs, sizeof(MPI_Fint));
+  /* MPI_Startall does not modify the requests, there is no need to
+   * convert them back
+   */
   *error = MPI_Startall_core(*count, p_req);
-
-  for (i = 0; i < *count; i++)
-    reqs[i] = MPI_Request_c2f(p_req[i]);
-
-  FREE_ITEMS(*count, p_req);
   FUNCTION_EXIT_("mpi_startall_");
 }
@@ -20,12 +20,30 @@
 #include <sys/timeb.h>
 #include <unistd.h>
 
+struct MPI_Test_args {
+  MPI_Request* req;
+  int* a;
+  MPI_Status* s;
+};
+
+static int MPI_Test_call(void* arg) {
+  struct MPI_Test_args* a = arg;
+  return libMPI_Test(a->req, a->a, a->s);
+}
+
 static int MPI_Test_core(MPI_Request* req,
 			 int* a,
 			 MPI_Status* s) {
-  LOCK();
-  int ret = libMPI_Test(req, a, s);
-  UNLOCK();
+  struct MPI_Test_args args = { req, a, s };
+  /* MPI may reuse the request once it completes */
+  struct mpii_request_info* posted = NULL;
+  if(mpii_infos.settings.request_registry)
+    posted = mpii_registry_check(*req);
+  int ret = MPII_EXEC(MPI_Test_call, &args);
+  if(posted)
+    mpii_registry_check_done(posted);
+  if(ret == MPI_SUCCESS && *a && posted)
+    mpii_registry_complete(posted);
   return ret;
 }
 
@@ -20,13 +20,36 @@
 #include <sys/timeb.h>
 #include <unistd.h>
 
+struct MPI_Testall_args {
+  int count;
+  MPI_Request* reqs;
+  int* flag;
+  MPI_Status* s;
+};
+
+static int MPI_Testall_call(void* arg) {
+  struct MPI_Testall_args* a = arg;
+  return libMPI_Testall(a->count, a->reqs, a->flag, a->s);
+}
+
 static int MPI_Testall_core(int count,
 			    MPI_Request* reqs,
 			    int* flag,
                             MPI_Status* s) {
-  LOCK();
-  int ret = libMPI_Testall(count, reqs, flag, s);
-  UNLOCK();
+  struct MPI_Testall_args args = { count, reqs, flag, s };
+  /* MPI may reuse the requests once they complete */
+  struct mpii_request_info** posted = NULL;
+  if(mpii_infos.settings.request_registry)
+    posted = mpii_registry_check_all(count, reqs);
+  int ret = MPII_EXEC(MPI_Testall_call, &args);
+  if(posted)
+    mpii_registry_check_done_all(count, posted);
+  if(ret == MPI_SUCCESS && *flag && posted) {
+    for(int i = 0; i < count; i++)
+      mpii_registry_complete(posted[i]);
+  } else if(ret == MPI_ERR_IN_STATUS && posted) {
+    mpii_registry_complete_in_status(count, posted, s);
+  }
   return ret;
 }
 
@@ -43,9 +66,8 @@ int MPI_Testall(int count,
 		MPI_Status* s) {
   FUNCTION_ENTRY;
 
-  MPI_Status ezt_mpi_status[count];
   if(s == MPI_STATUSES_IGNORE)
-    s = ezt_mpi_status;
+    s = MPII_ARENA_ALLOC(MPI_Status, count);
 
   int ret = MPI_Testall_core(count, reqs, flag, s);
   MPI_Testall_epilog(count, (void*)reqs, flag, s, sizeof(MPI_Request));
@@ -57,19 +79,19 @@ int MPI_Testall(int count,
 void mpif_testall_(int* count,
 		   MPI_Fint* r,
 		   int* index,
-		   MPI_Status* s,
+		   MPI_Fint* s,
                    int* error) {
   FUNCTION_ENTRY_("mpi_testall_");
-  int i;
-  ALLOCATE_ITEMS(MPI_Request, *count, c_req, p_req);
+  MPI_Request* p_req = mpii_requests_f2c(*count, r);
+  MPI_Status* c_status = MPII_ARENA_ALLOC(MPI_Status, *count);
 
-  for (i = 0; i < *count; i++)
-    p_req[i] = MPI_Request_f2c(r[i]);
-  *error = MPI_Testall_core(*count, p_req, index, s);
-  for (i = 0; i < *count; i++)
-    r[i] = MPI_Request_c2f(p_req[i]);
+  *error = MPI_Testall_core(*count, p_req, index, c_status);
+  /* the requests are only modified if they all completed */
+  if(*index) {
+    mpii_statuses_c2f(*count, c_status, s);
+    mpii_requests_c2f(*count, p_req, r);
+  }
 
-  MPI_Testall_epilog(*count, r, index, s, sizeof(MPI_Fint));
-  FREE_ITEMS(*count, p_req);
+  MPI_Testall_epilog(*count, r, index, c_status, sizeof(MPI_Fint));
   FUNCTION_EXIT_("mpi_testall_");
 }
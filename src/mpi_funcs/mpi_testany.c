@@ -20,14 +20,34 @@
 #include <sys/timeb.h>
 #include <unistd.h>
 
+struct MPI_Testany_args {
+  int count;
+  MPI_Request* reqs;
+  int* index;
+  int* flag;
+  MPI_Status* status;
+};
+
+static int MPI_Testany_call(void* arg) {
+  struct MPI_Testany_args* a = arg;
+  return libMPI_Testany(a->count, a->reqs, a->index, a->flag, a->status);
+}
+
 static int MPI_Testany_core(int count,
 			    MPI_Request* reqs,
 			    int* index,
 			    int* flag,
                             MPI_Status* status) {
-  LOCK();
-  int ret = libMPI_Testany(count, reqs, index, flag, status);
-  UNLOCK();
+  struct MPI_Testany_args args = { count, reqs, index, flag, status };
+  /* MPI may reuse the requests once they complete */
+  struct mpii_request_info** posted = NULL;
+  if(mpii_infos.settings.request_registry)
+    posted = mpii_registry_check_all(count, reqs);
+  int ret = MPII_EXEC(MPI_Testany_call, &args);
+  if(posted)
+    mpii_registry_check_done_all(count, posted);
+  if(ret == MPI_SUCCESS && *flag && *index != MPI_UNDEFINED && posted)
+    mpii_registry_complete(posted[*index]);
   return ret;
 }
 
@@ -46,9 +66,10 @@ int MPI_Testany(int count,
                 MPI_Status* status) {
   FUNCTION_ENTRY;
 
-  MPI_Status ezt_mpi_status[count];
-  if(status == MPI_STATUSES_IGNORE)
-    status = ezt_mpi_status;
+  /* only one status is needed */
+  MPI_Status ezt_mpi_status;
+  if(status == MPI_STATUS_IGNORE)
+    status = &ezt_mpi_status;
 
   int ret = MPI_Testany_core(count, reqs, index, flag, status);
   MPI_Testany_epilog(count, reqs, index, flag, status, sizeof(MPI_Request));
@@ -57,18 +78,21 @@ int MPI_Testany(int count,
 }
 
 void mpif_testany_(int* count, MPI_Fint* r, int* index, int* flag,
-                   MPI_Status* s, int* error) {
+                   MPI_Fint* s, int* error) {
   FUNCTION_ENTRY_("mpi_testany_");
-  int i;
-  ALLOCATE_ITEMS(MPI_Request, *count, c_req, p_req);
+  MPI_Status c_status;
+  MPI_Request* p_req = mpii_requests_f2c(*count, r);
 
-  for (i = 0; i < *count; i++)
-    p_req[i] = MPI_Request_f2c(r[i]);
-  *error = MPI_Testany_core(*count, p_req, index, flag, s);
-  for (i = 0; i < *count; i++)
-    r[i] = MPI_Request_c2f(p_req[i]);
+  *error = MPI_Testany_core(*count, p_req, index, flag, &c_status);
+  /* only the completed request may have changed */
+  if(*flag && *index != MPI_UNDEFINED) {
+    if(s != MPI_F_STATUS_IGNORE)
+      MPI_Status_c2f(&c_status, s);
+    mpii_request_c2f(p_req, r, *index);
+    /* Fortran indices start at 1 */
+    (*index)++;
+  }
 
-  MPI_Testany_epilog(*count, r, index, flag, s, sizeof(MPI_Fint));
-  FREE_ITEMS(*count, p_req);
+  MPI_Testany_epilog(*count, r, index, flag, &c_status, sizeof(MPI_Fint));
   FUNCTION_EXIT_("mpi_testany_");
 }
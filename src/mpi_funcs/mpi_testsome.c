@@ -20,14 +20,37 @@
 #include <sys/timeb.h>
 #include <unistd.h>
 
+struct MPI_Testsome_args {
+  int incount;
+  MPI_Request* reqs;
+  int* outcount;
+  int* indexes;
+  MPI_Status* statuses;
+};
+
+static int MPI_Testsome_call(void* arg) {
+  struct MPI_Testsome_args* a = arg;
+  return libMPI_Testsome(a->incount, a->reqs, a->outcount, a->indexes, a->statuses);
+}
+
 static int MPI_Testsome_core(int incount,
 			     MPI_Request* reqs,
 			     int* outcount,
                              int* indexes,
 			     MPI_Status* statuses) {
-  LOCK();
-  int ret = libMPI_Testsome(incount, reqs, outcount, indexes, statuses);
-  UNLOCK();
+  struct MPI_Testsome_args args = { incount, reqs, outcount, indexes, statuses };
+  /* MPI may reuse the requests once they complete */
+  struct mpii_request_info** posted = NULL;
+  if(mpii_infos.settings.request_registry)
+    posted = mpii_registry_check_all(incount, reqs);
+  int ret = MPII_EXEC(MPI_Testsome_call, &args);
+  if(posted)
+    mpii_registry_check_done_all(incount, posted);
+  /* with MPI_ERR_IN_STATUS, the requests that failed completed too */
+  if((ret == MPI_SUCCESS || ret == MPI_ERR_IN_STATUS) && *outcount != MPI_UNDEFINED && posted) {
+    for(int i = 0; i < *outcount; i++)
+      mpii_registry_complete(posted[indexes[i]]);
+  }
   return ret;
 }
 
@@ -45,9 +68,8 @@ int MPI_Testsome(int incount,
 		 int* indexes,
                  MPI_Status* statuses) {
   FUNCTION_ENTRY;
-  MPI_Status ezt_mpi_status[incount];
   if(statuses == MPI_STATUSES_IGNORE)
-    statuses = ezt_mpi_status;
+    statuses = MPII_ARENA_ALLOC(MPI_Status, incount);
 
   int res = MPI_Testsome_core(incount, reqs, outcount, indexes, statuses);
   MPI_Testsome_epilog(incount, reqs, outcount, indexes, statuses,
@@ -61,22 +83,23 @@ void mpif_testsome_(int* ic,
 		    MPI_Fint* r,
 		    int* oc,
 		    int* indexes,
-		    MPI_Status* s,
+		    MPI_Fint* s,
                     int* error) {
   FUNCTION_ENTRY_("mpi_testsome_");
   int i;
-  ALLOCATE_ITEMS(MPI_Request, *ic, c_req, p_req);
-
-  for (i = 0; i < *ic; i++)
-    p_req[i] = MPI_Request_f2c(r[i]);
-
-  *error = MPI_Testsome_core(*ic, p_req, oc, indexes, s);
-
-  for (i = 0; i < *ic; i++)
-    r[i] = MPI_Request_c2f(p_req[i]);
+  MPI_Request* p_req = mpii_requests_f2c(*ic, r);
+  MPI_Status* c_status = MPII_ARENA_ALLOC(MPI_Status, *ic);
 
-  MPI_Testsome_epilog(*ic, r, oc, indexes, s, sizeof(MPI_Fint));
+  *error = MPI_Testsome_core(*ic, p_req, oc, indexes, c_status);
+  if(*oc != MPI_UNDEFINED) {
+    mpii_statuses_c2f(*oc, c_status, s);
+    /* only the completed requests may have changed. Fortran indices
+     * start at 1
+     */
+    for (i = 0; i < *oc; i++)
+      mpii_request_c2f(p_req, r, indexes[i]++);
+  }
 
-  FREE_ITEMS(*ic, p_req);
+  MPI_Testsome_epilog(*ic, r, oc, indexes, c_status, sizeof(MPI_Fint));
   FUNCTION_EXIT_("mpi_testsome_");
 }
@@ -26,29 +26,24 @@ static void MPI_Wait_prolog(MPI_Fint* req MAYBE_UNUSED,
 }
 
 static int MPI_Wait_core(MPI_Request* req, MPI_Status* s) {
+  /* MPI may reuse the request once it completes */
+  struct mpii_request_info* posted = NULL;
+  if(mpii_infos.settings.request_registry)
+    posted = mpii_registry_check(*req);
+  int ret;
   if(should_lock) {
     /* MPI_Wait is blocking. So we should not call it while holding the lock.
      * Replace MPI_Wait with an active waiting
      */
-    uint64_t count = 0;
-    while(1) {
-      int ret = 0;
-      int flag;
-      ret = MPI_Test(req, &flag, s);
-      if(flag)
-	return ret;
-      count++;
-
-      if(count > 10) {      /* sleep a little bit to decrease contention */
-	sched_yield();
-      } else if (count > 100){
-	/* sleep even more */
-	usleep(10);
-      }
-    }
+    ret = mpii_exec_wait_request(req, s);
   } else {
-    return libMPI_Wait(req, s);
+    ret = libMPI_Wait(req, s);
   }
+  if(posted)
+    mpii_registry_check_done(posted);
+  if(ret == MPI_SUCCESS && posted)
+    mpii_registry_complete(posted);
+  return ret;
 }
 
 
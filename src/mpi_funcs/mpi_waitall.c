@@ -27,32 +27,43 @@ static void MPI_Waitall_prolog(int count MAYBE_UNUSED,
 
 }
 
+struct MPI_Waitall_args {
+  int count;
+  MPI_Request* req;
+  MPI_Status* s;
+};
+
+static int MPI_Waitall_test(void* arg, int* flag) {
+  struct MPI_Waitall_args* a = arg;
+  return libMPI_Testall(a->count, a->req, flag, a->s);
+}
+
 static int MPI_Waitall_core(int count,
 			    MPI_Request* req,
 			    MPI_Status* s) {
+  /* MPI may reuse the requests once they complete */
+  struct mpii_request_info** posted = NULL;
+  if(mpii_infos.settings.request_registry)
+    posted = mpii_registry_check_all(count, req);
+  int ret;
   if(should_lock) {
     /* MPI_Wait is blocking. So we should not call it while holding the lock.
      * Replace MPI_Wait with an active waiting
      */
-    uint64_t count = 0;
-    while(1) {
-      int ret = 0;
-      int flag;
-      ret = MPI_Testall(count, req, &flag, s);
-      if(flag)
-	return ret;
-      count++;
-
-      if(count > 10) {      /* sleep a little bit to decrease contention */
-	sched_yield();
-      } else if (count > 100){
-	/* sleep even more */
-	usleep(10);
-      }
-    }
+    struct MPI_Waitall_args args = { count, req, s };
+    ret = mpii_exec_wait(MPI_Waitall_test, &args);
   } else {
-    return libMPI_Waitall(count, req, s);
+    ret = libMPI_Waitall(count, req, s);
+  }
+  if(posted)
+    mpii_registry_check_done_all(count, posted);
+  if(ret == MPI_SUCCESS && posted) {
+    for(int i = 0; i < count; i++)
+      mpii_registry_complete(posted[i]);
+  } else if(ret == MPI_ERR_IN_STATUS && posted) {
+    mpii_registry_complete_in_status(count, posted, s);
   }
+  return ret;
 }
 
 
@@ -65,9 +76,8 @@ static void MPI_Waitall_epilog(int count MAYBE_UNUSED,
 int MPI_Waitall(int count, MPI_Request* req, MPI_Status* s) {
   FUNCTION_ENTRY;
 
-  MPI_Status ezt_mpi_status[count];
   if(s == MPI_STATUSES_IGNORE)
-    s = ezt_mpi_status;
+    s = MPII_ARENA_ALLOC(MPI_Status, count);
   
   MPI_Waitall_prolog(count, req, s, sizeof(MPI_Request));
   int ret = MPI_Waitall_core(count, req, s);
@@ -77,29 +87,23 @@ int MPI_Waitall(int count, MPI_Request* req, MPI_Status* s) {
   return ret;
 }
 
-void mpif_waitall_(int* c, MPI_Fint* r, MPI_Status* s, int* error) {
+void mpif_waitall_(int* c, MPI_Fint* r, MPI_Fint* s, int* error) {
   FUNCTION_ENTRY_("mpi_waitall_");
-  int i;
-  MPI_Waitall_prolog(*c, r, s, sizeof(MPI_Fint));
+  MPI_Status* c_status = MPII_ARENA_ALLOC(MPI_Status, *c);
+  MPI_Waitall_prolog(*c, r, c_status, sizeof(MPI_Fint));
 
-  /* allocate a MPI_Request array and convert all the fortran requests
-   * into C requests
-   */
-  ALLOCATE_ITEMS(MPI_Request, *c, c_req, p_req);
-  for (i = 0; i < *c; i++)
-    p_req[i] = MPI_Request_f2c(r[i]);
+  /* convert the fortran requests into C requests (if needed) */
+  MPI_Request* p_req = mpii_requests_f2c(*c, r);
 
   /* call the C version of MPI_Wait */
-  *error = MPI_Waitall_core(*c, p_req, s);
+  *error = MPI_Waitall_core(*c, p_req, c_status);
+  mpii_statuses_c2f(*c, c_status, s);
 
   /* Since the requests may have been modified by MPI_Waitall,
    * we need to convert them back to Fortran
    */
-  for (i = 0; i < *c; i++)
-    r[i] = MPI_Request_c2f(p_req[i]);
-
-  MPI_Waitall_epilog(*c, r, s, sizeof(MPI_Fint));
+  mpii_requests_c2f(*c, p_req, r);
 
-  FREE_ITEMS(*c, p_req);
+  MPI_Waitall_epilog(*c, r, c_status, sizeof(MPI_Fint));
   FUNCTION_EXIT_("mpi_waitall_");
 }
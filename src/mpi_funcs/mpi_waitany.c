@@ -27,33 +27,41 @@ static void MPI_Waitany_prolog(int count MAYBE_UNUSED,
                                size_t size MAYBE_UNUSED) {
 }
 
+struct MPI_Waitany_args {
+  int count;
+  MPI_Request* reqs;
+  int* index;
+  MPI_Status* status;
+};
+
+static int MPI_Waitany_test(void* arg, int* flag) {
+  struct MPI_Waitany_args* a = arg;
+  return libMPI_Testany(a->count, a->reqs, a->index, flag, a->status);
+}
+
 static int MPI_Waitany_core(int count,
 			    MPI_Request* reqs,
 			    int* index,
                             MPI_Status* status) {
+  /* MPI may reuse the requests once they complete */
+  struct mpii_request_info** posted = NULL;
+  if(mpii_infos.settings.request_registry)
+    posted = mpii_registry_check_all(count, reqs);
+  int ret;
   if(should_lock) {
     /* MPI_Wait is blocking. So we should not call it while holding the lock.
      * Replace MPI_Wait with an active waiting
      */
-    uint64_t count = 0;
-    while(1) {
-      int ret = 0;
-      int flag;
-      ret = MPI_Testany(count, reqs, index, &flag, status);
-      if(flag)
-	return ret;
-      count++;
-
-      if(count > 10) {      /* sleep a little bit to decrease contention */
-	sched_yield();
-      } else if (count > 100){
-	/* sleep even more */
-	usleep(10);
-      }
-    }
+    struct MPI_Waitany_args args = { count, reqs, index, status };
+    ret = mpii_exec_wait(MPI_Waitany_test, &args);
   } else {
-    return libMPI_Waitany(count, reqs, index, status);
+    ret = libMPI_Waitany(count, reqs, index, status);
   }
+  if(posted)
+    mpii_registry_check_done_all(count, posted);
+  if(ret == MPI_SUCCESS && *index != MPI_UNDEFINED && posted)
+    mpii_registry_complete(posted[*index]);
+  return ret;
 }
 
 
@@ -69,9 +77,10 @@ int MPI_Waitany(int count,
 		int* index,
 		MPI_Status* status) {
   FUNCTION_ENTRY;
-  MPI_Status ezt_mpi_status[count];
-  if(status == MPI_STATUSES_IGNORE)
-    status = ezt_mpi_status;
+  /* only one status is needed */
+  MPI_Status ezt_mpi_status;
+  if(status == MPI_STATUS_IGNORE)
+    status = &ezt_mpi_status;
 
   MPI_Waitany_prolog(count, reqs, index, status, sizeof(MPI_Request));
   int ret = MPI_Waitany_core(count, reqs, index, status);
@@ -82,22 +91,25 @@ int MPI_Waitany(int count,
 
 void mpif_waitany_(int* c,
 		   MPI_Fint* r,
-		   MPI_Status* s,
 		   int* index,
+		   MPI_Fint* s,
 		   int* error) {
   FUNCTION_ENTRY_("mpi_waitany_");
-  int i;
-  MPI_Waitany_prolog(*c, r, index, s, sizeof(MPI_Fint));
+  MPI_Status c_status;
+  MPI_Waitany_prolog(*c, r, index, &c_status, sizeof(MPI_Fint));
 
-  ALLOCATE_ITEMS(MPI_Request, *c, c_req, p_req);
+  MPI_Request* p_req = mpii_requests_f2c(*c, r);
 
-  for (i = 0; i < *c; i++)
-    p_req[i] = MPI_Request_f2c(r[i]);
-  *error = MPI_Waitany_core(*c, p_req, index, s);
-  for (i = 0; i < *c; i++)
-    r[i] = MPI_Request_c2f(p_req[i]);
+  *error = MPI_Waitany_core(*c, p_req, index, &c_status);
+  /* only the completed request may have changed */
+  if(*index != MPI_UNDEFINED) {
+    if(s != MPI_F_STATUS_IGNORE)
+      MPI_Status_c2f(&c_status, s);
+    mpii_request_c2f(p_req, r, *index);
+    /* Fortran indices start at 1 */
+    (*index)++;
+  }
 
-  MPI_Waitany_epilog(*c, r, index, s, sizeof(MPI_Fint));
-  FREE_ITEMS(*c, p_req);
+  MPI_Waitany_epilog(*c, r, index, &c_status, sizeof(MPI_Fint));
   FUNCTION_EXIT_("mpi_waitany_");
 }
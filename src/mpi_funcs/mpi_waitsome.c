@@ -30,34 +30,52 @@ static void MPI_Waitsome_prolog(int incount MAYBE_UNUSED,
 				size_t size MAYBE_UNUSED) {
 }
 
+struct MPI_Waitsome_args {
+  int incount;
+  MPI_Request* reqs;
+  int* outcount;
+  int* array_of_indices;
+  MPI_Status* array_of_statuses;
+};
+
+static int MPI_Waitsome_test(void* arg, int* flag) {
+  struct MPI_Waitsome_args* a = arg;
+  int ret = libMPI_Testsome(a->incount, a->reqs, a->outcount, a->array_of_indices,
+                            a->array_of_statuses);
+  /* outcount is MPI_UNDEFINED if there is no active request */
+  *flag = (*a->outcount != 0);
+  return ret;
+}
+
 static int MPI_Waitsome_core(int incount,
 			     MPI_Request* reqs,
 			     int* outcount,
                              int* array_of_indices,
                              MPI_Status* array_of_statuses) {
+  /* MPI may reuse the requests once they complete */
+  struct mpii_request_info** posted = NULL;
+  if(mpii_infos.settings.request_registry)
+    posted = mpii_registry_check_all(incount, reqs);
+  int ret;
   if(should_lock) {
     /* MPI_Wait is blocking. So we should not call it while holding the lock.
      * Replace MPI_Wait with an active waiting
      */
-    uint64_t count = 0;
-    while(1) {
-      int ret = 0;
-      ret = MPI_Testsome(incount, reqs, outcount, array_of_indices, array_of_statuses);
-      if(*outcount > 0)
-	return ret;
-      count++;
-
-      if(count > 10) {      /* sleep a little bit to decrease contention */
-	sched_yield();
-      } else if (count > 100){
-	/* sleep even more */
-	usleep(10);
-      }
-    }
+    struct MPI_Waitsome_args args = { incount, reqs, outcount, array_of_indices,
+                                      array_of_statuses };
+    ret = mpii_exec_wait(MPI_Waitsome_test, &args);
   } else {
-    return libMPI_Waitsome(incount, reqs, outcount, array_of_indices,
-			   array_of_statuses);
+    ret = libMPI_Waitsome(incount, reqs, outcount, array_of_indices,
+			  array_of_statuses);
   }
+  if(posted)
+    mpii_registry_check_done_all(incount, posted);
+  /* with MPI_ERR_IN_STATUS, the requests that failed completed too */
+  if((ret == MPI_SUCCESS || ret == MPI_ERR_IN_STATUS) && *outcount != MPI_UNDEFINED && posted) {
+    for(int i = 0; i < *outcount; i++)
+      mpii_registry_complete(posted[array_of_indices[i]]);
+  }
+  return ret;
 }
 
 
@@ -72,9 +90,8 @@ static void MPI_Waitsome_epilog(int incount MAYBE_UNUSED,
 int MPI_Waitsome(int incount, MPI_Request* reqs, int* outcount,
                  int* array_of_indices, MPI_Status* array_of_statuses) {
   FUNCTION_ENTRY;
-  MPI_Status ezt_mpi_status[incount];
   if(array_of_statuses == MPI_STATUSES_IGNORE)
-    array_of_statuses = ezt_mpi_status;
+    array_of_statuses = MPII_ARENA_ALLOC(MPI_Status, incount);
 
   MPI_Waitsome_prolog(incount, reqs, outcount, array_of_indices,
                       array_of_statuses, sizeof(MPI_Request));
@@ -86,23 +103,25 @@ int MPI_Waitsome(int incount, MPI_Request* reqs, int* outcount,
   return ret;
 }
 
-void mpif_waitsome_(int* ic, MPI_Fint* r, int* oc, int* indexes, MPI_Status* s,
+void mpif_waitsome_(int* ic, MPI_Fint* r, int* oc, int* indexes, MPI_Fint* s,
                     int* error) {
   FUNCTION_ENTRY_("mpi_waitsome_");
   int i;
-  MPI_Waitsome_prolog(*ic, r, oc, indexes, s, sizeof(MPI_Fint));
+  MPI_Status* c_status = MPII_ARENA_ALLOC(MPI_Status, *ic);
+  MPI_Waitsome_prolog(*ic, r, oc, indexes, c_status, sizeof(MPI_Fint));
 
-  ALLOCATE_ITEMS(MPI_Request, *ic, c_req, p_req);
+  MPI_Request* p_req = mpii_requests_f2c(*ic, r);
 
-  for (i = 0; i < *ic; i++)
-    p_req[i] = MPI_Request_f2c(r[i]);
-
-  *error = MPI_Waitsome_core(*ic, p_req, oc, indexes, s);
-
-  for (i = 0; i < *ic; i++)
-    r[i] = MPI_Request_c2f(p_req[i]);
+  *error = MPI_Waitsome_core(*ic, p_req, oc, indexes, c_status);
+  if(*oc != MPI_UNDEFINED) {
+    mpii_statuses_c2f(*oc, c_status, s);
+    /* only the completed requests may have changed. Fortran indices
+     * start at 1
+     */
+    for (i = 0; i < *oc; i++)
+      mpii_request_c2f(p_req, r, indexes[i]++);
+  }
 
-  MPI_Waitsome_epilog(*ic, r, oc, indexes, s, sizeof(MPI_Fint));
-  FREE_ITEMS(*ic, p_req);
+  MPI_Waitsome_epilog(*ic, r, oc, indexes, c_status, sizeof(MPI_Fint));
   FUNCTION_EXIT_("mpi_waitsome_");
 }
@@ -24,9 +24,32 @@ static struct argp_option options[] = {
 	{"show", 's', 0, 0, "Show the LD_PRELOAD command to run the application with instrumentation" },
 	{"check", 'c', 0, 0, "Check if the application performs concurrent MPI calls" },
 	{"check-abort", 'C', 0, 0, "Abort if the concurrency check fails" },
+	{"lock", 'l', "TYPE", 0, "Select the lock that protects MPI (mutex, ticket, mcs, adaptive)" },
+	{"progress", 'p', "MODE", 0, "Select how MPI calls are executed (lock, delegate)" },
+	{"wait", 'w', "POLICY", 0, "Select how threads wait in blocking MPI calls (eg. yield, or park,MPI_Recv=sleep:100)" },
+	{"no-combine", 'n', 0, 0, "Do not batch the calls that post communications when the lock is busy" },
+	{"completion-engine", 'e', 0, 0, "Let one thread poll MPI for all the threads blocked in MPI_Wait, MPI_Probe, etc." },
+	{"rma-requests", 'r', 0, 0, "Complete MPI_Put and MPI_Get outside of the lock in passive target epochs" },
+	{"request-registry", 'R', 0, 0, "Record the outstanding requests, and report their latency" },
+	{"lock-stats", 't', 0, 0, "Measure how long each MPI function waits for and holds the lock" },
+	{"comm-matrix", 'm', 0, 0, "Count the messages and bytes exchanged between each pair of ranks" },
+	{"size-histograms", 'H', 0, 0, "Record the size of the messages of each MPI function and communicator" },
+	{"trace", 'T', 0, 0, "Record the MPI calls and the lock acquisitions in a trace file" },
+	{"call-sites", 'a', "DEPTH", OPTION_ARG_OPTIONAL, "Measure the time spent in MPI by each call site, identified by DEPTH return addresses (default: 1)" },
+	{"live", 'L', 0, 0, "Publish live metrics in shared memory, that can be displayed with mpii_top" },
+	{"pvars", 'P', "PERIOD", OPTION_ARG_OPTIONAL, "Sample the MPI_T performance variables every PERIOD ms (default: 10)" },
+	{"perf-events", 'E', 0, 0, "Count the cycles, instructions, cache misses, context switches and page faults of each MPI function" },
+	{"async-log", 'A', 0, 0, "Write the verbose messages to mpii_log.<rank>.txt from a background thread" },
+	{"sample-rate", 'S', "N", 0, "Only record 1 out of N MPI calls, and estimate the time spent in each MPI function" },
 	{0}
 };
 
+static const char* lock_type_names[] = MPII_LOCK_TYPE_NAMES;
+static const char* progress_mode_names[] = MPII_PROGRESS_MODE_NAMES;
+
+/* wait policy. NULL means the default policy */
+static const char* wait_policy = NULL;
+
 static error_t parse_opt(int key, char *arg, struct argp_state *state) {
   /* Get the input settings from argp_parse, which we
    * know is a pointer to our settings structure. */
@@ -53,6 +76,69 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
     settings->abort_on_concurrency_check_failure = 1;
     settings->check_concurrency = 1;
     break;
+  case 'l':
+    settings->lock_type = -1;
+    for(int i=0; i<MPII_LOCK_NB_TYPES; i++) {
+      if(strcmp(arg, lock_type_names[i]) == 0)
+	settings->lock_type = i;
+    }
+    if(settings->lock_type < 0)
+      argp_error(state, "unknown lock type '%s'", arg);
+    break;
+  case 'w':
+    wait_policy = arg;
+    break;
+  case 'e':
+    settings->completion_engine = 1;
+    break;
+  case 'n':
+    settings->combine = 0;
+    break;
+  case 'r':
+    settings->rma_requests = 1;
+    break;
+  case 'R':
+    settings->request_registry = 1;
+    break;
+  case 't':
+    settings->lock_stats = 1;
+    break;
+  case 'm':
+    settings->comm_matrix = 1;
+    break;
+  case 'H':
+    settings->size_histograms = 1;
+    break;
+  case 'T':
+    settings->trace = 1;
+    break;
+  case 'L':
+    settings->live = 1;
+    break;
+  case 'A':
+    settings->async_log = 1;
+    break;
+  case 'E':
+    settings->perf_events = 1;
+    break;
+  case 'P':
+    settings->pvars = arg ? atoi(arg) : 10;
+    break;
+  case 'a':
+    settings->call_sites = arg ? atoi(arg) : 1;
+    break;
+  case 'S':
+    settings->sample_rate = atoi(arg);
+    break;
+  case 'p':
+    settings->progress_mode = -1;
+    for(int i=0; i<MPII_PROGRESS_NB_MODES; i++) {
+      if(strcmp(arg, progress_mode_names[i]) == 0)
+	settings->progress_mode = i;
+    }
+    if(settings->progress_mode < 0)
+      argp_error(state, "unknown progress mode '%s'", arg);
+    break;
 
   case ARGP_KEY_NO_ARGS:
     argp_usage(state);
@@ -80,6 +166,22 @@ int main(int argc, char**argv) {
   settings.force_thread_safety = SETTINGS_FORCE_THREAD_SAFETY_DEFAULT;
   settings.disable_thread_safety = SETTINGS_DISABLE_THREAD_SAFETY_DEFAULT;
   settings.abort_on_concurrency_check_failure = SETTINGS_ABORT_ON_CONCURRENCY_CHECK_FAILURE_DEFAULT;
+  settings.lock_type = SETTINGS_LOCK_TYPE_DEFAULT;
+  settings.progress_mode = SETTINGS_PROGRESS_MODE_DEFAULT;
+  settings.combine = SETTINGS_COMBINE_DEFAULT;
+  settings.completion_engine = SETTINGS_COMPLETION_ENGINE_DEFAULT;
+  settings.rma_requests = SETTINGS_RMA_REQUESTS_DEFAULT;
+  settings.request_registry = SETTINGS_REQUEST_REGISTRY_DEFAULT;
+  settings.lock_stats = SETTINGS_LOCK_STATS_DEFAULT;
+  settings.comm_matrix = SETTINGS_COMM_MATRIX_DEFAULT;
+  settings.size_histograms = SETTINGS_SIZE_HISTOGRAMS_DEFAULT;
+  settings.trace = SETTINGS_TRACE_DEFAULT;
+  settings.sample_rate = SETTINGS_SAMPLE_RATE_DEFAULT;
+  settings.call_sites = SETTINGS_CALL_SITES_DEFAULT;
+  settings.live = SETTINGS_LIVE_DEFAULT;
+  settings.pvars = SETTINGS_PVARS_DEFAULT;
+  settings.perf_events = SETTINGS_PERF_EVENTS_DEFAULT;
+  settings.async_log = SETTINGS_ASYNC_LOG_DEFAULT;
 
   // first divide argv between mpii options and target file and
   // options optionnal todo : better target detection : it should be
@@ -121,17 +223,53 @@ int main(int argc, char**argv) {
   setenv_int("MPII_FORCE_THREAD_SAFETY", settings.force_thread_safety, 1);
   setenv_int("MPII_DISABLE_THREAD_SAFETY", settings.disable_thread_safety, 1);
   setenv_int("MPII_ABORT_ON_CONCURRENCY_CHECK_FAILURE", settings.abort_on_concurrency_check_failure, 1);
+  setenv("MPII_LOCK", lock_type_names[settings.lock_type], 1);
+  setenv("MPII_PROGRESS", progress_mode_names[settings.progress_mode], 1);
+  setenv_int("MPII_COMBINE", settings.combine, 1);
+  setenv_int("MPII_COMPLETION_ENGINE", settings.completion_engine, 1);
+  setenv_int("MPII_RMA_REQUESTS", settings.rma_requests, 1);
+  setenv_int("MPII_REQUEST_REGISTRY", settings.request_registry, 1);
+  setenv_int("MPII_LOCK_STATS", settings.lock_stats, 1);
+  setenv_int("MPII_COMM_MATRIX", settings.comm_matrix, 1);
+  setenv_int("MPII_SIZE_HISTOGRAMS", settings.size_histograms, 1);
+  setenv_int("MPII_TRACE", settings.trace, 1);
+  setenv_int("MPII_SAMPLE_RATE", settings.sample_rate, 1);
+  setenv_int("MPII_CALL_SITES", settings.call_sites, 1);
+  setenv_int("MPII_LIVE", settings.live, 1);
+  setenv_int("MPII_PVARS", settings.pvars, 1);
+  setenv_int("MPII_PERF_EVENTS", settings.perf_events, 1);
+  setenv_int("MPII_ASYNC_LOG", settings.async_log, 1);
+  if(wait_policy)
+    setenv("MPII_WAIT_POLICY", wait_policy, 1);
 
 
   if(settings.show) {
     setenv("LD_PRELOAD", ld_preload, 1);
-    printf("LD_PRELOAD=%s MPII_VERBOSE=%d MPII_FORCE_THREAD_SAFETY=%d MPII_DISABLE_THREAD_SAFETY=%d MPII_CHECK_CONCURRENCY=%d MPII_ABORT_ON_CONCURRENCY_CHECK_FAILURE=%d",
+    printf("LD_PRELOAD=%s MPII_VERBOSE=%d MPII_FORCE_THREAD_SAFETY=%d MPII_DISABLE_THREAD_SAFETY=%d MPII_CHECK_CONCURRENCY=%d MPII_ABORT_ON_CONCURRENCY_CHECK_FAILURE=%d MPII_LOCK=%s MPII_PROGRESS=%s MPII_COMBINE=%d MPII_COMPLETION_ENGINE=%d MPII_RMA_REQUESTS=%d MPII_REQUEST_REGISTRY=%d MPII_LOCK_STATS=%d MPII_COMM_MATRIX=%d MPII_SIZE_HISTOGRAMS=%d MPII_TRACE=%d MPII_SAMPLE_RATE=%d MPII_CALL_SITES=%d MPII_LIVE=%d MPII_PVARS=%d MPII_PERF_EVENTS=%d MPII_ASYNC_LOG=%d",
 	   ld_preload,
 	   settings.verbose,
 	   settings.force_thread_safety,
 	   settings.disable_thread_safety,
 	   settings.check_concurrency,
-	   settings.abort_on_concurrency_check_failure);
+	   settings.abort_on_concurrency_check_failure,
+	   lock_type_names[settings.lock_type],
+	   progress_mode_names[settings.progress_mode],
+	   settings.combine,
+	   settings.completion_engine,
+	   settings.rma_requests,
+	   settings.request_registry,
+	   settings.lock_stats,
+	   settings.comm_matrix,
+	   settings.size_histograms,
+	   settings.trace,
+	   settings.sample_rate,
+	   settings.call_sites,
+	   settings.live,
+	   settings.pvars,
+	   settings.perf_events,
+	   settings.async_log);
+    if(wait_policy)
+      printf(" MPII_WAIT_POLICY=%s", wait_policy);
 
     for(int i=target_i; i<argc; i++)
       printf(" %s", argv[i]);
@@ -8,26 +8,69 @@
 #include <mpi.h>
 #include "mpii_macros.h"
 #include "mpii_config.h"
+#include "mpii_lock.h"
+#include "mpii_progress.h"
+#include "mpii_wait.h"
+#include "mpii_stats.h"
+#include "mpii_comm_cache.h"
+#include "mpii_type_cache.h"
+#include "mpii_pool.h"
+#include "mpii_win.h"
+#include "mpii_arena.h"
+#include "mpii_registry.h"
+#include "mpii_trace.h"
+#include "mpii_comm_matrix.h"
+#include "mpii_histogram.h"
+#include "mpii_concurrency.h"
+#include "mpii_sample.h"
+#include "mpii_call_sites.h"
+#include "mpii_shm.h"
+#include "mpii_pvar.h"
+#include "mpii_probes.h"
+#include "mpii_perf.h"
+#include "mpii_log.h"
 #include <pthread.h>
 
 /* should we protect MPI from concurrent accesses ? */
 extern int should_lock;
-/* mutex used for protecting MPI from concurren calls */
-extern pthread_mutex_t mpi_lock;
 
 /* prevent the library from processing recursive MPI calls */
 extern __thread int recursion_shield;
 
+/* take the lock that protects MPI from concurrent calls. The lock
+ * implementation is selected with MPII_LOCK (see mpii_lock.c)
+ */
 #define LOCK() do {				\
     if(should_lock) {				\
-      pthread_mutex_lock(&mpi_lock);		\
+      mpii_lock_acquire();			\
     }						\
   } while(0)
 
-#define UNLOCK() do {					\
-    if(should_lock) pthread_mutex_unlock(&mpi_lock);	\
+#define UNLOCK() do {				\
+    if(should_lock) mpii_lock_release();	\
   } while(0)
 
+/* execute call(arg) with MPI protected from concurrent calls: either
+ * while holding the MPI lock, or from the communication thread when
+ * MPII_PROGRESS=delegate (see mpii_progress.c)
+ */
+#define MPII_EXEC(call, arg) (should_lock ? mpii_exec(call, arg) : (call)(arg))
+
+/* same as MPII_EXEC, for the calls that post communications
+ * (eg. MPI_Isend). When the lock is busy, these calls are batched by
+ * the lock holder unless MPII_COMBINE=0 (see mpii_combine.c)
+ */
+#define MPII_EXEC_COMBINE(call, arg) \
+  (should_lock ? mpii_exec_combine(call, arg) : (call)(arg))
+
+/* execute call(arg) from the communication thread if MPI calls are
+ * delegated to it. This is used by the functions that are not
+ * protected by the MPI lock (eg. MPI_Comm_rank), but that MPI only
+ * allows the communication thread to call
+ */
+#define MPII_DELEGATE(call, arg) \
+  (mpii_progress_delegating ? mpii_exec(call, arg) : (call)(arg))
+
 struct ezt_instrumented_function {
   char function_name[1024];
   void* callback;
@@ -46,6 +89,10 @@ struct mpii_info {
   int mpi_proc_null;
   int mpi_comm_world;
   int mpi_comm_self;
+  /* Fortran version of MPI_REQUEST_NULL */
+  MPI_Fint f_request_null;
+  /* 1 if Fortran requests can be used as C requests */
+  int f_requests_are_c_requests;
 
   struct mpii_settings settings;
 };
@@ -53,14 +100,6 @@ struct mpii_info {
 extern struct mpii_info mpii_infos;
 
 
-/* number of pending mpi calls. If MPI is not thread safe, this should
-   always be 0 or 1 */
-extern _Atomic int current_mpi_calls;
-/* which thread is currently calling MPI ? */
-extern _Atomic int current_mpi_call_thread;
-/* which MPI function is currently being called ? */
-extern volatile const char* current_mpi_call_function;
-
 /* rank of the current thread */
 extern __thread int thread_rank;
 /* number of threads */
@@ -69,83 +108,84 @@ extern _Atomic int nb_threads;
 
 /* When entering an MPI function, check if another thread is currently
    using MPI */
-#define CHECK_CONCURRENCY_ENTER_MPI(fname) do {				\
-    if(mpii_infos.settings.check_concurrency != 0) {			\
-      int nb_calls = ++current_mpi_calls;				\
-      if( nb_calls != 1) {						\
-	MPII_PRINTF(0, "[P%dT%d]\tWarning: thread %d calls %s while thread %d calls %s! Concurrency_level: %d\n", \
-		    mpii_infos.rank, thread_rank,			\
-		    thread_rank, fname,					\
-		    current_mpi_call_thread, current_mpi_call_function, nb_calls); \
-	if(mpii_infos.settings.abort_on_concurrency_check_failure) abort(); \
-      }									\
-      current_mpi_call_thread = thread_rank;				\
-      current_mpi_call_function = fname;				\
-    }									\
+#define CHECK_CONCURRENCY_ENTER_MPI(function_id) do {			\
+    if(mpii_infos.settings.check_concurrency != 0)			\
+      mpii_concurrency_enter(function_id, __builtin_return_address(0)); \
   } while(0)
 
-/* When leaving an MPI function, check if another thread is currently
-   using MPI */
-#define CHECK_CONCURRENCY_LEAVE_MPI(fname) do {				\
-    if(mpii_infos.settings.check_concurrency != 0) {			\
-      int nb_calls = --current_mpi_calls;				\
-      if( nb_calls != 0) {						\
-	MPII_PRINTF(0, "[P%dT%d]\tWarning: thread %d leaves %s while thread %d is in %s! Concurrency_level: %d\n", \
-		    mpii_infos.rank, thread_rank,			\
-		    thread_rank, fname,					\
-		    current_mpi_call_thread, current_mpi_call_function, nb_calls); \
-	if(mpii_infos.settings.abort_on_concurrency_check_failure) abort(); \
-      }									\
-      current_mpi_call_thread = 0;					\
-      current_mpi_call_function = NULL;					\
-    }									\
+/* When leaving an MPI function */
+#define CHECK_CONCURRENCY_LEAVE_MPI() do {				\
+    if(mpii_infos.settings.check_concurrency != 0)			\
+      mpii_concurrency_leave();						\
   } while(0)
 
 /* called when entering an MPI function */
 #define FUNCTION_ENTRY_(fname) do {					\
     if(recursion_shield++ == 0) {					\
       if(thread_rank < 0) thread_rank = nb_threads++;			\
-      CHECK_CONCURRENCY_ENTER_MPI(fname);				\
-      MPII_PRINTF(2, "[%d/%d]\tEntering %s\n", mpii_infos.rank, mpii_infos.size, fname); \
+      static int _function_id = -1;					\
+      if(_function_id < 0) _function_id = mpii_stats_function_id(fname); \
+      mpii_current_function = fname;					\
+      mpii_current_function_id = _function_id;				\
+      MPII_PROBE3(function_entry, _function_id, thread_rank, fname);	\
+      if(mpii_infos.settings.request_registry)				\
+	mpii_current_call_site = __builtin_return_address(0);		\
+      MPII_SAMPLE_ENTER(_function_id);					\
+      if(mpii_infos.settings.trace && MPII_SAMPLED) mpii_trace_enter(_function_id); \
+      if(mpii_infos.settings.call_sites)				\
+	mpii_call_sites_enter(_function_id, __builtin_return_address(0)); \
+      if(mpii_infos.settings.live) mpii_shm_enter();			\
+      if(mpii_infos.settings.perf_events) mpii_perf_enter();		\
+      CHECK_CONCURRENCY_ENTER_MPI(_function_id);				\
+      if(mpii_infos.settings.verbose >= 2) MPII_LOG_FUNCTION("Entering", fname); \
     }									\
   } while(0)
 
 /* called when leaving an MPI function */
 #define FUNCTION_EXIT_(fname)  do {					\
     if(--recursion_shield == 0) {					\
-      CHECK_CONCURRENCY_LEAVE_MPI(fname);				\
-      MPII_PRINTF(2, "[%d/%d]\tLeaving %s\n", mpii_infos.rank, mpii_infos.size, fname);	\
+      MPII_PROBE2(function_exit, mpii_current_function_id, thread_rank); \
+      if(mpii_infos.settings.perf_events) mpii_perf_exit(mpii_current_function_id); \
+      if(mpii_infos.settings.trace && MPII_SAMPLED) mpii_trace_exit();	\
+      if(mpii_infos.settings.call_sites) mpii_call_sites_exit();	\
+      if(mpii_infos.settings.live) mpii_shm_exit(mpii_current_function_id); \
+      if(mpii_infos.settings.pvars) mpii_pvar_poll();			\
+      MPII_SAMPLE_EXIT();						\
+      mpii_current_function = NULL;					\
+      mpii_current_function_id = 0;					\
+      MPII_ARENA_RESET();						\
+      CHECK_CONCURRENCY_LEAVE_MPI();				\
+      if(mpii_infos.settings.verbose >= 2) MPII_LOG_FUNCTION("Leaving", fname); \
     }									\
   } while(0)
 
+/* print a message if the verbosity level is at least _debug_level_.
+ * With MPII_ASYNC_LOG=1, the message is written to the log file by the
+ * flusher thread (see mpii_log.c)
+ */
 #define MPII_PRINTF(_debug_level_, ...)			\
     {							\
       if (mpii_infos.settings.verbose >= _debug_level_) \
-	fprintf(stderr, __VA_ARGS__);			\
+	MPII_LOG(__VA_ARGS__);				\
     }
 
-#define FUNCTION_ENTRY FUNCTION_ENTRY_(__func__);
-#define FUNCTION_EXIT  FUNCTION_EXIT_(__func__);
-
-/* maximum number of items to be allocated statically
- * if the application need more than this, a dynamic array
- * is allocated using malloc()
+/* record the arguments of the MPI function called by the current
+ * thread (peer, tag, communicator, and the size of the message) for
+ * the tracing, the message size histograms, the sampling profiler, the
+ * call site profiler, the live metrics and the call_args probe.
+ * Called by the prologs
  */
-#define MAX_REQS 128
+void mpii_call_args(int peer, int tag, MPI_Comm comm, int count, MPI_Datatype datatype);
 
-/* allocate a number of elements using a static array if possible
- * if not possible (ie. count>MAX_REQS) use a dynamic array (ie. malloc)
- */
-#define ALLOCATE_ITEMS(type, count, static_var, dyn_var)	\
-  type static_var[MAX_REQS];					\
-  type* dyn_var = static_var;					\
-  if ((count) > MAX_REQS)					\
-    dyn_var = (type*)malloc(sizeof(type) * (count))
+#define MPII_CALL_ARGS(peer, tag, comm, count, datatype) do {		\
+    if(mpii_infos.settings.trace || mpii_infos.settings.size_histograms || \
+       mpii_infos.settings.call_sites || mpii_infos.settings.live || mpii_sampled || \
+       MPII_PROBE_ENABLED(call_args))					\
+      mpii_call_args(peer, tag, comm, count, datatype);		\
+  } while(0)
 
-/* Free an array created by ALLOCATE_ITEMS */
-#define FREE_ITEMS(count, dyn_var)		\
-  if ((count) > MAX_REQS)			\
-    free(dyn_var)
+#define FUNCTION_ENTRY FUNCTION_ENTRY_(__func__);
+#define FUNCTION_EXIT  FUNCTION_EXIT_(__func__);
 
 /* pointers to actual MPI functions (C version)  */
 extern int (*libMPI_Init)(int*, char***);
@@ -262,6 +302,12 @@ extern int (*libMPI_Get)(void*, int, MPI_Datatype, int, MPI_Aint, int,
                          MPI_Datatype, MPI_Win);
 extern int (*libMPI_Put)(CONST void*, int, MPI_Datatype, int, MPI_Aint, int,
                          MPI_Datatype, MPI_Win);
+#ifdef USE_MPI3
+extern int (*libMPI_Rget)(void*, int, MPI_Datatype, int, MPI_Aint, int,
+                          MPI_Datatype, MPI_Win, MPI_Request*);
+extern int (*libMPI_Rput)(const void*, int, MPI_Datatype, int, MPI_Aint, int,
+                          MPI_Datatype, MPI_Win, MPI_Request*);
+#endif
 
 extern int (*libMPI_Comm_spawn)(CONST char* command, char* argv[], int maxprocs,
                                 MPI_Info info, int root, MPI_Comm comm,
@@ -378,6 +424,61 @@ int ezt_mpi_is_in_place_(void* buf);
  */
 #define CHECK_MPI_IN_PLACE(p) (ezt_mpi_is_in_place_(p) ? MPI_IN_PLACE : (p))
 
+/* 1 if C requests are Fortran integers (eg. with MPICH), in which case
+ * the conversion between C and Fortran requests may be the identity
+ */
+#define MPII_REQUEST_IS_FINT _Generic((MPI_Request)0, MPI_Fint: 1, default: 0)
+
+/* return the C version of the count Fortran requests f_reqs. If the
+ * MPI library uses the same representation for both, f_reqs is
+ * returned. Otherwise, the requests are converted into an array
+ * allocated in the arena
+ */
+static inline MPI_Request* mpii_requests_f2c(int count, MPI_Fint* f_reqs) {
+  if(mpii_infos.f_requests_are_c_requests)
+    return (MPI_Request*)f_reqs;
+  MPI_Request* c_reqs = MPII_ARENA_ALLOC(MPI_Request, count);
+  for(int i = 0; i < count; i++)
+    c_reqs[i] = MPI_Request_f2c(f_reqs[i]);
+  return c_reqs;
+}
+
+/* update the Fortran request f_reqs[i] after MPI completed the C
+ * request c_reqs[i] (returned by mpii_requests_f2c). MPI either leaves
+ * a request unchanged (persistent or incomplete requests) or sets it
+ * to MPI_REQUEST_NULL, so only the latter need to be converted
+ */
+static inline void mpii_request_c2f(MPI_Request* c_reqs, MPI_Fint* f_reqs, int i) {
+  if((void*)c_reqs != (void*)f_reqs && c_reqs[i] == MPI_REQUEST_NULL)
+    f_reqs[i] = mpii_infos.f_request_null;
+}
+
+/* same as mpii_request_c2f, for the count first requests */
+static inline void mpii_requests_c2f(int count, MPI_Request* c_reqs, MPI_Fint* f_reqs) {
+  if((void*)c_reqs == (void*)f_reqs)
+    return;
+  for(int i = 0; i < count; i++)
+    if(c_reqs[i] == MPI_REQUEST_NULL)
+      f_reqs[i] = mpii_infos.f_request_null;
+}
+
+/* number of MPI_Fint in a Fortran status */
+#ifdef MPI_F_STATUS_SIZE
+#define MPII_F_STATUS_SIZE MPI_F_STATUS_SIZE
+#else
+#define MPII_F_STATUS_SIZE (sizeof(MPI_Status) / sizeof(MPI_Fint))
+#endif
+
+/* convert count C statuses into the Fortran statuses f_status, unless
+ * the Fortran program passed MPI_STATUSES_IGNORE
+ */
+static inline void mpii_statuses_c2f(int count, MPI_Status* c_status, MPI_Fint* f_status) {
+  if(f_status == MPI_F_STATUSES_IGNORE)
+    return;
+  for(int i = 0; i < count; i++)
+    MPI_Status_c2f(&c_status[i], &f_status[i * MPII_F_STATUS_SIZE]);
+}
+
 
 #define PPTRACE_START_INTERCEPT_FUNCTIONS(module_name) struct ezt_instrumented_function INSTRUMENTED_FUNCTIONS [] = {
 
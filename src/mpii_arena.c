@@ -0,0 +1,101 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Per-thread arena for the scratch arrays of the MPI wrappers (statuses,
+ * converted request arrays, ...).
+ *
+ * Allocating is bumping a pointer in the current chunk. When the chunk
+ * is full, a new chunk (twice as large) is allocated. When the arena is
+ * reset, the chunks are merged into one chunk that is large enough for
+ * all the memory that was allocated, so the following calls with the
+ * same number of items do not call malloc.
+ */
+
+#include "mpii.h"
+#include "mpii_arena.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+/* alignment of the allocated arrays */
+#define ARENA_ALIGN 16
+
+struct arena_chunk {
+  struct arena_chunk* prev;	/* previous (smaller) chunk */
+  size_t size;
+  size_t used;
+  char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+__thread size_t mpii_arena_used = 0;
+static __thread struct arena_chunk* current_chunk = NULL;
+
+/* the chunks are freed when the thread exits */
+static pthread_key_t arena_key;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+static void free_chunks(void* arg) {
+  struct arena_chunk* chunk = arg;
+  while(chunk) {
+    struct arena_chunk* prev = chunk->prev;
+    free(chunk);
+    chunk = prev;
+  }
+}
+
+static void arena_init(void) {
+  pthread_key_create(&arena_key, free_chunks);
+}
+
+static struct arena_chunk* new_chunk(size_t size, struct arena_chunk* prev) {
+  struct arena_chunk* chunk = malloc(sizeof(struct arena_chunk) + size);
+  if(!chunk) {
+    fprintf(stderr, "[MPII] Error: cannot allocate %zu bytes of scratch memory\n", size);
+    abort();
+  }
+  chunk->prev = prev;
+  chunk->size = size;
+  chunk->used = 0;
+  return chunk;
+}
+
+static void set_current_chunk(struct arena_chunk* chunk) {
+  pthread_once(&arena_once, arena_init);
+  current_chunk = chunk;
+  pthread_setspecific(arena_key, chunk);
+}
+
+void* mpii_arena_alloc(size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  struct arena_chunk* chunk = current_chunk;
+  if(!chunk || chunk->size - chunk->used < size) {
+    size_t chunk_size = chunk ? 2 * chunk->size : MPII_ARENA_MIN_CHUNK;
+    while(chunk_size < size)
+      chunk_size *= 2;
+    /* the memory allocated in the previous chunks is still in use */
+    chunk = new_chunk(chunk_size, chunk);
+    set_current_chunk(chunk);
+  }
+  void* ptr = chunk->data + chunk->used;
+  chunk->used += size;
+  mpii_arena_used += size;
+  return ptr;
+}
+
+void mpii_arena_reset(void) {
+  struct arena_chunk* chunk = current_chunk;
+  if(chunk && chunk->prev) {
+    /* replace the chunks with a single chunk that can hold all of them */
+    size_t total = 0;
+    for(struct arena_chunk* c = chunk; c; c = c->prev)
+      total += c->size;
+    free_chunks(chunk);
+    set_current_chunk(new_chunk(total, NULL));
+  } else if(chunk) {
+    chunk->used = 0;
+  }
+  mpii_arena_used = 0;
+}
@@ -0,0 +1,35 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+/* size of the first chunk of an arena */
+#define MPII_ARENA_MIN_CHUNK (64 * 1024)
+
+/* number of bytes allocated from the arena of the current thread since
+ * the last reset
+ */
+extern __thread size_t mpii_arena_used;
+
+/* allocate size bytes of scratch memory from the arena of the current
+ * thread. The memory is valid until the arena is reset, ie. when the
+ * thread leaves the outermost MPI function
+ */
+void* mpii_arena_alloc(size_t size);
+
+/* release all the memory allocated from the arena of the current thread */
+void mpii_arena_reset(void);
+
+/* allocate an array of count items of the given type */
+#define MPII_ARENA_ALLOC(type, count) \
+  ((type*)mpii_arena_alloc(sizeof(type) * (size_t)(count)))
+
+/* reset the arena if something was allocated */
+#define MPII_ARENA_RESET() do {			\
+    if(mpii_arena_used) mpii_arena_reset();	\
+  } while(0)
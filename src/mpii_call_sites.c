@@ -0,0 +1,445 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Call site profiler (MPII_CALL_SITES=DEPTH).
+ *
+ * When entering an MPI function, a thread records the return address
+ * of the function, ie. the place where the application calls MPI. If
+ * DEPTH > 1, the DEPTH - 1 callers of this place are added, so that
+ * the calls made by a communication library can be told apart. The
+ * time spent in MPI, the time spent waiting for and holding the MPI
+ * lock, and the size of the messages are accumulated per call site in
+ * a per-thread hash table.
+ *
+ * When MPI is finalized, the tables of all the threads are merged, and
+ * the call sites that spend the most time in MPI are written to
+ * mpii_call_sites.<rank>.txt. Addresses are symbolized with dladdr,
+ * and with addr2line if it is available. addr2line is run once MPI is
+ * finalized, in a single process per object, and without a shell.
+ *
+ * When sampling is enabled (MPII_SAMPLE_RATE), only the sampled calls
+ * are recorded, and the report is scaled by the sample rate.
+ */
+
+#define _GNU_SOURCE
+#include "mpii.h"
+#include "mpii_call_sites.h"
+#include "mpii_thread_list.h"
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <link.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* initial number of entries of the per-thread tables */
+#define THREAD_TABLE_MIN_SIZE 64
+
+#define EMPTY_FUNCTION (-1)
+
+struct call_site {
+  int function;
+  int depth;
+  void* addresses[MPII_CALL_SITES_MAX_DEPTH];
+  uint64_t nb_calls;
+  /* in cycles */
+  uint64_t duration;
+  uint64_t wait;
+  uint64_t hold;
+  uint64_t bytes;
+};
+
+struct call_sites_thread {
+  struct call_sites_thread* next;
+  struct call_site* sites;
+  unsigned capacity;		/* a power of 2 */
+  unsigned nb_sites;
+
+  /* current call */
+  int active;
+  struct call_site current;
+  uint64_t start;
+  uint64_t lock_start;
+};
+
+static struct mpii_thread_list threads = MPII_THREAD_LIST_INITIALIZER("the call sites");
+
+static __thread struct call_sites_thread* my_thread = NULL;
+
+static struct call_site* alloc_sites(unsigned capacity) {
+  struct call_site* sites = mpii_checked_calloc(capacity, sizeof(struct call_site), threads.name);
+  for(unsigned i = 0; i < capacity; i++)
+    sites[i].function = EMPTY_FUNCTION;
+  return sites;
+}
+
+static struct call_sites_thread* get_thread(void) {
+  if(!my_thread) {
+    struct call_sites_thread* t = mpii_thread_list_alloc(&threads, sizeof(struct call_sites_thread));
+    t->capacity = THREAD_TABLE_MIN_SIZE;
+    t->sites = alloc_sites(t->capacity);
+    mpii_thread_list_add(&threads, t);
+    my_thread = t;
+  }
+  return my_thread;
+}
+
+static unsigned hash(const struct call_site* key, unsigned capacity) {
+  uint64_t h = (uint64_t)key->function;
+  for(int i = 0; i < key->depth; i++)
+    h = (h ^ (uintptr_t)key->addresses[i]) * UINT64_C(0x9e3779b97f4a7c15);
+  return (h >> 32) & (capacity - 1);
+}
+
+static int same_site(const struct call_site* a, const struct call_site* b) {
+  return a->function == b->function && a->depth == b->depth &&
+    memcmp(a->addresses, b->addresses, a->depth * sizeof(void*)) == 0;
+}
+
+/* return the entry of key in sites, or the empty entry where it should be inserted */
+static struct call_site* find_site(struct call_site* sites, unsigned capacity,
+				   const struct call_site* key) {
+  unsigned index = hash(key, capacity);
+  while(sites[index].function != EMPTY_FUNCTION && !same_site(&sites[index], key))
+    index = (index + 1) & (capacity - 1);
+  return &sites[index];
+}
+
+static struct call_site* get_site(struct call_sites_thread* t, const struct call_site* key) {
+  struct call_site* s = find_site(t->sites, t->capacity, key);
+  if(s->function != EMPTY_FUNCTION)
+    return s;
+
+  if(2 * (t->nb_sites + 1) > t->capacity) {
+    /* keep the table half empty */
+    unsigned capacity = 2 * t->capacity;
+    struct call_site* sites = alloc_sites(capacity);
+    for(unsigned i = 0; i < t->capacity; i++)
+      if(t->sites[i].function != EMPTY_FUNCTION)
+	*find_site(sites, capacity, &t->sites[i]) = t->sites[i];
+    free(t->sites);
+    t->sites = sites;
+    t->capacity = capacity;
+    s = find_site(t->sites, t->capacity, key);
+  }
+  s->function = key->function;
+  s->depth = key->depth;
+  memcpy(s->addresses, key->addresses, key->depth * sizeof(void*));
+  t->nb_sites++;
+  return s;
+}
+
+void mpii_call_sites_enter(int function, void* site) {
+  if(!MPII_SAMPLED)
+    return;
+  struct call_sites_thread* t = get_thread();
+  struct call_site* c = &t->current;
+  c->function = function;
+  c->addresses[0] = site;
+  c->depth = 1;
+  c->wait = 0;
+  c->hold = 0;
+  c->bytes = 0;
+
+  int depth = mpii_infos.settings.call_sites;
+  if(depth > 1) {
+    /* find site in the backtrace, and add its callers */
+    void* frames[MPII_CALL_SITES_MAX_DEPTH + 4];
+    int nb_frames = backtrace(frames, MPII_CALL_SITES_MAX_DEPTH + 4);
+    for(int i = 0; i < nb_frames; i++) {
+      if(frames[i] != site)
+	continue;
+      for(int j = i + 1; j < nb_frames && c->depth < depth; j++)
+	c->addresses[c->depth++] = frames[j];
+      break;
+    }
+  }
+  t->active = 1;
+  t->start = mpii_tsc();
+}
+
+void mpii_call_sites_exit(void) {
+  struct call_sites_thread* t = my_thread;
+  if(!t || !t->active)
+    return;
+  uint64_t duration = mpii_tsc() - t->start;
+  struct call_site* s = get_site(t, &t->current);
+  s->nb_calls++;
+  s->duration += duration;
+  s->wait += t->current.wait;
+  s->hold += t->current.hold;
+  s->bytes += t->current.bytes;
+  t->active = 0;
+}
+
+void mpii_call_sites_args(uint64_t bytes) {
+  struct call_sites_thread* t = my_thread;
+  if(t && t->active)
+    t->current.bytes = bytes;
+}
+
+void mpii_call_sites_lock_acquired(uint64_t wait_start) {
+  struct call_sites_thread* t = my_thread;
+  if(!t || !t->active)
+    return;
+  t->lock_start = mpii_tsc();
+  t->current.wait += t->lock_start - wait_start;
+}
+
+void mpii_call_sites_lock_released(void) {
+  struct call_sites_thread* t = my_thread;
+  if(!t || !t->active)
+    return;
+  t->current.hold += mpii_tsc() - t->lock_start;
+}
+
+void mpii_call_sites_format(char* str, size_t len, const void* address) {
+  Dl_info info;
+  if(!address || !dladdr(address, &info) || !info.dli_fname) {
+    snprintf(str, len, "%p", address);
+  } else if(info.dli_sname) {
+    snprintf(str, len, "%s+%#tx (%s)", info.dli_sname,
+	     (const char*)address - (const char*)info.dli_saddr, info.dli_fname);
+  } else {
+    snprintf(str, len, "%s+%#tx", info.dli_fname,
+	     (const char*)address - (const char*)info.dli_fbase);
+  }
+}
+
+/* a return address printed in the report */
+struct frame {
+  const void* address;
+  Dl_info info;			/* info.dli_fname is NULL if dladdr failed */
+  int symbolized;		/* 1 once addr2line was run on the object of the frame */
+  char function[256];
+  char line[512];		/* empty if addr2line did not find the source line */
+};
+
+/* return the environment without LD_PRELOAD, so that the interceptor
+ * is not loaded in the child processes
+ */
+static char** child_environment(void) {
+  int n = 0;
+  while(environ[n])
+    n++;
+  char** env = mpii_checked_calloc(n + 1, sizeof(char*), threads.name);
+  int j = 0;
+  for(int i = 0; i < n; i++)
+    if(strncmp(environ[i], "LD_PRELOAD=", strlen("LD_PRELOAD=")) != 0)
+      env[j++] = environ[i];
+  return env;
+}
+
+/* find the function and the source line of the frames[indices[i]],
+ * which belong to the same object, with a single addr2line process
+ */
+static void addr2line(struct frame* frames, const int* indices, int count, char** env) {
+  const Dl_info* info = &frames[indices[0]].info;
+  /* addresses of the position-independent objects are relative to
+   * their base address
+   */
+  const ElfW(Ehdr)* ehdr = info->dli_fbase;
+  uintptr_t base = ehdr->e_type == ET_DYN ? (uintptr_t)info->dli_fbase : 0;
+
+  char** argv = mpii_checked_calloc(count + 6, sizeof(char*), threads.name);
+  char (*pcs)[32] = mpii_checked_calloc(count, sizeof(*pcs), threads.name);
+  int argc = 0;
+  argv[argc++] = "addr2line";
+  argv[argc++] = "-f";
+  argv[argc++] = "-C";
+  argv[argc++] = "-e";
+  argv[argc++] = (char*)info->dli_fname;
+  for(int i = 0; i < count; i++) {
+    /* the return address is after the call instruction */
+    uintptr_t pc = (uintptr_t)frames[indices[i]].address - 1 - base;
+    snprintf(pcs[i], sizeof(pcs[i]), "%#" PRIxPTR, pc);
+    argv[argc++] = pcs[i];
+  }
+  argv[argc] = NULL;
+
+  int fds[2];
+  FILE* f = NULL;
+  pid_t pid;
+  posix_spawn_file_actions_t actions;
+  if(pipe(fds) != 0)
+    goto out;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+  posix_spawn_file_actions_addclose(&actions, fds[0]);
+  posix_spawn_file_actions_addclose(&actions, fds[1]);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+  int ret = posix_spawnp(&pid, "addr2line", &actions, NULL, argv, env);
+  posix_spawn_file_actions_destroy(&actions);
+  close(fds[1]);
+  if(ret != 0 || !(f = fdopen(fds[0], "r"))) {
+    close(fds[0]);
+    if(ret == 0)
+      waitpid(pid, NULL, 0);
+    goto out;
+  }
+
+  /* addr2line prints the function and the source line of each address */
+  for(int i = 0; i < count; i++) {
+    struct frame* fr = &frames[indices[i]];
+    if(!fgets(fr->function, sizeof(fr->function), f) || !fgets(fr->line, sizeof(fr->line), f))
+      break;
+    fr->function[strcspn(fr->function, "\n")] = '\0';
+    fr->line[strcspn(fr->line, "\n")] = '\0';
+    if(fr->line[0] == '?')
+      fr->line[0] = '\0';
+  }
+  fclose(f);
+  waitpid(pid, NULL, 0);
+ out:
+  free(pcs);
+  free(argv);
+}
+
+/* find the source lines of the frames. Called once MPI is finalized,
+ * since addr2line runs in child processes
+ */
+static void symbolize(struct frame* frames, int nb_frames) {
+  int* indices = mpii_checked_calloc(nb_frames, sizeof(int), threads.name);
+  char** env = child_environment();
+  for(int i = 0; i < nb_frames; i++) {
+    if(!frames[i].info.dli_fname || frames[i].symbolized)
+      continue;
+    /* the frames of the same object */
+    int count = 0;
+    for(int j = i; j < nb_frames; j++) {
+      if(frames[j].info.dli_fname && !frames[j].symbolized &&
+	 strcmp(frames[j].info.dli_fname, frames[i].info.dli_fname) == 0) {
+	frames[j].symbolized = 1;
+	indices[count++] = j;
+      }
+    }
+    addr2line(frames, indices, count, env);
+  }
+  free(env);
+  free(indices);
+}
+
+/* describe the frame as function (object) file:line, or function+offset
+ * (object) if addr2line did not find its source line
+ */
+static void format_frame(char* str, size_t len, const struct frame* frame) {
+  if(frame->line[0])
+    snprintf(str, len, "%s (%s) %s", frame->function, frame->info.dli_fname, frame->line);
+  else
+    mpii_call_sites_format(str, len, frame->address);
+}
+
+static int compare_duration(const void* a, const void* b) {
+  const struct call_site* sa = a;
+  const struct call_site* sb = b;
+  if(sa->duration == sb->duration) return 0;
+  return sa->duration < sb->duration ? 1 : -1;
+}
+
+void mpii_call_sites_report(void) {
+  double us_per_cycle = mpii_stats_us_per_cycle();
+  double scale = mpii_infos.settings.sample_rate > 1 ? mpii_infos.settings.sample_rate : 1;
+
+  /* merge the tables of all the threads */
+  unsigned capacity = THREAD_TABLE_MIN_SIZE;
+  mpii_thread_list_lock(&threads);
+  for(struct call_sites_thread* t = threads.head; t; t = t->next)
+    capacity += 2 * t->nb_sites;
+  while(capacity & (capacity - 1))
+    capacity++;
+  struct call_site* merged = alloc_sites(capacity);
+  for(struct call_sites_thread* t = threads.head; t; t = t->next) {
+    for(unsigned i = 0; i < t->capacity; i++) {
+      struct call_site* s = &t->sites[i];
+      if(s->function == EMPTY_FUNCTION)
+	continue;
+      struct call_site* m = find_site(merged, capacity, s);
+      if(m->function == EMPTY_FUNCTION) {
+	*m = *s;
+	continue;
+      }
+      m->nb_calls += s->nb_calls;
+      m->duration += s->duration;
+      m->wait += s->wait;
+      m->hold += s->hold;
+      m->bytes += s->bytes;
+    }
+  }
+  mpii_thread_list_unlock(&threads);
+
+  unsigned n = 0;
+  uint64_t total = 0;
+  for(unsigned i = 0; i < capacity; i++) {
+    if(merged[i].function == EMPTY_FUNCTION)
+      continue;
+    merged[n++] = merged[i];
+    total += merged[i].duration;
+  }
+  qsort(merged, n, sizeof(struct call_site), compare_duration);
+
+  char filename[STRING_LENGTH];
+  snprintf(filename, sizeof(filename), "mpii_call_sites.%d.txt", mpii_infos.rank);
+  FILE* f = fopen(filename, "w");
+  if(!f) {
+    fprintf(stderr, "[MPII][P%d] Error: cannot create %s\n", mpii_infos.rank, filename);
+    goto out;
+  }
+  fprintf(f, "# Rank %d: %u call sites, %.1f us spent in MPI", mpii_infos.rank, n,
+	  total * scale * us_per_cycle);
+  if(scale > 1)
+    fprintf(f, " (estimated from 1 out of %.0f calls)", scale);
+  fprintf(f, "\n# %14s %7s %12s %12s %12s %12s %12s  %s\n",
+	  "time(us)", "%", "calls", "mean(us)", "wait(us)", "hold(us)", "bytes", "function");
+
+  /* the return addresses of the reported call sites */
+  unsigned nb_top = n < MPII_CALL_SITES_TOP ? n : MPII_CALL_SITES_TOP;
+  int nb_frames = 0;
+  struct frame* frames = mpii_checked_calloc(nb_top * MPII_CALL_SITES_MAX_DEPTH + 1,
+					     sizeof(struct frame), threads.name);
+  for(unsigned i = 0; i < nb_top; i++) {
+    for(int d = 0; d < merged[i].depth; d++) {
+      struct frame* fr = &frames[nb_frames++];
+      fr->address = merged[i].addresses[d];
+      if(!fr->address || !dladdr(fr->address, &fr->info))
+	fr->info.dli_fname = NULL;
+    }
+  }
+  symbolize(frames, nb_frames);
+
+  nb_frames = 0;
+  for(unsigned i = 0; i < nb_top; i++) {
+    struct call_site* s = &merged[i];
+    fprintf(f, "%16.1f %7.2f %12.0f %12.2f %12.1f %12.1f %12.0f  %s\n",
+	    s->duration * scale * us_per_cycle, total ? 100. * s->duration / total : 0,
+	    s->nb_calls * scale, (double)s->duration / s->nb_calls * us_per_cycle,
+	    s->wait * scale * us_per_cycle, s->hold * scale * us_per_cycle,
+	    s->bytes * scale, mpii_stats_function_name(s->function));
+    for(int d = 0; d < s->depth; d++) {
+      char address[1024];
+      format_frame(address, sizeof(address), &frames[nb_frames++]);
+      fprintf(f, "%18s %s\n", d == 0 ? "called at" : "from", address);
+    }
+  }
+  fclose(f);
+  free(frames);
+
+  if(n > 0) {
+    printf("[MPII][P%d] Call sites: %u call sites, the top %d are written to %s. Top call site: %s (%.1f%% of the time in MPI)\n",
+	   mpii_infos.rank, n, MPII_CALL_SITES_TOP, filename,
+	   mpii_stats_function_name(merged[0].function),
+	   total ? 100. * merged[0].duration / total : 0);
+  }
+ out:
+  free(merged);
+}
@@ -0,0 +1,44 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* maximum number of return addresses that identify a call site */
+#define MPII_CALL_SITES_MAX_DEPTH 8
+
+/* number of call sites written in the report */
+#define MPII_CALL_SITES_TOP 20
+
+/* the current thread calls function from site (the return address of
+ * the MPI function)
+ */
+void mpii_call_sites_enter(int function, void* site);
+
+/* the current thread leaves its MPI function */
+void mpii_call_sites_exit(void);
+
+/* record the size of the message of the current call */
+void mpii_call_sites_args(uint64_t bytes);
+
+/* record that the current thread got the MPI lock after waiting since
+ * wait_start (a mpii_tsc timestamp)
+ */
+void mpii_call_sites_lock_acquired(uint64_t wait_start);
+
+/* record that the current thread released the MPI lock */
+void mpii_call_sites_lock_released(void);
+
+/* describe address as function+offset (object), or object+offset if
+ * the function is not exported (this can be passed to addr2line)
+ */
+void mpii_call_sites_format(char* str, size_t len, const void* address);
+
+/* write the call sites that spend the most time in MPI to
+ * mpii_call_sites.<rank>.txt
+ */
+void mpii_call_sites_report(void);
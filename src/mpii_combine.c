@@ -0,0 +1,136 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Flat combining of the calls that post communications (MPI_Isend,
+ * MPI_Irecv, MPI_Start, ...).
+ *
+ * A thread that finds the MPI lock busy does not wait for it. Instead,
+ * it publishes its call in its own slot. Before releasing the lock,
+ * the lock holder executes all the published calls and writes back
+ * their return value. This way, a burst of posting calls from many
+ * threads is processed during one critical section, instead of
+ * transferring the lock from thread to thread.
+ *
+ * Slots are only accessed by their owner and by the lock holder, so
+ * no other synchronization than the slot state is needed. While its
+ * call is published, a thread waits according to the wait policy of
+ * its MPI function (see mpii_wait.c). The lock holder wakes up the
+ * parked threads once it executed their calls.
+ *
+ * A call executed by the lock holder is accounted to the lock holder
+ * in the lock statistics, the trace and the call sites profile. The
+ * time its owner waited is not recorded as lock wait: if the owner
+ * finally takes the lock itself, its wait is recorded as 0.
+ */
+
+#include "mpii.h"
+#include "mpii_combine.h"
+
+#include <stdatomic.h>
+
+enum slot_state {
+  SLOT_EMPTY,		/* no published call */
+  SLOT_PUBLISHED,	/* a call waits to be executed */
+  SLOT_DONE		/* the call was executed by the lock holder */
+};
+
+struct combine_slot {
+  _Atomic uint32_t state;
+  int (*call)(void* arg);
+  void* arg;
+  int ret;
+} CACHE_ALIGNED;
+
+static struct combine_slot slots[MPII_COMBINE_MAX_THREADS];
+
+/* number of calls waiting in the slots. This saves the lock holder
+ * from scanning the slots when nothing is published
+ */
+static _Atomic int nb_published CACHE_ALIGNED;
+
+void mpii_combine_drain(void) {
+  if(atomic_load_explicit(&nb_published, memory_order_acquire) == 0)
+    return;
+
+  int nb_slots = nb_threads;
+  if(nb_slots > MPII_COMBINE_MAX_THREADS)
+    nb_slots = MPII_COMBINE_MAX_THREADS;
+
+  int nb_executed = 0;
+  for(int i = 0; i < nb_slots; i++) {
+    struct combine_slot* slot = &slots[i];
+    if(atomic_load_explicit(&slot->state, memory_order_acquire) != SLOT_PUBLISHED)
+      continue;
+    slot->ret = slot->call(slot->arg);
+    atomic_fetch_sub_explicit(&nb_published, 1, memory_order_relaxed);
+    atomic_store_explicit(&slot->state, SLOT_DONE, memory_order_release);
+    nb_executed++;
+  }
+  /* wake up the publishers that are parked */
+  if(nb_executed > 0)
+    mpii_wait_notify();
+}
+
+/* publish call in slot, and wait until the lock holder executes it or
+ * until the lock is free. Return 1 if the call was executed by another
+ * thread (its return value is stored in ret). Otherwise, return 0 with
+ * the MPI lock held: the call was not executed.
+ */
+static int publish_and_wait(struct combine_slot* slot,
+			    int (*call)(void* arg), void* arg, int* ret) {
+  slot->call = call;
+  slot->arg = arg;
+  atomic_fetch_add_explicit(&nb_published, 1, memory_order_relaxed);
+  atomic_store_explicit(&slot->state, SLOT_PUBLISHED, memory_order_release);
+
+  struct mpii_wait_state wait_state;
+  mpii_wait_start(&wait_state);
+  while(1) {
+    if(atomic_load_explicit(&slot->state, memory_order_acquire) == SLOT_DONE) {
+      *ret = slot->ret;
+      atomic_store_explicit(&slot->state, SLOT_EMPTY, memory_order_relaxed);
+      return 1;
+    }
+
+    if(mpii_lock_try_acquire()) {
+      /* Only the lock holder executes published calls, so the state
+       * of our slot cannot change while we hold the lock
+       */
+      if(atomic_load_explicit(&slot->state, memory_order_acquire) == SLOT_DONE) {
+	*ret = slot->ret;
+	atomic_store_explicit(&slot->state, SLOT_EMPTY, memory_order_relaxed);
+	mpii_combine_drain();
+	mpii_lock_release();
+	return 1;
+      }
+      /* withdraw the call */
+      atomic_fetch_sub_explicit(&nb_published, 1, memory_order_relaxed);
+      atomic_store_explicit(&slot->state, SLOT_EMPTY, memory_order_relaxed);
+      return 0;
+    }
+
+    mpii_wait_idle(&wait_state);
+  }
+}
+
+int mpii_combine_exec(int (*call)(void* arg), void* arg) {
+  if(!mpii_lock_try_acquire()) {
+    if(thread_rank >= 0 && thread_rank < MPII_COMBINE_MAX_THREADS) {
+      int ret;
+      if(publish_and_wait(&slots[thread_rank], call, arg, &ret))
+	return ret;
+    } else {
+      /* this thread has no slot */
+      mpii_lock_acquire();
+    }
+  }
+
+  int ret = call(arg);
+  mpii_combine_drain();
+  mpii_lock_release();
+  mpii_wait_notify();
+  return ret;
+}
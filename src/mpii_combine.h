@@ -0,0 +1,23 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+/* maximum number of threads that can publish operations. The other
+ * threads take the MPI lock themselves
+ */
+#define MPII_COMBINE_MAX_THREADS 256
+
+/* execute call(arg) while holding the MPI lock. If the lock is busy,
+ * publish the call so that the lock holder executes it on our
+ * behalf. Return the value returned by call.
+ */
+int mpii_combine_exec(int (*call)(void* arg), void* arg);
+
+/* execute the calls published by the other threads. Must be called
+ * while holding the MPI lock, before releasing it
+ */
+void mpii_combine_drain(void);
@@ -0,0 +1,80 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Cache of the communicators rank and size.
+ *
+ * MPI_Comm_rank and MPI_Comm_size are called very often, and calling
+ * them would require to take the MPI lock. Instead, the rank and size
+ * of a communicator are queried once (when the communicator is created,
+ * or the first time they are needed), and stored in a hash table.
+ *
+ * Readers of the hash table (see mpii_table.c) do not take any lock:
+ * a slot is published by writing its value before its key, and the
+ * rank and size are packed in a single word so that they are read
+ * atomically. Writers (ie. communicator creation and destruction) are
+ * serialized by a mutex.
+ */
+
+#include "mpii.h"
+#include "mpii_comm_cache.h"
+#include "mpii_table.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+extern int (*libMPI_Comm_size)(MPI_Comm, int*);
+extern int (*libMPI_Comm_rank)(MPI_Comm, int*);
+
+struct comm_slot {
+  _Atomic uintptr_t key;
+  _Atomic uint64_t value;	/* rank << 32 | size */
+};
+
+static struct comm_slot slots[MPII_COMM_CACHE_SIZE];
+static struct mpii_table table = MPII_TABLE_INITIALIZER(slots, MPII_COMM_CACHE_SIZE);
+
+int mpii_comm_cache_lookup(MPI_Comm comm, int* rank, int* size) {
+  struct comm_slot* slot = mpii_table_find(&table, MPII_TABLE_KEY(comm));
+  if(!slot)
+    return 0;
+  uint64_t value = atomic_load_explicit(&slot->value, memory_order_relaxed);
+  if(rank) *rank = (int)(value >> 32);
+  if(size) *size = (int)(uint32_t)value;
+  return 1;
+}
+
+int mpii_comm_cache_add(MPI_Comm comm) {
+  if(comm == MPI_COMM_NULL)
+    return MPI_SUCCESS;
+
+  int rank, size;
+  int ret = libMPI_Comm_rank(comm, &rank);
+  if(ret != MPI_SUCCESS)
+    return ret;
+  ret = libMPI_Comm_size(comm, &size);
+  if(ret != MPI_SUCCESS)
+    return ret;
+
+  uintptr_t key = MPII_TABLE_KEY(comm);
+  if(!mpii_table_valid_key(key))
+    return MPI_SUCCESS;
+  uint64_t value = ((uint64_t)(uint32_t)rank << 32) | (uint32_t)size;
+
+  mpii_table_lock(&table);
+  int found;
+  struct comm_slot* slot = mpii_table_reserve(&table, key, &found);
+  /* if the cache is full, comm will be queried from MPI */
+  if(slot && !found) {
+    atomic_store_explicit(&slot->value, value, memory_order_relaxed);
+    mpii_table_publish(slot, key);
+  }
+  mpii_table_unlock(&table);
+  return MPI_SUCCESS;
+}
+
+void mpii_comm_cache_remove(MPI_Comm comm) {
+  mpii_table_remove(&table, MPII_TABLE_KEY(comm));
+}
@@ -0,0 +1,28 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <mpi.h>
+
+/* maximum number of communicators in the cache. The other
+ * communicators are queried from MPI
+ */
+#define MPII_COMM_CACHE_SIZE 4096
+
+/* Look up the rank and size of comm. Return 1 if comm is in the
+ * cache, 0 otherwise. This does not take any lock.
+ */
+int mpii_comm_cache_lookup(MPI_Comm comm, int* rank, int* size);
+
+/* query the rank and size of comm from MPI, and add them to the
+ * cache. Must be called while MPI is protected from concurrent calls
+ * (eg. from the call executed by MPII_EXEC)
+ */
+int mpii_comm_cache_add(MPI_Comm comm);
+
+/* remove comm from the cache. Called before comm is freed */
+void mpii_comm_cache_remove(MPI_Comm comm);
@@ -0,0 +1,577 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Communication matrix (MPII_COMM_MATRIX=1).
+ *
+ * The point-to-point functions count the messages and bytes sent to
+ * each destination, and received from each source. Peers are
+ * identified by their rank in MPI_COMM_WORLD: the translation of the
+ * ranks of the other communicators is computed once per communicator,
+ * and cached in a hash table that is read without any lock (see
+ * mpii_table.c).
+ *
+ * Counters are kept in per-thread hash tables keyed by peer, so that
+ * recording a message does not need any synchronization, and the
+ * memory used is proportional to the number of peers. When MPI is
+ * finalized, the tables of the threads are merged, and the non-zero
+ * entries are gathered on rank 0, which writes the matrix.
+ */
+
+#include "mpii.h"
+#include "mpii_comm_matrix.h"
+#include "mpii_table.h"
+#include "mpii_thread_list.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* number of slots of the table of persistent requests */
+#define PERSISTENT_TABLE_SIZE (1 << 14)
+
+/* initial number of entries of the per-thread tables */
+#define THREAD_TABLE_MIN_SIZE 64
+
+/* number of pairs of ranks printed in the report */
+#define NB_TOP_PAIRS 5
+
+/* peer of the messages received from an unknown source */
+#define UNKNOWN_PEER (-1)
+#define EMPTY_PEER INT_MIN
+
+enum counter {
+  SENT_MESSAGES,
+  SENT_BYTES,
+  RECV_MESSAGES,
+  RECV_BYTES,
+  NB_COUNTERS
+};
+
+struct matrix_entry {
+  int32_t peer;
+  int32_t padding;
+  uint64_t counters[NB_COUNTERS];
+};
+
+struct matrix_thread {
+  struct matrix_thread* next;
+  struct matrix_entry* entries;
+  unsigned capacity;		/* a power of 2 */
+  unsigned nb_entries;
+};
+
+static struct mpii_thread_list threads = MPII_THREAD_LIST_INITIALIZER("the communication matrix");
+
+static __thread struct matrix_thread* my_thread = NULL;
+
+/* ranks in MPI_COMM_WORLD of the ranks of a communicator */
+struct comm_ranks {
+  struct comm_ranks* next_retired;
+  int size;
+  int world_ranks[];		/* -1 if the rank is not in MPI_COMM_WORLD */
+};
+
+struct comm_slot {
+  _Atomic uintptr_t key;
+  struct comm_ranks* _Atomic ranks;
+};
+
+static struct comm_slot comm_slots[MPII_COMM_MATRIX_CACHE_SIZE];
+static struct mpii_table comm_table = MPII_TABLE_INITIALIZER(comm_slots, MPII_COMM_MATRIX_CACHE_SIZE);
+/* translations of the communicators that were freed. They are released
+ * when MPI is finalized, since another thread may still be reading
+ * them. Protected by the writer lock of comm_table
+ */
+static struct comm_ranks* retired_ranks = NULL;
+
+/* the message of a persistent request */
+struct persistent_info {
+  int send;
+  int peer;			/* in MPI_COMM_WORLD */
+  /* the size is computed when the request is created, since the
+   * datatype may be freed before the request is started
+   */
+  uint64_t bytes;
+};
+
+struct persistent_slot {
+  _Atomic uintptr_t key;
+  struct persistent_info* _Atomic info;
+};
+
+static struct persistent_slot persistent_slots[PERSISTENT_TABLE_SIZE];
+static struct mpii_table persistent_table = MPII_TABLE_INITIALIZER(persistent_slots, PERSISTENT_TABLE_SIZE);
+
+static struct matrix_thread* get_thread(void) {
+  if(!my_thread) {
+    struct matrix_thread* t = mpii_thread_list_alloc(&threads, sizeof(struct matrix_thread));
+    t->capacity = THREAD_TABLE_MIN_SIZE;
+    t->entries = mpii_checked_calloc(t->capacity, sizeof(struct matrix_entry), threads.name);
+    for(unsigned i = 0; i < t->capacity; i++)
+      t->entries[i].peer = EMPTY_PEER;
+    mpii_thread_list_add(&threads, t);
+    my_thread = t;
+  }
+  return my_thread;
+}
+
+static struct matrix_entry* find_entry(struct matrix_entry* entries, unsigned capacity, int peer) {
+  unsigned index = mpii_hash((uint32_t)peer, capacity);
+  while(entries[index].peer != peer && entries[index].peer != EMPTY_PEER)
+    index = (index + 1) & (capacity - 1);
+  return &entries[index];
+}
+
+/* return the counters of the messages exchanged with peer */
+static uint64_t* get_counters(int peer) {
+  struct matrix_thread* t = get_thread();
+  struct matrix_entry* entry = find_entry(t->entries, t->capacity, peer);
+  if(entry->peer == peer)
+    return entry->counters;
+
+  if(2 * (t->nb_entries + 1) > t->capacity) {
+    /* keep the table half empty */
+    unsigned capacity = 2 * t->capacity;
+    struct matrix_entry* entries = mpii_checked_calloc(capacity, sizeof(struct matrix_entry),
+						       threads.name);
+    for(unsigned i = 0; i < capacity; i++)
+      entries[i].peer = EMPTY_PEER;
+    for(unsigned i = 0; i < t->capacity; i++)
+      if(t->entries[i].peer != EMPTY_PEER)
+	*find_entry(entries, capacity, t->entries[i].peer) = t->entries[i];
+    free(t->entries);
+    t->entries = entries;
+    t->capacity = capacity;
+    entry = find_entry(t->entries, t->capacity, peer);
+  }
+  entry->peer = peer;
+  t->nb_entries++;
+  return entry->counters;
+}
+
+struct translate_args {
+  MPI_Comm comm;
+  struct comm_ranks* ranks;
+};
+
+/* compute the translation of the ranks of a->comm. Called with MPI
+ * protected from concurrent calls
+ */
+static int translate_call(void* arg) {
+  struct translate_args* a = arg;
+  int inter = 0;
+  MPI_Group group, world_group;
+  MPI_Comm_test_inter(a->comm, &inter);
+  /* the peers of an intercommunicator are in its remote group */
+  int ret = inter ? MPI_Comm_remote_group(a->comm, &group) : MPI_Comm_group(a->comm, &group);
+  if(ret != MPI_SUCCESS)
+    return ret;
+  MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+
+  int size;
+  MPI_Group_size(group, &size);
+  a->ranks = mpii_checked_calloc(1, sizeof(struct comm_ranks) + size * sizeof(int), threads.name);
+  a->ranks->size = size;
+  int* ranks = mpii_checked_calloc(size, sizeof(int), threads.name);
+  for(int i = 0; i < size; i++)
+    ranks[i] = i;
+  MPI_Group_translate_ranks(group, size, ranks, world_group, a->ranks->world_ranks);
+  for(int i = 0; i < size; i++)
+    if(a->ranks->world_ranks[i] == MPI_UNDEFINED)
+      a->ranks->world_ranks[i] = -1;
+  free(ranks);
+
+  MPI_Group_free(&world_group);
+  MPI_Group_free(&group);
+  return MPI_SUCCESS;
+}
+
+static struct comm_ranks* lookup_comm(uintptr_t key) {
+  struct comm_slot* slot = mpii_table_find(&comm_table, key);
+  return slot ? atomic_load_explicit(&slot->ranks, memory_order_relaxed) : NULL;
+}
+
+/* add the translation of the ranks of comm to the cache. Return 0 if
+ * the cache is full
+ */
+static int add_comm(uintptr_t key, struct comm_ranks* ranks) {
+  int found;
+  mpii_table_lock(&comm_table);
+  struct comm_slot* slot = mpii_table_reserve(&comm_table, key, &found);
+  if(slot && found) {
+    /* another thread added it */
+    ranks->next_retired = retired_ranks;
+    retired_ranks = ranks;
+  } else if(slot) {
+    atomic_store_explicit(&slot->ranks, ranks, memory_order_relaxed);
+    mpii_table_publish(slot, key);
+  }
+  mpii_table_unlock(&comm_table);
+  return slot != NULL;
+}
+
+void mpii_comm_matrix_remove_comm(MPI_Comm comm) {
+  uintptr_t key = MPII_TABLE_KEY(comm);
+  mpii_table_lock(&comm_table);
+  struct comm_slot* slot = mpii_table_find(&comm_table, key);
+  if(slot) {
+    struct comm_ranks* ranks = atomic_load_explicit(&slot->ranks, memory_order_relaxed);
+    ranks->next_retired = retired_ranks;
+    retired_ranks = ranks;
+    mpii_table_clear(slot);
+  }
+  mpii_table_unlock(&comm_table);
+}
+
+/* return the rank in MPI_COMM_WORLD of rank of comm, or -1 if it is unknown */
+static int world_rank(int rank, MPI_Comm comm) {
+  if(rank < 0)
+    return -1;
+  if(comm == MPI_COMM_WORLD)
+    return rank < mpii_infos.size ? rank : -1;
+
+  uintptr_t key = MPII_TABLE_KEY(comm);
+  struct comm_ranks* ranks = lookup_comm(key);
+  int cached = 1;
+  if(!ranks) {
+    struct translate_args args = { comm, NULL };
+    if(MPII_EXEC(translate_call, &args) != MPI_SUCCESS || !args.ranks)
+      return -1;
+    ranks = args.ranks;
+    cached = add_comm(key, ranks);
+  }
+  int result = rank < ranks->size ? ranks->world_ranks[rank] : -1;
+  if(!cached)
+    free(ranks);
+  return result;
+}
+
+static uint64_t message_size(int count, MPI_Datatype datatype) {
+  struct mpii_type_info info;
+  if(count <= 0 || mpii_type_info(datatype, &info) != MPI_SUCCESS)
+    return 0;
+  return (uint64_t)count * info.size;
+}
+
+static void record_send(int peer, uint64_t bytes) {
+  uint64_t* counters = get_counters(peer);
+  counters[SENT_MESSAGES]++;
+  counters[SENT_BYTES] += bytes;
+}
+
+static void record_recv(int peer, uint64_t bytes) {
+  uint64_t* counters = get_counters(peer);
+  counters[RECV_MESSAGES]++;
+  counters[RECV_BYTES] += bytes;
+}
+
+void mpii_comm_matrix_send(int dest, MPI_Comm comm, int count, MPI_Datatype datatype) {
+  /* only record the messages of the function called by the application */
+  if(recursion_shield != 1 || dest == MPI_PROC_NULL)
+    return;
+  record_send(world_rank(dest, comm), message_size(count, datatype));
+}
+
+void mpii_comm_matrix_recv(int source, MPI_Comm comm, int count, MPI_Datatype datatype) {
+  if(recursion_shield != 1 || source == MPI_PROC_NULL)
+    return;
+  record_recv(world_rank(source, comm), message_size(count, datatype));
+}
+
+void mpii_comm_matrix_recv_status(int source, MPI_Comm comm, const MPI_Status* status) {
+  if(source == MPI_ANY_SOURCE)
+    source = status->MPI_SOURCE;
+  if(recursion_shield != 1 || source == MPI_PROC_NULL)
+    return;
+  /* the message may be shorter than the receive buffer */
+  int bytes;
+  if(MPI_Get_count(status, MPI_BYTE, &bytes) != MPI_SUCCESS || bytes == MPI_UNDEFINED)
+    return;
+  record_recv(world_rank(source, comm), bytes);
+}
+
+void mpii_comm_matrix_init_persistent(MPI_Request req, int send, int peer, MPI_Comm comm,
+				      int count, MPI_Datatype datatype) {
+  if(peer == MPI_PROC_NULL)
+    return;
+  struct persistent_info* info = mpii_checked_calloc(1, sizeof(struct persistent_info),
+						     threads.name);
+  info->send = send;
+  info->peer = world_rank(peer, comm);
+  info->bytes = message_size(count, datatype);
+
+  uintptr_t key = MPII_TABLE_KEY(req);
+  int found;
+  mpii_table_lock(&persistent_table);
+  struct persistent_slot* slot = mpii_table_reserve(&persistent_table, key, &found);
+  if(slot) {
+    /* the handle may have been reused without mpii_comm_matrix_free */
+    struct persistent_info* old = NULL;
+    if(found)
+      old = atomic_load_explicit(&slot->info, memory_order_relaxed);
+    atomic_store_explicit(&slot->info, info, memory_order_relaxed);
+    mpii_table_publish(slot, key);
+    info = old;
+  }
+  mpii_table_unlock(&persistent_table);
+  /* if the table is full, the messages of req are not recorded */
+  free(info);
+}
+
+void mpii_comm_matrix_start(MPI_Request req) {
+  if(recursion_shield != 1)
+    return;
+  struct persistent_slot* slot = mpii_table_find(&persistent_table, MPII_TABLE_KEY(req));
+  if(!slot)
+    return;
+  struct persistent_info* info = atomic_load_explicit(&slot->info, memory_order_relaxed);
+  if(info->send)
+    record_send(info->peer, info->bytes);
+  else
+    record_recv(info->peer, info->bytes);
+}
+
+void mpii_comm_matrix_free(MPI_Request req) {
+  mpii_table_lock(&persistent_table);
+  struct persistent_slot* slot = mpii_table_find(&persistent_table, MPII_TABLE_KEY(req));
+  if(slot) {
+    free(atomic_load_explicit(&slot->info, memory_order_relaxed));
+    mpii_table_clear(slot);
+  }
+  mpii_table_unlock(&persistent_table);
+}
+
+/* write size bytes at offset of fd. Return -1 on error */
+static int write_at(int fd, const void* buf, size_t size, off_t offset) {
+  const char* p = buf;
+  while(size > 0) {
+    ssize_t n = pwrite(fd, p, size, offset);
+    if(n < 0) {
+      if(errno == EINTR)
+	continue;
+      return -1;
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+static int write_binary(const char* filename, int size,
+			const struct matrix_entry* entries, const int* nb_entries) {
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+    return -1;
+  struct mpii_comm_matrix_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MPII_COMM_MATRIX_MAGIC, sizeof(header.magic));
+  header.version = MPII_COMM_MATRIX_VERSION;
+  header.size = size;
+
+  /* the file is created empty, only the non-zero entries are written */
+  off_t matrix_size = (off_t)size * size * sizeof(uint64_t);
+  if(ftruncate(fd, sizeof(header) + NB_COUNTERS * matrix_size) < 0 ||
+     write_at(fd, &header, sizeof(header), 0) < 0)
+    goto error;
+  const struct matrix_entry* e = entries;
+  for(int rank = 0; rank < size; rank++) {
+    for(int i = 0; i < nb_entries[rank]; i++, e++) {
+      if(e->peer < 0)
+	continue;
+      for(int c = 0; c < NB_COUNTERS; c++) {
+	if(!e->counters[c])
+	  continue;
+	/* entry [i][j] describes the messages from i to j */
+	int sent = c == SENT_MESSAGES || c == SENT_BYTES;
+	int src = sent ? rank : e->peer;
+	int dst = sent ? e->peer : rank;
+	off_t offset = sizeof(header) + c * matrix_size +
+	  ((off_t)src * size + dst) * sizeof(uint64_t);
+	if(write_at(fd, &e->counters[c], sizeof(uint64_t), offset) < 0)
+	  goto error;
+      }
+    }
+  }
+  return close(fd);
+ error:
+  close(fd);
+  return -1;
+}
+
+static int write_csv(const char* filename, int size, enum counter counter,
+		     const struct matrix_entry* entries, const int* nb_entries) {
+  FILE* f = fopen(filename, "w");
+  if(!f)
+    return -1;
+  uint64_t* row = mpii_checked_calloc(size, sizeof(uint64_t), threads.name);
+  const struct matrix_entry* e = entries;
+  for(int rank = 0; rank < size; rank++) {
+    memset(row, 0, size * sizeof(uint64_t));
+    for(int i = 0; i < nb_entries[rank]; i++, e++)
+      if(e->peer >= 0)
+	row[e->peer] = e->counters[counter];
+    for(int j = 0; j < size; j++)
+      fprintf(f, j ? ",%" PRIu64 : "%" PRIu64, row[j]);
+    fprintf(f, "\n");
+  }
+  free(row);
+  return fclose(f);
+}
+
+/* print the totals, the imbalance and the busiest pairs of ranks */
+static void print_summary(int size, const struct matrix_entry* entries, const int* nb_entries) {
+  struct {
+    int src, dst;
+    uint64_t messages, bytes;
+  } top[NB_TOP_PAIRS];
+  int nb_top = 0;
+  uint64_t total_messages = 0, total_bytes = 0, unknown = 0;
+  uint64_t max_bytes = 0;
+  int max_rank = 0;
+
+  const struct matrix_entry* e = entries;
+  for(int rank = 0; rank < size; rank++) {
+    uint64_t rank_bytes = 0;
+    for(int i = 0; i < nb_entries[rank]; i++, e++) {
+      if(e->peer < 0) {
+	unknown += e->counters[RECV_MESSAGES];
+	continue;
+      }
+      total_messages += e->counters[SENT_MESSAGES];
+      total_bytes += e->counters[SENT_BYTES];
+      rank_bytes += e->counters[SENT_BYTES];
+      if(!e->counters[SENT_MESSAGES])
+	continue;
+      /* insert the pair in the sorted list of the busiest pairs */
+      int pos = nb_top < NB_TOP_PAIRS ? nb_top++ : NB_TOP_PAIRS;
+      while(pos > 0 && top[pos - 1].bytes < e->counters[SENT_BYTES]) {
+	if(pos < NB_TOP_PAIRS)
+	  top[pos] = top[pos - 1];
+	pos--;
+      }
+      if(pos < NB_TOP_PAIRS) {
+	top[pos].src = rank;
+	top[pos].dst = e->peer;
+	top[pos].messages = e->counters[SENT_MESSAGES];
+	top[pos].bytes = e->counters[SENT_BYTES];
+      }
+    }
+    if(rank_bytes > max_bytes) {
+      max_bytes = rank_bytes;
+      max_rank = rank;
+    }
+  }
+
+  double mean_bytes = (double)total_bytes / size;
+  printf("[MPII][P0] Communication matrix: %" PRIu64 " messages, %" PRIu64 " bytes sent between %d ranks\n",
+	 total_messages, total_bytes, size);
+  printf("[MPII][P0] Bytes sent per rank: mean %.0f, max %" PRIu64 " (rank %d), imbalance %.2f\n",
+	 mean_bytes, max_bytes, max_rank, mean_bytes > 0 ? max_bytes / mean_bytes : 0.);
+  for(int i = 0; i < nb_top; i++)
+    printf("[MPII][P0]   %d -> %d: %" PRIu64 " messages, %" PRIu64 " bytes\n",
+	   top[i].src, top[i].dst, top[i].messages, top[i].bytes);
+  if(unknown)
+    printf("[MPII][P0] %" PRIu64 " messages were received from an unknown source\n", unknown);
+}
+
+void mpii_comm_matrix_report(void) {
+  int size = mpii_infos.size;
+
+  /* merge the tables of the threads. Entry 0 is the unknown peer */
+  uint64_t (*merged)[NB_COUNTERS] = mpii_checked_calloc(size + 1, sizeof(*merged), threads.name);
+  mpii_thread_list_lock(&threads);
+  for(struct matrix_thread* t = threads.head; t; t = t->next) {
+    for(unsigned i = 0; i < t->capacity; i++) {
+      struct matrix_entry* e = &t->entries[i];
+      if(e->peer == EMPTY_PEER)
+	continue;
+      int index = e->peer >= 0 && e->peer < size ? e->peer + 1 : 0;
+      for(int c = 0; c < NB_COUNTERS; c++)
+	merged[index][c] += e->counters[c];
+    }
+  }
+  mpii_thread_list_unlock(&threads);
+
+  int nb_entries = 0;
+  for(int i = 0; i <= size; i++)
+    for(int c = 0; c < NB_COUNTERS; c++)
+      if(merged[i][c]) {
+	nb_entries++;
+	break;
+      }
+  struct matrix_entry* entries = mpii_checked_calloc(nb_entries + 1, sizeof(struct matrix_entry),
+						     threads.name);
+  int n = 0;
+  for(int i = 0; i <= size; i++) {
+    int used = 0;
+    for(int c = 0; c < NB_COUNTERS; c++)
+      used |= merged[i][c] != 0;
+    if(!used)
+      continue;
+    entries[n].peer = i == 0 ? UNKNOWN_PEER : i - 1;
+    memcpy(entries[n].counters, merged[i], sizeof(merged[i]));
+    n++;
+  }
+  free(merged);
+
+  /* gather the non-zero entries on rank 0 */
+  int* all_nb_entries = NULL;
+  int* bytes = NULL;
+  int* displs = NULL;
+  struct matrix_entry* all_entries = NULL;
+  if(mpii_infos.rank == 0) {
+    all_nb_entries = mpii_checked_calloc(size, sizeof(int), threads.name);
+    bytes = mpii_checked_calloc(size, sizeof(int), threads.name);
+    displs = mpii_checked_calloc(size, sizeof(int), threads.name);
+  }
+  MPI_Gather(&nb_entries, 1, MPI_INT, all_nb_entries, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  size_t total = 0;
+  if(mpii_infos.rank == 0) {
+    for(int i = 0; i < size; i++) {
+      displs[i] = total * sizeof(struct matrix_entry);
+      bytes[i] = all_nb_entries[i] * sizeof(struct matrix_entry);
+      total += all_nb_entries[i];
+    }
+    all_entries = mpii_checked_calloc(total + 1, sizeof(struct matrix_entry), threads.name);
+  }
+  MPI_Gatherv(entries, nb_entries * sizeof(struct matrix_entry), MPI_BYTE,
+	      all_entries, bytes, displs, MPI_BYTE, 0, MPI_COMM_WORLD);
+  free(entries);
+
+  if(mpii_infos.rank == 0) {
+    const char* files[] = { "mpii_comm_matrix_messages.csv", "mpii_comm_matrix_bytes.csv",
+			    "mpii_comm_matrix.bin" };
+    if(write_csv(files[0], size, SENT_MESSAGES, all_entries, all_nb_entries) != 0 ||
+       write_csv(files[1], size, SENT_BYTES, all_entries, all_nb_entries) != 0 ||
+       write_binary(files[2], size, all_entries, all_nb_entries) != 0)
+      fprintf(stderr, "[MPII][P0] Error: cannot write the communication matrix: %s\n",
+	      strerror(errno));
+    else
+      printf("[MPII][P0] Communication matrix written to %s, %s and %s\n",
+	     files[0], files[1], files[2]);
+    print_summary(size, all_entries, all_nb_entries);
+    free(all_entries);
+    free(all_nb_entries);
+    free(bytes);
+    free(displs);
+  }
+
+  mpii_table_lock(&comm_table);
+  while(retired_ranks) {
+    struct comm_ranks* next = retired_ranks->next_retired;
+    free(retired_ranks);
+    retired_ranks = next;
+  }
+  mpii_table_unlock(&comm_table);
+}
@@ -0,0 +1,82 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <mpi.h>
+#include <stdint.h>
+
+/* Format of the binary matrix written by rank 0 (mpii_comm_matrix.bin):
+ *
+ *   struct mpii_comm_matrix_header
+ *   4 matrices of size * size uint64_t, in row-major order. Entry
+ *   [i][j] of each matrix describes the messages from rank i to rank j
+ *   of MPI_COMM_WORLD:
+ *     - number of messages sent (counted by i)
+ *     - number of bytes sent (counted by i)
+ *     - number of messages received (counted by j)
+ *     - number of bytes received (counted by j: size of the receive buffers)
+ */
+#define MPII_COMM_MATRIX_MAGIC "MPIICMX"
+#define MPII_COMM_MATRIX_VERSION 1
+
+struct mpii_comm_matrix_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t size;		/* number of ranks */
+};
+
+/* maximum number of communicators whose ranks translation is cached */
+#define MPII_COMM_MATRIX_CACHE_SIZE 4096
+
+/* record a message sent by the current thread to rank dest of comm */
+void mpii_comm_matrix_send(int dest, MPI_Comm comm, int count, MPI_Datatype datatype);
+
+/* record a message received by the current thread from rank source of
+ * comm. source may be MPI_ANY_SOURCE if it is not known yet
+ */
+void mpii_comm_matrix_recv(int source, MPI_Comm comm, int count, MPI_Datatype datatype);
+
+/* record the message received by the current thread from rank source of
+ * comm, described by status. source may be MPI_ANY_SOURCE
+ */
+void mpii_comm_matrix_recv_status(int source, MPI_Comm comm, const MPI_Status* status);
+
+/* record the persistent request req created by MPI_*_init, so that
+ * the message can be accounted when req is started
+ */
+void mpii_comm_matrix_init_persistent(MPI_Request req, int send, int peer, MPI_Comm comm,
+				      int count, MPI_Datatype datatype);
+
+/* record the message of the persistent request req */
+void mpii_comm_matrix_start(MPI_Request req);
+
+/* forget the persistent request req. Called when req is freed */
+void mpii_comm_matrix_free(MPI_Request req);
+
+/* forget the ranks of comm. Called before comm is freed */
+void mpii_comm_matrix_remove_comm(MPI_Comm comm);
+
+/* reduce the matrix to rank 0, which writes it. Collective over
+ * MPI_COMM_WORLD, called when MPI is finalized
+ */
+void mpii_comm_matrix_report(void);
+
+/* record a message sent or received by a point-to-point function */
+#define MPII_COMM_MATRIX_SEND(dest, comm, count, datatype) do {		\
+    if(mpii_infos.settings.comm_matrix)					\
+      mpii_comm_matrix_send(dest, comm, count, datatype);		\
+  } while(0)
+
+#define MPII_COMM_MATRIX_RECV(source, comm, count, datatype) do {	\
+    if(mpii_infos.settings.comm_matrix)					\
+      mpii_comm_matrix_recv(source, comm, count, datatype);		\
+  } while(0)
+
+#define MPII_COMM_MATRIX_RECV_STATUS(source, comm, status) do {		\
+    if(mpii_infos.settings.comm_matrix)					\
+      mpii_comm_matrix_recv_status(source, comm, status);		\
+  } while(0)
@@ -0,0 +1,274 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Completion engine for the blocking calls (MPI_Wait, MPI_Waitall,
+ * MPI_Probe, ...) when MPII_COMPLETION_ENGINE=1.
+ *
+ * Instead of having each waiting thread poll MPI (and take the MPI
+ * lock at each iteration), waiting threads register their operation
+ * in a registry and park on a futex. One of them is elected as the
+ * poller: it takes the MPI lock once per round and, during this
+ * critical section:
+ * - tests all the single requests (MPI_Wait) with one MPI_Testsome;
+ * - calls the test function of the other operations (eg. MPI_Testall
+ *   for MPI_Waitall).
+ * It then wakes up the threads whose operation completed. When its own
+ * operation completes, the poller hands over its role to another
+ * waiting thread.
+ */
+
+#include "mpii.h"
+#include "mpii_completion.h"
+#include "mpii_combine.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+enum waiter_state {
+  WAITER_WAITING,	/* the operation is not completed */
+  WAITER_PARKED,	/* the operation is not completed, and the thread is parked */
+  WAITER_POLL,		/* the thread is asked to become the poller */
+  WAITER_DONE		/* the operation is completed */
+};
+
+/* A thread waiting for an operation. Waiters are allocated on the stack
+ * of the waiting thread.
+ */
+struct mpii_waiter {
+  struct mpii_waiter* prev;
+  struct mpii_waiter* next;
+  MPI_Request* req;		/* single request to wait for, or NULL */
+  MPI_Status* status;
+  int (*test)(void* arg, int* flag); /* test function if req is NULL */
+  void* arg;
+  int ret;
+  _Atomic uint32_t state;
+};
+
+/* registered waiters. Waiters are only removed by the poller, once
+ * their operation is completed
+ */
+static struct {
+  pthread_mutex_t lock;
+  struct mpii_waiter* head;
+} registry CACHE_ALIGNED = { PTHREAD_MUTEX_INITIALIZER, NULL };
+
+/* set when a thread is polling for the registered waiters */
+static _Atomic int poller_active CACHE_ALIGNED;
+
+/* arrays used by the poller for calling MPI_Testsome. They are only
+ * accessed by the poller, while holding the registry lock
+ */
+static struct {
+  MPI_Request* reqs;
+  MPI_Status* statuses;
+  int* indices;
+  struct mpii_waiter** waiters;
+  int size;
+} poll_buffers;
+
+/* number of times a waiter checks its state before parking */
+#define SPINS_BEFORE_PARKING 128
+
+static void registry_add(struct mpii_waiter* w) {
+  pthread_mutex_lock(&registry.lock);
+  w->prev = NULL;
+  w->next = registry.head;
+  if(registry.head)
+    registry.head->prev = w;
+  registry.head = w;
+  pthread_mutex_unlock(&registry.lock);
+}
+
+/* must be called while holding the registry lock */
+static void registry_remove(struct mpii_waiter* w) {
+  if(w->prev)
+    w->prev->next = w->next;
+  else
+    registry.head = w->next;
+  if(w->next)
+    w->next->prev = w->prev;
+}
+
+/* remove w from the registry and wake up its thread. Must be called by
+ * the poller while holding the registry lock
+ */
+static void waiter_complete(struct mpii_waiter* w, int ret) {
+  registry_remove(w);
+  w->ret = ret;
+  if(atomic_exchange_explicit(&w->state, WAITER_DONE, memory_order_release) == WAITER_PARKED)
+    mpii_futex_wake(&w->state, 1);
+}
+
+static void poll_buffers_reserve(int size) {
+  if(size <= poll_buffers.size)
+    return;
+  int new_size = poll_buffers.size ? poll_buffers.size : 16;
+  while(new_size < size)
+    new_size *= 2;
+  poll_buffers.reqs = realloc(poll_buffers.reqs, new_size * sizeof(MPI_Request));
+  poll_buffers.statuses = realloc(poll_buffers.statuses, new_size * sizeof(MPI_Status));
+  poll_buffers.indices = realloc(poll_buffers.indices, new_size * sizeof(int));
+  poll_buffers.waiters = realloc(poll_buffers.waiters, new_size * sizeof(struct mpii_waiter*));
+  if(!poll_buffers.reqs || !poll_buffers.statuses ||
+     !poll_buffers.indices || !poll_buffers.waiters) {
+    fprintf(stderr, "[MPII] Error: cannot allocate memory for the completion engine\n");
+    abort();
+  }
+  poll_buffers.size = new_size;
+}
+
+/* test all the registered operations during one critical
+ * section. Return the number of completed operations
+ */
+static int poll_round(void) {
+  int nb_completed = 0;
+
+  LOCK();
+  pthread_mutex_lock(&registry.lock);
+
+  /* test all the single requests at once */
+  int nb_reqs = 0;
+  for(struct mpii_waiter* w = registry.head; w; w = w->next) {
+    if(w->req) {
+      poll_buffers_reserve(nb_reqs + 1);
+      poll_buffers.reqs[nb_reqs] = *w->req;
+      poll_buffers.waiters[nb_reqs] = w;
+      nb_reqs++;
+    }
+  }
+
+  if(nb_reqs > 0) {
+    int outcount = 0;
+    int ret = libMPI_Testsome(nb_reqs, poll_buffers.reqs, &outcount,
+			      poll_buffers.indices, poll_buffers.statuses);
+    if(outcount == MPI_UNDEFINED) {
+      /* none of the requests is active. Let MPI_Test set their status */
+      for(int i = 0; i < nb_reqs; i++) {
+	struct mpii_waiter* w = poll_buffers.waiters[i];
+	int flag;
+	waiter_complete(w, libMPI_Test(w->req, &flag, w->status));
+	nb_completed++;
+      }
+    } else if(ret != MPI_SUCCESS && ret != MPI_ERR_IN_STATUS) {
+      for(int i = 0; i < nb_reqs; i++) {
+	waiter_complete(poll_buffers.waiters[i], ret);
+	nb_completed++;
+      }
+    } else {
+      for(int i = 0; i < outcount; i++) {
+	int index = poll_buffers.indices[i];
+	struct mpii_waiter* w = poll_buffers.waiters[index];
+	/* the request may have been freed or deactivated by MPI_Testsome.
+	 * statuses are in the same order as indices
+	 */
+	*w->req = poll_buffers.reqs[index];
+	*w->status = poll_buffers.statuses[i];
+	waiter_complete(w, ret == MPI_ERR_IN_STATUS ?
+			poll_buffers.statuses[i].MPI_ERROR : MPI_SUCCESS);
+	nb_completed++;
+      }
+    }
+  }
+
+  /* test the other operations */
+  struct mpii_waiter* next;
+  for(struct mpii_waiter* w = registry.head; w; w = next) {
+    next = w->next;
+    if(w->req)
+      continue;
+    int flag = 0;
+    int ret = w->test(w->arg, &flag);
+    if(flag || ret != MPI_SUCCESS) {
+      waiter_complete(w, ret);
+      nb_completed++;
+    }
+  }
+
+  pthread_mutex_unlock(&registry.lock);
+  mpii_combine_drain();
+  UNLOCK();
+  if(nb_completed > 0)
+    mpii_wait_notify();
+  return nb_completed;
+}
+
+/* poll for all the registered waiters until self is completed, and
+ * hand over the poller role to another waiter
+ */
+static void poll_until(struct mpii_waiter* self) {
+  struct mpii_wait_state wait_state;
+  mpii_wait_start(&wait_state);
+  while(atomic_load_explicit(&self->state, memory_order_acquire) != WAITER_DONE) {
+    if(poll_round() > 0)
+      mpii_wait_start(&wait_state);
+    else
+      mpii_wait_idle(&wait_state);
+  }
+
+  atomic_store(&poller_active, 0);
+
+  /* A waiter that failed to become the poller before we cleared
+   * poller_active is already in the registry: ask one of them to poll
+   */
+  pthread_mutex_lock(&registry.lock);
+  for(struct mpii_waiter* w = registry.head; w; w = w->next) {
+    uint32_t state = atomic_load(&w->state);
+    if((state == WAITER_WAITING || state == WAITER_PARKED) &&
+       atomic_compare_exchange_strong(&w->state, &state, WAITER_POLL)) {
+      if(state == WAITER_PARKED)
+	mpii_futex_wake(&w->state, 1);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&registry.lock);
+}
+
+int mpii_completion_wait(MPI_Request* req, MPI_Status* status,
+			 int (*test)(void* arg, int* flag), void* arg) {
+  /* the operation may already be completed */
+  int flag = 0;
+  LOCK();
+  int ret = req ? libMPI_Test(req, &flag, status) : test(arg, &flag);
+  mpii_combine_drain();
+  UNLOCK();
+  if(flag || ret != MPI_SUCCESS)
+    return ret;
+
+  struct mpii_waiter w = { .req = req, .status = status, .test = test, .arg = arg };
+  atomic_store(&w.state, WAITER_WAITING);
+  registry_add(&w);
+
+  uint32_t spins = 0;
+  while(1) {
+    uint32_t state = atomic_load_explicit(&w.state, memory_order_acquire);
+    if(state == WAITER_DONE)
+      return w.ret;
+
+    if(state == WAITER_POLL &&
+       !atomic_compare_exchange_strong(&w.state, &state, WAITER_WAITING))
+      continue;
+
+    int expected = 0;
+    if(atomic_compare_exchange_strong(&poller_active, &expected, 1)) {
+      poll_until(&w);
+      return w.ret;
+    }
+
+    if(++spins < SPINS_BEFORE_PARKING) {
+      mpii_cpu_relax();
+      continue;
+    }
+
+    /* another thread is polling: park until it completes our operation,
+     * or until it asks us to become the poller
+     */
+    state = WAITER_WAITING;
+    if(atomic_compare_exchange_strong(&w.state, &state, WAITER_PARKED) ||
+       state == WAITER_PARKED)
+      mpii_futex_wait(&w.state, WAITER_PARKED);
+  }
+}
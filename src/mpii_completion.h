@@ -0,0 +1,17 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <mpi.h>
+
+/* Block until a blocking operation completes, using the completion
+ * engine. The operation is either a single request (req, status), or
+ * a call to test(arg, &flag) that sets flag once the operation is
+ * completed (req is NULL). Return the MPI error code of the operation.
+ */
+int mpii_completion_wait(MPI_Request* req, MPI_Status* status,
+			 int (*test)(void* arg, int* flag), void* arg);
@@ -0,0 +1,224 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Concurrency checker (MPII_CHECK_CONCURRENCY=1).
+ *
+ * Each thread owns a slot that holds the MPI function it is calling
+ * (if any) and its call site. When entering an MPI function, a thread
+ * publishes its slot, and then looks at the slots of the other
+ * threads: since both accesses are sequentially consistent, when two
+ * calls overlap, at least one of the two threads sees the other one.
+ * A thread only writes its own slot, so checking a call does not
+ * modify any shared cache line as long as there is no conflict.
+ *
+ * Each conflict is accounted in a table indexed by the pair (function
+ * being called, function already running), that also keeps the call
+ * sites of the first occurrence. The table is printed when MPI is
+ * finalized.
+ */
+
+#define _GNU_SOURCE
+#include "mpii.h"
+#include "mpii_concurrency.h"
+#include "mpii_lock.h"
+#include "mpii_table.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SLOT_IDLE 0
+
+struct thread_slot {
+  _Atomic int function;		/* function id + 1, or SLOT_IDLE */
+  _Atomic(const void*) site;
+} CACHE_ALIGNED;
+
+static struct thread_slot thread_slots[MPII_CONCURRENCY_MAX_THREADS];
+/* number of slots used so far */
+static _Atomic int nb_slots = 0;
+/* number of calls that were not checked because there are too many threads */
+static _Atomic uint64_t nb_unchecked = 0;
+
+#define KEY_EMPTY 0
+
+struct conflict {
+  _Atomic uint32_t key;		/* (function << 16 | other_function) + 1 */
+  _Atomic uint64_t count;
+  _Atomic int max_level;
+  /* call sites of the first occurrence */
+  const void* site;
+  const void* other_site;
+};
+
+static struct conflict conflicts[MPII_CONCURRENCY_MAX_CONFLICTS];
+static pthread_mutex_t conflicts_lock = PTHREAD_MUTEX_INITIALIZER;
+/* number of conflicts that do not fit in the table */
+static _Atomic uint64_t nb_lost_conflicts = 0;
+
+static uint32_t conflict_key(int function, int other_function) {
+  return (((uint32_t)function << 16) | (uint32_t)other_function) + 1;
+}
+
+/* return the entry of the pair (function, other_function), or NULL if the table is full */
+static struct conflict* get_conflict(int function, const void* site,
+				     int other_function, const void* other_site, int* first) {
+  uint32_t key = conflict_key(function, other_function);
+  unsigned index = mpii_hash(key, MPII_CONCURRENCY_MAX_CONFLICTS);
+  *first = 0;
+  for(int i = 0; i < MPII_CONCURRENCY_MAX_CONFLICTS; i++) {
+    struct conflict* c = &conflicts[(index + i) & (MPII_CONCURRENCY_MAX_CONFLICTS - 1)];
+    uint32_t k = atomic_load_explicit(&c->key, memory_order_acquire);
+    if(k == key)
+      return c;
+    if(k == KEY_EMPTY)
+      break;
+  }
+
+  struct conflict* res = NULL;
+  pthread_mutex_lock(&conflicts_lock);
+  for(int i = 0; i < MPII_CONCURRENCY_MAX_CONFLICTS; i++) {
+    struct conflict* c = &conflicts[(index + i) & (MPII_CONCURRENCY_MAX_CONFLICTS - 1)];
+    uint32_t k = atomic_load_explicit(&c->key, memory_order_relaxed);
+    if(k == key) {
+      res = c;
+      break;
+    }
+    if(k == KEY_EMPTY) {
+      c->site = site;
+      c->other_site = other_site;
+      atomic_store_explicit(&c->key, key, memory_order_release);
+      *first = 1;
+      res = c;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&conflicts_lock);
+  return res;
+}
+
+static void record_conflict(int function, const void* site, int other_thread,
+			    int other_function, const void* other_site, int level) {
+  int first;
+  struct conflict* c = get_conflict(function, site, other_function, other_site, &first);
+  if(!c) {
+    nb_lost_conflicts++;
+    return;
+  }
+  atomic_fetch_add_explicit(&c->count, 1, memory_order_relaxed);
+  int max_level = atomic_load_explicit(&c->max_level, memory_order_relaxed);
+  while(level > max_level &&
+	!atomic_compare_exchange_weak_explicit(&c->max_level, &max_level, level,
+					       memory_order_relaxed, memory_order_relaxed))
+    ;
+
+  if(first || mpii_infos.settings.abort_on_concurrency_check_failure) {
+    /* only the first occurrence of each pair is printed */
+    char where[256], other_where[256];
+    mpii_call_sites_format(where, sizeof(where), site);
+    mpii_call_sites_format(other_where, sizeof(other_where), other_site);
+    MPII_PRINTF(0, "[P%dT%d]\tWarning: thread %d calls %s from %s while thread %d calls %s from %s! Concurrency_level: %d\n",
+		mpii_infos.rank, thread_rank,
+		thread_rank, mpii_stats_function_name(function), where,
+		other_thread, mpii_stats_function_name(other_function), other_where, level);
+    if(mpii_infos.settings.abort_on_concurrency_check_failure)
+      abort();
+  }
+}
+
+void mpii_concurrency_enter(int function, const void* site) {
+  int me = thread_rank;
+  if(me < 0 || me >= MPII_CONCURRENCY_MAX_THREADS) {
+    nb_unchecked++;
+    return;
+  }
+  int n = atomic_load_explicit(&nb_slots, memory_order_relaxed);
+  while(me >= n &&
+	!atomic_compare_exchange_weak_explicit(&nb_slots, &n, me + 1,
+					       memory_order_relaxed, memory_order_relaxed))
+    ;
+  if(me >= n)
+    n = me + 1;
+
+  struct thread_slot* my_slot = &thread_slots[me];
+  atomic_store_explicit(&my_slot->site, site, memory_order_relaxed);
+  atomic_store(&my_slot->function, function + 1);
+
+  /* count the threads that are already in MPI */
+  int level = 1;
+  for(int i = 0; i < n; i++) {
+    if(i != me && atomic_load(&thread_slots[i].function) != SLOT_IDLE)
+      level++;
+  }
+  if(level == 1)
+    return;
+
+  for(int i = 0; i < n; i++) {
+    if(i == me)
+      continue;
+    int other_function = atomic_load_explicit(&thread_slots[i].function, memory_order_relaxed);
+    const void* other_site = atomic_load_explicit(&thread_slots[i].site, memory_order_relaxed);
+    if(other_function != SLOT_IDLE)
+      record_conflict(function, site, i, other_function - 1, other_site, level);
+  }
+}
+
+void mpii_concurrency_leave(void) {
+  int me = thread_rank;
+  if(me < 0 || me >= MPII_CONCURRENCY_MAX_THREADS)
+    return;
+  atomic_store_explicit(&thread_slots[me].function, SLOT_IDLE, memory_order_release);
+}
+
+static int compare_count(const void* a, const void* b) {
+  uint64_t ca = atomic_load(&(*(struct conflict* const*)a)->count);
+  uint64_t cb = atomic_load(&(*(struct conflict* const*)b)->count);
+  if(ca == cb) return 0;
+  return ca < cb ? 1 : -1;
+}
+
+void mpii_concurrency_report(void) {
+  struct conflict* sorted[MPII_CONCURRENCY_MAX_CONFLICTS];
+  int n = 0;
+  uint64_t total = 0;
+  int max_level = 1;
+  for(int i = 0; i < MPII_CONCURRENCY_MAX_CONFLICTS; i++) {
+    struct conflict* c = &conflicts[i];
+    if(atomic_load_explicit(&c->key, memory_order_acquire) == KEY_EMPTY)
+      continue;
+    sorted[n++] = c;
+    total += c->count;
+    if(c->max_level > max_level)
+      max_level = c->max_level;
+  }
+  qsort(sorted, n, sizeof(struct conflict*), compare_count);
+
+  if(!n) {
+    printf("[MPII][P%d] Concurrency check: no concurrent MPI call\n", mpii_infos.rank);
+  } else {
+    printf("[MPII][P%d] Concurrency check: %" PRIu64 " concurrent MPI calls (%d pairs of functions), max concurrency level %d\n",
+	   mpii_infos.rank, total, n, max_level);
+    for(int i = 0; i < n; i++) {
+      struct conflict* c = sorted[i];
+      uint32_t key = c->key - 1;
+      char where[256], other_where[256];
+      mpii_call_sites_format(where, sizeof(where), c->site);
+      mpii_call_sites_format(other_where, sizeof(other_where), c->other_site);
+      printf("[MPII][P%d]   %s while %s: %" PRIu64 " times, max level %d. First: %s while %s\n",
+	     mpii_infos.rank,
+	     mpii_stats_function_name(key >> 16), mpii_stats_function_name(key & 0xffff),
+	     (uint64_t)c->count, (int)c->max_level, where, other_where);
+    }
+  }
+  if(nb_lost_conflicts)
+    printf("[MPII][P%d] %" PRIu64 " concurrent calls were not recorded because the conflict table is full\n",
+	   mpii_infos.rank, (uint64_t)nb_lost_conflicts);
+  if(nb_unchecked)
+    printf("[MPII][P%d] %" PRIu64 " calls were not checked because there are more than %d threads\n",
+	   mpii_infos.rank, (uint64_t)nb_unchecked, MPII_CONCURRENCY_MAX_THREADS);
+}
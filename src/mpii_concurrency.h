@@ -0,0 +1,27 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+/* maximum number of threads whose MPI calls are checked. The calls of
+ * the other threads are not checked
+ */
+#define MPII_CONCURRENCY_MAX_THREADS 1024
+
+/* maximum number of pairs of functions in the conflict table */
+#define MPII_CONCURRENCY_MAX_CONFLICTS 4096
+
+/* the current thread enters the MPI function function (see
+ * mpii_stats_function_id), called from site. Record a conflict with
+ * each thread that is already in an MPI function
+ */
+void mpii_concurrency_enter(int function, const void* site);
+
+/* the current thread leaves its MPI function */
+void mpii_concurrency_leave(void);
+
+/* print the conflicts detected by this process */
+void mpii_concurrency_report(void);
@@ -0,0 +1,297 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Message size histograms (MPII_SIZE_HISTOGRAMS=1).
+ *
+ * The size of the messages (count * size of the datatype) is recorded
+ * in log2 histograms, indexed by the MPI function and by the
+ * communicator. Histograms are private to each thread, so that
+ * recording a message does not need any atomic operation, and are
+ * merged and printed when MPI is finalized.
+ *
+ * Communicators are identified by a label, which is assigned the
+ * first time a communicator is used and is named after the
+ * communicator (see MPI_Comm_set_name). The labels are found in a hash
+ * table that is read without any lock (see mpii_table.c). A
+ * label is never reused, so that the histograms of a communicator that
+ * was freed remain valid.
+ */
+
+#include "mpii.h"
+#include "mpii_histogram.h"
+#include "mpii_table.h"
+#include "mpii_thread_list.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* bucket 0 counts the empty messages, and bucket i > 0 the messages
+ * whose size is in [2^(i-1), 2^i)
+ */
+#define NB_BUCKETS 65
+
+/* messages smaller than this are likely to be latency-bound */
+#define SMALL_MESSAGE_SIZE 4096
+
+/* initial number of entries of the per-thread tables */
+#define THREAD_TABLE_MIN_SIZE 32
+
+/* label of the RMA functions, and of the communicators that do not fit in the table */
+#define LABEL_WINDOW 0
+#define LABEL_OTHER 1
+#define FIRST_COMM_LABEL 2
+
+#define EMPTY_FUNCTION (-1)
+
+struct histogram {
+  int function;
+  int label;
+  uint64_t nb_messages;
+  uint64_t bytes;
+  uint64_t buckets[NB_BUCKETS];
+};
+
+struct histogram_thread {
+  struct histogram_thread* next;
+  struct histogram* histograms;
+  unsigned capacity;		/* a power of 2 */
+  unsigned nb_histograms;
+};
+
+static struct mpii_thread_list threads =
+  MPII_THREAD_LIST_INITIALIZER("the message size histograms");
+
+static __thread struct histogram_thread* my_thread = NULL;
+
+struct comm_slot {
+  _Atomic uintptr_t key;
+  _Atomic int label;
+};
+
+static struct comm_slot comm_slots[MPII_HISTOGRAM_MAX_COMMS];
+static struct mpii_table comm_table = MPII_TABLE_INITIALIZER(comm_slots, MPII_HISTOGRAM_MAX_COMMS);
+static char label_names[MPII_HISTOGRAM_MAX_COMMS][MPI_MAX_OBJECT_NAME] = {
+  "(RMA window)", "(other)"
+};
+/* protected by the writer lock of comm_table */
+static int nb_labels = FIRST_COMM_LABEL;
+
+static struct histogram* alloc_histograms(unsigned capacity) {
+  struct histogram* histograms = mpii_checked_calloc(capacity, sizeof(struct histogram),
+						     threads.name);
+  for(unsigned i = 0; i < capacity; i++)
+    histograms[i].function = EMPTY_FUNCTION;
+  return histograms;
+}
+
+static struct histogram_thread* get_thread(void) {
+  if(!my_thread) {
+    struct histogram_thread* t = mpii_thread_list_alloc(&threads, sizeof(struct histogram_thread));
+    t->capacity = THREAD_TABLE_MIN_SIZE;
+    t->histograms = alloc_histograms(t->capacity);
+    mpii_thread_list_add(&threads, t);
+    my_thread = t;
+  }
+  return my_thread;
+}
+
+static struct histogram* find_histogram(struct histogram* histograms, unsigned capacity,
+					int function, int label) {
+  unsigned index = mpii_hash(((uint64_t)function << 32) | (uint32_t)label, capacity);
+  while(histograms[index].function != EMPTY_FUNCTION &&
+	(histograms[index].function != function || histograms[index].label != label))
+    index = (index + 1) & (capacity - 1);
+  return &histograms[index];
+}
+
+static struct histogram* get_histogram(int function, int label) {
+  struct histogram_thread* t = get_thread();
+  struct histogram* h = find_histogram(t->histograms, t->capacity, function, label);
+  if(h->function != EMPTY_FUNCTION)
+    return h;
+
+  if(2 * (t->nb_histograms + 1) > t->capacity) {
+    /* keep the table half empty */
+    unsigned capacity = 2 * t->capacity;
+    struct histogram* histograms = alloc_histograms(capacity);
+    for(unsigned i = 0; i < t->capacity; i++) {
+      struct histogram* old = &t->histograms[i];
+      if(old->function != EMPTY_FUNCTION)
+	*find_histogram(histograms, capacity, old->function, old->label) = *old;
+    }
+    free(t->histograms);
+    t->histograms = histograms;
+    t->capacity = capacity;
+    h = find_histogram(t->histograms, t->capacity, function, label);
+  }
+  h->function = function;
+  h->label = label;
+  t->nb_histograms++;
+  return h;
+}
+
+struct get_name_args {
+  MPI_Comm comm;
+  char* name;
+  int size;
+};
+
+static int get_name_call(void* arg) {
+  struct get_name_args* a = arg;
+  int len = 0;
+  int ret = MPI_Comm_get_name(a->comm, a->name, &len);
+  if(ret != MPI_SUCCESS)
+    return ret;
+  return libMPI_Comm_size(a->comm, &a->size);
+}
+
+/* return the label of comm */
+static int comm_label(MPI_Comm comm) {
+  if(comm == MPI_COMM_NULL)
+    return LABEL_WINDOW;
+
+  uintptr_t key = MPII_TABLE_KEY(comm);
+  struct comm_slot* slot = mpii_table_find(&comm_table, key);
+  if(slot)
+    return atomic_load_explicit(&slot->label, memory_order_relaxed);
+
+  /* first use of comm: name it */
+  char name[MPI_MAX_OBJECT_NAME] = "";
+  struct get_name_args args = { comm, name, 0 };
+  MPII_EXEC(get_name_call, &args);
+
+  int label = LABEL_OTHER;
+  int found;
+  mpii_table_lock(&comm_table);
+  slot = mpii_table_reserve(&comm_table, key, &found);
+  if(slot && found) {
+    /* another thread named it */
+    label = atomic_load_explicit(&slot->label, memory_order_relaxed);
+  } else if(slot && nb_labels < MPII_HISTOGRAM_MAX_COMMS) {
+    label = nb_labels++;
+    if(name[0]) {
+      strncpy(label_names[label], name, MPI_MAX_OBJECT_NAME - 1);
+    } else {
+      snprintf(label_names[label], MPI_MAX_OBJECT_NAME, "comm %d (%d ranks)",
+	       label - FIRST_COMM_LABEL, args.size);
+    }
+    atomic_store_explicit(&slot->label, label, memory_order_relaxed);
+    mpii_table_publish(slot, key);
+  }
+  mpii_table_unlock(&comm_table);
+  return label;
+}
+
+void mpii_histogram_remove_comm(MPI_Comm comm) {
+  mpii_table_remove(&comm_table, MPII_TABLE_KEY(comm));
+}
+
+static int bucket(uint64_t bytes) {
+  return bytes ? 64 - __builtin_clzll(bytes) : 0;
+}
+
+void mpii_histogram_record(MPI_Comm comm, uint64_t bytes) {
+  struct histogram* h = get_histogram(mpii_current_function_id, comm_label(comm));
+  h->nb_messages++;
+  h->bytes += bytes;
+  h->buckets[bucket(bytes)]++;
+}
+
+/* print size (a power of 2) with a unit */
+static void format_size(char* str, size_t len, uint64_t size) {
+  static const char* units[] = { "", "K", "M", "G", "T", "P", "E" };
+  int unit = 0;
+  while(size >= 1024 && size % 1024 == 0) {
+    size /= 1024;
+    unit++;
+  }
+  snprintf(str, len, "%" PRIu64 "%s", size, units[unit]);
+}
+
+static int compare_messages(const void* a, const void* b) {
+  const struct histogram* ha = a;
+  const struct histogram* hb = b;
+  if(ha->nb_messages == hb->nb_messages) return 0;
+  return ha->nb_messages < hb->nb_messages ? 1 : -1;
+}
+
+void mpii_histogram_report(void) {
+  /* merge the histograms of all the threads */
+  unsigned capacity = THREAD_TABLE_MIN_SIZE;
+  mpii_thread_list_lock(&threads);
+  for(struct histogram_thread* t = threads.head; t; t = t->next)
+    capacity += 2 * t->nb_histograms;
+  while(capacity & (capacity - 1))
+    capacity++;
+  struct histogram* merged = alloc_histograms(capacity);
+  for(struct histogram_thread* t = threads.head; t; t = t->next) {
+    for(unsigned i = 0; i < t->capacity; i++) {
+      struct histogram* h = &t->histograms[i];
+      if(h->function == EMPTY_FUNCTION)
+	continue;
+      struct histogram* m = find_histogram(merged, capacity, h->function, h->label);
+      if(m->function == EMPTY_FUNCTION) {
+	*m = *h;
+	continue;
+      }
+      m->nb_messages += h->nb_messages;
+      m->bytes += h->bytes;
+      for(int b = 0; b < NB_BUCKETS; b++)
+	m->buckets[b] += h->buckets[b];
+    }
+  }
+  mpii_thread_list_unlock(&threads);
+
+  /* compact and sort the histograms by number of messages */
+  uint64_t nb_messages = 0, nb_small = 0, bytes = 0;
+  unsigned n = 0;
+  for(unsigned i = 0; i < capacity; i++) {
+    if(merged[i].function == EMPTY_FUNCTION)
+      continue;
+    merged[n] = merged[i];
+    nb_messages += merged[n].nb_messages;
+    bytes += merged[n].bytes;
+    for(int b = 0; b < NB_BUCKETS && (b == 0 || (UINT64_C(1) << (b - 1)) < SMALL_MESSAGE_SIZE); b++)
+      nb_small += merged[n].buckets[b];
+    n++;
+  }
+  qsort(merged, n, sizeof(struct histogram), compare_messages);
+
+  printf("[MPII][P%d] Message sizes: %" PRIu64 " messages, %" PRIu64 " bytes\n",
+	 mpii_infos.rank, nb_messages, bytes);
+  if(nb_messages)
+    printf("[MPII][P%d] %.1f%% of the messages are smaller than %d bytes\n",
+	   mpii_infos.rank, 100. * nb_small / nb_messages, SMALL_MESSAGE_SIZE);
+  printf("[MPII][P%d] %-24s %-32s %12s %12s  %s\n", mpii_infos.rank,
+	 "function", "communicator", "messages", "mean(B)", "histogram (size range: messages)");
+  for(unsigned i = 0; i < n; i++) {
+    struct histogram* h = &merged[i];
+    printf("[MPII][P%d] %-24s %-32s %12" PRIu64 " %12.1f ", mpii_infos.rank,
+	   mpii_stats_function_name(h->function), label_names[h->label],
+	   h->nb_messages, (double)h->bytes / h->nb_messages);
+    for(int b = 0; b < NB_BUCKETS; b++) {
+      if(!h->buckets[b])
+	continue;
+      if(b == 0) {
+	printf(" 0:%" PRIu64, h->buckets[b]);
+      } else {
+	char low[32], high[32];
+	format_size(low, sizeof(low), UINT64_C(1) << (b - 1));
+	if(b < 64)
+	  format_size(high, sizeof(high), UINT64_C(1) << b);
+	else
+	  strcpy(high, "16E");
+	printf(" %s-%s:%" PRIu64, low, high, h->buckets[b]);
+      }
+    }
+    printf("\n");
+  }
+  free(merged);
+}
@@ -0,0 +1,25 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <mpi.h>
+#include <stdint.h>
+
+/* maximum number of communicators whose name is cached */
+#define MPII_HISTOGRAM_MAX_COMMS 4096
+
+/* record a message of size bytes sent or received by the current
+ * thread on comm (MPI_COMM_NULL for the RMA functions). The message is
+ * accounted to the MPI function that the thread is calling
+ */
+void mpii_histogram_record(MPI_Comm comm, uint64_t bytes);
+
+/* forget comm. Called before comm is freed */
+void mpii_histogram_remove_comm(MPI_Comm comm);
+
+/* print the message size histograms of all the threads */
+void mpii_histogram_report(void);
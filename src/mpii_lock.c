@@ -0,0 +1,348 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Implementations of the lock that serializes calls to MPI.
+ *
+ * All the lock states are padded to a cache line so that the lock
+ * does not share a cache line with unrelated (and frequently
+ * modified) data.
+ */
+
+#include "mpii.h"
+#include "mpii_lock.h"
+#include "mpii_stats.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+static const char* lock_type_names[] = MPII_LOCK_TYPE_NAMES;
+
+/* lock implementation selected by mpii_lock_init */
+static enum mpii_lock_type lock_type = SETTINGS_LOCK_TYPE_DEFAULT;
+
+/* mutex lock */
+static struct {
+  pthread_mutex_t mutex;
+} mutex_lock CACHE_ALIGNED = { PTHREAD_MUTEX_INITIALIZER };
+
+/* ticket lock. next and owner are modified by different threads, so
+ * they live in different cache lines
+ */
+static struct {
+  _Atomic uint32_t next CACHE_ALIGNED;
+  /* number of threads parked on owner */
+  _Atomic uint32_t nb_parked;
+  _Atomic uint32_t owner CACHE_ALIGNED;
+} ticket_lock CACHE_ALIGNED;
+
+/* MCS lock. Each thread waits on its own queue node.
+ * locked is 0 (the lock was handed over), 1 (waiting) or 2 (waiting, and parked)
+ */
+struct mcs_node {
+  struct mcs_node* _Atomic next;
+  _Atomic uint32_t locked;
+} CACHE_ALIGNED;
+
+static struct {
+  struct mcs_node* _Atomic tail;
+} mcs_lock CACHE_ALIGNED;
+
+/* a thread holds at most one MPI lock at a time, so one node per thread is enough */
+static __thread struct mcs_node mcs_local_node;
+
+/* adaptive lock.
+ * state is 0 (unlocked), 1 (locked), or 2 (locked, and some threads may be parked)
+ */
+static struct {
+  _Atomic uint32_t state CACHE_ALIGNED;
+  /* estimation of the number of spins needed for getting the lock */
+  _Atomic uint32_t spin_estimate CACHE_ALIGNED;
+} adaptive_lock CACHE_ALIGNED;
+
+/* number of spins before parking when the lock is heavily contended */
+#define ADAPTIVE_MIN_SPINS 32
+/* never spin more than this before parking */
+#define ADAPTIVE_MAX_SPINS 4096
+
+/* in the ticket lock, number of pauses per thread ahead of us in the queue */
+#define TICKET_BACKOFF 64
+
+/* Spinning locks (ticket and MCS) park after this number of
+ * pauses. This prevents waiters from burning the time slice of a
+ * preempted lock holder when cores are oversubscribed
+ */
+#define SPINS_BEFORE_PARKING 4096
+
+static void ticket_acquire(void) {
+  uint32_t my_ticket = atomic_fetch_add_explicit(&ticket_lock.next, 1, memory_order_relaxed);
+  uint32_t cur;
+  uint32_t spins = 0;
+  while ((cur = atomic_load_explicit(&ticket_lock.owner, memory_order_acquire)) != my_ticket) {
+    if (spins > SPINS_BEFORE_PARKING) {
+      atomic_fetch_add(&ticket_lock.nb_parked, 1);
+      /* check owner again after registering: a concurrent release may have missed us */
+      if (atomic_load(&ticket_lock.owner) == cur)
+	mpii_futex_wait(&ticket_lock.owner, cur);
+      atomic_fetch_sub(&ticket_lock.nb_parked, 1);
+      continue;
+    }
+    /* proportional backoff: the further we are in the queue, the longer we wait */
+    uint32_t nb_pauses = (my_ticket - cur) * TICKET_BACKOFF;
+    for (uint32_t i = 0; i < nb_pauses; i++)
+      mpii_cpu_relax();
+    spins += nb_pauses;
+  }
+}
+
+static int ticket_try_acquire(void) {
+  uint32_t cur = atomic_load_explicit(&ticket_lock.owner, memory_order_relaxed);
+  /* the lock is free iff nobody took a ticket after the owner's one */
+  return atomic_compare_exchange_strong_explicit(&ticket_lock.next, &cur, cur + 1,
+						 memory_order_acquire, memory_order_relaxed);
+}
+
+static void ticket_release(void) {
+  uint32_t cur = atomic_load_explicit(&ticket_lock.owner, memory_order_relaxed);
+  atomic_store(&ticket_lock.owner, cur + 1);
+  if (atomic_load(&ticket_lock.nb_parked))
+    /* we don't know which thread holds the next ticket, wake them all */
+    mpii_futex_wake(&ticket_lock.owner, INT_MAX);
+}
+
+static void mcs_acquire(void) {
+  struct mcs_node* node = &mcs_local_node;
+  atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+  atomic_store_explicit(&node->locked, 1, memory_order_relaxed);
+
+  struct mcs_node* pred = atomic_exchange_explicit(&mcs_lock.tail, node, memory_order_acq_rel);
+  if (pred) {
+    /* the lock is taken. Enqueue and wait until our predecessor hands it over */
+    atomic_store_explicit(&pred->next, node, memory_order_release);
+    uint32_t spins = 0;
+    while (atomic_load_explicit(&node->locked, memory_order_acquire)) {
+      if (++spins > SPINS_BEFORE_PARKING) {
+	uint32_t expected = 1;
+	if (atomic_compare_exchange_strong(&node->locked, &expected, 2) || expected == 2)
+	  mpii_futex_wait(&node->locked, 2);
+      } else {
+	mpii_cpu_relax();
+      }
+    }
+  }
+}
+
+static int mcs_try_acquire(void) {
+  struct mcs_node* node = &mcs_local_node;
+  atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+  struct mcs_node* expected = NULL;
+  return atomic_compare_exchange_strong_explicit(&mcs_lock.tail, &expected, node,
+						 memory_order_acquire, memory_order_relaxed);
+}
+
+static void mcs_release(void) {
+  struct mcs_node* node = &mcs_local_node;
+  struct mcs_node* next = atomic_load_explicit(&node->next, memory_order_acquire);
+  if (!next) {
+    struct mcs_node* expected = node;
+    if (atomic_compare_exchange_strong_explicit(&mcs_lock.tail, &expected, NULL,
+						memory_order_acq_rel, memory_order_relaxed))
+      /* nobody is waiting */
+      return;
+
+    /* a thread is enqueuing itself. Wait until it is linked to us */
+    while (!(next = atomic_load_explicit(&node->next, memory_order_acquire)))
+      sched_yield();
+  }
+  if (atomic_exchange_explicit(&next->locked, 0, memory_order_release) == 2)
+    mpii_futex_wake(&next->locked, 1);
+}
+
+static void adaptive_acquire(void) {
+  uint32_t expected = 0;
+  if (atomic_compare_exchange_strong_explicit(&adaptive_lock.state, &expected, 1,
+					      memory_order_acquire, memory_order_relaxed))
+    return;
+
+  /* If some threads are already parked, the lock is heavily contended
+   * and spinning is a waste of CPU. Otherwise, spin for a duration
+   * that depends on how long we previously had to spin.
+   */
+  if (expected != 2) {
+    uint32_t estimate = atomic_load_explicit(&adaptive_lock.spin_estimate, memory_order_relaxed);
+    uint32_t max_spins = estimate + ADAPTIVE_MIN_SPINS;
+    if (max_spins > ADAPTIVE_MAX_SPINS)
+      max_spins = ADAPTIVE_MAX_SPINS;
+
+    for (uint32_t spins = 0; spins < max_spins; spins++) {
+      mpii_cpu_relax();
+      if (atomic_load_explicit(&adaptive_lock.state, memory_order_relaxed) == 0) {
+	expected = 0;
+	if (atomic_compare_exchange_weak_explicit(&adaptive_lock.state, &expected, 1,
+						  memory_order_acquire, memory_order_relaxed)) {
+	  /* spinning paid off: next time, spin about twice as long as this time */
+	  int32_t delta = ((int32_t)(2 * spins) - (int32_t)estimate) / 8;
+	  atomic_store_explicit(&adaptive_lock.spin_estimate, estimate + delta,
+				memory_order_relaxed);
+	  return;
+	}
+      }
+    }
+    /* spinning did not pay off: spin less next time */
+    atomic_store_explicit(&adaptive_lock.spin_estimate, estimate - estimate / 8,
+			  memory_order_relaxed);
+  }
+
+  /* park until the lock is released */
+  while (atomic_exchange_explicit(&adaptive_lock.state, 2, memory_order_acquire) != 0)
+    mpii_futex_wait(&adaptive_lock.state, 2);
+}
+
+static int adaptive_try_acquire(void) {
+  uint32_t expected = 0;
+  return atomic_compare_exchange_strong_explicit(&adaptive_lock.state, &expected, 1,
+						 memory_order_acquire, memory_order_relaxed);
+}
+
+static void adaptive_release(void) {
+  if (atomic_exchange_explicit(&adaptive_lock.state, 0, memory_order_release) == 2)
+    /* some threads may be parked. Wake one of them */
+    mpii_futex_wake(&adaptive_lock.state, 1);
+}
+
+void mpii_lock_init(enum mpii_lock_type type) {
+  lock_type = type;
+}
+
+/* return the time when the current thread starts waiting for the lock,
+ * or 0 if no profiler measures the wait
+ */
+static uint64_t wait_start_time(void) {
+  if(mpii_infos.settings.lock_stats || mpii_infos.settings.trace ||
+     mpii_infos.settings.call_sites || mpii_infos.settings.live ||
+     mpii_infos.settings.pvars || mpii_sampled)
+    return mpii_tsc();
+  return 0;
+}
+
+/* notify the profilers that the current thread acquired the lock. It
+ * started waiting at wait_start
+ */
+static void lock_acquired_hooks(uint64_t wait_start) {
+  MPII_PROBE2(lock_acquired, mpii_current_function_id, thread_rank);
+  if(mpii_infos.settings.lock_stats)
+    mpii_stats_lock_acquired(wait_start);
+  if(mpii_infos.settings.trace && MPII_SAMPLED)
+    mpii_trace_lock_acquired(wait_start);
+  if(mpii_sampled)
+    mpii_sample_lock_acquired(wait_start);
+  if(mpii_infos.settings.call_sites)
+    mpii_call_sites_lock_acquired(wait_start);
+  if(mpii_infos.settings.live)
+    mpii_shm_lock_acquired(wait_start);
+  if(mpii_infos.settings.pvars)
+    mpii_pvar_lock_acquired(wait_start);
+}
+
+/* notify the profilers that the current thread is about to release the lock */
+static void lock_released_hooks(void) {
+  MPII_PROBE2(lock_release, mpii_current_function_id, thread_rank);
+  if(mpii_infos.settings.lock_stats)
+    mpii_stats_lock_released();
+  if(mpii_infos.settings.trace && MPII_SAMPLED)
+    mpii_trace_lock_released();
+  if(mpii_sampled)
+    mpii_sample_lock_released();
+  if(mpii_infos.settings.call_sites)
+    mpii_call_sites_lock_released();
+  if(mpii_infos.settings.live)
+    mpii_shm_lock_released();
+  if(mpii_infos.settings.pvars)
+    mpii_pvar_lock_released();
+}
+
+void mpii_lock_acquire(void) {
+  MPII_PROBE2(lock_acquire, mpii_current_function_id, thread_rank);
+  uint64_t wait_start = wait_start_time();
+  switch (lock_type) {
+  case MPII_LOCK_TICKET:
+    ticket_acquire();
+    break;
+  case MPII_LOCK_MCS:
+    mcs_acquire();
+    break;
+  case MPII_LOCK_ADAPTIVE:
+    adaptive_acquire();
+    break;
+  case MPII_LOCK_MUTEX:
+  default:
+    pthread_mutex_lock(&mutex_lock.mutex);
+    break;
+  }
+  lock_acquired_hooks(wait_start);
+}
+
+int mpii_lock_try_acquire(void) {
+  uint64_t wait_start = wait_start_time();
+  int acquired;
+  switch (lock_type) {
+  case MPII_LOCK_TICKET:
+    acquired = ticket_try_acquire();
+    break;
+  case MPII_LOCK_MCS:
+    acquired = mcs_try_acquire();
+    break;
+  case MPII_LOCK_ADAPTIVE:
+    acquired = adaptive_try_acquire();
+    break;
+  case MPII_LOCK_MUTEX:
+  default:
+    acquired = pthread_mutex_trylock(&mutex_lock.mutex) == 0;
+    break;
+  }
+  if(acquired) {
+    /* a zero-length wait, so that tracers can pair the probes */
+    MPII_PROBE2(lock_acquire, mpii_current_function_id, thread_rank);
+    lock_acquired_hooks(wait_start);
+  }
+  return acquired;
+}
+
+void mpii_lock_release(void) {
+  /* the hold time stops before the lock is handed over */
+  lock_released_hooks();
+  switch (lock_type) {
+  case MPII_LOCK_TICKET:
+    ticket_release();
+    break;
+  case MPII_LOCK_MCS:
+    mcs_release();
+    break;
+  case MPII_LOCK_ADAPTIVE:
+    adaptive_release();
+    break;
+  case MPII_LOCK_MUTEX:
+  default:
+    pthread_mutex_unlock(&mutex_lock.mutex);
+    break;
+  }
+}
+
+const char* mpii_lock_type_name(int type) {
+  if (type < 0 || type >= MPII_LOCK_NB_TYPES)
+    return "unknown";
+  return lock_type_names[type];
+}
+
+int mpii_lock_type_from_name(const char* name) {
+  for (int i = 0; i < MPII_LOCK_NB_TYPES; i++) {
+    if (strcmp(name, lock_type_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
@@ -0,0 +1,62 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "mpii_config.h"
+
+#define MPII_CACHE_LINE_SIZE 64
+#define CACHE_ALIGNED __attribute__((aligned(MPII_CACHE_LINE_SIZE)))
+
+/* tell the CPU that we are busy-waiting */
+static inline void mpii_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield" ::: "memory");
+#else
+  __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/* block until *addr != val (or until a spurious wakeup occurs) */
+static inline void mpii_futex_wait(_Atomic uint32_t* addr, uint32_t val) {
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+/* same as mpii_futex_wait, but return after timeout (a relative duration) */
+static inline void mpii_futex_wait_timeout(_Atomic uint32_t* addr, uint32_t val,
+					   const struct timespec* timeout) {
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+/* wake up to nb_threads threads blocked on addr */
+static inline void mpii_futex_wake(_Atomic uint32_t* addr, int nb_threads) {
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, nb_threads, NULL, NULL, 0);
+}
+
+/* select the implementation of the global MPI lock. Must be called
+ * before the first call to mpii_lock_acquire
+ */
+void mpii_lock_init(enum mpii_lock_type type);
+
+/* take/release the global MPI lock */
+void mpii_lock_acquire(void);
+void mpii_lock_release(void);
+
+/* take the global MPI lock if it is free. Return 1 if the lock was taken, 0 otherwise */
+int mpii_lock_try_acquire(void);
+
+/* return the name of a lock type */
+const char* mpii_lock_type_name(int type);
+
+/* return the lock type called name, or -1 if there is no such lock type */
+int mpii_lock_type_from_name(const char* name);
@@ -0,0 +1,303 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Asynchronous log (MPII_ASYNC_LOG=1).
+ *
+ * Printing the verbose messages on stderr serializes the threads on
+ * the stdio lock. Instead, each thread writes its messages in its own
+ * ring buffer, that a flusher thread drains every
+ * MPII_LOG_FLUSH_PERIOD us (or earlier, when a buffer is half full).
+ * The flusher merges the buffers in timestamp order, and writes the
+ * messages to mpii_log.<rank>.txt.
+ *
+ * A ring buffer has a single producer (its thread) and a single
+ * consumer (the flusher), so it does not need any lock: the producer
+ * publishes a record by advancing head, the flusher frees it by
+ * advancing tail. When a buffer is full, the message is dropped and
+ * counted, so that logging never blocks the application.
+ *
+ * Generic messages are formatted by the thread in its buffer. The
+ * messages printed when entering and leaving an MPI function only
+ * record a pointer to the function name, and are formatted by the
+ * flusher.
+ */
+
+#include "mpii.h"
+#include "mpii_log.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECORD_ALIGNMENT 16
+
+enum record_type {
+  RECORD_PADDING,		/* unused space at the end of the buffer */
+  RECORD_MESSAGE,		/* followed by the message */
+  RECORD_FUNCTION,		/* struct function_record */
+};
+
+struct record {
+  uint64_t tsc;
+  uint32_t size;		/* including the header, multiple of RECORD_ALIGNMENT */
+  uint16_t type;
+  int16_t thread;
+};
+
+struct function_record {
+  struct record header;
+  const char* event;
+  const char* function;
+};
+
+struct log_buffer {
+  struct log_buffer* next;
+  _Atomic uint64_t head CACHE_ALIGNED;	/* written by the thread */
+  _Atomic uint64_t dropped;		/* number of messages dropped because the buffer was full */
+  _Atomic uint64_t tail CACHE_ALIGNED;	/* written by the flusher */
+  /* only accessed by the flusher */
+  uint64_t cursor;
+  uint64_t end;
+  uint64_t reported_dropped;
+  _Atomic int exited;			/* 1 when the thread exited */
+  char data[MPII_LOG_BUFFER_SIZE] __attribute__((aligned(RECORD_ALIGNMENT)));
+};
+
+int mpii_log_active = 0;
+
+static struct log_buffer* buffers = NULL;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct log_buffer* my_buffer = NULL;
+
+/* marks the buffers of the threads that exit, so that the flusher frees them */
+static pthread_key_t thread_key;
+
+static FILE* log_file = NULL;
+static uint64_t start_tsc;
+static pthread_t flusher;
+static _Atomic int stop = 0;
+/* set to wake the flusher up before the end of its period */
+static _Atomic uint32_t wakeup = 0;
+
+static void thread_exit(void* arg) {
+  struct log_buffer* b = arg;
+  atomic_store_explicit(&b->exited, 1, memory_order_release);
+}
+
+static struct log_buffer* get_buffer(void) {
+  if(!my_buffer) {
+    my_buffer = aligned_alloc(RECORD_ALIGNMENT, sizeof(struct log_buffer));
+    if(!my_buffer) {
+      fprintf(stderr, "[MPII] Error: cannot allocate memory for the log\n");
+      abort();
+    }
+    memset(my_buffer, 0, offsetof(struct log_buffer, data));
+    pthread_setspecific(thread_key, my_buffer);
+    pthread_mutex_lock(&buffers_lock);
+    my_buffer->next = buffers;
+    buffers = my_buffer;
+    pthread_mutex_unlock(&buffers_lock);
+  }
+  return my_buffer;
+}
+
+static void wake_flusher(void) {
+  if(atomic_exchange_explicit(&wakeup, 1, memory_order_relaxed) == 0)
+    mpii_futex_wake(&wakeup, 1);
+}
+
+/* reserve size bytes in the buffer of the current thread. Return NULL
+ * if the buffer is full. The record is published by commit
+ */
+static struct record* reserve(struct log_buffer* b, uint32_t size) {
+  uint64_t head = atomic_load_explicit(&b->head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&b->tail, memory_order_acquire);
+  uint64_t offset = head & (MPII_LOG_BUFFER_SIZE - 1);
+  uint64_t contiguous = MPII_LOG_BUFFER_SIZE - offset;
+  /* records do not wrap around the end of the buffer */
+  uint64_t needed = size <= contiguous ? size : contiguous + size;
+  if(head + needed - tail > MPII_LOG_BUFFER_SIZE) {
+    atomic_store_explicit(&b->dropped, atomic_load_explicit(&b->dropped, memory_order_relaxed) + 1,
+			  memory_order_relaxed);
+    wake_flusher();
+    return NULL;
+  }
+  if(head + needed - tail > MPII_LOG_BUFFER_SIZE / 2)
+    wake_flusher();
+
+  if(size > contiguous) {
+    struct record* padding = (struct record*)(b->data + offset);
+    padding->type = RECORD_PADDING;
+    padding->size = contiguous;
+    atomic_store_explicit(&b->head, head + contiguous, memory_order_release);
+    offset = 0;
+  }
+  return (struct record*)(b->data + offset);
+}
+
+static void commit(struct log_buffer* b, struct record* r) {
+  uint64_t head = atomic_load_explicit(&b->head, memory_order_relaxed);
+  atomic_store_explicit(&b->head, head + r->size, memory_order_release);
+}
+
+static uint32_t align(uint32_t size) {
+  return (size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+void mpii_log_printf(const char* format, ...) {
+  uint64_t tsc = mpii_tsc();
+  struct log_buffer* b = get_buffer();
+  /* the message is formatted in place: reserve the maximum size */
+  struct record* r = reserve(b, align(sizeof(struct record) + MPII_LOG_MAX_MESSAGE));
+  if(!r)
+    return;
+  char* message = (char*)(r + 1);
+  va_list ap;
+  va_start(ap, format);
+  int len = vsnprintf(message, MPII_LOG_MAX_MESSAGE, format, ap);
+  va_end(ap);
+  if(len < 0)
+    return;
+  if(len >= MPII_LOG_MAX_MESSAGE)
+    len = MPII_LOG_MAX_MESSAGE - 1;
+  r->tsc = tsc;
+  r->size = align(sizeof(struct record) + len + 1);
+  r->type = RECORD_MESSAGE;
+  r->thread = thread_rank;
+  commit(b, r);
+}
+
+void mpii_log_function(const char* event, const char* function) {
+  uint64_t tsc = mpii_tsc();
+  struct log_buffer* b = get_buffer();
+  struct function_record* r = (struct function_record*)reserve(b, align(sizeof(struct function_record)));
+  if(!r)
+    return;
+  r->header.tsc = tsc;
+  r->header.size = align(sizeof(struct function_record));
+  r->header.type = RECORD_FUNCTION;
+  r->header.thread = thread_rank;
+  r->event = event;
+  r->function = function;
+  commit(b, &r->header);
+}
+
+static struct record* record_at(struct log_buffer* b, uint64_t position) {
+  return (struct record*)(b->data + (position & (MPII_LOG_BUFFER_SIZE - 1)));
+}
+
+static void write_record(const struct record* r, double us_per_cycle) {
+  fprintf(log_file, "%14.3f T%-3d ", (double)(r->tsc - start_tsc) * us_per_cycle, r->thread);
+  if(r->type == RECORD_FUNCTION) {
+    const struct function_record* f = (const struct function_record*)r;
+    fprintf(log_file, "[%d/%d]\t%s %s\n", mpii_infos.rank, mpii_infos.size, f->event, f->function);
+  } else {
+    fputs((const char*)(r + 1), log_file);
+  }
+}
+
+/* write the records older than limit (a mpii_tsc timestamp) in
+ * timestamp order. The more recent records are kept for the next flush,
+ * so that they are ordered with the records that the other threads are
+ * writing
+ */
+static void flush(uint64_t limit) {
+  double us_per_cycle = mpii_stats_us_per_cycle();
+  pthread_mutex_lock(&buffers_lock);
+  for(struct log_buffer* b = buffers; b; b = b->next) {
+    b->cursor = atomic_load_explicit(&b->tail, memory_order_relaxed);
+    b->end = atomic_load_explicit(&b->head, memory_order_acquire);
+  }
+
+  /* merge the buffers */
+  while(1) {
+    struct log_buffer* oldest = NULL;
+    uint64_t oldest_tsc = limit;
+    for(struct log_buffer* b = buffers; b; b = b->next) {
+      while(b->cursor < b->end && record_at(b, b->cursor)->type == RECORD_PADDING)
+	b->cursor += record_at(b, b->cursor)->size;
+      if(b->cursor < b->end && record_at(b, b->cursor)->tsc < oldest_tsc) {
+	oldest = b;
+	oldest_tsc = record_at(b, b->cursor)->tsc;
+      }
+    }
+    if(!oldest)
+      break;
+    struct record* r = record_at(oldest, oldest->cursor);
+    write_record(r, us_per_cycle);
+    oldest->cursor += r->size;
+  }
+
+  struct log_buffer** prev = &buffers;
+  struct log_buffer* b;
+  while((b = *prev)) {
+    atomic_store_explicit(&b->tail, b->cursor, memory_order_release);
+    uint64_t dropped = atomic_load_explicit(&b->dropped, memory_order_relaxed);
+    if(dropped != b->reported_dropped) {
+      fprintf(log_file, "[MPII] Warning: %" PRIu64 " messages were dropped because the log buffer was full\n",
+	      dropped - b->reported_dropped);
+      b->reported_dropped = dropped;
+    }
+    if(atomic_load_explicit(&b->exited, memory_order_acquire) &&
+       b->cursor == atomic_load_explicit(&b->head, memory_order_acquire)) {
+      *prev = b->next;
+      free(b);
+    } else {
+      prev = &b->next;
+    }
+  }
+  pthread_mutex_unlock(&buffers_lock);
+  fflush(log_file);
+}
+
+static void* flusher_loop(void* arg MAYBE_UNUSED) {
+  while(!atomic_load(&stop)) {
+    struct timespec timeout = { 0, MPII_LOG_FLUSH_PERIOD * 1000 };
+    mpii_futex_wait_timeout(&wakeup, 0, &timeout);
+    atomic_store_explicit(&wakeup, 0, memory_order_relaxed);
+    flush(mpii_tsc());
+  }
+  return NULL;
+}
+
+/* stop the flusher and write the remaining messages. Called when the
+ * process exits, so that the messages printed after MPI_Finalize are
+ * logged too
+ */
+static void log_finalize(void) {
+  mpii_log_active = 0;
+  atomic_store(&stop, 1);
+  mpii_futex_wake(&wakeup, 1);
+  pthread_join(flusher, NULL);
+  flush(UINT64_MAX);
+  fclose(log_file);
+}
+
+void mpii_log_init(void) {
+  char filename[STRING_LENGTH];
+  snprintf(filename, sizeof(filename), "mpii_log.%d.txt", mpii_infos.rank);
+  log_file = fopen(filename, "w");
+  if(!log_file) {
+    fprintf(stderr, "[MPII][P%d] Error: cannot create %s. Messages are printed on stderr\n",
+	    mpii_infos.rank, filename);
+    return;
+  }
+  fprintf(log_file, "#      time(us) thread message\n");
+  start_tsc = mpii_tsc();
+  pthread_key_create(&thread_key, thread_exit);
+  if(pthread_create(&flusher, NULL, flusher_loop, NULL) != 0) {
+    fprintf(stderr, "[MPII][P%d] Error: cannot create the log flusher thread. Messages are printed on stderr\n",
+	    mpii_infos.rank);
+    fclose(log_file);
+    return;
+  }
+  atexit(log_finalize);
+  mpii_log_active = 1;
+}
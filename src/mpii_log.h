@@ -0,0 +1,51 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+/* size of the log buffer of each thread, in bytes (a power of 2) */
+#define MPII_LOG_BUFFER_SIZE (256 * 1024)
+
+/* maximum length of a formatted message */
+#define MPII_LOG_MAX_MESSAGE 1024
+
+/* period of the flusher thread, in us */
+#define MPII_LOG_FLUSH_PERIOD 10000
+
+/* 1 when the messages are written to the log file by the flusher thread */
+extern int mpii_log_active;
+
+/* start logging to mpii_log.<rank>.txt. Called once the rank is known */
+void mpii_log_init(void);
+
+/* record a message in the buffer of the current thread. The message is
+ * formatted by the current thread, and written by the flusher thread
+ */
+void mpii_log_printf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+/* record that the current thread enters (or leaves) the MPI function
+ * function, a string that must not be freed. The message is formatted
+ * by the flusher thread
+ */
+void mpii_log_function(const char* event, const char* function);
+
+/* print a message, either in the log file or on stderr */
+#define MPII_LOG(...) do {					\
+    if(mpii_log_active)						\
+      mpii_log_printf(__VA_ARGS__);				\
+    else							\
+      fprintf(stderr, __VA_ARGS__);				\
+  } while(0)
+
+/* print "[rank/size]\t<event> <function>" */
+#define MPII_LOG_FUNCTION(event, function) do {				\
+    if(mpii_log_active)							\
+      mpii_log_function(event, function);				\
+    else								\
+      fprintf(stderr, "[%d/%d]\t%s %s\n", mpii_infos.rank, mpii_infos.size, event, function); \
+  } while(0)
@@ -0,0 +1,299 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Performance counters per MPI function (MPII_PERF_EVENTS=1).
+ *
+ * Each thread opens a group of perf events the first time it calls
+ * MPI: cycles, instructions, cache misses, context switches and page
+ * faults. The group is read (with a single read(), thanks to
+ * PERF_FORMAT_GROUP) when the thread enters and leaves an MPI function,
+ * and the differences are accumulated per function. The differences
+ * between leaving MPI and entering it again are accumulated apart, so
+ * that the effect of the MPI calls on the computation (eg. the cache
+ * misses of the compute phases) can be compared with a run without MPI
+ * calls.
+ *
+ * If the hardware events cannot be opened (no PMU, for instance in a
+ * virtual machine, or perf_event_paranoid forbids them), cycles are
+ * replaced with the task clock, and only the software events are
+ * counted. Kernel events are excluded if perf_event_paranoid requires
+ * it.
+ */
+
+#include "mpii.h"
+#include "mpii_perf.h"
+#include "mpii_thread_list.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct event {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+};
+
+static const struct event hardware_events[MPII_PERF_NB_EVENTS] = {
+  [MPII_PERF_CYCLES] = { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  [MPII_PERF_INSTRUCTIONS] = { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  [MPII_PERF_CACHE_MISSES] = { "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  [MPII_PERF_CONTEXT_SWITCHES] = { "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+  [MPII_PERF_PAGE_FAULTS] = { "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+/* replaces the cycles when the hardware events are not available */
+static const struct event task_clock = { "task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK };
+
+/* events opened by the threads. They are selected by the first thread */
+static struct event events[MPII_PERF_NB_EVENTS];
+static int available[MPII_PERF_NB_EVENTS];
+static int exclude_kernel = 0;
+static int configured = 0;
+static pthread_mutex_t configure_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct counters {
+  uint64_t nb_calls;
+  uint64_t values[MPII_PERF_NB_EVENTS];
+};
+
+struct thread_perf {
+  struct thread_perf* next;
+  int leader;				/* file descriptor of the group (-1: no event) */
+  int fds[MPII_PERF_NB_EVENTS];		/* file descriptors of the events (-1: not opened) */
+  int slots[MPII_PERF_NB_EVENTS];	/* position of the events in the group */
+  uint64_t entry[MPII_PERF_NB_EVENTS];	/* values when entering MPI */
+  uint64_t exit[MPII_PERF_NB_EVENTS];	/* values when leaving MPI */
+  int has_exited;
+  struct counters outside;		/* between two MPI calls */
+  struct counters functions[MPII_STATS_MAX_FUNCTIONS];
+};
+
+static struct mpii_thread_list threads = MPII_THREAD_LIST_INITIALIZER("the perf events");
+static __thread struct thread_perf* my_perf = NULL;
+
+/* closes the events of the threads that exit */
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+static int perf_event_open(const struct event* e, int group, int exclude) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = e->type;
+  attr.config = e->config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.exclude_kernel = exclude;
+  attr.exclude_hv = 1;
+  /* count the current thread, on any cpu */
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+/* select the events that can be opened. Called by the first thread */
+static void configure(void) {
+  for(int i = 0; i < MPII_PERF_NB_EVENTS; i++) {
+    events[i] = hardware_events[i];
+    int fd = perf_event_open(&events[i], -1, exclude_kernel);
+    if(fd < 0 && (errno == EACCES || errno == EPERM) && !exclude_kernel) {
+      /* perf_event_paranoid only allows counting the user space */
+      exclude_kernel = 1;
+      fd = perf_event_open(&events[i], -1, exclude_kernel);
+    }
+    if(fd < 0 && i == MPII_PERF_CYCLES) {
+      events[i] = task_clock;
+      fd = perf_event_open(&events[i], -1, exclude_kernel);
+    }
+    if(fd >= 0) {
+      available[i] = 1;
+      close(fd);
+    }
+  }
+
+  int nb_available = 0;
+  for(int i = 0; i < MPII_PERF_NB_EVENTS; i++)
+    nb_available += available[i];
+  if(nb_available == 0)
+    fprintf(stderr, "[MPII][P%d] Warning: cannot open any perf event: %s\n",
+	    mpii_infos.rank, strerror(errno));
+  else if(events[MPII_PERF_CYCLES].type != PERF_TYPE_HARDWARE)
+    MPII_PRINTF(1, "[MPII][P%d] Hardware perf events are not available, counting the software events\n",
+		mpii_infos.rank);
+}
+
+static void thread_exit(void* arg) {
+  struct thread_perf* t = arg;
+  t->leader = -1;
+  for(int i = 0; i < MPII_PERF_NB_EVENTS; i++) {
+    if(t->fds[i] >= 0)
+      close(t->fds[i]);
+    t->fds[i] = -1;
+  }
+}
+
+static void create_thread_key(void) {
+  pthread_key_create(&thread_key, thread_exit);
+}
+
+/* open the events of the current thread */
+static void open_events(struct thread_perf* t) {
+  t->leader = -1;
+  int position = 0;
+  for(int i = 0; i < MPII_PERF_NB_EVENTS; i++) {
+    t->fds[i] = available[i] ? perf_event_open(&events[i], t->leader, exclude_kernel) : -1;
+    if(t->fds[i] < 0)
+      continue;
+    if(t->leader < 0)
+      t->leader = t->fds[i];
+    t->slots[i] = position++;
+  }
+}
+
+static struct thread_perf* get_thread_perf(void) {
+  if(!my_perf) {
+    pthread_mutex_lock(&configure_lock);
+    if(!configured) {
+      configure();
+      configured = 1;
+    }
+    pthread_mutex_unlock(&configure_lock);
+
+    struct thread_perf* t = mpii_thread_list_alloc(&threads, sizeof(struct thread_perf));
+    open_events(t);
+    pthread_once(&thread_key_once, create_thread_key);
+    pthread_setspecific(thread_key, t);
+    mpii_thread_list_add(&threads, t);
+    my_perf = t;
+  }
+  return my_perf;
+}
+
+/* read the events of t in values. Return 0 on success */
+static int read_events(struct thread_perf* t, uint64_t* values) {
+  uint64_t buffer[1 + MPII_PERF_NB_EVENTS];
+  if(t->leader < 0 || read(t->leader, buffer, sizeof(buffer)) < (ssize_t)sizeof(uint64_t))
+    return -1;
+  for(int i = 0; i < MPII_PERF_NB_EVENTS; i++)
+    values[i] = t->fds[i] >= 0 && (uint64_t)t->slots[i] < buffer[0] ? buffer[1 + t->slots[i]] : 0;
+  return 0;
+}
+
+static void accumulate(struct counters* c, const uint64_t* start, const uint64_t* end) {
+  c->nb_calls++;
+  for(int i = 0; i < MPII_PERF_NB_EVENTS; i++)
+    c->values[i] += end[i] - start[i];
+}
+
+void mpii_perf_enter(void) {
+  struct thread_perf* t = get_thread_perf();
+  if(read_events(t, t->entry) < 0)
+    return;
+  if(t->has_exited)
+    accumulate(&t->outside, t->exit, t->entry);
+}
+
+void mpii_perf_exit(int function) {
+  struct thread_perf* t = get_thread_perf();
+  if(read_events(t, t->exit) < 0)
+    return;
+  accumulate(&t->functions[function], t->entry, t->exit);
+  t->has_exited = 1;
+}
+
+static void print_counters(const char* name, const struct counters* c) {
+  printf("[MPII][P%d] %-24s %12" PRIu64, mpii_infos.rank, name, c->nb_calls);
+  if(events[MPII_PERF_CYCLES].type == PERF_TYPE_HARDWARE)
+    printf(" %16" PRIu64, c->values[MPII_PERF_CYCLES]);
+  else
+    /* the task clock is in ns */
+    printf(" %16.1f", c->values[MPII_PERF_CYCLES] / 1e3);
+
+  uint64_t instructions = c->values[MPII_PERF_INSTRUCTIONS];
+  if(available[MPII_PERF_INSTRUCTIONS]) {
+    printf(" %16" PRIu64, instructions);
+    if(available[MPII_PERF_CYCLES] && c->values[MPII_PERF_CYCLES] &&
+       events[MPII_PERF_CYCLES].type == PERF_TYPE_HARDWARE)
+      printf(" %6.2f", (double)instructions / c->values[MPII_PERF_CYCLES]);
+    else
+      printf(" %6s", "-");
+  } else {
+    printf(" %16s %6s", "-", "-");
+  }
+
+  if(available[MPII_PERF_CACHE_MISSES]) {
+    printf(" %14" PRIu64, c->values[MPII_PERF_CACHE_MISSES]);
+    if(instructions)
+      printf(" %8.2f", 1e3 * c->values[MPII_PERF_CACHE_MISSES] / instructions);
+    else
+      printf(" %8s", "-");
+  } else {
+    printf(" %14s %8s", "-", "-");
+  }
+
+  for(int i = MPII_PERF_CONTEXT_SWITCHES; i <= MPII_PERF_PAGE_FAULTS; i++) {
+    if(available[i])
+      printf(" %12" PRIu64, c->values[i]);
+    else
+      printf(" %12s", "-");
+  }
+  printf("\n");
+}
+
+static int compare_cycles(const void* a, const void* b) {
+  const struct counters* ca = a;
+  const struct counters* cb = b;
+  if(ca->values[MPII_PERF_CYCLES] == cb->values[MPII_PERF_CYCLES]) return 0;
+  return ca->values[MPII_PERF_CYCLES] < cb->values[MPII_PERF_CYCLES] ? 1 : -1;
+}
+
+void mpii_perf_report(void) {
+  int nb_functions = mpii_stats_nb_functions();
+  /* keep track of the function names when sorting */
+  struct {
+    struct counters counters;
+    int function;
+  }* merged = calloc(nb_functions, sizeof(*merged));
+  if(!merged)
+    return;
+  struct counters outside;
+  memset(&outside, 0, sizeof(outside));
+
+  mpii_thread_list_lock(&threads);
+  for(struct thread_perf* t = threads.head; t; t = t->next) {
+    outside.nb_calls += t->outside.nb_calls;
+    for(int e = 0; e < MPII_PERF_NB_EVENTS; e++)
+      outside.values[e] += t->outside.values[e];
+    for(int i = 0; i < nb_functions; i++) {
+      merged[i].counters.nb_calls += t->functions[i].nb_calls;
+      for(int e = 0; e < MPII_PERF_NB_EVENTS; e++)
+	merged[i].counters.values[e] += t->functions[i].values[e];
+    }
+  }
+  mpii_thread_list_unlock(&threads);
+
+  for(int i = 0; i < nb_functions; i++)
+    merged[i].function = i;
+  /* counters is the first field, so compare_cycles works on the whole entries */
+  qsort(merged, nb_functions, sizeof(*merged), compare_cycles);
+
+  printf("[MPII][P%d] Perf events per MPI function%s:\n", mpii_infos.rank,
+	 exclude_kernel ? " (user space only)" : "");
+  printf("[MPII][P%d] %-24s %12s %16s %16s %6s %14s %8s %12s %12s\n", mpii_infos.rank,
+	 "function", "calls",
+	 events[MPII_PERF_CYCLES].type == PERF_TYPE_HARDWARE ? "cycles" : "task-clock(us)",
+	 "instructions", "IPC", "cache-misses", "MPKI", "ctx-switches", "page-faults");
+  print_counters("(outside MPI)", &outside);
+  for(int i = 0; i < nb_functions; i++) {
+    if(merged[i].counters.nb_calls == 0)
+      continue;
+    print_counters(mpii_stats_function_name(merged[i].function), &merged[i].counters);
+  }
+  free(merged);
+}
@@ -0,0 +1,32 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+/* events counted by each thread. When the hardware events are not
+ * available (no PMU, or perf_event_paranoid forbids them), cycles are
+ * replaced with the task clock, and the other hardware events are not
+ * counted
+ */
+enum mpii_perf_event {
+  MPII_PERF_CYCLES,
+  MPII_PERF_INSTRUCTIONS,
+  MPII_PERF_CACHE_MISSES,
+  MPII_PERF_CONTEXT_SWITCHES,
+  MPII_PERF_PAGE_FAULTS,
+  MPII_PERF_NB_EVENTS
+};
+
+/* called when the current thread enters an MPI function */
+void mpii_perf_enter(void);
+
+/* called when the current thread leaves the MPI function function */
+void mpii_perf_exit(int function);
+
+/* print the counters of each MPI function, and of the code that runs
+ * outside MPI
+ */
+void mpii_perf_report(void);
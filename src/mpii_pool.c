@@ -0,0 +1,95 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Pool of temporary buffers (eg. the copy of the data sent by
+ * MPI_Sendrecv_replace).
+ *
+ * Buffers are rounded up to a power of two, and the released buffers
+ * are kept in one free list per size, so that the next allocations of
+ * the same size do not call malloc.
+ */
+
+#include "mpii.h"
+#include "mpii_pool.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+/* the smallest buffer is 1 << MIN_CLASS bytes */
+#define MIN_CLASS 12
+#define NB_CLASSES 64
+
+/* header stored before each buffer. It is padded so that the buffer
+ * is as aligned as a buffer returned by malloc
+ */
+struct pool_buffer {
+  struct pool_buffer* next;
+  int size_class;
+} CACHE_ALIGNED;
+
+static struct {
+  pthread_mutex_t lock;
+  struct pool_buffer* free_list;
+  int nb_free;
+} classes[NB_CLASSES];
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static void pool_init(void) {
+  for(int i = 0; i < NB_CLASSES; i++) {
+    pthread_mutex_init(&classes[i].lock, NULL);
+    classes[i].free_list = NULL;
+    classes[i].nb_free = 0;
+  }
+}
+
+static int size_class(size_t size) {
+  if(size <= ((size_t)1 << MIN_CLASS))
+    return MIN_CLASS;
+  return 64 - __builtin_clzll((unsigned long long)(size - 1));
+}
+
+void* mpii_pool_alloc(size_t size) {
+  pthread_once(&pool_once, pool_init);
+  int c = size_class(size);
+  if(c >= NB_CLASSES)
+    return NULL;
+
+  struct pool_buffer* b = NULL;
+  pthread_mutex_lock(&classes[c].lock);
+  if(classes[c].free_list) {
+    b = classes[c].free_list;
+    classes[c].free_list = b->next;
+    classes[c].nb_free--;
+  }
+  pthread_mutex_unlock(&classes[c].lock);
+
+  if(!b) {
+    b = malloc(sizeof(struct pool_buffer) + ((size_t)1 << c));
+    if(!b)
+      return NULL;
+    b->size_class = c;
+  }
+  return b + 1;
+}
+
+void mpii_pool_free(void* buffer) {
+  if(!buffer)
+    return;
+  struct pool_buffer* b = (struct pool_buffer*)buffer - 1;
+  int c = b->size_class;
+
+  pthread_mutex_lock(&classes[c].lock);
+  if(classes[c].nb_free < MPII_POOL_MAX_CACHED) {
+    b->next = classes[c].free_list;
+    classes[c].free_list = b;
+    classes[c].nb_free++;
+    b = NULL;
+  }
+  pthread_mutex_unlock(&classes[c].lock);
+  /* the pool is full */
+  free(b);
+}
@@ -0,0 +1,20 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+/* maximum number of free buffers kept for each size class */
+#define MPII_POOL_MAX_CACHED 8
+
+/* allocate a temporary buffer of at least size bytes. The buffer is
+ * taken from a pool of previously released buffers if possible
+ */
+void* mpii_pool_alloc(size_t size);
+
+/* release a buffer allocated with mpii_pool_alloc */
+void mpii_pool_free(void* buffer);
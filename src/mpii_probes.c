@@ -0,0 +1,27 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Semaphores of the USDT probes (see mpii_probes.h). Tracers find them
+ * in the .probes section, and increment them when they attach to a
+ * probe
+ */
+
+#include "mpii.h"
+#include "mpii_probes.h"
+
+#ifdef HAVE_SYS_SDT_H
+
+#define SEMAPHORE(name) \
+  unsigned short MPII_PROBE_SEMAPHORE(name) __attribute__((section(".probes"))) = 0
+
+SEMAPHORE(function_entry);
+SEMAPHORE(function_exit);
+SEMAPHORE(call_args);
+SEMAPHORE(lock_acquire);
+SEMAPHORE(lock_acquired);
+SEMAPHORE(lock_release);
+
+#endif
@@ -0,0 +1,54 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+/* USDT probes (provider mpii), that perf, bpftrace or systemtap can
+ * attach to a running process:
+ *
+ *   function_entry(function_id, thread_rank, function_name)
+ *   function_exit(function_id, thread_rank)
+ *   call_args(function_id, thread_rank, peer, bytes)
+ *   lock_acquire(function_id, thread_rank)	the thread starts waiting for the MPI lock
+ *   lock_acquired(function_id, thread_rank)	the thread got the MPI lock
+ *   lock_release(function_id, thread_rank)
+ *
+ * A probe is a nop until a tracer attaches to it. Each probe has a
+ * semaphore that the tracer increments, so that the arguments that are
+ * costly to compute are only computed when the probe is used.
+ *
+ * The probes are compiled if sys/sdt.h (systemtap-sdt-dev) is found.
+ */
+
+#ifdef HAVE_SYS_SDT_H
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define MPII_PROBE_SEMAPHORE(name) mpii_##name##_semaphore
+
+extern unsigned short MPII_PROBE_SEMAPHORE(function_entry);
+extern unsigned short MPII_PROBE_SEMAPHORE(function_exit);
+extern unsigned short MPII_PROBE_SEMAPHORE(call_args);
+extern unsigned short MPII_PROBE_SEMAPHORE(lock_acquire);
+extern unsigned short MPII_PROBE_SEMAPHORE(lock_acquired);
+extern unsigned short MPII_PROBE_SEMAPHORE(lock_release);
+
+/* 1 if a tracer is attached to the probe name */
+#define MPII_PROBE_ENABLED(name) __builtin_expect(MPII_PROBE_SEMAPHORE(name) != 0, 0)
+
+#define MPII_PROBE2(name, a1, a2) STAP_PROBE2(mpii, name, a1, a2)
+#define MPII_PROBE3(name, a1, a2, a3) STAP_PROBE3(mpii, name, a1, a2, a3)
+#define MPII_PROBE4(name, a1, a2, a3, a4) STAP_PROBE4(mpii, name, a1, a2, a3, a4)
+
+#else
+
+#define MPII_PROBE_ENABLED(name) 0
+#define MPII_PROBE2(name, a1, a2) do { } while(0)
+#define MPII_PROBE3(name, a1, a2, a3) do { } while(0)
+#define MPII_PROBE4(name, a1, a2, a3, a4) do { } while(0)
+
+#endif
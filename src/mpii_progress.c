@@ -0,0 +1,361 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Execution of the MPI calls when the custom thread-safety is enabled.
+ *
+ * In lock mode, each application thread calls MPI while holding the
+ * MPI lock.
+ *
+ * In delegate mode, the application threads describe each MPI call
+ * with an operation (struct mpii_op) and push it in a lock-free
+ * multi-producer/single-consumer queue. A communication thread pops
+ * the operations and executes them. Since only one thread calls MPI,
+ * this works with MPI_THREAD_FUNNELED, and the MPI internal state
+ * stays in the cache of one core. The application thread then waits
+ * until the operation is completed.
+ *
+ * Blocking operations (eg. MPI_Wait) are replaced with their
+ * non-blocking counterpart (eg. MPI_Test) that the communication
+ * thread polls until completion, so that a blocked thread does not
+ * prevent the others from progressing.
+ */
+
+#include "mpii.h"
+#include "mpii_progress.h"
+#include "mpii_combine.h"
+#include "mpii_completion.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char* progress_mode_names[] = MPII_PROGRESS_MODE_NAMES;
+
+int mpii_progress_delegating = 0;
+
+enum op_state {
+  OP_PENDING,	/* the operation has not been completed yet */
+  OP_PARKED,	/* the operation has not been completed, and the caller is parked */
+  OP_DONE	/* the operation is completed */
+};
+
+/* An operation delegated to the communication thread. Operations are
+ * allocated on the stack of the calling thread, which waits until
+ * they are completed
+ */
+struct mpii_op {
+  struct mpii_op* _Atomic next;	/* next operation in the queue */
+  int (*call)(void* arg);	/* call to execute, or NULL */
+  int (*test)(void* arg, int* flag); /* call to poll until completion, or NULL */
+  void* arg;
+  int ret;
+  _Atomic uint32_t state;
+  struct mpii_op* next_pending;	/* next operation being polled */
+};
+
+/* Vyukov's intrusive MPSC queue. Producers push at the head, the
+ * communication thread pops at the tail. stub is a dummy operation that
+ * keeps the queue non-empty.
+ */
+static struct {
+  struct mpii_op* _Atomic head CACHE_ALIGNED;
+  struct mpii_op* tail CACHE_ALIGNED;
+  struct mpii_op stub;
+} queue CACHE_ALIGNED;
+
+static struct {
+  pthread_t thread;
+  /* set when the communication thread waits for operations */
+  _Atomic uint32_t sleeping CACHE_ALIGNED;
+  _Atomic int stop;
+} comm;
+
+/* number of times a caller checks its operation before parking */
+#define SPINS_BEFORE_PARKING 1024
+
+static void queue_init(void) {
+  atomic_store(&queue.stub.next, NULL);
+  atomic_store(&queue.head, &queue.stub);
+  queue.tail = &queue.stub;
+}
+
+static void queue_push(struct mpii_op* op) {
+  atomic_store_explicit(&op->next, NULL, memory_order_relaxed);
+  struct mpii_op* prev = atomic_exchange(&queue.head, op);
+  /* between the exchange and this store, the queue is inconsistent:
+   * the consumer has to wait until op is linked to prev
+   */
+  atomic_store_explicit(&prev->next, op, memory_order_release);
+}
+
+/* Only the communication thread pops operations. Return NULL if the
+ * queue is empty, or if a push is in progress
+ */
+static struct mpii_op* queue_pop(void) {
+  struct mpii_op* tail = queue.tail;
+  struct mpii_op* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  if(tail == &queue.stub) {
+    if(!next)
+      return NULL;
+    queue.tail = next;
+    tail = next;
+    next = atomic_load_explicit(&next->next, memory_order_acquire);
+  }
+
+  if(next) {
+    queue.tail = next;
+    return tail;
+  }
+
+  if(tail != atomic_load(&queue.head))
+    /* a producer is pushing an operation */
+    return NULL;
+
+  /* tail is the last operation. Push the stub so that tail can be removed */
+  queue_push(&queue.stub);
+  next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  if(next) {
+    queue.tail = next;
+    return tail;
+  }
+  return NULL;
+}
+
+static int queue_empty(void) {
+  return atomic_load(&queue.head) == queue.tail;
+}
+
+/* signal the caller that op is completed. op may be deallocated as
+ * soon as its state is set to OP_DONE.
+ */
+static void op_complete(struct mpii_op* op) {
+  if(atomic_exchange_explicit(&op->state, OP_DONE, memory_order_release) == OP_PARKED)
+    mpii_futex_wake(&op->state, 1);
+}
+
+/* push op and wait until the communication thread completes it */
+static int op_submit(struct mpii_op* op) {
+  atomic_store_explicit(&op->state, OP_PENDING, memory_order_relaxed);
+  queue_push(op);
+
+  /* wake up the communication thread. This pairs with the check of
+   * the queue in progress_loop
+   */
+  if(atomic_load(&comm.sleeping) && atomic_exchange(&comm.sleeping, 0))
+    mpii_futex_wake(&comm.sleeping, 1);
+  /* while operations are being polled, the communication thread waits
+   * with mpii_wait_idle and may be parked
+   */
+  mpii_wait_notify();
+
+  uint32_t spins = 0;
+  uint32_t state;
+  while((state = atomic_load_explicit(&op->state, memory_order_acquire)) != OP_DONE) {
+    if(++spins > SPINS_BEFORE_PARKING) {
+      uint32_t expected = OP_PENDING;
+      if(atomic_compare_exchange_strong(&op->state, &expected, OP_PARKED) ||
+	 expected == OP_PARKED)
+	mpii_futex_wait(&op->state, OP_PARKED);
+    } else {
+      mpii_cpu_relax();
+    }
+  }
+  return op->ret;
+}
+
+/* pin the calling thread on cpu. If cpu is -1, pin it on the last cpu
+ * the process is bound to, unless the process is not bound at all
+ */
+static void progress_pin(int cpu) {
+  cpu_set_t mask;
+  if(cpu < 0) {
+    if(sched_getaffinity(0, sizeof(mask), &mask) != 0)
+      return;
+    int nb_cpus = CPU_COUNT(&mask);
+    if(nb_cpus < 2 || nb_cpus >= sysconf(_SC_NPROCESSORS_ONLN))
+      return;
+    for(int i = CPU_SETSIZE - 1; i >= 0; i--) {
+      if(CPU_ISSET(i, &mask)) {
+	cpu = i;
+	break;
+      }
+    }
+  }
+
+  CPU_ZERO(&mask);
+  CPU_SET(cpu, &mask);
+  int ret = pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+  if(ret != 0)
+    fprintf(stderr, "[MPII] Warning: cannot pin the communication thread on cpu %d: %s\n",
+	    cpu, strerror(ret));
+  else
+    MPII_PRINTF(1, "Communication thread pinned on cpu %d\n", cpu);
+}
+
+static void* progress_loop(void* arg) {
+  progress_pin((int)(intptr_t)arg);
+
+  /* operations that are being polled */
+  struct mpii_op* pending = NULL;
+  struct mpii_wait_state wait_state;
+  mpii_wait_start(&wait_state);
+
+  while(1) {
+    int progress = 0;
+
+    /* execute the queued operations in order */
+    struct mpii_op* op;
+    while((op = queue_pop())) {
+      progress = 1;
+      if(op->test) {
+	op->next_pending = pending;
+	pending = op;
+      } else {
+	op->ret = op->call(op->arg);
+	op_complete(op);
+      }
+    }
+
+    /* poll the blocking operations */
+    struct mpii_op** prev = &pending;
+    while((op = *prev)) {
+      int flag = 0;
+      op->ret = op->test(op->arg, &flag);
+      if(flag || op->ret != MPI_SUCCESS) {
+	progress = 1;
+	*prev = op->next_pending;
+	op_complete(op);
+      } else {
+	prev = &op->next_pending;
+      }
+    }
+
+    if(progress) {
+      mpii_wait_start(&wait_state);
+      continue;
+    }
+
+    if(pending) {
+      /* some operations are waiting for messages */
+      mpii_wait_idle(&wait_state);
+      continue;
+    }
+
+    if(atomic_load(&comm.stop) && queue_empty())
+      break;
+
+    /* nothing to do: sleep until an operation is pushed */
+    atomic_store(&comm.sleeping, 1);
+    if(queue_empty() && !atomic_load(&comm.stop))
+      mpii_futex_wait(&comm.sleeping, 1);
+    atomic_store(&comm.sleeping, 0);
+  }
+  return NULL;
+}
+
+int mpii_exec(int (*call)(void* arg), void* arg) {
+  if(mpii_progress_delegating) {
+    struct mpii_op op = { .call = call, .arg = arg };
+    return op_submit(&op);
+  }
+
+  LOCK();
+  int ret = call(arg);
+  mpii_combine_drain();
+  UNLOCK();
+  mpii_wait_notify();
+  return ret;
+}
+
+int mpii_exec_combine(int (*call)(void* arg), void* arg) {
+  if(mpii_progress_delegating || !mpii_infos.settings.combine)
+    return mpii_exec(call, arg);
+  return mpii_combine_exec(call, arg);
+}
+
+int mpii_exec_wait(int (*test)(void* arg, int* flag), void* arg) {
+  if(mpii_progress_delegating) {
+    struct mpii_op op = { .test = test, .arg = arg };
+    return op_submit(&op);
+  }
+
+  if(mpii_infos.settings.completion_engine)
+    return mpii_completion_wait(NULL, NULL, test, arg);
+
+  struct mpii_wait_state wait_state;
+  mpii_wait_start(&wait_state);
+  while(1) {
+    int flag = 0;
+    LOCK();
+    int ret = test(arg, &flag);
+    mpii_combine_drain();
+    UNLOCK();
+    if(flag || ret != MPI_SUCCESS) {
+      mpii_wait_notify();
+      return ret;
+    }
+    mpii_wait_idle(&wait_state);
+  }
+}
+
+struct wait_request_args {
+  MPI_Request* req;
+  MPI_Status* status;
+};
+
+static int wait_request_test(void* arg, int* flag) {
+  struct wait_request_args* a = arg;
+  return libMPI_Test(a->req, flag, a->status);
+}
+
+int mpii_exec_wait_request(MPI_Request* req, MPI_Status* status) {
+  if(!mpii_progress_delegating && mpii_infos.settings.completion_engine)
+    /* the completion engine tests all the single requests at once */
+    return mpii_completion_wait(req, status, NULL, NULL);
+
+  struct wait_request_args args = { req, status };
+  return mpii_exec_wait(wait_request_test, &args);
+}
+
+void mpii_progress_start(int cpu) {
+  queue_init();
+  atomic_store(&comm.stop, 0);
+  atomic_store(&comm.sleeping, 0);
+  int ret = pthread_create(&comm.thread, NULL, progress_loop, (void*)(intptr_t)cpu);
+  if(ret != 0) {
+    fprintf(stderr, "[MPII] Error: cannot create the communication thread: %s\n",
+	    strerror(ret));
+    abort();
+  }
+  mpii_progress_delegating = 1;
+}
+
+void mpii_progress_stop(void) {
+  if(!mpii_progress_delegating)
+    return;
+  mpii_progress_delegating = 0;
+  atomic_store(&comm.stop, 1);
+  if(atomic_exchange(&comm.sleeping, 0))
+    mpii_futex_wake(&comm.sleeping, 1);
+  pthread_join(comm.thread, NULL);
+}
+
+const char* mpii_progress_mode_name(int mode) {
+  if (mode < 0 || mode >= MPII_PROGRESS_NB_MODES)
+    return "unknown";
+  return progress_mode_names[mode];
+}
+
+int mpii_progress_mode_from_name(const char* name) {
+  for (int i = 0; i < MPII_PROGRESS_NB_MODES; i++) {
+    if (strcmp(name, progress_mode_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
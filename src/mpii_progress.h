@@ -0,0 +1,53 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <mpi.h>
+#include "mpii_config.h"
+
+/* execute call(arg) while holding the MPI lock, or delegate it to the
+ * communication thread. Return the value returned by call.
+ */
+int mpii_exec(int (*call)(void* arg), void* arg);
+
+/* same as mpii_exec, but if the lock is busy, the call may be
+ * executed by the lock holder (see mpii_combine.c). This is meant for
+ * short calls that post communications.
+ */
+int mpii_exec_combine(int (*call)(void* arg), void* arg);
+
+/* block until test(arg, &flag) sets flag or fails. This replaces a
+ * blocking MPI call (eg. MPI_Wait) with its non-blocking counterpart
+ * (eg. MPI_Test) so that the MPI lock is not held while waiting.
+ * Return the value returned by the last call to test.
+ */
+int mpii_exec_wait(int (*test)(void* arg, int* flag), void* arg);
+
+/* block until the request req completes (like mpii_exec_wait with
+ * MPI_Test)
+ */
+int mpii_exec_wait_request(MPI_Request* req, MPI_Status* status);
+
+/* start the communication thread. MPI calls are delegated to it
+ * until mpii_progress_stop is called
+ */
+void mpii_progress_start(int cpu);
+
+/* wait until all the delegated calls are processed and stop the
+ * communication thread
+ */
+void mpii_progress_stop(void);
+
+/* are MPI calls delegated to the communication thread ? */
+extern int mpii_progress_delegating;
+
+/* return the name of a progress mode */
+const char* mpii_progress_mode_name(int mode);
+
+/* return the progress mode called name, or -1 if there is no such mode */
+int mpii_progress_mode_from_name(const char* name);
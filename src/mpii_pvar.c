@@ -0,0 +1,488 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* MPI_T performance variables (MPII_PVARS=PERIOD).
+ *
+ * When MPI is initialized, we initialize MPI_T and select the
+ * performance variables that the MPI implementation exposes (eg. the
+ * length of the unexpected message queue), optionally filtered with
+ * MPII_PVARS_FILTER (eg. "unexpected,posted,!psm2"). The variables that are bound to a communicator are
+ * bound to MPI_COMM_WORLD. When a variable has several elements (eg. one
+ * per peer), its elements are summed.
+ *
+ * The variables are sampled when a thread leaves an MPI function, at
+ * most once every PERIOD ms. Reading them requires calling MPI, so the
+ * sample is taken with MPII_EXEC. Each thread also accumulates the time
+ * it waits for and holds the MPI lock, so that each sample can be
+ * correlated with the lock contention during the last period.
+ *
+ * The samples are written to mpii_pvars.<rank>.csv. When MPI is
+ * finalized, the minimum, mean and maximum of each variable (the rate
+ * of the counters) are printed, with their correlation to the lock
+ * wait and hold times.
+ */
+
+#include "mpii.h"
+#include "mpii_pvar.h"
+#include "mpii_thread_list.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NAME_LENGTH 64
+
+/* variables sampled when MPII_PVARS_FILTER is not set. Open MPI 4
+ * crashes when allocating a handle for the variables of the psm2 MTL
+ * if another MTL is used
+ */
+#define DEFAULT_FILTER "!mtl_psm2"
+
+/* lock statistics of a thread. Only the thread writes them, the thread
+ * that takes a sample reads them
+ */
+struct thread_counters {
+  struct thread_counters* next;
+  uint64_t nb_calls;
+  uint64_t lock_wait;
+  uint64_t lock_hold;
+  uint64_t hold_start;	/* only accessed by the thread */
+};
+
+/* running sums used to compute the statistics of a series */
+struct series {
+  uint64_t nb_samples;
+  double min;
+  double max;
+  double sum;
+  double sum_squares;
+  double sum_wait;		/* sum of the products with the lock wait */
+  double sum_hold;		/* sum of the products with the lock hold */
+};
+
+struct variable {
+  char name[NAME_LENGTH];
+  int var_class;
+  MPI_Datatype datatype;
+  int count;			/* number of elements */
+  int continuous;
+  MPI_T_pvar_handle handle;
+  void* buffer;			/* count elements */
+  double value;			/* sum of the elements at the last sample */
+  double sample;		/* value (increase for the counters) at the last sample */
+  struct series series;
+};
+
+static struct variable variables[MPII_PVAR_MAX_VARIABLES];
+static int nb_variables = 0;
+static MPI_T_pvar_session session;
+static MPI_Comm comm_world;
+
+/* 1 while the variables can be sampled */
+static int sampling = 0;
+/* mpii_tsc timestamp of the next sample */
+static uint64_t next_sample = 0;
+/* sampling period, in cycles. Until the TSC frequency is known, the
+ * variables are sampled at each call
+ */
+static uint64_t period_cycles = 0;
+/* protects the samples */
+static pthread_mutex_t samples_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* values at the previous sample */
+static uint64_t first_tsc = 0;
+static uint64_t last_tsc = 0;
+static uint64_t last_wait = 0;
+static uint64_t last_hold = 0;
+static uint64_t last_calls = 0;
+static uint64_t nb_samples = 0;
+
+/* fraction of the period spent waiting for (and holding) the MPI lock,
+ * summed over the threads
+ */
+static struct series wait_series = { .min = INFINITY, .max = -INFINITY };
+static struct series hold_series = { .min = INFINITY, .max = -INFINITY };
+
+static FILE* csv = NULL;
+
+static struct mpii_thread_list threads = MPII_THREAD_LIST_INITIALIZER("the performance variables");
+static __thread struct thread_counters* my_counters = NULL;
+
+static const char* class_names[] = {
+  [MPI_T_PVAR_CLASS_STATE] = "state",
+  [MPI_T_PVAR_CLASS_LEVEL] = "level",
+  [MPI_T_PVAR_CLASS_SIZE] = "size",
+  [MPI_T_PVAR_CLASS_PERCENTAGE] = "percentage",
+  [MPI_T_PVAR_CLASS_HIGHWATERMARK] = "highwatermark",
+  [MPI_T_PVAR_CLASS_LOWWATERMARK] = "lowwatermark",
+  [MPI_T_PVAR_CLASS_COUNTER] = "counter",
+  [MPI_T_PVAR_CLASS_AGGREGATE] = "aggregate",
+  [MPI_T_PVAR_CLASS_TIMER] = "timer",
+  [MPI_T_PVAR_CLASS_GENERIC] = "generic",
+};
+
+/* return 1 if the variable only increases. Such variables are
+ * reported as rates
+ */
+static int is_counter(int var_class) {
+  return var_class == MPI_T_PVAR_CLASS_COUNTER ||
+    var_class == MPI_T_PVAR_CLASS_AGGREGATE ||
+    var_class == MPI_T_PVAR_CLASS_TIMER;
+}
+
+static struct thread_counters* get_thread_counters(void) {
+  if(!my_counters) {
+    my_counters = mpii_thread_list_alloc(&threads, sizeof(struct thread_counters));
+    mpii_thread_list_add(&threads, my_counters);
+  }
+  return my_counters;
+}
+
+/* return 1 if name is selected by filter, a comma-separated list of
+ * substrings. Names that contain a substring prefixed with ! are
+ * excluded. If filter only contains exclusions, the other names are
+ * selected
+ */
+static int match_filter(const char* name, const char* filter) {
+  int included = 0;
+  int has_inclusions = 0;
+  const char* start = filter;
+  while(*start) {
+    const char* end = strchr(start, ',');
+    size_t len = end ? (size_t)(end - start) : strlen(start);
+    int exclude = len > 0 && *start == '!';
+    const char* pattern = exclude ? start + 1 : start;
+    size_t pattern_len = exclude ? len - 1 : len;
+    int match = 0;
+    for(const char* p = name; pattern_len > 0 && *p; p++) {
+      if(strncmp(p, pattern, pattern_len) == 0) {
+	match = 1;
+	break;
+      }
+    }
+    if(exclude && match)
+      return 0;
+    if(!exclude && pattern_len > 0) {
+      has_inclusions = 1;
+      included |= match;
+    }
+    if(!end)
+      break;
+    start = end + 1;
+  }
+  return included || !has_inclusions;
+}
+
+static int datatype_size(MPI_Datatype datatype) {
+  if(datatype == MPI_INT || datatype == MPI_UNSIGNED)
+    return sizeof(int);
+  if(datatype == MPI_UNSIGNED_LONG)
+    return sizeof(unsigned long);
+  if(datatype == MPI_UNSIGNED_LONG_LONG)
+    return sizeof(unsigned long long);
+  if(datatype == MPI_COUNT)
+    return sizeof(MPI_Count);
+  if(datatype == MPI_DOUBLE)
+    return sizeof(double);
+  return 0;
+}
+
+/* return the sum of the elements of v */
+static double variable_sum(struct variable* v) {
+  double sum = 0;
+  for(int i = 0; i < v->count; i++) {
+    if(v->datatype == MPI_INT)
+      sum += ((int*)v->buffer)[i];
+    else if(v->datatype == MPI_UNSIGNED)
+      sum += ((unsigned*)v->buffer)[i];
+    else if(v->datatype == MPI_UNSIGNED_LONG)
+      sum += ((unsigned long*)v->buffer)[i];
+    else if(v->datatype == MPI_UNSIGNED_LONG_LONG)
+      sum += ((unsigned long long*)v->buffer)[i];
+    else if(v->datatype == MPI_COUNT)
+      sum += ((MPI_Count*)v->buffer)[i];
+    else if(v->datatype == MPI_DOUBLE)
+      sum += ((double*)v->buffer)[i];
+  }
+  return sum;
+}
+
+/* select the variable index. Return 0 if it can be sampled */
+static int select_variable(int index, const char* filter) {
+  char name[NAME_LENGTH];
+  char desc[1024];
+  int name_len = sizeof(name);
+  int desc_len = sizeof(desc);
+  int verbosity, var_class, bind, readonly, continuous, atomic;
+  MPI_Datatype datatype;
+  MPI_T_enum enumtype;
+  if(MPI_T_pvar_get_info(index, name, &name_len, &verbosity, &var_class, &datatype, &enumtype,
+			 desc, &desc_len, &bind, &readonly, &continuous, &atomic) != MPI_SUCCESS)
+    return -1;
+
+  if(var_class == MPI_T_PVAR_CLASS_STATE || var_class == MPI_T_PVAR_CLASS_GENERIC)
+    return -1;
+  if(datatype_size(datatype) == 0)
+    return -1;
+  if(bind != MPI_T_BIND_NO_OBJECT && bind != MPI_T_BIND_MPI_COMM)
+    return -1;
+  if(!match_filter(name, filter))
+    return -1;
+  /* some implementations register the same variable several times */
+  for(int i = 0; i < nb_variables; i++) {
+    if(strcmp(variables[i].name, name) == 0)
+      return -1;
+  }
+
+  struct variable* v = &variables[nb_variables];
+  void* object = bind == MPI_T_BIND_MPI_COMM ? &comm_world : NULL;
+  if(MPI_T_pvar_handle_alloc(session, index, object, &v->handle, &v->count) != MPI_SUCCESS)
+    return -1;
+  if(v->count <= 0 || !(v->buffer = calloc(v->count, datatype_size(datatype)))) {
+    MPI_T_pvar_handle_free(session, &v->handle);
+    return -1;
+  }
+  if(!continuous && MPI_T_pvar_start(session, v->handle) != MPI_SUCCESS) {
+    MPI_T_pvar_handle_free(session, &v->handle);
+    free(v->buffer);
+    return -1;
+  }
+  strncpy(v->name, name, NAME_LENGTH - 1);
+  v->var_class = var_class;
+  v->datatype = datatype;
+  v->continuous = continuous;
+  v->series.min = INFINITY;
+  v->series.max = -INFINITY;
+  nb_variables++;
+  return 0;
+}
+
+static int init_call(void* arg) {
+  const char* filter = arg;
+  int provided;
+  int ret = MPI_T_init_thread(MPI_THREAD_MULTIPLE, &provided);
+  if(ret != MPI_SUCCESS)
+    return ret;
+  ret = MPI_T_pvar_session_create(&session);
+  if(ret != MPI_SUCCESS) {
+    MPI_T_finalize();
+    return ret;
+  }
+  int nb_pvars = 0;
+  MPI_T_pvar_get_num(&nb_pvars);
+  for(int i = 0; i < nb_pvars && nb_variables < MPII_PVAR_MAX_VARIABLES; i++)
+    select_variable(i, filter);
+  return MPI_SUCCESS;
+}
+
+static void add_to_series(struct series* s, double x, double wait, double hold) {
+  s->nb_samples++;
+  if(x < s->min) s->min = x;
+  if(x > s->max) s->max = x;
+  s->sum += x;
+  s->sum_squares += x * x;
+  s->sum_wait += x * wait;
+  s->sum_hold += x * hold;
+}
+
+/* read the variables and the lock statistics. Called with samples_lock held */
+static int sample_call(void* arg MAYBE_UNUSED) {
+  if(!sampling)
+    return MPI_SUCCESS;
+
+  uint64_t now = mpii_tsc();
+  for(int i = 0; i < nb_variables; i++) {
+    struct variable* v = &variables[i];
+    if(MPI_T_pvar_read(session, v->handle, v->buffer) != MPI_SUCCESS)
+      continue;
+    double value = variable_sum(v);
+    /* counters are reported as the increase during the period */
+    v->sample = is_counter(v->var_class) ? value - v->value : value;
+    v->value = value;
+  }
+
+  uint64_t nb_calls = 0, wait = 0, hold = 0;
+  mpii_thread_list_lock(&threads);
+  for(struct thread_counters* t = threads.head; t; t = t->next) {
+    nb_calls += __atomic_load_n(&t->nb_calls, __ATOMIC_RELAXED);
+    wait += __atomic_load_n(&t->lock_wait, __ATOMIC_RELAXED);
+    hold += __atomic_load_n(&t->lock_hold, __ATOMIC_RELAXED);
+  }
+  mpii_thread_list_unlock(&threads);
+
+  double us_per_cycle = mpii_stats_us_per_cycle();
+  if(nb_samples == 0) {
+    first_tsc = now;
+  } else if(now > last_tsc) {
+    /* the first sample has no period to be compared with */
+    double period = now - last_tsc;
+    double wait_fraction = (wait - last_wait) / period;
+    double hold_fraction = (hold - last_hold) / period;
+    add_to_series(&wait_series, wait_fraction, wait_fraction, hold_fraction);
+    add_to_series(&hold_series, hold_fraction, wait_fraction, hold_fraction);
+    for(int i = 0; i < nb_variables; i++) {
+      double x = variables[i].sample;
+      if(is_counter(variables[i].var_class) && us_per_cycle > 0)
+	x = x / (period * us_per_cycle) * 1e6;
+      add_to_series(&variables[i].series, x, wait_fraction, hold_fraction);
+    }
+  }
+
+  if(csv) {
+    fprintf(csv, "%.1f,%" PRIu64 ",%.1f,%.1f", (now - first_tsc) * us_per_cycle,
+	    nb_calls - last_calls, (wait - last_wait) * us_per_cycle,
+	    (hold - last_hold) * us_per_cycle);
+    for(int i = 0; i < nb_variables; i++)
+      fprintf(csv, ",%.17g", variables[i].value);
+    fprintf(csv, "\n");
+  }
+
+  last_tsc = now;
+  last_wait = wait;
+  last_hold = hold;
+  last_calls = nb_calls;
+  nb_samples++;
+
+  if(us_per_cycle > 0)
+    period_cycles = mpii_infos.settings.pvars * 1e3 / us_per_cycle;
+  return MPI_SUCCESS;
+}
+
+void mpii_pvar_init(void) {
+  comm_world = MPI_COMM_WORLD;
+  const char* filter = getenv("MPII_PVARS_FILTER");
+  if(!filter)
+    filter = DEFAULT_FILTER;
+  if(MPII_EXEC(init_call, (void*)filter) != MPI_SUCCESS) {
+    fprintf(stderr, "[MPII][P%d] Warning: cannot initialize MPI_T. The performance variables are not sampled\n",
+	    mpii_infos.rank);
+    return;
+  }
+  MPII_PRINTF(1, "[MPII][P%d] %d performance variables are sampled\n", mpii_infos.rank, nb_variables);
+
+  char filename[STRING_LENGTH];
+  snprintf(filename, sizeof(filename), "mpii_pvars.%d.csv", mpii_infos.rank);
+  csv = fopen(filename, "w");
+  if(!csv) {
+    fprintf(stderr, "[MPII][P%d] Error: cannot create %s\n", mpii_infos.rank, filename);
+  } else {
+    fprintf(csv, "time(us),calls,lock_wait(us),lock_hold(us)");
+    for(int i = 0; i < nb_variables; i++)
+      fprintf(csv, ",%s", variables[i].name);
+    fprintf(csv, "\n");
+  }
+  __atomic_store_n(&sampling, 1, __ATOMIC_RELEASE);
+}
+
+void mpii_pvar_poll(void) {
+  struct thread_counters* t = get_thread_counters();
+  __atomic_store_n(&t->nb_calls, t->nb_calls + 1, __ATOMIC_RELAXED);
+
+  if(!__atomic_load_n(&sampling, __ATOMIC_ACQUIRE))
+    return;
+  uint64_t now = mpii_tsc();
+  uint64_t next = __atomic_load_n(&next_sample, __ATOMIC_RELAXED);
+  if(now < next)
+    return;
+  /* only one thread takes the sample */
+  if(!__atomic_compare_exchange_n(&next_sample, &next, now + period_cycles, 0,
+				  __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    return;
+  pthread_mutex_lock(&samples_lock);
+  MPII_EXEC(sample_call, NULL);
+  pthread_mutex_unlock(&samples_lock);
+}
+
+void mpii_pvar_lock_acquired(uint64_t wait_start) {
+  uint64_t now = mpii_tsc();
+  struct thread_counters* t = get_thread_counters();
+  __atomic_store_n(&t->lock_wait, t->lock_wait + (now - wait_start), __ATOMIC_RELAXED);
+  t->hold_start = now;
+}
+
+void mpii_pvar_lock_released(void) {
+  struct thread_counters* t = get_thread_counters();
+  __atomic_store_n(&t->lock_hold, t->lock_hold + (mpii_tsc() - t->hold_start), __ATOMIC_RELAXED);
+}
+
+static int finalize_call(void* arg MAYBE_UNUSED) {
+  for(int i = 0; i < nb_variables; i++) {
+    if(!variables[i].continuous)
+      MPI_T_pvar_stop(session, variables[i].handle);
+    MPI_T_pvar_handle_free(session, &variables[i].handle);
+  }
+  MPI_T_pvar_session_free(&session);
+  return MPI_T_finalize();
+}
+
+/* return the correlation between s and the series other, whose sum of
+ * products with s is sum_products
+ */
+static double correlation(const struct series* s, const struct series* other, double sum_products) {
+  double n = s->nb_samples;
+  double covariance = n * sum_products - s->sum * other->sum;
+  double variance_s = n * s->sum_squares - s->sum * s->sum;
+  double variance_other = n * other->sum_squares - other->sum * other->sum;
+  if(variance_s <= 0 || variance_other <= 0)
+    return NAN;
+  return covariance / sqrt(variance_s * variance_other);
+}
+
+static void print_correlation(double c) {
+  if(isnan(c))
+    printf(" %10s", "-");
+  else
+    printf(" %10.2f", c);
+}
+
+void mpii_pvar_report(void) {
+  if(!__atomic_load_n(&sampling, __ATOMIC_ACQUIRE))
+    return;
+  pthread_mutex_lock(&samples_lock);
+  MPII_EXEC(sample_call, NULL);
+  __atomic_store_n(&sampling, 0, __ATOMIC_RELEASE);
+  MPII_EXEC(finalize_call, NULL);
+  pthread_mutex_unlock(&samples_lock);
+  if(csv)
+    fclose(csv);
+
+  printf("[MPII][P%d] Performance variables (%" PRIu64 " samples, every %d ms):\n",
+	 mpii_infos.rank, nb_samples, mpii_infos.settings.pvars);
+  /* the counters are reported as rates, the lock wait and hold times
+   * as the number of threads that wait for or hold the lock
+   */
+  printf("[MPII][P%d] %-40s %-14s %12s %12s %12s %10s %10s\n", mpii_infos.rank,
+	 "variable", "class", "min", "mean", "max", "corr(wait)", "corr(hold)");
+  const struct series* lock_series[] = { &wait_series, &hold_series };
+  const char* lock_names[] = { "(lock wait)", "(lock hold)" };
+  for(int i = 0; i < 2; i++) {
+    const struct series* s = lock_series[i];
+    if(s->nb_samples == 0)
+      continue;
+    printf("[MPII][P%d] %-40s %-14s %12.3f %12.3f %12.3f", mpii_infos.rank, lock_names[i], "threads",
+	   s->min, s->sum / s->nb_samples, s->max);
+    print_correlation(correlation(s, &wait_series, s->sum_wait));
+    print_correlation(correlation(s, &hold_series, s->sum_hold));
+    printf("\n");
+  }
+  for(int i = 0; i < nb_variables; i++) {
+    struct variable* v = &variables[i];
+    const struct series* s = &v->series;
+    if(s->nb_samples == 0)
+      continue;
+    char class_name[32];
+    snprintf(class_name, sizeof(class_name), "%s%s", class_names[v->var_class],
+	     is_counter(v->var_class) ? "/s" : "");
+    printf("[MPII][P%d] %-40s %-14s %12.1f %12.1f %12.1f", mpii_infos.rank, v->name, class_name,
+	   s->min, s->sum / s->nb_samples, s->max);
+    print_correlation(correlation(s, &wait_series, s->sum_wait));
+    print_correlation(correlation(s, &hold_series, s->sum_hold));
+    printf("\n");
+    free(v->buffer);
+  }
+}
@@ -0,0 +1,35 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* maximum number of performance variables that are sampled */
+#define MPII_PVAR_MAX_VARIABLES 64
+
+/* initialize MPI_T and select the performance variables to sample.
+ * Called when MPI is initialized
+ */
+void mpii_pvar_init(void);
+
+/* called when the current thread leaves an MPI function. Sample the
+ * performance variables if the sampling period has elapsed
+ */
+void mpii_pvar_poll(void);
+
+/* record that the current thread got the MPI lock after waiting since
+ * wait_start (a mpii_tsc timestamp)
+ */
+void mpii_pvar_lock_acquired(uint64_t wait_start);
+
+/* record that the current thread released the MPI lock */
+void mpii_pvar_lock_released(void);
+
+/* take a last sample, finalize MPI_T and print the statistics of the
+ * performance variables. Called before MPI is finalized
+ */
+void mpii_pvar_report(void);
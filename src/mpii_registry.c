@@ -0,0 +1,472 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Registry of the outstanding requests (MPII_REQUEST_REGISTRY=1).
+ *
+ * When a request is posted (MPI_Isend, MPI_Irecv, MPI_I* collectives,
+ * MPI_Start, ...), the thread, the time, the peer, the tag, the
+ * communicator and the size of the message are recorded. The entry is
+ * removed when the request is completed by MPI_Wait*, or MPI_Test*,
+ * and the latency of the request is accounted to the function that
+ * posted it.
+ *
+ * The registry also measures how much the requests overlap with the
+ * application: for each request, it records when the request was
+ * posted, when the application first tested or waited it, when MPI
+ * reported its completion, and how long the threads were blocked in
+ * MPI_Test* and MPI_Wait* on it. The overlap of a request is the part
+ * of its lifetime (from its post to its completion) during which no
+ * thread was blocked on it. It is reported per function and per call
+ * site.
+ *
+ * The registry is a hash table that uses open addressing, keyed by
+ * MPI_Request. It is accessed without any lock: a slot is claimed
+ * with a compare-and-swap, and published by writing its entry before
+ * its key. The entries are taken from per-thread free lists, so that
+ * posting a request does not allocate memory once the free list is
+ * warm. An entry always goes back to the thread that allocated it: a
+ * thread that completes the request of another thread pushes the entry
+ * on the return stack of its owner (with a compare-and-swap), and the
+ * owner takes back the whole stack when its free list is empty.
+ *
+ * A handle is recorded only once: MPI may reuse the handle of a
+ * request as soon as it completes (ie. before the thread that
+ * completed it removes its entry), and some MPI implementations return
+ * the same handle for all the requests that complete immediately
+ * (eg. ompi_request_empty). Such requests are not tracked. For the same
+ * reason, MPI_Wait* and MPI_Test* look the entries up before calling
+ * MPI, and an entry is only completed once.
+ */
+
+#include "mpii.h"
+#include "mpii_registry.h"
+#include "mpii_table.h"
+#include "mpii_thread_list.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* maximum number of slots visited when looking for a request */
+#define MAX_PROBES 64
+
+/* number of entries allocated at once when a free list is empty */
+#define ALLOC_BATCH 64
+
+/* maximum number of outstanding requests printed by the report */
+#define MAX_REPORTED_REQUESTS 10
+
+/* initial number of entries of the per-thread tables of call sites */
+#define SITE_TABLE_MIN_SIZE 64
+
+struct registry_slot {
+  _Atomic uintptr_t key;
+  struct mpii_request_info* _Atomic info;
+};
+
+static struct registry_slot slots[MPII_REGISTRY_SIZE];
+static struct mpii_table table = MPII_TABLE_INITIALIZER(slots, MAX_PROBES);
+
+/* latency and overlap of the requests of a function or a call site (in cycles) */
+struct function_latency {
+  uint64_t nb_completed;
+  uint64_t total;
+  uint64_t max;
+  uint64_t before_check;	/* time between the post and the first test or wait */
+  uint64_t blocked;
+};
+
+struct site_latency {
+  const void* site;		/* NULL for the empty entries */
+  int function;
+  struct function_latency latency;
+};
+
+/* Per-thread data. It is kept after the thread exits, since its
+ * entries may still be in the registry
+ */
+struct registry_thread {
+  struct registry_thread* next;
+  struct mpii_request_info* free_infos;
+  /* entries of the thread freed by the other threads */
+  struct mpii_request_info* _Atomic returned_infos;
+  uint64_t nb_posted;
+  uint64_t nb_shared;		/* requests not recorded because their handle is already recorded */
+  uint64_t nb_full;		/* requests not recorded because the registry is full */
+  struct function_latency functions[MPII_STATS_MAX_FUNCTIONS];
+  /* hash table of the call sites that posted the requests completed by the thread */
+  struct site_latency* sites;
+  unsigned sites_capacity;	/* a power of 2 */
+  unsigned nb_sites;
+  /* when the thread started to test or wait requests */
+  uint64_t check_start;
+};
+
+static struct mpii_thread_list threads = MPII_THREAD_LIST_INITIALIZER("the request registry");
+
+static __thread struct registry_thread* my_thread = NULL;
+
+static struct registry_thread* get_thread(void) {
+  if(!my_thread) {
+    struct registry_thread* t = mpii_thread_list_alloc(&threads, sizeof(struct registry_thread));
+    t->sites_capacity = SITE_TABLE_MIN_SIZE;
+    t->sites = mpii_checked_calloc(SITE_TABLE_MIN_SIZE, sizeof(struct site_latency), threads.name);
+    mpii_thread_list_add(&threads, t);
+    my_thread = t;
+  }
+  return my_thread;
+}
+
+static struct mpii_request_info* alloc_info(struct registry_thread* t) {
+  if(!t->free_infos)
+    t->free_infos = atomic_exchange_explicit(&t->returned_infos, NULL, memory_order_acquire);
+  if(!t->free_infos) {
+    struct mpii_request_info* batch = mpii_checked_calloc(ALLOC_BATCH, sizeof(struct mpii_request_info),
+							  threads.name);
+    for(int i = 0; i < ALLOC_BATCH; i++) {
+      batch[i].owner = t;
+      batch[i].next = t->free_infos;
+      t->free_infos = &batch[i];
+    }
+  }
+  struct mpii_request_info* info = t->free_infos;
+  t->free_infos = info->next;
+  return info;
+}
+
+/* give info back to the thread that allocated it. t is the current thread */
+static void free_info(struct registry_thread* t, struct mpii_request_info* info) {
+  struct registry_thread* owner = info->owner;
+  if(owner == t) {
+    info->next = t->free_infos;
+    t->free_infos = info;
+    return;
+  }
+  /* the owner only takes the whole stack, so pushing is not subject to ABA */
+  struct mpii_request_info* head = atomic_load_explicit(&owner->returned_infos, memory_order_relaxed);
+  do {
+    info->next = head;
+  } while(!atomic_compare_exchange_weak_explicit(&owner->returned_infos, &head, info,
+						 memory_order_release, memory_order_relaxed));
+}
+
+struct mpii_request_info* mpii_registry_lookup(MPI_Request req) {
+  if(req == MPI_REQUEST_NULL)
+    return NULL;
+  struct registry_slot* slot = mpii_table_find(&table, MPII_TABLE_KEY(req));
+  return slot ? atomic_load_explicit(&slot->info, memory_order_relaxed) : NULL;
+}
+
+/* insert info in the registry. Return 0 on success, -1 if the handle
+ * is already recorded, or -2 if the registry is full
+ */
+static int insert(struct mpii_request_info* info) {
+  uintptr_t key = MPII_TABLE_KEY(info->request);
+  int found;
+  struct registry_slot* slot = mpii_table_claim(&table, key, &found);
+  if(!slot)
+    return found ? -1 : -2;
+  info->slot = slot - slots;
+  atomic_store_explicit(&slot->info, info, memory_order_relaxed);
+  mpii_table_publish(slot, key);
+  return 0;
+}
+
+/* remove info from the registry */
+static void remove_info(struct registry_thread* t, struct mpii_request_info* info) {
+  mpii_table_clear(&slots[info->slot]);
+  free_info(t, info);
+}
+
+/* fill the fields that describe who posted a request */
+static void set_poster(struct mpii_request_info* info) {
+  info->post_time = mpii_tsc();
+  info->first_check = 0;
+  info->blocked = 0;
+  info->site = mpii_current_call_site;
+  info->thread = thread_rank;
+  info->function = mpii_current_function_id;
+}
+
+static void post(MPI_Request req, int peer, int tag, MPI_Comm comm,
+		 int count, MPI_Datatype datatype, int persistent) {
+  if(req == MPI_REQUEST_NULL)
+    return;
+  struct registry_thread* t = get_thread();
+  struct mpii_request_info* info = alloc_info(t);
+  info->request = req;
+  info->comm = comm;
+  info->bytes = 0;
+  if(count > 0 && datatype != MPI_DATATYPE_NULL) {
+    struct mpii_type_info type_info;
+    if(mpii_type_info(datatype, &type_info) == MPI_SUCCESS)
+      info->bytes = (size_t)count * type_info.size;
+  }
+  info->peer = peer;
+  info->tag = tag;
+  info->persistent = persistent;
+  atomic_store_explicit(&info->active, !persistent, memory_order_relaxed);
+  set_poster(info);
+  if(!persistent) {
+    t->nb_posted++;
+    if(mpii_infos.settings.live)
+      mpii_shm_request_posted();
+  }
+
+  int ret = insert(info);
+  if(ret < 0) {
+    if(ret == -1)
+      t->nb_shared++;
+    else
+      t->nb_full++;
+    free_info(t, info);
+  }
+}
+
+void mpii_registry_post(MPI_Request req, int peer, int tag, MPI_Comm comm,
+			int count, MPI_Datatype datatype) {
+  post(req, peer, tag, comm, count, datatype, 0);
+}
+
+void mpii_registry_post_persistent(MPI_Request req, int peer, int tag, MPI_Comm comm,
+				   int count, MPI_Datatype datatype) {
+  post(req, peer, tag, comm, count, datatype, 1);
+}
+
+void mpii_registry_start(MPI_Request req) {
+  struct mpii_request_info* info = mpii_registry_lookup(req);
+  if(!info)
+    return;
+  set_poster(info);
+  atomic_store_explicit(&info->active, 1, memory_order_relaxed);
+  get_thread()->nb_posted++;
+  if(mpii_infos.settings.live)
+    mpii_shm_request_posted();
+}
+
+/* return the entry of site in sites, or the empty entry where it should be inserted */
+static struct site_latency* find_site(struct site_latency* sites, unsigned capacity,
+				      const void* site) {
+  unsigned index = mpii_hash((uintptr_t)site, capacity);
+  while(sites[index].site && sites[index].site != site)
+    index = (index + 1) & (capacity - 1);
+  return &sites[index];
+}
+
+static struct site_latency* get_site(struct registry_thread* t, const void* site, int function) {
+  struct site_latency* s = find_site(t->sites, t->sites_capacity, site);
+  if(s->site)
+    return s;
+
+  if(2 * (t->nb_sites + 1) > t->sites_capacity) {
+    /* keep the table half empty */
+    unsigned capacity = 2 * t->sites_capacity;
+    struct site_latency* sites = mpii_checked_calloc(capacity, sizeof(struct site_latency), threads.name);
+    for(unsigned i = 0; i < t->sites_capacity; i++)
+      if(t->sites[i].site)
+	*find_site(sites, capacity, t->sites[i].site) = t->sites[i];
+    free(t->sites);
+    t->sites = sites;
+    t->sites_capacity = capacity;
+    s = find_site(t->sites, t->sites_capacity, site);
+  }
+  s->site = site;
+  s->function = function;
+  t->nb_sites++;
+  return s;
+}
+
+static void add_latency(struct function_latency* f, uint64_t latency,
+			uint64_t before_check, uint64_t blocked) {
+  f->nb_completed++;
+  f->total += latency;
+  if(latency > f->max)
+    f->max = latency;
+  f->before_check += before_check;
+  f->blocked += blocked;
+}
+
+void mpii_registry_complete(struct mpii_request_info* info) {
+  /* the same entry may appear several times in an array of requests */
+  if(!info || !atomic_exchange_explicit(&info->active, 0, memory_order_relaxed))
+    return;
+  struct registry_thread* t = get_thread();
+  uint64_t latency = mpii_tsc() - info->post_time;
+  uint64_t before_check = info->first_check ? info->first_check - info->post_time : latency;
+  uint64_t blocked = info->blocked < latency ? info->blocked : latency;
+  add_latency(&t->functions[info->function], latency, before_check, blocked);
+  if(mpii_infos.settings.live)
+    mpii_shm_request_completed(info->function);
+  if(info->site)
+    add_latency(&get_site(t, info->site, info->function)->latency,
+		latency, before_check, blocked);
+  if(!info->persistent)
+    remove_info(t, info);
+}
+
+struct mpii_request_info* mpii_registry_check(MPI_Request req) {
+  struct mpii_request_info* info = mpii_registry_lookup(req);
+  uint64_t now = mpii_tsc();
+  get_thread()->check_start = now;
+  if(info && !info->first_check)
+    info->first_check = now;
+  return info;
+}
+
+struct mpii_request_info** mpii_registry_check_all(int count, const MPI_Request* reqs) {
+  struct mpii_request_info** infos = MPII_ARENA_ALLOC(struct mpii_request_info*, count);
+  uint64_t now = mpii_tsc();
+  get_thread()->check_start = now;
+  for(int i = 0; i < count; i++) {
+    infos[i] = mpii_registry_lookup(reqs[i]);
+    if(infos[i] && !infos[i]->first_check)
+      infos[i]->first_check = now;
+  }
+  return infos;
+}
+
+void mpii_registry_complete_in_status(int count, struct mpii_request_info** infos,
+				      const MPI_Status* statuses) {
+  for(int i = 0; i < count; i++) {
+    /* the other requests completed, possibly with an error */
+    if(statuses[i].MPI_ERROR != MPI_ERR_PENDING)
+      mpii_registry_complete(infos[i]);
+  }
+}
+
+void mpii_registry_check_done(struct mpii_request_info* info) {
+  if(info && atomic_load_explicit(&info->active, memory_order_relaxed))
+    info->blocked += mpii_tsc() - my_thread->check_start;
+}
+
+void mpii_registry_check_done_all(int count, struct mpii_request_info** infos) {
+  uint64_t blocked = mpii_tsc() - my_thread->check_start;
+  for(int i = 0; i < count; i++) {
+    /* the blocked time of an entry that appears several times in the
+     * array is bounded by its latency when it completes
+     */
+    struct mpii_request_info* info = infos[i];
+    if(info && atomic_load_explicit(&info->active, memory_order_relaxed))
+      info->blocked += blocked;
+  }
+}
+
+void mpii_registry_free(MPI_Request req) {
+  struct mpii_request_info* info = mpii_registry_lookup(req);
+  if(info)
+    remove_info(get_thread(), info);
+}
+
+static void merge_latency(struct function_latency* to, const struct function_latency* from) {
+  to->nb_completed += from->nb_completed;
+  to->total += from->total;
+  if(from->max > to->max)
+    to->max = from->max;
+  to->before_check += from->before_check;
+  to->blocked += from->blocked;
+}
+
+/* part of the lifetime of the requests during which no thread was blocked on them, in % */
+static double overlap(const struct function_latency* f) {
+  return f->total ? 100. * (f->total - f->blocked) / f->total : 0;
+}
+
+static int compare_blocked(const void* a, const void* b) {
+  const struct site_latency* sa = a;
+  const struct site_latency* sb = b;
+  if(sa->latency.blocked == sb->latency.blocked) return 0;
+  return sa->latency.blocked < sb->latency.blocked ? 1 : -1;
+}
+
+void mpii_registry_report(void) {
+  double us_per_cycle = mpii_stats_us_per_cycle();
+  uint64_t now = mpii_tsc();
+
+  /* merge the statistics of all the threads */
+  struct function_latency* merged = calloc(MPII_STATS_MAX_FUNCTIONS, sizeof(struct function_latency));
+  if(!merged)
+    return;
+  uint64_t nb_posted = 0;
+  uint64_t nb_shared = 0;
+  uint64_t nb_full = 0;
+  unsigned sites_capacity = SITE_TABLE_MIN_SIZE;
+  mpii_thread_list_lock(&threads);
+  for(struct registry_thread* t = threads.head; t; t = t->next)
+    sites_capacity += 2 * t->nb_sites;
+  while(sites_capacity & (sites_capacity - 1))
+    sites_capacity++;
+  struct site_latency* sites = mpii_checked_calloc(sites_capacity, sizeof(struct site_latency), threads.name);
+  for(struct registry_thread* t = threads.head; t; t = t->next) {
+    nb_posted += t->nb_posted;
+    nb_shared += t->nb_shared;
+    nb_full += t->nb_full;
+    for(int i = 0; i < MPII_STATS_MAX_FUNCTIONS; i++)
+      merge_latency(&merged[i], &t->functions[i]);
+    for(unsigned i = 0; i < t->sites_capacity; i++) {
+      if(!t->sites[i].site)
+	continue;
+      struct site_latency* s = find_site(sites, sites_capacity, t->sites[i].site);
+      s->site = t->sites[i].site;
+      s->function = t->sites[i].function;
+      merge_latency(&s->latency, &t->sites[i].latency);
+    }
+  }
+  mpii_thread_list_unlock(&threads);
+
+  printf("[MPII][P%d] Request registry: %" PRIu64 " requests posted, %" PRIu64
+	 " not tracked (%" PRIu64 " with a shared handle, %" PRIu64 " because the registry is full)\n",
+	 mpii_infos.rank, nb_posted, nb_shared + nb_full, nb_shared, nb_full);
+  /* overlap is the part of the latency during which no thread was blocked on the requests */
+  printf("[MPII][P%d] %-24s %12s %18s %18s %18s %18s %10s\n", mpii_infos.rank,
+	 "function", "completed", "mean latency(us)", "max latency(us)",
+	 "before check(us)", "mean blocked(us)", "overlap(%)");
+  for(int i = 0; i < MPII_STATS_MAX_FUNCTIONS; i++) {
+    struct function_latency* f = &merged[i];
+    if(f->nb_completed == 0)
+      continue;
+    printf("[MPII][P%d] %-24s %12" PRIu64 " %18.2f %18.2f %18.2f %18.2f %10.1f\n", mpii_infos.rank,
+	   mpii_stats_function_name(i), f->nb_completed,
+	   (double)f->total / f->nb_completed * us_per_cycle, f->max * us_per_cycle,
+	   (double)f->before_check / f->nb_completed * us_per_cycle,
+	   (double)f->blocked / f->nb_completed * us_per_cycle, overlap(f));
+  }
+  free(merged);
+
+  /* the call sites whose requests block the threads the longest */
+  unsigned nb_sites = 0;
+  for(unsigned i = 0; i < sites_capacity; i++)
+    if(sites[i].site)
+      sites[nb_sites++] = sites[i];
+  qsort(sites, nb_sites, sizeof(struct site_latency), compare_blocked);
+  for(unsigned i = 0; i < nb_sites && i < MPII_REGISTRY_REPORTED_SITES; i++) {
+    struct site_latency* s = &sites[i];
+    char where[1024];
+    mpii_call_sites_format(where, sizeof(where), s->site);
+    printf("[MPII][P%d] Call site %s: %s, %" PRIu64 " requests, %.2f us blocked per request, %.1f%% overlap\n",
+	   mpii_infos.rank, where, mpii_stats_function_name(s->function), s->latency.nb_completed,
+	   (double)s->latency.blocked / s->latency.nb_completed * us_per_cycle, overlap(&s->latency));
+  }
+  free(sites);
+
+  /* the requests that were never completed */
+  int nb_outstanding = 0;
+  for(int i = 0; i < MPII_REGISTRY_SIZE; i++) {
+    uintptr_t k = atomic_load_explicit(&slots[i].key, memory_order_acquire);
+    if(!mpii_table_valid_key(k))
+      continue;
+    struct mpii_request_info* info = atomic_load_explicit(&slots[i].info, memory_order_relaxed);
+    if(!atomic_load_explicit(&info->active, memory_order_relaxed))
+      continue;
+    if(nb_outstanding++ < MAX_REPORTED_REQUESTS)
+      printf("[MPII][P%d] Outstanding request: %s posted by thread %d %.0f us ago (peer %d, tag %d, %zu bytes)\n",
+	     mpii_infos.rank, mpii_stats_function_name(info->function), info->thread,
+	     (now - info->post_time) * us_per_cycle, info->peer, info->tag, info->bytes);
+  }
+  if(nb_outstanding > 0)
+    printf("[MPII][P%d] %d requests are still outstanding\n", mpii_infos.rank, nb_outstanding);
+}
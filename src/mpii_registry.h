@@ -0,0 +1,101 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <mpi.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* number of slots of the registry. When the registry is full, the
+ * new requests are not tracked
+ */
+#define MPII_REGISTRY_SIZE (1 << 16)
+
+/* what the registry knows about an outstanding request */
+struct mpii_request_info {
+  MPI_Request request;
+  MPI_Comm comm;
+  uint64_t post_time;		/* mpii_tsc() when the request was posted */
+  uint64_t first_check;		/* mpii_tsc() when the request was first tested or waited (0 if never) */
+  uint64_t blocked;		/* time spent in the MPI_Test* and MPI_Wait* calls on the request */
+  const void* site;		/* return address of the function that posted the request */
+  size_t bytes;			/* count * datatype size (0 if unknown) */
+  int peer;			/* rank of the peer, or root of a collective (-1 if none) */
+  int tag;			/* -1 for collectives */
+  int thread;			/* rank of the thread that posted the request */
+  int function;			/* id of the MPI function that posted the request */
+  int persistent;		/* 1 for the requests created by MPI_*_init */
+  _Atomic int active;		/* 0 once completed, or for a persistent request that is not started */
+  unsigned slot;		/* index of the entry in the registry */
+  struct registry_thread* owner; /* thread whose free list the entry belongs to */
+  struct mpii_request_info* next; /* next free entry */
+};
+
+/* record a request posted by the current thread */
+void mpii_registry_post(MPI_Request req, int peer, int tag, MPI_Comm comm,
+			int count, MPI_Datatype datatype);
+
+/* record a persistent request created by the current thread. The
+ * request is not active until it is started
+ */
+void mpii_registry_post_persistent(MPI_Request req, int peer, int tag, MPI_Comm comm,
+				   int count, MPI_Datatype datatype);
+
+/* record that the current thread started the persistent request req */
+void mpii_registry_start(MPI_Request req);
+
+/* return the entry of the outstanding request req, or NULL if req is
+ * not in the registry
+ */
+struct mpii_request_info* mpii_registry_lookup(MPI_Request req);
+
+/* return the entry of the request req, that the current thread is
+ * about to test or wait, or NULL if req is not in the registry
+ */
+struct mpii_request_info* mpii_registry_check(MPI_Request req);
+
+/* return the entries of the count requests reqs, that the current
+ * thread is about to test or wait, in an array allocated in the arena.
+ * Entries are NULL for the requests that are not in the registry
+ */
+struct mpii_request_info** mpii_registry_check_all(int count, const MPI_Request* reqs);
+
+/* record that the current thread finished testing or waiting the
+ * request of info (returned by mpii_registry_check). info may be NULL
+ */
+void mpii_registry_check_done(struct mpii_request_info* info);
+
+/* same as mpii_registry_check_done, for the entries returned by mpii_registry_check_all */
+void mpii_registry_check_done_all(int count, struct mpii_request_info** infos);
+
+/* record that the request of info (returned by mpii_registry_check)
+ * completed. The entry is looked up before the request is completed,
+ * since MPI may reuse the request handle once it completes. A
+ * persistent request remains in the registry until it is freed. info
+ * may be NULL
+ */
+void mpii_registry_complete(struct mpii_request_info* info);
+
+/* record the completion of the count requests of infos (returned by
+ * mpii_registry_check_all), after MPI_Waitall or MPI_Testall returned
+ * MPI_ERR_IN_STATUS. The requests whose status is MPI_ERR_PENDING did
+ * not complete
+ */
+void mpii_registry_complete_in_status(int count, struct mpii_request_info** infos,
+				      const MPI_Status* statuses);
+
+/* remove req from the registry. Called when req is freed */
+void mpii_registry_free(MPI_Request req);
+
+/* maximum number of call sites whose overlap is printed by the report */
+#define MPII_REGISTRY_REPORTED_SITES 10
+
+/* print the latency and the overlap of the requests, and the requests
+ * that are still outstanding
+ */
+void mpii_registry_report(void);
@@ -0,0 +1,233 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Sampling profiler (MPII_SAMPLE_RATE=N).
+ *
+ * Each thread records one MPI call out of N on average: a per-thread
+ * countdown is decremented by each call, and the call that brings it
+ * to 0 is sampled. The next countdown is drawn uniformly in [1, 2N-1],
+ * so that the samples are not aliased with a periodic pattern of
+ * calls. The first countdown of a thread is drawn the same way when the
+ * thread makes its first MPI call, so that this call is not always
+ * sampled.
+ *
+ * For a sampled call, the duration, the time spent waiting for and
+ * holding the MPI lock, and the size of the message are accumulated
+ * in per-thread statistics. When MPI is finalized, the statistics are
+ * scaled by N into estimates of the number of calls and of the time
+ * spent in each function, with 95% confidence intervals. Each call is
+ * considered as sampled independently with probability 1/N, so that
+ * the variance of an estimated total sum(N * x) is N * (N - 1) *
+ * sum(x^2), computed over the sampled calls.
+ */
+
+#include "mpii.h"
+#include "mpii_sample.h"
+#include "mpii_thread_list.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* quantile of the normal distribution for a 95% confidence interval */
+#define Z_95 1.96
+
+__thread int mpii_sample_countdown = 0;
+__thread int mpii_sampled = 0;
+
+struct sample_stats {
+  uint64_t nb_samples;
+  /* sums and sums of squares, in cycles */
+  double duration;
+  double duration2;
+  double wait;
+  double wait2;
+  double hold;
+  double bytes;
+};
+
+struct sample_thread {
+  struct sample_thread* next;
+  struct sample_stats functions[MPII_STATS_MAX_FUNCTIONS];
+  /* current call */
+  int function;
+  uint64_t start;
+  uint64_t wait;
+  uint64_t hold;
+  uint64_t bytes;
+  uint64_t lock_start;
+  /* state of the random generator */
+  uint64_t seed;
+};
+
+static struct mpii_thread_list threads = MPII_THREAD_LIST_INITIALIZER("the sampling profiler");
+
+static __thread struct sample_thread* my_thread = NULL;
+
+/* xorshift64 */
+static uint64_t next_random(struct sample_thread* t) {
+  t->seed ^= t->seed << 13;
+  t->seed ^= t->seed >> 7;
+  t->seed ^= t->seed << 17;
+  return t->seed;
+}
+
+/* number of calls until the next sampled call, in [1, 2N-1] */
+static int next_countdown(struct sample_thread* t) {
+  int rate = mpii_infos.settings.sample_rate;
+  return rate > 1 ? 1 + next_random(t) % (2 * rate - 1) : 1;
+}
+
+/* allocate the data of the current thread, and draw its first countdown */
+static struct sample_thread* setup_thread(void) {
+  struct sample_thread* t = mpii_thread_list_alloc(&threads, sizeof(struct sample_thread));
+  t->seed = mpii_tsc() | 1;
+  mpii_thread_list_add(&threads, t);
+  my_thread = t;
+  mpii_sample_countdown = next_countdown(t);
+  return t;
+}
+
+void mpii_sample_enter(int function) {
+  struct sample_thread* t = my_thread;
+  if(!t) {
+    /* first call of the thread: its countdown was not drawn yet, and
+     * starts with this call
+     */
+    t = setup_thread();
+    if(--mpii_sample_countdown > 0)
+      return;
+  }
+  mpii_sample_countdown = next_countdown(t);
+  mpii_sampled = 1;
+  t->function = function;
+  t->wait = 0;
+  t->hold = 0;
+  t->bytes = 0;
+  t->start = mpii_tsc();
+}
+
+void mpii_sample_exit(void) {
+  uint64_t duration = mpii_tsc() - my_thread->start;
+  struct sample_thread* t = my_thread;
+  struct sample_stats* s = &t->functions[t->function];
+  s->nb_samples++;
+  s->duration += duration;
+  s->duration2 += (double)duration * duration;
+  s->wait += t->wait;
+  s->wait2 += (double)t->wait * t->wait;
+  s->hold += t->hold;
+  s->bytes += t->bytes;
+  mpii_sampled = 0;
+}
+
+void mpii_sample_args(uint64_t bytes) {
+  my_thread->bytes = bytes;
+}
+
+void mpii_sample_lock_acquired(uint64_t wait_start) {
+  struct sample_thread* t = my_thread;
+  t->lock_start = mpii_tsc();
+  t->wait += t->lock_start - wait_start;
+}
+
+void mpii_sample_lock_released(void) {
+  struct sample_thread* t = my_thread;
+  t->hold += mpii_tsc() - t->lock_start;
+}
+
+struct estimate {
+  const char* name;
+  uint64_t nb_samples;
+  double calls, calls_ci;	/* number of calls */
+  double total, total_ci;	/* total time, in us */
+  double mean, mean_ci;		/* duration of a call, in us */
+  double wait, wait_ci;		/* lock wait per call, in us */
+  double hold;			/* lock hold per call, in us */
+  double bytes;			/* bytes per call */
+};
+
+/* half width of the confidence interval of the mean of n samples */
+static double mean_ci(double sum, double sum2, uint64_t n) {
+  if(n < 2)
+    return NAN;
+  double mean = sum / n;
+  double variance = (sum2 - n * mean * mean) / (n - 1);
+  return variance > 0 ? Z_95 * sqrt(variance / n) : 0;
+}
+
+static int compare_total(const void* a, const void* b) {
+  const struct estimate* ea = a;
+  const struct estimate* eb = b;
+  if(ea->total == eb->total) return 0;
+  return ea->total < eb->total ? 1 : -1;
+}
+
+void mpii_sample_report(void) {
+  double us_per_cycle = mpii_stats_us_per_cycle();
+  double rate = mpii_infos.settings.sample_rate;
+  int nb_functions = mpii_stats_nb_functions();
+
+  struct sample_stats* merged = calloc(nb_functions, sizeof(struct sample_stats));
+  struct estimate* estimates = calloc(nb_functions, sizeof(struct estimate));
+  if(!merged || !estimates)
+    goto out;
+  mpii_thread_list_lock(&threads);
+  for(struct sample_thread* t = threads.head; t; t = t->next) {
+    for(int i = 0; i < nb_functions; i++) {
+      struct sample_stats* s = &t->functions[i];
+      merged[i].nb_samples += s->nb_samples;
+      merged[i].duration += s->duration;
+      merged[i].duration2 += s->duration2;
+      merged[i].wait += s->wait;
+      merged[i].wait2 += s->wait2;
+      merged[i].hold += s->hold;
+      merged[i].bytes += s->bytes;
+    }
+  }
+  mpii_thread_list_unlock(&threads);
+
+  uint64_t nb_samples = 0;
+  int n = 0;
+  for(int i = 0; i < nb_functions; i++) {
+    struct sample_stats* s = &merged[i];
+    if(!s->nb_samples)
+      continue;
+    nb_samples += s->nb_samples;
+    double scale = rate * (rate - 1);
+    struct estimate* e = &estimates[n++];
+    e->name = mpii_stats_function_name(i);
+    e->nb_samples = s->nb_samples;
+    e->calls = rate * s->nb_samples;
+    e->calls_ci = Z_95 * sqrt(scale * s->nb_samples);
+    e->total = rate * s->duration * us_per_cycle;
+    e->total_ci = Z_95 * sqrt(scale * s->duration2) * us_per_cycle;
+    e->mean = s->duration / s->nb_samples * us_per_cycle;
+    e->mean_ci = mean_ci(s->duration, s->duration2, s->nb_samples) * us_per_cycle;
+    e->wait = s->wait / s->nb_samples * us_per_cycle;
+    e->wait_ci = mean_ci(s->wait, s->wait2, s->nb_samples) * us_per_cycle;
+    e->hold = s->hold / s->nb_samples * us_per_cycle;
+    e->bytes = s->bytes / s->nb_samples;
+  }
+  qsort(estimates, n, sizeof(struct estimate), compare_total);
+
+  printf("[MPII][P%d] Sampling profile: %" PRIu64 " calls sampled (1 out of %d), estimates with 95%% confidence intervals:\n",
+	 mpii_infos.rank, nb_samples, mpii_infos.settings.sample_rate);
+  printf("[MPII][P%d] %-24s %8s %22s %24s %20s %18s %10s %10s\n", mpii_infos.rank,
+	 "function", "samples", "calls", "total(us)", "mean(us)", "wait(us)", "hold(us)", "bytes");
+  for(int i = 0; i < n; i++) {
+    struct estimate* e = &estimates[i];
+    printf("[MPII][P%d] %-24s %8" PRIu64 " %12.0f +-%8.0f %13.1f +-%9.1f %10.2f +-%7.2f %9.2f +-%6.2f %10.2f %10.0f\n",
+	   mpii_infos.rank, e->name, e->nb_samples,
+	   e->calls, e->calls_ci, e->total, e->total_ci,
+	   e->mean, e->mean_ci, e->wait, e->wait_ci, e->hold, e->bytes);
+  }
+ out:
+  free(estimates);
+  free(merged);
+}
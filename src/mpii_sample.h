@@ -0,0 +1,55 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* number of calls before the next sampled call of the current thread */
+extern __thread int mpii_sample_countdown;
+/* 1 if the current call of the thread is sampled */
+extern __thread int mpii_sampled;
+
+/* start recording the call to function by the current thread, and
+ * choose the next call to sample. On the first call of a thread, only
+ * draw its first countdown (the call is recorded if the countdown is 1)
+ */
+void mpii_sample_enter(int function);
+
+/* stop recording the current call */
+void mpii_sample_exit(void);
+
+/* record the size of the message of the current call */
+void mpii_sample_args(uint64_t bytes);
+
+/* record that the current thread got the MPI lock after waiting since
+ * wait_start (a mpii_tsc timestamp)
+ */
+void mpii_sample_lock_acquired(uint64_t wait_start);
+
+/* record that the current thread released the MPI lock */
+void mpii_sample_lock_released(void);
+
+/* print the estimates computed from the sampled calls of all the threads */
+void mpii_sample_report(void);
+
+/* decide whether the call to function is sampled: the cost of the
+ * calls that are not sampled is a decrement and a branch
+ */
+#define MPII_SAMPLE_ENTER(function) do {				\
+    if(mpii_infos.settings.sample_rate && --mpii_sample_countdown <= 0) \
+      mpii_sample_enter(function);					\
+  } while(0)
+
+#define MPII_SAMPLE_EXIT() do {						\
+    if(mpii_sampled)							\
+      mpii_sample_exit();						\
+  } while(0)
+
+/* true if the current call is recorded: either sampling is disabled
+ * (all the calls are recorded), or the call is sampled
+ */
+#define MPII_SAMPLED (!mpii_infos.settings.sample_rate || mpii_sampled)
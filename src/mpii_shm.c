@@ -0,0 +1,186 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Live metrics (MPII_LIVE=1).
+ *
+ * Each process publishes, per thread and per MPI function, the number
+ * of calls, the size of the messages, the time spent in MPI, waiting
+ * for and holding the MPI lock, and the requests posted and completed,
+ * in a POSIX shared memory segment (/dev/shm/mpii.<pid>, see
+ * mpii_shm.h). mpii_top attaches to the segments of the processes that
+ * run on the node, and displays the metrics while the application is
+ * running.
+ *
+ * The counters of a thread are only written by this thread, that
+ * updates them like a seqlock once per MPI call: publishing does not
+ * need any atomic read-modify-write operation or system call.
+ */
+
+#include "mpii.h"
+#include "mpii_shm.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+_Static_assert(MPII_SHM_MAX_FUNCTIONS >= MPII_STATS_MAX_FUNCTIONS,
+	       "the segment should hold all the profiled functions");
+
+static char segment_name[STRING_LENGTH];
+static struct mpii_shm_header* header = NULL;
+static struct mpii_shm_thread* threads = NULL;
+static pthread_mutex_t names_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* state of the current thread */
+struct shm_thread_state {
+  struct mpii_shm_thread* slot;	/* NULL if the thread has no slot */
+  int registered;
+  uint64_t start;
+  uint64_t bytes;
+  uint64_t lock_wait;
+  uint64_t lock_hold;
+  uint64_t lock_start;
+};
+
+static __thread struct shm_thread_state my_state;
+
+void mpii_shm_init(void) {
+  snprintf(segment_name, sizeof(segment_name), "/" MPII_SHM_PREFIX "%d", (int)getpid());
+  int fd = shm_open(segment_name, O_CREAT | O_TRUNC | O_RDWR, 0644);
+  if(fd < 0) {
+    fprintf(stderr, "[MPII][P%d] Warning: cannot create the shared memory segment %s. Live metrics are disabled\n",
+	    mpii_infos.rank, segment_name);
+    mpii_infos.settings.live = 0;
+    return;
+  }
+  void* map = MAP_FAILED;
+  if(ftruncate(fd, MPII_SHM_SIZE) == 0)
+    map = mmap(NULL, MPII_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED) {
+    fprintf(stderr, "[MPII][P%d] Warning: cannot map the shared memory segment %s. Live metrics are disabled\n",
+	    mpii_infos.rank, segment_name);
+    shm_unlink(segment_name);
+    mpii_infos.settings.live = 0;
+    return;
+  }
+
+  header = map;
+  threads = (struct mpii_shm_thread*)(header + 1);
+  header->version = MPII_SHM_VERSION;
+  header->rank = mpii_infos.rank;
+  header->size = mpii_infos.size;
+  header->pid = getpid();
+  gethostname(header->hostname, sizeof(header->hostname) - 1);
+  /* the magic number is written last, so that readers ignore the segment until it is ready */
+  atomic_thread_fence(memory_order_release);
+  memcpy(header->magic, MPII_SHM_MAGIC, sizeof(MPII_SHM_MAGIC));
+}
+
+void mpii_shm_finalize(void) {
+  if(!header)
+    return;
+  __atomic_store_n(&header->finalized, 1, __ATOMIC_RELEASE);
+  shm_unlink(segment_name);
+}
+
+/* give a slot to the current thread */
+static void register_thread(void) {
+  if(!header)
+    return;
+  my_state.registered = 1;
+  uint32_t slot = __atomic_fetch_add(&header->nb_threads, 1, __ATOMIC_RELAXED);
+  if(slot >= MPII_SHM_MAX_THREADS) {
+    MPII_PRINTF(1, "[MPII][P%d] Warning: too many threads, the metrics of thread %d are not published\n",
+		mpii_infos.rank, thread_rank);
+    return;
+  }
+  my_state.slot = &threads[slot];
+  my_state.slot->thread = thread_rank;
+}
+
+/* copy the names of the functions to the segment */
+static void publish_names(void) {
+  pthread_mutex_lock(&names_lock);
+  int n = mpii_stats_nb_functions();
+  for(int i = header->nb_functions; i < n; i++)
+    strncpy(header->function_names[i], mpii_stats_function_name(i), MPII_SHM_NAME_LENGTH - 1);
+  __atomic_store_n(&header->nb_functions, n, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&names_lock);
+}
+
+/* start updating the counters of slot */
+static void write_begin(struct mpii_shm_thread* slot) {
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+  atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(struct mpii_shm_thread* slot) {
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+void mpii_shm_enter(void) {
+  if(!my_state.registered)
+    register_thread();
+  my_state.bytes = 0;
+  my_state.lock_wait = 0;
+  my_state.lock_hold = 0;
+  my_state.start = mpii_tsc();
+}
+
+void mpii_shm_exit(int function) {
+  struct mpii_shm_thread* slot = my_state.slot;
+  if(!slot)
+    return;
+  uint64_t duration = mpii_tsc() - my_state.start;
+  if((uint32_t)function >= __atomic_load_n(&header->nb_functions, __ATOMIC_RELAXED))
+    publish_names();
+
+  struct mpii_shm_counters* c = &slot->functions[function];
+  write_begin(slot);
+  c->nb_calls++;
+  c->bytes += my_state.bytes;
+  c->duration += duration;
+  c->lock_wait += my_state.lock_wait;
+  c->lock_hold += my_state.lock_hold;
+  write_end(slot);
+}
+
+void mpii_shm_args(uint64_t bytes) {
+  my_state.bytes = bytes;
+}
+
+void mpii_shm_lock_acquired(uint64_t wait_start) {
+  my_state.lock_start = mpii_tsc();
+  my_state.lock_wait += my_state.lock_start - wait_start;
+}
+
+void mpii_shm_lock_released(void) {
+  my_state.lock_hold += mpii_tsc() - my_state.lock_start;
+}
+
+void mpii_shm_request_posted(void) {
+  struct mpii_shm_thread* slot = my_state.slot;
+  if(!slot)
+    return;
+  write_begin(slot);
+  slot->functions[mpii_current_function_id].requests_posted++;
+  write_end(slot);
+}
+
+void mpii_shm_request_completed(int function) {
+  struct mpii_shm_thread* slot = my_state.slot;
+  if(!slot)
+    return;
+  write_begin(slot);
+  slot->functions[function].requests_completed++;
+  write_end(slot);
+}
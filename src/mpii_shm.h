@@ -0,0 +1,92 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* Layout of the shared memory segment (/dev/shm/mpii.<pid>) where
+ * each process publishes its live metrics (MPII_LIVE=1):
+ *
+ *   struct mpii_shm_header
+ *   MPII_SHM_MAX_THREADS struct mpii_shm_thread
+ *
+ * Each thread is the only writer of its struct mpii_shm_thread, that
+ * it updates like a seqlock: seq is odd while the counters are being
+ * updated. Readers copy the structure, and retry if seq was odd or
+ * changed during the copy.
+ */
+#define MPII_SHM_MAGIC "MPIISHM"
+#define MPII_SHM_VERSION 1
+#define MPII_SHM_PREFIX "mpii."
+
+#define MPII_SHM_MAX_THREADS 128
+#define MPII_SHM_MAX_FUNCTIONS 256
+#define MPII_SHM_NAME_LENGTH 32
+
+struct mpii_shm_header {
+  char magic[8];
+  uint32_t version;
+  int32_t rank;
+  int32_t size;
+  int32_t pid;
+  char hostname[64];
+  uint32_t nb_threads;		/* number of thread slots in use */
+  uint32_t nb_functions;	/* number of function names published */
+  uint32_t finalized;		/* 1 once MPI is finalized */
+  uint32_t padding;
+  char function_names[MPII_SHM_MAX_FUNCTIONS][MPII_SHM_NAME_LENGTH];
+};
+
+/* counters of an MPI function. Durations are in mpii_tsc cycles */
+struct mpii_shm_counters {
+  uint64_t nb_calls;
+  uint64_t bytes;
+  uint64_t duration;
+  uint64_t lock_wait;
+  uint64_t lock_hold;
+  uint64_t requests_posted;	/* only counted with the request registry */
+  uint64_t requests_completed;	/* requests posted by this function and completed by the thread */
+};
+
+struct mpii_shm_thread {
+  uint32_t seq;
+  int32_t thread;		/* rank of the thread */
+  uint64_t padding[7];
+  struct mpii_shm_counters functions[MPII_SHM_MAX_FUNCTIONS];
+};
+
+#define MPII_SHM_SIZE (sizeof(struct mpii_shm_header) +			\
+		       MPII_SHM_MAX_THREADS * sizeof(struct mpii_shm_thread))
+
+/* create the segment of the current process. Called when MPI is initialized */
+void mpii_shm_init(void);
+
+/* remove the segment. Called when MPI is finalized */
+void mpii_shm_finalize(void);
+
+/* the current thread enters an MPI function */
+void mpii_shm_enter(void);
+
+/* the current thread leaves the MPI function function (see mpii_stats_function_id) */
+void mpii_shm_exit(int function);
+
+/* record the size of the message of the current call */
+void mpii_shm_args(uint64_t bytes);
+
+/* record that the current thread got the MPI lock after waiting since
+ * wait_start (a mpii_tsc timestamp)
+ */
+void mpii_shm_lock_acquired(uint64_t wait_start);
+
+/* record that the current thread released the MPI lock */
+void mpii_shm_lock_released(void);
+
+/* record that the current thread posted a request */
+void mpii_shm_request_posted(void);
+
+/* record that the current thread completed a request posted by function */
+void mpii_shm_request_completed(int function);
@@ -0,0 +1,235 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Lock statistics (MPII_LOCK_STATS=1).
+ *
+ * Each time the MPI lock is taken, we measure how long the thread
+ * waited for it, and how long it held it. Durations are measured with
+ * the TSC, and recorded in log2 histograms. Histograms are private to
+ * each thread (so that recording does not need any synchronization),
+ * and are indexed by the outermost MPI function called by the thread.
+ * They are merged and printed when MPI is finalized.
+ */
+
+#include "mpii.h"
+#include "mpii_stats.h"
+#include "mpii_thread_list.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NB_BUCKETS 64
+
+__thread int mpii_current_function_id = 0;
+__thread void* mpii_current_call_site = NULL;
+
+/* names of the profiled functions. Function 0 gathers the lock
+ * acquisitions that happen outside of an MPI function
+ */
+static const char* function_names[MPII_STATS_MAX_FUNCTIONS] = { "(other)" };
+static int nb_functions = 1;
+static pthread_mutex_t functions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct function_stats {
+  uint64_t nb_acquisitions;
+  uint64_t total_wait;
+  uint64_t total_hold;
+  uint64_t wait_histogram[NB_BUCKETS];
+  uint64_t hold_histogram[NB_BUCKETS];
+};
+
+struct thread_stats {
+  struct thread_stats* next;
+  struct function_stats* functions[MPII_STATS_MAX_FUNCTIONS];
+  uint64_t hold_start;
+  int hold_function;
+};
+
+/* statistics of all the threads, including the threads that exited */
+static struct mpii_thread_list threads = MPII_THREAD_LIST_INITIALIZER("the lock statistics");
+
+static __thread struct thread_stats* my_stats = NULL;
+
+/* timestamps when the measurement started */
+static uint64_t start_tsc;
+static struct timespec start_time;
+
+int mpii_stats_function_id(const char* name) {
+  pthread_mutex_lock(&functions_lock);
+  int id;
+  for(id = 1; id < nb_functions; id++) {
+    if(strcmp(function_names[id], name) == 0)
+      goto out;
+  }
+  if(nb_functions < MPII_STATS_MAX_FUNCTIONS) {
+    id = nb_functions++;
+    function_names[id] = name;
+  } else {
+    id = 0;
+  }
+ out:
+  pthread_mutex_unlock(&functions_lock);
+  return id;
+}
+
+const char* mpii_stats_function_name(int id) {
+  if(id < 0 || id >= nb_functions)
+    return function_names[0];
+  return function_names[id];
+}
+
+int mpii_stats_nb_functions(void) {
+  return nb_functions;
+}
+
+void mpii_stats_init(void) {
+  start_tsc = mpii_tsc();
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+/* return the time since mpii_stats_init, in us */
+static double elapsed_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start_time.tv_sec) * 1e6 +
+    (now.tv_nsec - start_time.tv_nsec) / 1e3;
+}
+
+double mpii_stats_us_per_cycle(void) {
+  uint64_t elapsed_tsc = mpii_tsc() - start_tsc;
+  double elapsed_us = elapsed_time();
+  if(elapsed_tsc == 0 || elapsed_us <= 0)
+    return 0;
+  return elapsed_us / elapsed_tsc;
+}
+
+static struct thread_stats* get_thread_stats(void) {
+  if(!my_stats) {
+    my_stats = mpii_thread_list_alloc(&threads, sizeof(struct thread_stats));
+    mpii_thread_list_add(&threads, my_stats);
+  }
+  return my_stats;
+}
+
+static struct function_stats* get_function_stats(struct thread_stats* t, int function) {
+  if(!t->functions[function]) {
+    t->functions[function] = mpii_checked_calloc(1, sizeof(struct function_stats), threads.name);
+  }
+  return t->functions[function];
+}
+
+static int bucket(uint64_t duration) {
+  return 63 - __builtin_clzll(duration | 1);
+}
+
+void mpii_stats_lock_acquired(uint64_t wait_start) {
+  uint64_t now = mpii_tsc();
+  struct thread_stats* t = get_thread_stats();
+  int function = mpii_current_function_id;
+  struct function_stats* f = get_function_stats(t, function);
+  uint64_t wait = now - wait_start;
+  f->nb_acquisitions++;
+  f->total_wait += wait;
+  f->wait_histogram[bucket(wait)]++;
+  t->hold_start = now;
+  t->hold_function = function;
+}
+
+void mpii_stats_lock_released(void) {
+  uint64_t now = mpii_tsc();
+  struct thread_stats* t = get_thread_stats();
+  /* hold_function was allocated when the lock was taken */
+  struct function_stats* f = t->functions[t->hold_function];
+  if(!f)
+    return;
+  uint64_t hold = now - t->hold_start;
+  f->total_hold += hold;
+  f->hold_histogram[bucket(hold)]++;
+}
+
+/* return the duration (in cycles) below which a fraction p of the samples are */
+static uint64_t percentile(const uint64_t* histogram, uint64_t nb_samples, double p) {
+  uint64_t threshold = (uint64_t)(p * nb_samples);
+  uint64_t sum = 0;
+  for(int i = 0; i < NB_BUCKETS; i++) {
+    sum += histogram[i];
+    if(sum > threshold || sum == nb_samples)
+      return i < 63 ? (UINT64_C(1) << (i + 1)) : UINT64_MAX;
+  }
+  return 0;
+}
+
+static int compare_hold(const void* a, const void* b) {
+  const struct function_stats* fa = a;
+  const struct function_stats* fb = b;
+  if(fa->total_hold == fb->total_hold) return 0;
+  return fa->total_hold < fb->total_hold ? 1 : -1;
+}
+
+void mpii_stats_report(void) {
+  double elapsed_us = elapsed_time();
+  double us_per_cycle = mpii_stats_us_per_cycle();
+  if(us_per_cycle == 0)
+    return;
+
+  /* merge the statistics of all the threads */
+  struct function_stats* merged = calloc(nb_functions, sizeof(struct function_stats));
+  if(!merged)
+    return;
+  mpii_thread_list_lock(&threads);
+  for(struct thread_stats* t = threads.head; t; t = t->next) {
+    for(int i = 0; i < nb_functions; i++) {
+      struct function_stats* f = t->functions[i];
+      if(!f)
+	continue;
+      merged[i].nb_acquisitions += f->nb_acquisitions;
+      merged[i].total_wait += f->total_wait;
+      merged[i].total_hold += f->total_hold;
+      for(int b = 0; b < NB_BUCKETS; b++) {
+	merged[i].wait_histogram[b] += f->wait_histogram[b];
+	merged[i].hold_histogram[b] += f->hold_histogram[b];
+      }
+    }
+  }
+  mpii_thread_list_unlock(&threads);
+
+  /* sort the functions by hold time. Keep track of their names */
+  struct {
+    struct function_stats stats;
+    const char* name;
+  }* sorted = calloc(nb_functions, sizeof(*sorted));
+  if(!sorted)
+    goto out;
+  for(int i = 0; i < nb_functions; i++) {
+    sorted[i].stats = merged[i];
+    sorted[i].name = function_names[i];
+  }
+  /* stats is the first field, so compare_hold works on the whole entries */
+  qsort(sorted, nb_functions, sizeof(*sorted), compare_hold);
+
+  printf("[MPII][P%d] Lock statistics (%.0f us since MPI_Init):\n", mpii_infos.rank, elapsed_us);
+  /* percentiles are upper bounds of the histogram buckets */
+  printf("[MPII][P%d] %-24s %12s %8s %12s %12s %12s %12s %12s\n", mpii_infos.rank,
+	 "function", "acquisitions", "hold(%)", "hold(us)", "wait(us)",
+	 "p50 wait(us)", "p99 wait(us)", "p99 hold(us)");
+  for(int i = 0; i < nb_functions; i++) {
+    struct function_stats* f = &sorted[i].stats;
+    if(f->nb_acquisitions == 0)
+      continue;
+    double hold_us = f->total_hold * us_per_cycle;
+    printf("[MPII][P%d] %-24s %12" PRIu64 " %8.2f %12.1f %12.1f %12.2f %12.2f %12.2f\n",
+	   mpii_infos.rank, sorted[i].name, f->nb_acquisitions,
+	   100. * hold_us / elapsed_us, hold_us, f->total_wait * us_per_cycle,
+	   percentile(f->wait_histogram, f->nb_acquisitions, 0.5) * us_per_cycle,
+	   percentile(f->wait_histogram, f->nb_acquisitions, 0.99) * us_per_cycle,
+	   percentile(f->hold_histogram, f->nb_acquisitions, 0.99) * us_per_cycle);
+  }
+  free(sorted);
+ out:
+  free(merged);
+}
@@ -0,0 +1,65 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* maximum number of MPI functions that can be profiled */
+#define MPII_STATS_MAX_FUNCTIONS 256
+
+/* read a cheap timestamp (in cycles of an unspecified frequency) */
+static inline uint64_t mpii_tsc(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t t;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+  return t;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* id of the outermost MPI function called by the current thread (0 if none) */
+extern __thread int mpii_current_function_id;
+
+/* return address of the outermost MPI function called by the current
+ * thread. Only set when the request registry is enabled
+ */
+extern __thread void* mpii_current_call_site;
+
+/* return the id of the MPI function called name */
+int mpii_stats_function_id(const char* name);
+
+/* return the name of the MPI function whose id is id */
+const char* mpii_stats_function_name(int id);
+
+/* return the number of function ids in use */
+int mpii_stats_nb_functions(void);
+
+/* start measuring. Called when MPI is initialized */
+void mpii_stats_init(void);
+
+/* return the duration of a mpii_tsc cycle, in us */
+double mpii_stats_us_per_cycle(void);
+
+/* record that the current thread got the MPI lock after waiting since
+ * wait_start (a mpii_tsc timestamp)
+ */
+void mpii_stats_lock_acquired(uint64_t wait_start);
+
+/* record that the current thread released the MPI lock */
+void mpii_stats_lock_released(void);
+
+/* print the lock statistics of all the threads */
+void mpii_stats_report(void);
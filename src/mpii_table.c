@@ -0,0 +1,112 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Hash tables keyed by MPI handles (communicators, datatypes, windows,
+ * requests).
+ *
+ * The tables use open addressing with linear probing. Readers do not
+ * take any lock: a slot is published by writing its value before its
+ * key (with release semantics), and a removed slot keeps its value
+ * until it is reused. Writers are either serialized by the writer lock
+ * of the table (mpii_table_reserve), or claim a slot with a
+ * compare-and-swap (mpii_table_claim) when insertions are on the
+ * critical path.
+ */
+
+#include "mpii_table.h"
+
+static void* probe(struct mpii_table* table, uintptr_t key, unsigned i) {
+  return mpii_table_slot(table, (mpii_hash(key, table->size) + i) & (table->size - 1));
+}
+
+void* mpii_table_find(struct mpii_table* table, uintptr_t key) {
+  for(unsigned i = 0; i < table->max_probes; i++) {
+    void* slot = probe(table, key, i);
+    uintptr_t k = mpii_table_key(slot, memory_order_acquire);
+    if(k == key)
+      return slot;
+    if(k == MPII_TABLE_EMPTY)
+      return NULL;
+  }
+  return NULL;
+}
+
+void mpii_table_lock(struct mpii_table* table) {
+  pthread_mutex_lock(&table->writer_lock);
+}
+
+void mpii_table_unlock(struct mpii_table* table) {
+  pthread_mutex_unlock(&table->writer_lock);
+}
+
+void* mpii_table_reserve(struct mpii_table* table, uintptr_t key, int* found) {
+  void* free_slot = NULL;
+  *found = 0;
+  for(unsigned i = 0; i < table->max_probes; i++) {
+    void* slot = probe(table, key, i);
+    uintptr_t k = mpii_table_key(slot, memory_order_relaxed);
+    if(k == key) {
+      *found = 1;
+      return slot;
+    }
+    if(k == MPII_TABLE_REMOVED && !free_slot)
+      free_slot = slot;
+    if(k == MPII_TABLE_EMPTY)
+      return free_slot ? free_slot : slot;
+  }
+  return free_slot;
+}
+
+void mpii_table_publish(void* slot, uintptr_t key) {
+  atomic_store_explicit((_Atomic uintptr_t*)slot, key, memory_order_release);
+}
+
+void mpii_table_clear(void* slot) {
+  atomic_store_explicit((_Atomic uintptr_t*)slot, MPII_TABLE_REMOVED, memory_order_release);
+}
+
+void mpii_table_remove(struct mpii_table* table, uintptr_t key) {
+  mpii_table_lock(table);
+  for(unsigned i = 0; i < table->max_probes; i++) {
+    void* slot = probe(table, key, i);
+    uintptr_t k = mpii_table_key(slot, memory_order_relaxed);
+    if(k == key) {
+      mpii_table_clear(slot);
+      break;
+    }
+    if(k == MPII_TABLE_EMPTY)
+      break;
+  }
+  mpii_table_unlock(table);
+}
+
+void* mpii_table_claim(struct mpii_table* table, uintptr_t key, int* found) {
+  *found = 0;
+  while(1) {
+    void* free_slot = NULL;
+    for(unsigned i = 0; i < table->max_probes; i++) {
+      void* slot = probe(table, key, i);
+      uintptr_t k = mpii_table_key(slot, memory_order_relaxed);
+      if(k == key) {
+	*found = 1;
+	return NULL;
+      }
+      if((k == MPII_TABLE_EMPTY || k == MPII_TABLE_REMOVED) && !free_slot)
+	free_slot = slot;
+      if(k == MPII_TABLE_EMPTY)
+	break;
+    }
+    if(!free_slot)
+      return NULL;
+
+    uintptr_t k = mpii_table_key(free_slot, memory_order_relaxed);
+    if((k == MPII_TABLE_EMPTY || k == MPII_TABLE_REMOVED) &&
+       atomic_compare_exchange_strong_explicit((_Atomic uintptr_t*)free_slot, &k, MPII_TABLE_BUSY,
+					       memory_order_acquire, memory_order_relaxed))
+      return free_slot;
+    /* another thread took the slot */
+  }
+}
@@ -0,0 +1,106 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* keys with a special meaning. They cannot be stored in a table */
+#define MPII_TABLE_EMPTY   ((uintptr_t)0)	/* the slot was never used */
+#define MPII_TABLE_REMOVED ((uintptr_t)1)	/* the key of the slot was removed */
+#define MPII_TABLE_BUSY    ((uintptr_t)2)	/* the slot is being written (see mpii_table_claim) */
+
+/* A hash table with open addressing, keyed by MPI handles (see
+ * mpii_table.c). Slots are defined by the user of the table, and start
+ * with the key:
+ *
+ *   struct my_slot {
+ *     _Atomic uintptr_t key;
+ *     ... value ...
+ *   };
+ */
+struct mpii_table {
+  void* slots;
+  size_t slot_size;
+  unsigned size;		/* number of slots, a power of 2 */
+  unsigned max_probes;		/* maximum number of slots visited by a lookup */
+  pthread_mutex_t writer_lock;
+};
+
+/* initializer of a table that uses the array slots */
+#define MPII_TABLE_INITIALIZER(slots, max_probes)			\
+  { (slots), sizeof((slots)[0]), sizeof(slots) / sizeof((slots)[0]),	\
+      (max_probes), PTHREAD_MUTEX_INITIALIZER }
+
+/* hash key into [0, size). size must be a power of 2. This is also
+ * used by the private tables of the threads
+ */
+static inline unsigned mpii_hash(uint64_t key, unsigned size) {
+  uint64_t h = key * UINT64_C(0x9e3779b97f4a7c15);
+  return (h >> 32) & (size - 1);
+}
+
+/* MPI handles are either integers or pointers, depending on the MPI
+ * implementation
+ */
+#define MPII_TABLE_KEY(handle) ((uintptr_t)(handle))
+
+/* return 1 if key can be stored in a table */
+static inline int mpii_table_valid_key(uintptr_t key) {
+  return key != MPII_TABLE_EMPTY && key != MPII_TABLE_REMOVED && key != MPII_TABLE_BUSY;
+}
+
+/* return the slot of key, or NULL. This does not take any lock. The
+ * value of the slot was written before its key was published
+ */
+void* mpii_table_find(struct mpii_table* table, uintptr_t key);
+
+/* serialize the writers */
+void mpii_table_lock(struct mpii_table* table);
+void mpii_table_unlock(struct mpii_table* table);
+
+/* return the slot of key and set *found to 1 if key is in the table.
+ * Otherwise, return a free slot where key can be published and set
+ * *found to 0, or return NULL if the table is full. Must be called
+ * with the writer lock held
+ */
+void* mpii_table_reserve(struct mpii_table* table, uintptr_t key, int* found);
+
+/* make the slot returned by mpii_table_reserve or mpii_table_claim
+ * visible to the readers. Its value must be written before
+ */
+void mpii_table_publish(void* slot, uintptr_t key);
+
+/* remove the key of slot. The value is kept until the slot is reused,
+ * so a reader that found the slot before can still read it. Must be
+ * called with the writer lock held, unless the table is only written
+ * with mpii_table_claim
+ */
+void mpii_table_clear(void* slot);
+
+/* remove key from the table */
+void mpii_table_remove(struct mpii_table* table, uintptr_t key);
+
+/* lock-free insertion: claim a free slot for key with a
+ * compare-and-swap. Return the slot, whose value can then be written
+ * before mpii_table_publish is called. Return NULL and set *found to
+ * 1 if key is already in the table, or to 0 if the table is full.
+ * Tables written with mpii_table_claim do not use the writer lock
+ */
+void* mpii_table_claim(struct mpii_table* table, uintptr_t key, int* found);
+
+/* return the slot number index of table */
+static inline void* mpii_table_slot(struct mpii_table* table, unsigned index) {
+  return (char*)table->slots + (size_t)index * table->slot_size;
+}
+
+/* return the key of slot */
+static inline uintptr_t mpii_table_key(void* slot, memory_order order) {
+  return atomic_load_explicit((_Atomic uintptr_t*)slot, order);
+}
@@ -0,0 +1,45 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Lists of the per-thread data of the profilers */
+
+#include "mpii_thread_list.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct thread_data {
+  struct thread_data* next;
+};
+
+void* mpii_checked_calloc(size_t nmemb, size_t size, const char* what) {
+  void* ptr = calloc(nmemb, size);
+  if(!ptr) {
+    fprintf(stderr, "[MPII] Error: cannot allocate memory for %s\n", what);
+    abort();
+  }
+  return ptr;
+}
+
+void* mpii_thread_list_alloc(struct mpii_thread_list* list, size_t size) {
+  return mpii_checked_calloc(1, size, list->name);
+}
+
+void mpii_thread_list_add(struct mpii_thread_list* list, void* data) {
+  struct thread_data* d = data;
+  pthread_mutex_lock(&list->lock);
+  d->next = list->head;
+  list->head = d;
+  pthread_mutex_unlock(&list->lock);
+}
+
+void mpii_thread_list_lock(struct mpii_thread_list* list) {
+  pthread_mutex_lock(&list->lock);
+}
+
+void mpii_thread_list_unlock(struct mpii_thread_list* list) {
+  pthread_mutex_unlock(&list->lock);
+}
@@ -0,0 +1,42 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+
+/* The per-thread data of a profiler. Each thread allocates its data
+ * the first time it needs it, and adds it to the list, so that the
+ * data of all the threads (including the threads that exited) can be
+ * merged in the report. The data must start with a pointer to the
+ * next data of the list:
+ *
+ *   struct my_thread {
+ *     struct my_thread* next;
+ *     ...
+ *   };
+ */
+struct mpii_thread_list {
+  const char* name;		/* what the data is used for, for the error messages */
+  void* head;
+  pthread_mutex_t lock;
+};
+
+#define MPII_THREAD_LIST_INITIALIZER(name) { (name), NULL, PTHREAD_MUTEX_INITIALIZER }
+
+/* allocate zeroed memory, or abort with an error message about what */
+void* mpii_checked_calloc(size_t nmemb, size_t size, const char* what);
+
+/* allocate zeroed data for the current thread */
+void* mpii_thread_list_alloc(struct mpii_thread_list* list, size_t size);
+
+/* add the data of the current thread to list, once it is initialized */
+void mpii_thread_list_add(struct mpii_thread_list* list, void* data);
+
+/* protect the list while it is traversed */
+void mpii_thread_list_lock(struct mpii_thread_list* list);
+void mpii_thread_list_unlock(struct mpii_thread_list* list);
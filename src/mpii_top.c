@@ -0,0 +1,337 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Display the live metrics published by the processes that run with
+ * MPII_LIVE=1 on the current node (see mpii_shm.h).
+ *
+ * mpii_top attaches to the shared memory segments of the processes,
+ * and periodically prints, for each rank and each thread, the MPI
+ * functions that take the most time during the last interval.
+ */
+
+#include <argp.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "mpii_shm.h"
+#include "mpii_stats.h"
+
+#define SHM_DIRECTORY "/dev/shm"
+
+/* maximum number of retries when reading the counters of a thread that is updating them */
+#define MAX_READ_RETRIES 1000
+
+static char doc[] = "Display the live metrics of the MPI processes that run with MPII_LIVE=1 on this node";
+static char args_doc[] = "";
+
+static struct argp_option options[] = {
+	{"delay", 'd', "SECONDS", 0, "Refresh the display every SECONDS seconds (default: 1)" },
+	{"iterations", 'n', "N", 0, "Exit after N refreshes (default: run until interrupted)" },
+	{"batch", 'b', 0, 0, "Do not clear the screen between two refreshes" },
+	{"top", 't', "N", 0, "Display the N functions of each thread that take the most time (default: 5)" },
+	{0}
+};
+
+struct arguments {
+  double delay;
+  int iterations;
+  int batch;
+  int top;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+  struct arguments* arguments = state->input;
+
+  switch(key) {
+  case 'd':
+    arguments->delay = atof(arg);
+    if(arguments->delay <= 0)
+      argp_error(state, "invalid delay: %s", arg);
+    break;
+  case 'n':
+    arguments->iterations = atoi(arg);
+    break;
+  case 'b':
+    arguments->batch = 1;
+    break;
+  case 't':
+    arguments->top = atoi(arg);
+    break;
+  default:
+    return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+/* a process that publishes its metrics */
+struct segment {
+  struct segment* next;
+  char name[256];
+  const struct mpii_shm_header* header;
+  /* copy of the counters of the threads at the previous refresh */
+  struct mpii_shm_thread* previous;
+  struct mpii_shm_thread* current;
+  uint32_t nb_threads;
+  int seen;			/* 1 if the segment still exists */
+};
+
+static struct segment* segments = NULL;
+
+static struct segment* find_segment(const char* name) {
+  for(struct segment* s = segments; s; s = s->next)
+    if(strcmp(s->name, name) == 0)
+      return s;
+  return NULL;
+}
+
+static void attach(const char* name) {
+  char path[512];
+  snprintf(path, sizeof(path), SHM_DIRECTORY "/%s", name);
+  int fd = open(path, O_RDONLY);
+  if(fd < 0)
+    return;
+  void* map = mmap(NULL, MPII_SHM_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED)
+    return;
+  const struct mpii_shm_header* header = map;
+  if(memcmp(header->magic, MPII_SHM_MAGIC, sizeof(MPII_SHM_MAGIC)) != 0 ||
+     header->version != MPII_SHM_VERSION) {
+    /* not ready yet, or not an MPII segment */
+    munmap(map, MPII_SHM_SIZE);
+    return;
+  }
+
+  struct segment* s = calloc(1, sizeof(struct segment));
+  if(s) {
+    s->previous = calloc(MPII_SHM_MAX_THREADS, sizeof(struct mpii_shm_thread));
+    s->current = calloc(MPII_SHM_MAX_THREADS, sizeof(struct mpii_shm_thread));
+  }
+  if(!s || !s->previous || !s->current) {
+    fprintf(stderr, "cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  strncpy(s->name, name, sizeof(s->name) - 1);
+  s->header = header;
+  s->seen = 1;
+  s->next = segments;
+  segments = s;
+}
+
+static void detach(struct segment* s) {
+  struct segment** prev = &segments;
+  while(*prev != s)
+    prev = &(*prev)->next;
+  *prev = s->next;
+  munmap((void*)s->header, MPII_SHM_SIZE);
+  free(s->previous);
+  free(s->current);
+  free(s);
+}
+
+/* attach to the new segments, and detach from the processes that exited */
+static void scan_segments(void) {
+  for(struct segment* s = segments; s; s = s->next)
+    s->seen = 0;
+  DIR* dir = opendir(SHM_DIRECTORY);
+  if(dir) {
+    struct dirent* entry;
+    while((entry = readdir(dir))) {
+      if(strncmp(entry->d_name, MPII_SHM_PREFIX, strlen(MPII_SHM_PREFIX)) != 0)
+	continue;
+      struct segment* s = find_segment(entry->d_name);
+      if(s)
+	s->seen = 1;
+      else
+	attach(entry->d_name);
+    }
+    closedir(dir);
+  }
+
+  struct segment* next;
+  for(struct segment* s = segments; s; s = next) {
+    next = s->next;
+    int dead = kill(s->header->pid, 0) < 0 && errno == ESRCH;
+    if(!s->seen || dead || __atomic_load_n(&s->header->finalized, __ATOMIC_ACQUIRE))
+      detach(s);
+  }
+}
+
+/* copy the counters of a thread. Return 0 on success */
+static int read_thread(const struct mpii_shm_thread* slot, struct mpii_shm_thread* copy) {
+  for(int i = 0; i < MAX_READ_RETRIES; i++) {
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if(seq & 1)
+      continue;
+    memcpy(copy, slot, sizeof(*copy));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+      return 0;
+  }
+  return -1;
+}
+
+static void read_segment(struct segment* s) {
+  struct mpii_shm_thread* tmp = s->previous;
+  s->previous = s->current;
+  s->current = tmp;
+
+  const struct mpii_shm_thread* threads = (const struct mpii_shm_thread*)(s->header + 1);
+  uint32_t nb_threads = __atomic_load_n(&s->header->nb_threads, __ATOMIC_ACQUIRE);
+  if(nb_threads > MPII_SHM_MAX_THREADS)
+    nb_threads = MPII_SHM_MAX_THREADS;
+  for(uint32_t i = 0; i < nb_threads; i++) {
+    if(read_thread(&threads[i], &s->current[i]) < 0)
+      /* the thread is too busy: keep its previous counters */
+      s->current[i] = i < s->nb_threads ? s->previous[i] : (struct mpii_shm_thread){ 0 };
+  }
+  /* the threads that appeared since the previous refresh start from 0 */
+  for(uint32_t i = s->nb_threads; i < nb_threads; i++)
+    memset(&s->previous[i], 0, sizeof(struct mpii_shm_thread));
+  s->nb_threads = nb_threads;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct function_delta {
+  int function;
+  struct mpii_shm_counters delta;
+};
+
+static int compare_duration(const void* a, const void* b) {
+  const struct function_delta* fa = a;
+  const struct function_delta* fb = b;
+  if(fa->delta.duration == fb->delta.duration) return 0;
+  return fa->delta.duration < fb->delta.duration ? 1 : -1;
+}
+
+static int compare_rank(const void* a, const void* b) {
+  const struct segment* sa = *(const struct segment* const*)a;
+  const struct segment* sb = *(const struct segment* const*)b;
+  return sa->header->rank - sb->header->rank;
+}
+
+static const char* function_name(const struct segment* s, int function) {
+  uint32_t nb_functions = __atomic_load_n(&s->header->nb_functions, __ATOMIC_ACQUIRE);
+  if(function < 0 || (uint32_t)function >= nb_functions)
+    return "(unknown)";
+  return s->header->function_names[function];
+}
+
+static void display_segment(const struct segment* s, double seconds, double cycles, int top) {
+  struct function_delta deltas[MPII_SHM_MAX_FUNCTIONS];
+  uint64_t calls = 0, bytes = 0, duration = 0;
+  int64_t outstanding = 0;
+  for(uint32_t t = 0; t < s->nb_threads; t++) {
+    for(int f = 0; f < MPII_SHM_MAX_FUNCTIONS; f++) {
+      const struct mpii_shm_counters* cur = &s->current[t].functions[f];
+      const struct mpii_shm_counters* prev = &s->previous[t].functions[f];
+      calls += cur->nb_calls - prev->nb_calls;
+      bytes += cur->bytes - prev->bytes;
+      duration += cur->duration - prev->duration;
+      outstanding += (int64_t)cur->requests_posted - (int64_t)cur->requests_completed;
+    }
+  }
+  printf("Rank %d (pid %d): %u threads, %.0f calls/s, %.2f MB/s, %.1f%% of a thread in MPI, %" PRId64 " outstanding requests\n",
+	 s->header->rank, s->header->pid, s->nb_threads, calls / seconds, bytes / seconds / 1e6,
+	 100. * duration / cycles, outstanding);
+  printf("  %-7s %-24s %12s %10s %8s %8s %8s\n",
+	 "thread", "function", "calls/s", "MB/s", "%MPI", "%wait", "%hold");
+
+  for(uint32_t t = 0; t < s->nb_threads; t++) {
+    int n = 0;
+    for(int f = 0; f < MPII_SHM_MAX_FUNCTIONS; f++) {
+      const struct mpii_shm_counters* cur = &s->current[t].functions[f];
+      const struct mpii_shm_counters* prev = &s->previous[t].functions[f];
+      if(cur->nb_calls == prev->nb_calls)
+	continue;
+      deltas[n].function = f;
+      deltas[n].delta = (struct mpii_shm_counters) {
+	.nb_calls = cur->nb_calls - prev->nb_calls,
+	.bytes = cur->bytes - prev->bytes,
+	.duration = cur->duration - prev->duration,
+	.lock_wait = cur->lock_wait - prev->lock_wait,
+	.lock_hold = cur->lock_hold - prev->lock_hold,
+      };
+      n++;
+    }
+    qsort(deltas, n, sizeof(struct function_delta), compare_duration);
+    for(int i = 0; i < n && i < top; i++) {
+      const struct mpii_shm_counters* d = &deltas[i].delta;
+      printf("  T%-6d %-24s %12.0f %10.2f %8.1f %8.1f %8.1f\n",
+	     s->current[t].thread, function_name(s, deltas[i].function),
+	     d->nb_calls / seconds, d->bytes / seconds / 1e6,
+	     100. * d->duration / cycles, 100. * d->lock_wait / cycles, 100. * d->lock_hold / cycles);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  struct arguments arguments = { 1, 0, 0, 5 };
+  argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+  char hostname[64] = "";
+  gethostname(hostname, sizeof(hostname) - 1);
+
+  scan_segments();
+  for(struct segment* s = segments; s; s = s->next)
+    read_segment(s);
+  double last_time = now_seconds();
+  uint64_t last_tsc = mpii_tsc();
+
+  for(int iteration = 0; arguments.iterations <= 0 || iteration < arguments.iterations; iteration++) {
+    usleep(arguments.delay * 1e6);
+
+    scan_segments();
+    int nb_segments = 0;
+    for(struct segment* s = segments; s; s = s->next) {
+      read_segment(s);
+      nb_segments++;
+    }
+    double time = now_seconds();
+    uint64_t tsc = mpii_tsc();
+    double seconds = time - last_time;
+    double cycles = tsc - last_tsc;
+    last_time = time;
+    last_tsc = tsc;
+
+    struct segment** sorted = calloc(nb_segments + 1, sizeof(struct segment*));
+    int n = 0;
+    for(struct segment* s = segments; s; s = s->next)
+      sorted[n++] = s;
+    qsort(sorted, n, sizeof(struct segment*), compare_rank);
+
+    if(!arguments.batch)
+      printf("\033[H\033[2J");
+    printf("mpii_top - %s: %d MPI processes, refreshed every %.1f s\n\n",
+	   hostname, nb_segments, arguments.delay);
+    for(int i = 0; i < n; i++)
+      display_segment(sorted[i], seconds, cycles, arguments.top);
+    if(arguments.batch)
+      printf("\n");
+    fflush(stdout);
+    free(sorted);
+  }
+
+  while(segments)
+    detach(segments);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,286 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Binary event tracing (MPII_TRACE=1).
+ *
+ * Each thread writes fixed-size records (struct mpii_trace_record) in
+ * its own ring buffer: one record per MPI function, and one record
+ * each time the thread holds the MPI lock. The thread is the only
+ * producer of its buffer, and a background thread is the only
+ * consumer, so recording an event only costs a few stores. When a
+ * buffer is full, records are dropped instead of blocking the
+ * application.
+ *
+ * The background thread periodically copies the records to a file
+ * mapped in memory (mpii_trace.<rank>.bin). mpii_trace2json converts
+ * the files to the Chrome trace format, which can be displayed by
+ * Perfetto or chrome://tracing.
+ */
+
+#include "mpii.h"
+#include "mpii_trace.h"
+#include "mpii_thread_list.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(struct mpii_trace_record) == 64, "trace records should fill a cache line");
+
+/* interval between two flushes of the buffers, in ns */
+#define FLUSH_INTERVAL 10000000
+
+/* initial size of the trace file. The file grows by doubling its size */
+#define FILE_MIN_SIZE (64 * 1024 * 1024)
+
+struct trace_buffer {
+  struct trace_buffer* next;
+  int thread;
+  /* the record of the MPI function being called */
+  struct mpii_trace_record current;
+  /* when the thread got the MPI lock, and how long it waited for it */
+  uint64_t lock_start;
+  uint64_t lock_wait;
+  uint64_t nb_dropped;
+  /* records [tail, head) are waiting to be flushed */
+  _Atomic uint64_t head CACHE_ALIGNED;	/* written by the thread */
+  _Atomic uint64_t tail CACHE_ALIGNED;	/* written by the flusher */
+  struct mpii_trace_record records[MPII_TRACE_BUFFER_SIZE];
+};
+
+static struct mpii_thread_list buffers = MPII_THREAD_LIST_INITIALIZER("the trace");
+
+static __thread struct trace_buffer* my_buffer = NULL;
+
+static struct {
+  int fd;
+  char filename[STRING_LENGTH];
+  char* map;			/* the file mapped in memory */
+  size_t map_size;
+  uint64_t nb_records;		/* number of records written in the file */
+} file = { .fd = -1 };
+
+static struct {
+  pthread_t thread;
+  _Atomic int stop;
+  int started;
+} flusher;
+
+static uint64_t start_tsc;
+
+static struct trace_buffer* get_buffer(void) {
+  if(!my_buffer) {
+    void* ptr = NULL;
+    if(posix_memalign(&ptr, MPII_CACHE_LINE_SIZE, sizeof(struct trace_buffer)) != 0) {
+      fprintf(stderr, "[MPII] Error: cannot allocate memory for %s\n", buffers.name);
+      abort();
+    }
+    memset(ptr, 0, sizeof(struct trace_buffer));
+    struct trace_buffer* b = ptr;
+    b->thread = thread_rank;
+    mpii_thread_list_add(&buffers, b);
+    my_buffer = b;
+  }
+  return my_buffer;
+}
+
+static void push(struct trace_buffer* b, const struct mpii_trace_record* record) {
+  uint64_t head = atomic_load_explicit(&b->head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&b->tail, memory_order_acquire);
+  if(head - tail >= MPII_TRACE_BUFFER_SIZE) {
+    b->nb_dropped++;
+    return;
+  }
+  b->records[head & (MPII_TRACE_BUFFER_SIZE - 1)] = *record;
+  atomic_store_explicit(&b->head, head + 1, memory_order_release);
+}
+
+void mpii_trace_enter(int function) {
+  struct trace_buffer* b = get_buffer();
+  b->current = (struct mpii_trace_record) {
+    .start = mpii_tsc(),
+    .type = MPII_TRACE_CALL,
+    .function = function,
+    .thread = thread_rank,
+    .peer = -1,
+    .tag = -1,
+    .comm = -1,
+  };
+}
+
+void mpii_trace_exit(void) {
+  struct trace_buffer* b = get_buffer();
+  b->current.end = mpii_tsc();
+  push(b, &b->current);
+}
+
+void mpii_trace_args(int peer, int tag, MPI_Comm comm, uint64_t bytes) {
+  struct trace_buffer* b = get_buffer();
+  b->current.peer = peer;
+  b->current.tag = tag;
+  b->current.comm = comm != MPI_COMM_NULL ? MPI_Comm_c2f(comm) : -1;
+  b->current.bytes = bytes;
+}
+
+void mpii_trace_lock_acquired(uint64_t wait_start) {
+  struct trace_buffer* b = get_buffer();
+  b->lock_start = mpii_tsc();
+  b->lock_wait = b->lock_start - wait_start;
+  b->current.lock_wait += b->lock_wait;
+}
+
+void mpii_trace_lock_released(void) {
+  struct trace_buffer* b = get_buffer();
+  uint64_t now = mpii_tsc();
+  struct mpii_trace_record record = {
+    .start = b->lock_start,
+    .end = now,
+    .lock_wait = b->lock_wait,
+    .lock_hold = now - b->lock_start,
+    .type = MPII_TRACE_LOCK,
+    .function = mpii_current_function_id,
+    .thread = thread_rank,
+    .peer = -1,
+    .tag = -1,
+    .comm = -1,
+  };
+  b->current.lock_hold += record.lock_hold;
+  push(b, &record);
+}
+
+/* map size bytes of the trace file. Return -1 on error */
+static int map_file(size_t size) {
+  if(file.map)
+    munmap(file.map, file.map_size);
+  file.map = NULL;
+  if(ftruncate(file.fd, size) < 0)
+    return -1;
+  void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+  if(map == MAP_FAILED)
+    return -1;
+  file.map = map;
+  file.map_size = size;
+  return 0;
+}
+
+/* copy the pending records of b to the file */
+static void flush_buffer(struct trace_buffer* b) {
+  uint64_t tail = atomic_load_explicit(&b->tail, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&b->head, memory_order_acquire);
+  if(head == tail || !file.map)
+    return;
+
+  size_t needed = sizeof(struct mpii_trace_header) +
+    (file.nb_records + (head - tail)) * sizeof(struct mpii_trace_record);
+  if(needed > file.map_size) {
+    size_t size = file.map_size;
+    while(size < needed)
+      size *= 2;
+    if(map_file(size) < 0) {
+      fprintf(stderr, "[MPII][P%d] Error: cannot extend the trace file %s: %s. Tracing is stopped\n",
+	      mpii_infos.rank, file.filename, strerror(errno));
+      return;
+    }
+  }
+
+  struct mpii_trace_record* dest = (struct mpii_trace_record*)
+    (file.map + sizeof(struct mpii_trace_header)) + file.nb_records;
+  for(uint64_t i = tail; i < head; i++)
+    *dest++ = b->records[i & (MPII_TRACE_BUFFER_SIZE - 1)];
+  file.nb_records += head - tail;
+  atomic_store_explicit(&b->tail, head, memory_order_release);
+}
+
+static void flush_all(void) {
+  mpii_thread_list_lock(&buffers);
+  for(struct trace_buffer* b = buffers.head; b; b = b->next)
+    flush_buffer(b);
+  mpii_thread_list_unlock(&buffers);
+}
+
+static void* flusher_loop(void* arg MAYBE_UNUSED) {
+  struct timespec interval = { 0, FLUSH_INTERVAL };
+  while(!atomic_load(&flusher.stop)) {
+    flush_all();
+    nanosleep(&interval, NULL);
+  }
+  return NULL;
+}
+
+void mpii_trace_init(void) {
+  start_tsc = mpii_tsc();
+  snprintf(file.filename, sizeof(file.filename), "mpii_trace.%d.bin", mpii_infos.rank);
+  file.fd = open(file.filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(file.fd < 0 || map_file(FILE_MIN_SIZE) < 0) {
+    fprintf(stderr, "[MPII][P%d] Error: cannot create the trace file %s: %s\n",
+	    mpii_infos.rank, file.filename, strerror(errno));
+    return;
+  }
+
+  if(pthread_create(&flusher.thread, NULL, flusher_loop, NULL) != 0) {
+    fprintf(stderr, "[MPII][P%d] Error: cannot create the trace flushing thread\n",
+	    mpii_infos.rank);
+    return;
+  }
+  flusher.started = 1;
+}
+
+void mpii_trace_finalize(void) {
+  if(flusher.started) {
+    atomic_store(&flusher.stop, 1);
+    pthread_join(flusher.thread, NULL);
+    flusher.started = 0;
+  }
+  if(!file.map)
+    return;
+  flush_all();
+
+  /* the function names are written after the records */
+  uint64_t nb_dropped = 0;
+  for(struct trace_buffer* b = buffers.head; b; b = b->next)
+    nb_dropped += b->nb_dropped;
+  int nb_functions = mpii_stats_nb_functions();
+  size_t records_end = sizeof(struct mpii_trace_header) +
+    file.nb_records * sizeof(struct mpii_trace_record);
+  size_t size = records_end + (size_t)nb_functions * MPII_TRACE_NAME_LENGTH;
+  if(size > file.map_size && map_file(size) < 0) {
+    fprintf(stderr, "[MPII][P%d] Error: cannot extend the trace file %s: %s\n",
+	    mpii_infos.rank, file.filename, strerror(errno));
+    goto out;
+  }
+  for(int i = 0; i < nb_functions; i++)
+    strncpy(file.map + records_end + (size_t)i * MPII_TRACE_NAME_LENGTH,
+	    mpii_stats_function_name(i), MPII_TRACE_NAME_LENGTH - 1);
+
+  struct mpii_trace_header* header = (struct mpii_trace_header*)file.map;
+  memcpy(header->magic, MPII_TRACE_MAGIC, sizeof(header->magic));
+  header->version = MPII_TRACE_VERSION;
+  header->rank = mpii_infos.rank;
+  header->nb_records = file.nb_records;
+  header->nb_dropped = nb_dropped;
+  header->start_tsc = start_tsc;
+  header->us_per_cycle = mpii_stats_us_per_cycle();
+  header->nb_functions = nb_functions;
+
+  munmap(file.map, file.map_size);
+  file.map = NULL;
+  if(ftruncate(file.fd, size) < 0)
+    fprintf(stderr, "[MPII][P%d] Error: cannot truncate the trace file %s: %s\n",
+	    mpii_infos.rank, file.filename, strerror(errno));
+  printf("[MPII][P%d] Trace: %" PRIu64 " events written to %s (%" PRIu64 " dropped)\n",
+	 mpii_infos.rank, file.nb_records, file.filename, nb_dropped);
+ out:
+  close(file.fd);
+  file.fd = -1;
+}
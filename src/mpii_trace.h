@@ -0,0 +1,85 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <mpi.h>
+#include <stdint.h>
+
+/* Format of the trace files (mpii_trace.<rank>.bin):
+ *
+ *   struct mpii_trace_header
+ *   nb_records * struct mpii_trace_record
+ *   nb_functions * MPII_TRACE_NAME_LENGTH bytes: the function names
+ *
+ * Records of different threads are interleaved. The records of a
+ * thread are sorted by end time.
+ */
+#define MPII_TRACE_MAGIC "MPIITRC"
+#define MPII_TRACE_VERSION 1
+#define MPII_TRACE_NAME_LENGTH 64
+
+enum mpii_trace_record_type {
+  MPII_TRACE_CALL,		/* an MPI function */
+  MPII_TRACE_LOCK,		/* the MPI lock was held */
+};
+
+struct mpii_trace_header {
+  char magic[8];
+  uint32_t version;
+  int32_t rank;
+  uint64_t nb_records;
+  uint64_t nb_dropped;		/* records lost because a buffer was full */
+  uint64_t start_tsc;		/* timestamp of MPI_Init */
+  double us_per_cycle;		/* duration of a timestamp cycle, in us */
+  uint32_t nb_functions;
+  uint32_t padding;
+};
+
+/* a record of the trace. Timestamps are mpii_tsc() values */
+struct mpii_trace_record {
+  uint64_t start;
+  uint64_t end;
+  uint64_t lock_wait;		/* MPII_TRACE_CALL: time spent waiting for the lock
+				 * MPII_TRACE_LOCK: time spent waiting before start */
+  uint64_t lock_hold;		/* time spent holding the lock */
+  uint64_t bytes;		/* size of the message (0 if unknown) */
+  uint16_t type;		/* enum mpii_trace_record_type */
+  uint16_t function;		/* id of the MPI function (see mpii_stats_function_id) */
+  int32_t thread;
+  int32_t peer;			/* rank of the peer, or root of a collective (-1 if none) */
+  int32_t tag;			/* -1 if none */
+  int32_t comm;			/* Fortran handle of the communicator (-1 if none) */
+  int32_t padding;
+};
+
+/* number of records of the ring buffer of each thread */
+#define MPII_TRACE_BUFFER_SIZE (1 << 14)
+
+/* start tracing. Called when MPI is initialized */
+void mpii_trace_init(void);
+
+/* flush the buffers and close the trace file. Called when MPI is finalized */
+void mpii_trace_finalize(void);
+
+/* record that the current thread enters the MPI function function */
+void mpii_trace_enter(int function);
+
+/* record that the current thread leaves its MPI function */
+void mpii_trace_exit(void);
+
+/* record the arguments of the MPI function called by the current thread.
+ * bytes is the size of the message
+ */
+void mpii_trace_args(int peer, int tag, MPI_Comm comm, uint64_t bytes);
+
+/* record that the current thread got the MPI lock after waiting since
+ * wait_start (a mpii_tsc timestamp)
+ */
+void mpii_trace_lock_acquired(uint64_t wait_start);
+
+/* record that the current thread releases the MPI lock */
+void mpii_trace_lock_released(void);
@@ -0,0 +1,231 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Convert the trace files written with MPII_TRACE=1 to the Chrome
+ * trace format (JSON), which can be displayed by Perfetto
+ * (https://ui.perfetto.dev) or chrome://tracing.
+ *
+ * Each MPI process is displayed as a process, and each thread as a
+ * thread. MPI calls are displayed as slices, and the intervals during
+ * which a thread waits for or holds the MPI lock are displayed as
+ * nested slices.
+ */
+
+#include <argp.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpii_trace.h"
+
+static char doc[] = "Convert MPII trace files (mpii_trace.<rank>.bin) to the Chrome trace format";
+static char args_doc[] = "TRACE_FILE...";
+
+static struct argp_option options[] = {
+	{"output", 'o', "FILE", 0, "Write the JSON trace to FILE (default: standard output)" },
+	{0}
+};
+
+struct arguments {
+  const char* output;
+  char** files;
+  int nb_files;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+  struct arguments* arguments = state->input;
+
+  switch(key) {
+  case 'o':
+    arguments->output = arg;
+    break;
+  case ARGP_KEY_ARGS:
+    arguments->files = state->argv + state->next;
+    arguments->nb_files = state->argc - state->next;
+    break;
+  case ARGP_KEY_NO_ARGS:
+    argp_usage(state);
+    break;
+  default:
+    return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+/* a trace file loaded in memory */
+struct trace {
+  const char* filename;
+  struct mpii_trace_header header;
+  struct mpii_trace_record* records;
+  char (*function_names)[MPII_TRACE_NAME_LENGTH];
+};
+
+static int load_trace(const char* filename, struct trace* trace) {
+  memset(trace, 0, sizeof(*trace));
+  trace->filename = filename;
+  FILE* f = fopen(filename, "r");
+  if(!f) {
+    perror(filename);
+    return -1;
+  }
+  if(fread(&trace->header, sizeof(trace->header), 1, f) != 1 ||
+     memcmp(trace->header.magic, MPII_TRACE_MAGIC, sizeof(MPII_TRACE_MAGIC)) != 0) {
+    fprintf(stderr, "%s: not an MPII trace file\n", filename);
+    goto error;
+  }
+  if(trace->header.version != MPII_TRACE_VERSION) {
+    fprintf(stderr, "%s: unsupported trace version %u\n", filename, trace->header.version);
+    goto error;
+  }
+
+  trace->records = malloc(trace->header.nb_records * sizeof(struct mpii_trace_record));
+  trace->function_names = calloc(trace->header.nb_functions, MPII_TRACE_NAME_LENGTH);
+  if((trace->header.nb_records && !trace->records) ||
+     (trace->header.nb_functions && !trace->function_names)) {
+    fprintf(stderr, "%s: cannot allocate memory\n", filename);
+    goto error;
+  }
+  if(fread(trace->records, sizeof(struct mpii_trace_record), trace->header.nb_records, f)
+     != trace->header.nb_records ||
+     fread(trace->function_names, MPII_TRACE_NAME_LENGTH, trace->header.nb_functions, f)
+     != trace->header.nb_functions) {
+    fprintf(stderr, "%s: truncated trace file\n", filename);
+    goto error;
+  }
+  for(uint32_t i = 0; i < trace->header.nb_functions; i++)
+    trace->function_names[i][MPII_TRACE_NAME_LENGTH - 1] = '\0';
+  fclose(f);
+  return 0;
+
+ error:
+  free(trace->records);
+  free(trace->function_names);
+  fclose(f);
+  return -1;
+}
+
+static const char* function_name(const struct trace* trace, int function) {
+  if(function < 0 || (uint32_t)function >= trace->header.nb_functions)
+    return "(unknown)";
+  return trace->function_names[function];
+}
+
+/* convert a timestamp of trace to us since origin */
+static double timestamp(const struct trace* trace, uint64_t tsc, uint64_t origin) {
+  return ((double)tsc - (double)origin) * trace->header.us_per_cycle;
+}
+
+static void print_separator(FILE* out, int* first) {
+  fprintf(out, *first ? "\n" : ",\n");
+  *first = 0;
+}
+
+static void convert_trace(FILE* out, const struct trace* trace, uint64_t origin, int* first) {
+  int rank = trace->header.rank;
+  double us_per_cycle = trace->header.us_per_cycle;
+
+  print_separator(out, first);
+  fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"P%d\"}}",
+	  rank, rank);
+
+  /* name the threads in the order they appear */
+  int max_thread = -1;
+  for(uint64_t i = 0; i < trace->header.nb_records; i++)
+    if(trace->records[i].thread > max_thread)
+      max_thread = trace->records[i].thread;
+  char* named = calloc(max_thread + 2, 1);
+
+  for(uint64_t i = 0; i < trace->header.nb_records; i++) {
+    const struct mpii_trace_record* r = &trace->records[i];
+    int tid = r->thread;
+    if(named && tid >= 0 && !named[tid]) {
+      named[tid] = 1;
+      print_separator(out, first);
+      fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"T%d\"}}",
+	      rank, tid, tid);
+    }
+
+    switch(r->type) {
+    case MPII_TRACE_CALL:
+      print_separator(out, first);
+      fprintf(out, "{\"name\":\"%s\",\"cat\":\"mpi\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+	      "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"peer\":%d,\"tag\":%d,\"comm\":%d,"
+	      "\"bytes\":%" PRIu64 ",\"lock_wait_us\":%.3f,\"lock_hold_us\":%.3f}}",
+	      function_name(trace, r->function), rank, tid,
+	      timestamp(trace, r->start, origin), (r->end - r->start) * us_per_cycle,
+	      r->peer, r->tag, r->comm, r->bytes,
+	      r->lock_wait * us_per_cycle, r->lock_hold * us_per_cycle);
+      break;
+    case MPII_TRACE_LOCK:
+      if(r->lock_wait > 0) {
+	print_separator(out, first);
+	fprintf(out, "{\"name\":\"lock wait\",\"cat\":\"lock\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+		"\"ts\":%.3f,\"dur\":%.3f}",
+		rank, tid, timestamp(trace, r->start - r->lock_wait, origin),
+		r->lock_wait * us_per_cycle);
+      }
+      print_separator(out, first);
+      fprintf(out, "{\"name\":\"lock held\",\"cat\":\"lock\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+	      "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"function\":\"%s\"}}",
+	      rank, tid, timestamp(trace, r->start, origin), r->lock_hold * us_per_cycle,
+	      function_name(trace, r->function));
+      break;
+    default:
+      break;
+    }
+  }
+  free(named);
+
+  if(trace->header.nb_dropped)
+    fprintf(stderr, "%s: warning: %" PRIu64 " events were dropped while tracing\n",
+	    trace->filename, trace->header.nb_dropped);
+}
+
+int main(int argc, char** argv) {
+  struct arguments arguments = { NULL, NULL, 0 };
+  argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+  struct trace* traces = calloc(arguments.nb_files, sizeof(struct trace));
+  if(!traces)
+    return EXIT_FAILURE;
+  /* all the processes use the same time origin, so that the processes
+   * that run on the same node are aligned
+   */
+  uint64_t origin = UINT64_MAX;
+  for(int i = 0; i < arguments.nb_files; i++) {
+    if(load_trace(arguments.files[i], &traces[i]) < 0)
+      return EXIT_FAILURE;
+    if(traces[i].header.start_tsc < origin)
+      origin = traces[i].header.start_tsc;
+  }
+
+  FILE* out = stdout;
+  if(arguments.output) {
+    out = fopen(arguments.output, "w");
+    if(!out) {
+      perror(arguments.output);
+      return EXIT_FAILURE;
+    }
+  }
+
+  int first = 1;
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  for(int i = 0; i < arguments.nb_files; i++)
+    convert_trace(out, &traces[i], origin, &first);
+  fprintf(out, "\n]}\n");
+
+  if(out != stdout)
+    fclose(out);
+  for(int i = 0; i < arguments.nb_files; i++) {
+    free(traces[i].records);
+    free(traces[i].function_names);
+  }
+  free(traces);
+  return EXIT_SUCCESS;
+}
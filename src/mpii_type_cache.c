@@ -0,0 +1,110 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Cache of the datatypes size and extent.
+ *
+ * Computing the number of bytes of a message requires the size of its
+ * datatype, which would require to call MPI (and to take the MPI
+ * lock). Instead, the size, extent, and true extent of a datatype are
+ * queried once (when the datatype is committed, or the first time they
+ * are needed), and stored in a hash table.
+ *
+ * Readers of the hash table (see mpii_table.c) do not take any lock,
+ * and the information about a datatype is written before its key is
+ * published. A slot is only reused after its datatype is freed.
+ */
+
+#include "mpii.h"
+#include "mpii_type_cache.h"
+#include "mpii_table.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+extern int (*libMPI_Type_size)(MPI_Datatype datatype, int* size);
+extern int (*libMPI_Type_get_extent)(MPI_Datatype datatype, MPI_Aint* lb, MPI_Aint* extent);
+extern int (*libMPI_Type_get_true_extent)(MPI_Datatype datatype, MPI_Aint* true_lb,
+					  MPI_Aint* true_extent);
+
+struct type_slot {
+  _Atomic uintptr_t key;
+  struct mpii_type_info info;
+};
+
+static struct type_slot slots[MPII_TYPE_CACHE_SIZE];
+static struct mpii_table table = MPII_TABLE_INITIALIZER(slots, MPII_TYPE_CACHE_SIZE);
+
+int mpii_type_cache_lookup(MPI_Datatype type, struct mpii_type_info* info) {
+  struct type_slot* slot = mpii_table_find(&table, MPII_TABLE_KEY(type));
+  if(!slot)
+    return 0;
+  *info = slot->info;
+  return 1;
+}
+
+static int query_type_info(MPI_Datatype type, struct mpii_type_info* info) {
+  int ret = libMPI_Type_size(type, &info->size);
+  if(ret != MPI_SUCCESS)
+    return ret;
+  ret = libMPI_Type_get_extent(type, &info->lb, &info->extent);
+  if(ret != MPI_SUCCESS)
+    return ret;
+  ret = libMPI_Type_get_true_extent(type, &info->true_lb, &info->true_extent);
+  if(ret != MPI_SUCCESS)
+    return ret;
+  /* no holes within an element, and no gap between consecutive elements */
+  info->contiguous = info->size != MPI_UNDEFINED &&
+    info->true_extent == info->size && info->extent == info->size;
+  return MPI_SUCCESS;
+}
+
+int mpii_type_cache_add(MPI_Datatype type, struct mpii_type_info* info) {
+  if(type == MPI_DATATYPE_NULL)
+    return MPI_ERR_TYPE;
+
+  struct mpii_type_info new_info;
+  int ret = query_type_info(type, &new_info);
+  if(ret != MPI_SUCCESS)
+    return ret;
+  if(info)
+    *info = new_info;
+
+  uintptr_t key = MPII_TABLE_KEY(type);
+  if(!mpii_table_valid_key(key))
+    return MPI_SUCCESS;
+
+  mpii_table_lock(&table);
+  int found;
+  struct type_slot* slot = mpii_table_reserve(&table, key, &found);
+  /* if the cache is full, type will be queried from MPI */
+  if(slot && !found) {
+    slot->info = new_info;
+    mpii_table_publish(slot, key);
+  }
+  mpii_table_unlock(&table);
+  return MPI_SUCCESS;
+}
+
+void mpii_type_cache_remove(MPI_Datatype type) {
+  mpii_table_remove(&table, MPII_TABLE_KEY(type));
+}
+
+struct type_info_args {
+  MPI_Datatype type;
+  struct mpii_type_info* info;
+};
+
+static int type_info_call(void* arg) {
+  struct type_info_args* a = arg;
+  return mpii_type_cache_add(a->type, a->info);
+}
+
+int mpii_type_info(MPI_Datatype type, struct mpii_type_info* info) {
+  if(mpii_type_cache_lookup(type, info))
+    return MPI_SUCCESS;
+  struct type_info_args args = { type, info };
+  return MPII_EXEC(type_info_call, &args);
+}
@@ -0,0 +1,43 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <mpi.h>
+
+/* maximum number of datatypes in the cache. The other datatypes are
+ * queried from MPI
+ */
+#define MPII_TYPE_CACHE_SIZE 4096
+
+/* information about a datatype */
+struct mpii_type_info {
+  int size;			/* as returned by MPI_Type_size */
+  MPI_Aint lb;
+  MPI_Aint extent;
+  MPI_Aint true_lb;
+  MPI_Aint true_extent;
+  int contiguous;		/* count elements occupy count*size contiguous bytes */
+};
+
+/* Look up the information about type. Return 1 if type is in the
+ * cache, 0 otherwise. This does not take any lock.
+ */
+int mpii_type_cache_lookup(MPI_Datatype type, struct mpii_type_info* info);
+
+/* query the information about type from MPI, and add it to the cache.
+ * info (if not NULL) is filled. Must be called while MPI is protected
+ * from concurrent calls (eg. from the call executed by MPII_EXEC)
+ */
+int mpii_type_cache_add(MPI_Datatype type, struct mpii_type_info* info);
+
+/* remove type from the cache. Called before type is freed */
+void mpii_type_cache_remove(MPI_Datatype type);
+
+/* get the information about type, from the cache if possible, or
+ * from MPI. Must not be called while holding the MPI lock
+ */
+int mpii_type_info(MPI_Datatype type, struct mpii_type_info* info);
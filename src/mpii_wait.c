@@ -0,0 +1,236 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Wait policies used when a blocking MPI call is converted into a
+ * polling loop (MPI_Wait, MPI_Probe, MPI_Recv, MPI_Barrier, ...).
+ *
+ * Between two unsuccessful polls, a thread:
+ * - spin: polls again immediately;
+ * - pause: executes a pause instruction;
+ * - yield: pauses for a number of iterations, then yields the cpu;
+ * - sleep: pauses for a number of iterations, then sleeps for an
+ *   exponentially increasing duration;
+ * - park: pauses for a number of iterations, then parks on a futex
+ *   until another thread makes progress in MPI, or for an exponentially
+ *   increasing duration.
+ *
+ * The policy can be set for all the MPI functions, and overridden for
+ * some of them (see MPII_WAIT_POLICY in the README).
+ */
+
+#include "mpii.h"
+#include "mpii_wait.h"
+
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+static const char* wait_policy_names[] = MPII_WAIT_POLICY_NAMES;
+
+__thread const char* mpii_current_function = NULL;
+
+static struct mpii_wait_config default_config = {
+  SETTINGS_WAIT_POLICY_DEFAULT, SETTINGS_WAIT_SPINS_DEFAULT
+};
+
+/* policies that apply to specific MPI functions */
+#define MAX_WAIT_OVERRIDES 32
+#define WAIT_FUNCTION_NAME_LENGTH 64
+struct wait_override {
+  char function[WAIT_FUNCTION_NAME_LENGTH];
+  struct mpii_wait_config config;
+};
+static struct wait_override overrides[MAX_WAIT_OVERRIDES];
+static int nb_overrides = 0;
+
+/* duration of the first sleep, and maximum duration of a sleep */
+#define SLEEP_MIN_NS 1000
+static uint32_t sleep_max_ns = SETTINGS_WAIT_SLEEP_MAX_DEFAULT * 1000;
+
+/* parked threads wait for seq to change */
+static struct {
+  _Atomic uint32_t seq;
+  _Atomic uint32_t nb_parked;
+} progress CACHE_ALIGNED;
+
+/* compare two MPI function names, ignoring the case and the trailing
+ * underscore of the Fortran functions (so that MPI_Recv matches mpi_recv_)
+ */
+static int same_function(const char* a, const char* b) {
+  size_t len_a = strlen(a);
+  size_t len_b = strlen(b);
+  if(len_a > 0 && a[len_a - 1] == '_') len_a--;
+  if(len_b > 0 && b[len_b - 1] == '_') len_b--;
+  return len_a == len_b && strncasecmp(a, b, len_a) == 0;
+}
+
+/* parse "policy[:spins]" */
+static int parse_config(const char* str, size_t len, struct mpii_wait_config* config) {
+  const char* colon = memchr(str, ':', len);
+  size_t name_len = colon ? (size_t)(colon - str) : len;
+
+  int policy = -1;
+  for(int i = 0; i < MPII_WAIT_NB_POLICIES; i++) {
+    if(strlen(wait_policy_names[i]) == name_len &&
+       strncmp(str, wait_policy_names[i], name_len) == 0)
+      policy = i;
+  }
+  if(policy < 0)
+    return -1;
+
+  config->policy = policy;
+  config->spins = default_config.spins;
+  if(colon) {
+    char* end;
+    long spins = strtol(colon + 1, &end, 10);
+    if(end != str + len || end == colon + 1 || spins < 0)
+      return -1;
+    config->spins = spins;
+  }
+  return 0;
+}
+
+int mpii_wait_configure(const char* spec) {
+  struct mpii_wait_config new_default = default_config;
+  struct wait_override new_overrides[MAX_WAIT_OVERRIDES];
+  int new_nb_overrides = 0;
+
+  const char* item = spec;
+  while(*item) {
+    size_t len = strcspn(item, ",");
+    const char* equal = memchr(item, '=', len);
+    if(equal) {
+      /* function=policy[:spins] */
+      size_t name_len = equal - item;
+      if(name_len == 0 || name_len >= WAIT_FUNCTION_NAME_LENGTH ||
+	 new_nb_overrides >= MAX_WAIT_OVERRIDES)
+	return -1;
+      struct wait_override* o = &new_overrides[new_nb_overrides++];
+      memcpy(o->function, item, name_len);
+      o->function[name_len] = '\0';
+      if(parse_config(equal + 1, len - name_len - 1, &o->config) < 0)
+	return -1;
+    } else {
+      if(parse_config(item, len, &new_default) < 0)
+	return -1;
+    }
+    item += len;
+    if(*item == ',')
+      item++;
+  }
+
+  default_config = new_default;
+  memcpy(overrides, new_overrides, sizeof(struct wait_override) * new_nb_overrides);
+  nb_overrides = new_nb_overrides;
+  return 0;
+}
+
+void mpii_wait_set_sleep_max(uint32_t max_us) {
+  if(max_us > 1000000)
+    max_us = 1000000;
+  sleep_max_ns = max_us * 1000;
+  if(sleep_max_ns < SLEEP_MIN_NS)
+    sleep_max_ns = SLEEP_MIN_NS;
+}
+
+void mpii_wait_start(struct mpii_wait_state* state) {
+  state->config = default_config;
+  if(nb_overrides > 0 && mpii_current_function) {
+    for(int i = 0; i < nb_overrides; i++) {
+      if(same_function(overrides[i].function, mpii_current_function)) {
+	state->config = overrides[i].config;
+	break;
+      }
+    }
+  }
+  state->iterations = 0;
+  state->sleep_ns = SLEEP_MIN_NS;
+}
+
+static void next_sleep_duration(struct mpii_wait_state* state) {
+  state->sleep_ns *= 2;
+  if(state->sleep_ns > sleep_max_ns)
+    state->sleep_ns = sleep_max_ns;
+}
+
+static struct timespec to_timespec(uint32_t duration_ns) {
+  struct timespec ts = { duration_ns / 1000000000, duration_ns % 1000000000 };
+  return ts;
+}
+
+static void park(uint32_t duration_ns) {
+  struct timespec timeout = to_timespec(duration_ns);
+  uint32_t seq = atomic_load(&progress.seq);
+  atomic_fetch_add(&progress.nb_parked, 1);
+  mpii_futex_wait_timeout(&progress.seq, seq, &timeout);
+  atomic_fetch_sub(&progress.nb_parked, 1);
+}
+
+void mpii_wait_idle(struct mpii_wait_state* state) {
+  uint32_t iteration = state->iterations++;
+  switch(state->config.policy) {
+  case MPII_WAIT_SPIN:
+    atomic_signal_fence(memory_order_seq_cst);
+    return;
+  case MPII_WAIT_PAUSE:
+    mpii_cpu_relax();
+    return;
+  default:
+    break;
+  }
+
+  if(iteration < state->config.spins) {
+    mpii_cpu_relax();
+    return;
+  }
+
+  switch(state->config.policy) {
+  case MPII_WAIT_YIELD:
+    sched_yield();
+    break;
+  case MPII_WAIT_SLEEP:
+    {
+      struct timespec duration = to_timespec(state->sleep_ns);
+      nanosleep(&duration, NULL);
+      next_sleep_duration(state);
+    }
+    break;
+  case MPII_WAIT_PARK:
+    park(state->sleep_ns);
+    next_sleep_duration(state);
+    break;
+  default:
+    break;
+  }
+}
+
+void mpii_wait_notify(void) {
+  /* A thread that is about to park may be missed. This only delays
+   * it until its timeout expires
+   */
+  if(atomic_load_explicit(&progress.nb_parked, memory_order_relaxed)) {
+    atomic_fetch_add(&progress.seq, 1);
+    mpii_futex_wake(&progress.seq, INT_MAX);
+  }
+}
+
+const char* mpii_wait_policy_name(int policy) {
+  if(policy < 0 || policy >= MPII_WAIT_NB_POLICIES)
+    return "unknown";
+  return wait_policy_names[policy];
+}
+
+void mpii_wait_print_config(void) {
+  printf("[MPII] Wait policy: %s:%u", mpii_wait_policy_name(default_config.policy),
+	 default_config.spins);
+  for(int i = 0; i < nb_overrides; i++)
+    printf(",%s=%s:%u", overrides[i].function,
+	   mpii_wait_policy_name(overrides[i].config.policy), overrides[i].config.spins);
+  printf("\n");
+}
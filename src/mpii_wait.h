@@ -0,0 +1,54 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "mpii_config.h"
+
+/* how a thread waits between two unsuccessful polls */
+struct mpii_wait_config {
+  enum mpii_wait_policy policy;
+  uint32_t spins;		/* number of busy iterations before yielding/sleeping/parking */
+};
+
+/* state of a thread that polls for an operation */
+struct mpii_wait_state {
+  struct mpii_wait_config config;
+  uint32_t iterations;
+  uint32_t sleep_ns;		/* next sleep/park duration */
+};
+
+/* Parse a wait policy specification (see MPII_WAIT_POLICY in the
+ * README) and use it for the next waits. Return 0 on success, or -1
+ * if spec is invalid (in which case the configuration is unchanged)
+ */
+int mpii_wait_configure(const char* spec);
+
+/* set the maximum duration of a sleep (in microseconds) */
+void mpii_wait_set_sleep_max(uint32_t max_us);
+
+/* start waiting. The policy depends on the MPI function that is
+ * being called by the current thread
+ */
+void mpii_wait_start(struct mpii_wait_state* state);
+
+/* wait after an unsuccessful poll, according to the policy */
+void mpii_wait_idle(struct mpii_wait_state* state);
+
+/* called when a thread may have made MPI progress (eg. after it
+ * called MPI). This wakes up the threads parked by mpii_wait_idle
+ */
+void mpii_wait_notify(void);
+
+/* return the name of a wait policy */
+const char* mpii_wait_policy_name(int policy);
+
+/* print the current configuration */
+void mpii_wait_print_config(void);
+
+/* name of the outermost MPI function called by the current thread */
+extern __thread const char* mpii_current_function;
@@ -0,0 +1,70 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Synchronization state of the RMA windows.
+ *
+ * Request-based RMA operations (MPI_Rput, MPI_Rget) can only be used
+ * in passive target epochs, so we count the locks that are held on
+ * each window. The counters are stored in a hash table (see
+ * mpii_table.c): lookups do not take any lock, and slots are created
+ * or removed under a mutex.
+ */
+
+#include "mpii.h"
+#include "mpii_win.h"
+#include "mpii_table.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+struct win_slot {
+  _Atomic uintptr_t key;
+  _Atomic int nb_passive;	/* number of locks held on the window */
+};
+
+static struct win_slot slots[MPII_WIN_TABLE_SIZE];
+static struct mpii_table table = MPII_TABLE_INITIALIZER(slots, MPII_WIN_TABLE_SIZE);
+
+/* find the slot of key, or create it. Return NULL if the table is full */
+static struct win_slot* get_slot(uintptr_t key) {
+  struct win_slot* slot = mpii_table_find(&table, key);
+  if(slot)
+    return slot;
+
+  mpii_table_lock(&table);
+  int found;
+  slot = mpii_table_reserve(&table, key, &found);
+  if(slot && !found) {
+    atomic_store_explicit(&slot->nb_passive, 0, memory_order_relaxed);
+    mpii_table_publish(slot, key);
+  }
+  mpii_table_unlock(&table);
+  return slot;
+}
+
+void mpii_win_passive_begin(MPI_Win win) {
+  uintptr_t key = MPII_TABLE_KEY(win);
+  if(!mpii_table_valid_key(key))
+    return;
+  struct win_slot* slot = get_slot(key);
+  if(slot)
+    atomic_fetch_add(&slot->nb_passive, 1);
+}
+
+void mpii_win_passive_end(MPI_Win win) {
+  struct win_slot* slot = mpii_table_find(&table, MPII_TABLE_KEY(win));
+  if(slot && atomic_load(&slot->nb_passive) > 0)
+    atomic_fetch_sub(&slot->nb_passive, 1);
+}
+
+int mpii_win_passive(MPI_Win win) {
+  struct win_slot* slot = mpii_table_find(&table, MPII_TABLE_KEY(win));
+  return slot && atomic_load_explicit(&slot->nb_passive, memory_order_relaxed) > 0;
+}
+
+void mpii_win_remove(MPI_Win win) {
+  mpii_table_remove(&table, MPII_TABLE_KEY(win));
+}
@@ -0,0 +1,26 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+#pragma once
+
+#include <mpi.h>
+
+/* maximum number of windows whose epochs are tracked. RMA operations
+ * on the other windows are not converted to request-based operations
+ */
+#define MPII_WIN_TABLE_SIZE 1024
+
+/* called when a passive target epoch starts (MPI_Win_lock,
+ * MPI_Win_lock_all) or ends (MPI_Win_unlock, MPI_Win_unlock_all) on win
+ */
+void mpii_win_passive_begin(MPI_Win win);
+void mpii_win_passive_end(MPI_Win win);
+
+/* return 1 if win is in a passive target epoch. This does not take any lock */
+int mpii_win_passive(MPI_Win win);
+
+/* forget about win. Called before win is freed */
+void mpii_win_remove(MPI_Win win);
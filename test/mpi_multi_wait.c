@@ -0,0 +1,121 @@
+/* -*- c-file-style: "GNU" -*- */
+/*
+ * Copyright (C) Telecom SudParis
+ * See COPYING in top-level directory.
+ */
+
+/* Several threads of rank 0 wait at the same time for messages from
+ * rank 1. Rank 1 first sends the messages of the odd threads, then the
+ * messages of the even threads, so that the completion engine
+ * (MPII_COMPLETION_ENGINE=1) completes several MPI_Wait in the same
+ * round, and the completed requests are not the first ones of the
+ * round. Each thread checks the status and the content of its message.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <mpi.h>
+#include <pthread.h>
+
+#define NB_THREADS 8
+#define ITERATIONS 1000
+
+static int comm_rank = -1;
+static pthread_barrier_t barrier;
+static _Atomic int nb_errors = 0;
+
+/* the message for thread t contains t + 1 integers */
+static void check_message(int thread, int iteration, int* buffer, MPI_Status* status) {
+  int count;
+  MPI_Get_count(status, MPI_INT, &count);
+  if(status->MPI_SOURCE != 1 || status->MPI_TAG != thread || count != thread + 1) {
+    fprintf(stderr, "[T%d] iteration %d: wrong status: source %d, tag %d, count %d\n",
+	    thread, iteration, status->MPI_SOURCE, status->MPI_TAG, count);
+    nb_errors++;
+    return;
+  }
+  for(int i = 0; i < count; i++) {
+    if(buffer[i] != iteration * NB_THREADS + thread) {
+      fprintf(stderr, "[T%d] iteration %d: wrong data\n", thread, iteration);
+      nb_errors++;
+      return;
+    }
+  }
+}
+
+static void* receiver(void* arg) {
+  int thread = (int)(intptr_t)arg;
+  int buffer[NB_THREADS];
+  for(int i = 0; i < ITERATIONS; i++) {
+    MPI_Request req;
+    MPI_Status status;
+    MPI_Irecv(buffer, NB_THREADS, MPI_INT, 1, thread, MPI_COMM_WORLD, &req);
+    pthread_barrier_wait(&barrier);
+    /* all the receives are posted, let rank 1 send the messages */
+    if(thread == 0)
+      MPI_Send(NULL, 0, MPI_INT, 1, NB_THREADS, MPI_COMM_WORLD);
+    MPI_Wait(&req, &status);
+    check_message(thread, i, buffer, &status);
+    pthread_barrier_wait(&barrier);
+  }
+  return NULL;
+}
+
+static void sender(void) {
+  int buffers[NB_THREADS][NB_THREADS];
+  MPI_Request reqs[NB_THREADS];
+  for(int i = 0; i < ITERATIONS; i++) {
+    MPI_Recv(NULL, 0, MPI_INT, 0, NB_THREADS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    /* give the receivers some time to enter MPI_Wait */
+    usleep(100);
+    for(int first = 1; first >= 0; first--) {
+      for(int t = first; t < NB_THREADS; t += 2) {
+	for(int j = 0; j <= t; j++)
+	  buffers[t][j] = i * NB_THREADS + t;
+	MPI_Isend(buffers[t], t + 1, MPI_INT, 0, t, MPI_COMM_WORLD, &reqs[t]);
+      }
+      usleep(100);
+    }
+    MPI_Waitall(NB_THREADS, reqs, MPI_STATUSES_IGNORE);
+  }
+}
+
+int main(int argc, char** argv) {
+  int provided = -1;
+  int comm_size;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+  if(provided < MPI_THREAD_MULTIPLE) {
+    printf("mpi init error: required %d, provided %d\n", MPI_THREAD_MULTIPLE, provided);
+    return EXIT_FAILURE;
+  }
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  if(comm_size != 2) {
+    fprintf(stderr, "This program requires 2 MPI processes, aborting...\n");
+    abort();
+  }
+
+  if(comm_rank == 0) {
+    pthread_t tids[NB_THREADS];
+    pthread_barrier_init(&barrier, NULL, NB_THREADS);
+    for(int i = 0; i < NB_THREADS; i++)
+      pthread_create(&tids[i], NULL, receiver, (void*)(intptr_t)i);
+    for(int i = 0; i < NB_THREADS; i++)
+      pthread_join(tids[i], NULL);
+    pthread_barrier_destroy(&barrier);
+  } else {
+    sender();
+  }
+
+  MPI_Finalize();
+  if(comm_rank == 0) {
+    if(nb_errors) {
+      printf("%d errors\n", nb_errors);
+      return EXIT_FAILURE;
+    }
+    printf("OK\n");
+  }
+  return EXIT_SUCCESS;
+}
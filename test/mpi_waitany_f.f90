@@ -0,0 +1,124 @@
+! -*- f90 -*-
+!
+! Copyright (C) Telecom SudParis
+! See COPYING in top-level directory.
+!
+! Check the indices and the statuses returned by the Fortran
+! MPI_WAITANY, MPI_TESTANY, MPI_WAITSOME and MPI_TESTSOME: indices start
+! at 1, and the status of request i has the tag i.
+
+program mpi_waitany_f
+  implicit none
+  include 'mpif.h'
+
+  integer, parameter :: n = 4
+  integer :: rank, nprocs, ierr, i, errors
+  integer :: buffers(n)
+
+  call MPI_INIT(ierr)
+  call MPI_COMM_RANK(MPI_COMM_WORLD, rank, ierr)
+  call MPI_COMM_SIZE(MPI_COMM_WORLD, nprocs, ierr)
+  if (nprocs /= 2) then
+     print *, 'This program requires 2 MPI processes, aborting...'
+     call MPI_ABORT(MPI_COMM_WORLD, 1, ierr)
+  end if
+
+  errors = 0
+  do i = 1, 4
+     if (rank == 0) then
+        call receive(i)
+     else
+        call send()
+     end if
+  end do
+
+  call MPI_FINALIZE(ierr)
+  if (rank == 0) then
+     if (errors /= 0) then
+        print *, errors, ' errors'
+        stop 1
+     end if
+     print *, 'OK'
+  end if
+
+contains
+
+  ! send the message with tag i to rank 0, for i = 1..n
+  subroutine send()
+    integer :: t, values(n)
+    integer :: reqs(n)
+    call MPI_BARRIER(MPI_COMM_WORLD, ierr)
+    do t = 1, n
+       values(t) = 100 * t
+       call MPI_ISEND(values(t), 1, MPI_INTEGER, 0, t, MPI_COMM_WORLD, reqs(t), ierr)
+    end do
+    call MPI_WAITALL(n, reqs, MPI_STATUSES_IGNORE, ierr)
+  end subroutine send
+
+  ! check that request index completed with status
+  subroutine check(name, index, status)
+    character(len=*), intent(in) :: name
+    integer, intent(in) :: index
+    integer, intent(in) :: status(MPI_STATUS_SIZE)
+    if (index < 1 .or. index > n) then
+       print *, name, ': wrong index ', index
+       errors = errors + 1
+    else if (status(MPI_SOURCE) /= 1 .or. status(MPI_TAG) /= index &
+         .or. buffers(index) /= 100 * index) then
+       print *, name, ': wrong status for index ', index, ': source ', &
+            status(MPI_SOURCE), ', tag ', status(MPI_TAG)
+       errors = errors + 1
+    end if
+  end subroutine check
+
+  ! receive the messages, and wait for them with the function number test
+  subroutine receive(test)
+    integer, intent(in) :: test
+    integer :: t, index, count, done
+    logical :: flag
+    integer :: reqs(n), indices(n)
+    integer :: status(MPI_STATUS_SIZE), statuses(MPI_STATUS_SIZE, n)
+
+    buffers = 0
+    do t = 1, n
+       call MPI_IRECV(buffers(t), 1, MPI_INTEGER, 1, t, MPI_COMM_WORLD, reqs(t), ierr)
+    end do
+    call MPI_BARRIER(MPI_COMM_WORLD, ierr)
+
+    done = 0
+    do while (done < n)
+       select case (test)
+       case (1)
+          call MPI_WAITANY(n, reqs, index, status, ierr)
+          call check('MPI_WAITANY', index, status)
+          done = done + 1
+       case (2)
+          call MPI_TESTANY(n, reqs, index, flag, status, ierr)
+          if (flag) then
+             call check('MPI_TESTANY', index, status)
+             done = done + 1
+          end if
+       case (3)
+          call MPI_WAITSOME(n, reqs, count, indices, statuses, ierr)
+          do t = 1, count
+             call check('MPI_WAITSOME', indices(t), statuses(:, t))
+          end do
+          done = done + count
+       case (4)
+          call MPI_TESTSOME(n, reqs, count, indices, statuses, ierr)
+          do t = 1, count
+             call check('MPI_TESTSOME', indices(t), statuses(:, t))
+          end do
+          done = done + count
+       end select
+    end do
+
+    do t = 1, n
+       if (reqs(t) /= MPI_REQUEST_NULL) then
+          print *, 'request ', t, ' was not freed'
+          errors = errors + 1
+       end if
+    end do
+  end subroutine receive
+
+end program mpi_waitany_f